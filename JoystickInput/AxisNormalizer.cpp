@@ -0,0 +1,62 @@
+﻿/**
+ * @file
+ * @brief AxisNormalizer constants and per-value mapping.
+ */
+
+#include "AxisNormalizer.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+namespace joystick {
+
+    bool AxisNormalizer::Configure(int axis, int32_t rawMin, int32_t rawMax, const AxisConfig& config) {
+        if (axis < 0 || axis >= kMaxAxes || rawMax <= rawMin || config.max <= config.min) return false;
+        Axis& a = axes_[axis];
+        const int64_t half2 = int64_t(rawMax) - rawMin;
+        const uint32_t dead = config.deadzone > 10000 ? 10000 : config.deadzone;
+        const uint32_t sat = config.saturation > 10000 ? 10000 : config.saturation;
+        a.center2 = int64_t(rawMin) + rawMax;
+        a.dead2 = half2 * dead / 10000;
+        a.sat2 = half2 * sat / 10000;
+        a.outMin = config.min;
+        a.outMax = config.max;
+        a.outCenter = (int64_t(config.min) + config.max) / 2;
+        mask_ = static_cast<uint8_t>(mask_ | (1u << axis));
+        return true;
+    }
+
+    int32_t AxisNormalizer::Normalize(int axis, int32_t raw) const {
+        const Axis& a = axes_[axis];
+        const int64_t d = int64_t(raw) * 2 - a.center2;
+        const int64_t dist = d < 0 ? -d : d;
+        if (dist <= a.dead2) return static_cast<int32_t>(a.outCenter);
+        if (dist >= a.sat2) return static_cast<int32_t>(d < 0 ? a.outMin : a.outMax);
+        // Linear from the dead-zone edge (center) to the saturation edge (min or max), rounded.
+        const int64_t span = a.sat2 - a.dead2;
+        const int64_t extent = d < 0 ? a.outCenter - a.outMin : a.outMax - a.outCenter;
+        const int64_t offset = ((dist - a.dead2) * extent + span / 2) / span;
+        return static_cast<int32_t>(d < 0 ? a.outCenter - offset : a.outCenter + offset);
+    }
+
+    bool ParseAxisRange(const char* text, AxisConfig& config) {
+        char* end = nullptr;
+        const long lo = std::strtol(text, &end, 10);
+        if (end == text || *end != ':') return false;
+        const char* second = end + 1;
+        const long hi = std::strtol(second, &end, 10);
+        if (end == second || *end != '\0') return false;
+        if (lo < INT32_MIN || hi > INT32_MAX || lo >= hi) return false;
+        config.min = static_cast<int32_t>(lo);
+        config.max = static_cast<int32_t>(hi);
+        return true;
+    }
+
+    void PrintAxisProfile(const AxisProfile& profile, int driverAxes, int softwareAxes) {
+        const AxisConfig& c = profile.axes[0];
+        std::printf("axes: range %d..%d, dead zone %.2f%%, saturation %.2f%%; %d in the driver, %d in software\n",
+            c.min, c.max, c.deadzone / 100.0, c.saturation / 100.0, driverAxes, softwareAxes);
+    }
+
+} // namespace joystick
@@ -0,0 +1,81 @@
+﻿/**
+ * @file
+ * @brief Software axis normalization with DirectInput DIPROP_RANGE / DEADZONE / SATURATION semantics.
+ * @details
+ *   - DirectInput devices get the AxisProfile as driver properties, so their values arrive already
+ *     scaled. AxisNormalizer is the fallback for backends without such properties (XInput, evdev) and
+ *     for DirectInput axes that reject them; it produces the same values the driver would.
+ *   - The per-axis constants are precomputed from the raw range, so Apply() is a few integer
+ *     operations per present axis.
+ */
+
+#pragma once
+
+#include "InputCore.h"
+
+#include <cstdint>
+
+namespace joystick {
+
+    /**
+     * @brief Maps raw axis values into AxisConfig ranges.
+     */
+    class AxisNormalizer {
+    public:
+        /**
+         * @brief Normalizes axis @p axis from the raw range [rawMin, rawMax] according to @p config.
+         * @return false if @p axis is out of range or the raw range is empty.
+         */
+        bool Configure(int axis, int32_t rawMin, int32_t rawMax, const AxisConfig& config);
+
+        /// Leaves axis @p axis in backend units.
+        void Clear(int axis) { mask_ = static_cast<uint8_t>(mask_ & ~(1u << axis)); }
+
+        /// True if any axis is configured.
+        bool Active() const { return mask_ != 0; }
+
+        /// Bit i set: axes[i] is normalized.
+        uint8_t Mask() const { return mask_; }
+
+        /// Number of normalized axes.
+        int AxisCount() const {
+            int n = 0;
+            for (int i = 0; i < kMaxAxes; ++i) n += (mask_ >> i) & 1;
+            return n;
+        }
+
+        /// Normalizes one raw value of axis @p axis (which must be configured).
+        int32_t Normalize(int axis, int32_t raw) const;
+
+        /// Normalizes every configured axis of @p state in place.
+        void Apply(InputState& state) const {
+            for (int i = 0; i < kMaxAxes; ++i) {
+                if ((mask_ >> i) & 1u) state.axes[i] = Normalize(i, state.axes[i]);
+            }
+        }
+
+    private:
+        /// Constants of one axis; distances are doubled so the raw center is an integer.
+        struct Axis {
+            int64_t center2 = 0;   //!< rawMin + rawMax.
+            int64_t dead2 = 0;     //!< Doubled dead-zone radius.
+            int64_t sat2 = 0;      //!< Doubled saturation radius.
+            int64_t outCenter = 0;
+            int64_t outMin = 0;
+            int64_t outMax = 0;
+        };
+
+        Axis axes_[kMaxAxes];
+        uint8_t mask_ = 0;
+    };
+
+    /**
+     * @brief Parses "<min>:<max>" into @p config (min < max).
+     * @return false on a malformed or empty range.
+     */
+    bool ParseAxisRange(const char* text, AxisConfig& config);
+
+    /// Prints the profile on one line ("axes: ...") with how many axes the driver and software handle.
+    void PrintAxisProfile(const AxisProfile& profile, int driverAxes, int softwareAxes);
+
+} // namespace joystick
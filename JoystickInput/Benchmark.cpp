@@ -0,0 +1,2999 @@
+﻿/**
+ * @file
+ * @brief Benchmark scenarios and the small timing harness they share.
+ */
+
+#include "Benchmark.h"
+
+#include "AxisNormalizer.h"
+#include "DeviceIdentity.h"
+#include "DeviceRegistry.h"
+#include "DiEvents.h"
+#include "HidDescriptor.h"
+#include "Hotplug.h"
+#include "InputCore.h"
+#include "KnownControllers.h"
+#include "LatencyCompare.h"
+#include "PhaseLock.h"
+#include "PollScheduler.h"
+#include "RawInputBatch.h"
+#include "Reactor.h"
+#include "ReaderPool.h"
+#include "StateRing.h"
+#include "SyntheticBackend.h"
+#include "XInputProxies.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cwctype>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include "EvdevBackend.h"
+#include "UringReadEngine.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace joystick {
+
+    namespace {
+
+        using BenchClock = std::chrono::steady_clock;
+
+        /// Nanoseconds elapsed since @p start.
+        double ElapsedNs(BenchClock::time_point start) {
+            return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count();
+        }
+
+        /// Prints one result row in a uniform format.
+        void Report(const char* scenario, const char* stage, uint64_t items, double ns) {
+            std::printf("%-16s %-22s %12llu items %10.1f ns/item\n",
+                scenario, stage, (unsigned long long)items, items ? ns / (double)items : 0.0);
+        }
+
+        /**
+         * @brief Sink that formats into a scratch buffer and discards the text, so terminal speed does not skew results.
+         */
+        struct FormatOnlySink {
+            explicit FormatOnlySink(StateLayout l) : layout(l) {}
+
+            StateLayout layout;
+            uint64_t bytes = 0;
+            char line[kMaxFormattedState];
+
+            void operator()(const InputState& state) {
+                bytes += FormatState(layout, state, line, sizeof(line));
+            }
+        };
+
+        /**
+         * @brief Sample -> diff -> format, measured stage by stage on synthetic traffic.
+         */
+        int BenchPipeline(const BenchOptions& opt) {
+            const StateLayout layouts[] = { StateLayout::Gamepad, StateLayout::Joystick };
+            for (StateLayout layout : layouts) {
+                const char* name = layout == StateLayout::Gamepad ? "pipeline/pad" : "pipeline/joy";
+                SyntheticConfig cfg;
+                cfg.seed = opt.seed;
+                cfg.layout = layout;
+                cfg.maxSamples = opt.samples;
+
+                // Stage 1: sampling only.
+                {
+                    SyntheticBackend backend(cfg);
+                    InputState st;
+                    auto t0 = BenchClock::now();
+                    while (backend.Sample(st) != SampleStatus::Disconnected) {}
+                    Report(name, "sample", opt.samples, ElapsedNs(t0));
+                }
+
+                // Stage 2: sampling + diffing.
+                {
+                    SyntheticBackend backend(cfg);
+                    InputState prev, cur;
+                    uint64_t diffs = 0;
+                    auto t0 = BenchClock::now();
+                    SampleStatus s;
+                    while ((s = backend.Sample(cur)) != SampleStatus::Disconnected) {
+                        if (s == SampleStatus::Changed && DiffStates(prev, cur) != kChangedNone) {
+                            prev = cur;
+                            ++diffs;
+                        }
+                    }
+                    Report(name, "sample+diff", opt.samples, ElapsedNs(t0));
+                }
+
+                // Stage 3: the full reader loop with formatting.
+                {
+                    SyntheticBackend backend(cfg);
+                    FormatOnlySink sink(layout);
+                    std::atomic_bool running{ true };
+                    ReaderStats stats;
+                    auto t0 = BenchClock::now();
+                    RunReader(backend, sink, running, &stats);
+                    const double ns = ElapsedNs(t0);
+                    Report(name, "sample+diff+format", stats.samples, ns);
+                    std::printf("%-16s emitted=%llu bytes=%llu\n", name,
+                        (unsigned long long)stats.emitted, (unsigned long long)sink.bytes);
+                }
+            }
+            return 0;
+        }
+
+        /**
+         * @brief Built-in gamepad descriptor: report ID 1, 16 buttons, an 8-way hat, four signed 16-bit
+         *        sticks and two unaligned 10-bit pedals (15-byte reports).
+         */
+        const uint8_t kBenchGamepadDescriptor[] = {
+            0x05, 0x01, 0x09, 0x05, 0xA1, 0x01,             // Usage Page (GD), Usage (Game Pad), Collection (Application)
+            0x85, 0x01,                                     //   Report ID (1)
+            0x05, 0x09, 0x19, 0x01, 0x29, 0x10,             //   Usage Page (Button), Usage Min (1), Usage Max (16)
+            0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x10, //   Logical 0..1, Size 1, Count 16
+            0x81, 0x02,                                     //   Input (Data, Var, Abs)
+            0x05, 0x01, 0x09, 0x39,                         //   Usage Page (GD), Usage (Hat switch)
+            0x15, 0x00, 0x25, 0x07, 0x75, 0x04, 0x95, 0x01, //   Logical 0..7, Size 4, Count 1
+            0x81, 0x42,                                     //   Input (Data, Var, Abs, Null)
+            0x75, 0x04, 0x95, 0x01, 0x81, 0x03,             //   4 bits padding
+            0x09, 0x30, 0x09, 0x31, 0x09, 0x33, 0x09, 0x34, //   Usage (X), (Y), (Rx), (Ry)
+            0x16, 0x00, 0x80, 0x26, 0xFF, 0x7F,             //   Logical -32768..32767
+            0x75, 0x10, 0x95, 0x04, 0x81, 0x02,             //   Size 16, Count 4, Input (Data, Var, Abs)
+            0x05, 0x02, 0x09, 0xC5, 0x09, 0xC4,             //   Usage Page (Simulation), Usage (Brake), (Accelerator)
+            0x15, 0x00, 0x26, 0xFF, 0x03,                   //   Logical 0..1023
+            0x75, 0x0A, 0x95, 0x02, 0x81, 0x02,             //   Size 10, Count 2, Input (Data, Var, Abs)
+            0x75, 0x04, 0x95, 0x01, 0x81, 0x03,             //   4 bits padding
+            0xC0                                            // End Collection
+        };
+        constexpr size_t kBenchGamepadReportSize = 15;
+
+        /// Writes @p bits little-endian bits of @p value at @p bitOffset (report builder for the benches).
+        void PutBits(uint8_t* report, uint32_t bitOffset, uint32_t bits, uint32_t value) {
+            for (uint32_t i = 0; i < bits; ++i) {
+                const uint32_t b = bitOffset + i;
+                if ((value >> i) & 1u) report[b >> 3] |= static_cast<uint8_t>(1u << (b & 7));
+            }
+        }
+
+        /// Fills one report of kBenchGamepadDescriptor.
+        void BuildGamepadReport(uint8_t* report, uint16_t buttons, uint32_t hat, const int16_t sticks[4], uint32_t brake, uint32_t accel) {
+            std::memset(report, 0, kBenchGamepadReportSize);
+            report[0] = 1;
+            PutBits(report, 8, 16, buttons);
+            PutBits(report, 24, 4, hat);
+            for (int i = 0; i < 4; ++i) PutBits(report, 32 + 16 * i, 16, static_cast<uint16_t>(sticks[i]));
+            PutBits(report, 96, 10, brake);
+            PutBits(report, 106, 10, accel);
+        }
+
+        /// Random reports for kBenchGamepadDescriptor, back to back.
+        std::vector<uint8_t> MakeGamepadReports(uint64_t count, uint64_t seed) {
+            std::vector<uint8_t> out(count * kBenchGamepadReportSize);
+            uint64_t r = seed ? seed : 1;
+            for (uint64_t i = 0; i < count; ++i) {
+                r ^= r << 13; r ^= r >> 7; r ^= r << 17;
+                const int16_t sticks[4] = { (int16_t)r, (int16_t)(r >> 16), (int16_t)(r >> 32), (int16_t)(r >> 48) };
+                BuildGamepadReport(&out[i * kBenchGamepadReportSize], (uint16_t)(r >> 7), (uint32_t)(r >> 29) % 9,
+                    sticks, (uint32_t)(r >> 3) & 0x3FF, (uint32_t)(r >> 41) & 0x3FF);
+            }
+            return out;
+        }
+
+        /// Decodes one hand-built report and checks every field.
+        bool CheckGamepadPlan(const HidDecodePlan& plan) {
+            uint8_t report[kBenchGamepadReportSize];
+            const int16_t sticks[4] = { -32768, 32767, 0, -1 };
+            BuildGamepadReport(report, 0x8005, 2, sticks, 1023, 0);
+            InputState st;
+            if (!DecodeHidReport(plan, report, sizeof(report), st)) return false;
+            // Sticks span -32768..32767 and pedals 0..1023, both scaled onto 0..65535; Z/Rz stay unset.
+            const int32_t want[kMaxAxes] = { 0, 65535, 0, 32768, 32767, 0, 65535, 0 };
+            for (int i = 0; i < kMaxAxes; ++i) {
+                if (st.axes[i] != want[i]) return false;
+            }
+            return st.povs[0] == 9000 && st.povs[1] == kPovCentered && st.buttons[0] == 0x8005 && st.buttons[1] == 0;
+        }
+
+        /**
+         * @brief Descriptor-compiled plan vs walking the descriptor for every report.
+         */
+        int BenchHidDecode(const BenchOptions& opt) {
+            HidDecodePlan plan;
+            std::string error;
+            if (!CompileHidDescriptor(kBenchGamepadDescriptor, sizeof(kBenchGamepadDescriptor), plan, &error)) {
+                std::printf("%-16s FAILED: %s\n", "hid", error.c_str());
+                return 1;
+            }
+            if (!CheckGamepadPlan(plan)) {
+                std::printf("%-16s FAILED: decoded fields do not match the built report\n", "hid");
+                return 1;
+            }
+            {
+                // Report Size 32 x Report Count 0x08000000 wraps to 0 bits in 32-bit arithmetic.
+                const uint8_t hostile[] = { 0x05, 0x01, 0x75, 0x20, 0x97, 0x00, 0x00, 0x00, 0x08, 0x81, 0x02 };
+                HidDecodePlan rejected;
+                const auto t0 = BenchClock::now();
+                if (CompileHidDescriptor(hostile, sizeof(hostile), rejected) || ElapsedNs(t0) > 10e6) {
+                    std::printf("%-16s FAILED: oversized report count was not rejected up front\n", "hid");
+                    return 1;
+                }
+            }
+
+            const uint64_t count = opt.samples;
+            const std::vector<uint8_t> reports = MakeGamepadReports(count, opt.seed);
+            const uint8_t* data = reports.data();
+            uint64_t sink = 0;
+
+            // Baseline: the descriptor is interpreted again for every report.
+            {
+                const uint64_t n = count < 100000 ? count : 100000;
+                InputState st;
+                auto t0 = BenchClock::now();
+                for (uint64_t i = 0; i < n; ++i) {
+                    HidDecodePlan fresh;
+                    CompileHidDescriptor(kBenchGamepadDescriptor, sizeof(kBenchGamepadDescriptor), fresh);
+                    DecodeHidReport(fresh, data + i * kBenchGamepadReportSize, kBenchGamepadReportSize, st);
+                }
+                Report("hid", "walk-per-report", n, ElapsedNs(t0));
+                sink += (uint64_t)st.axes[0];
+            }
+
+            // Compiled plan.
+            {
+                InputState st;
+                auto t0 = BenchClock::now();
+                for (uint64_t i = 0; i < count; ++i) {
+                    DecodeHidReport(plan, data + i * kBenchGamepadReportSize, kBenchGamepadReportSize, st);
+                }
+                Report("hid", "plan", count, ElapsedNs(t0));
+                sink += (uint64_t)st.axes[0];
+            }
+
+            // Compiled plan + diff, as the reader loop would run it.
+            {
+                InputState prev, cur;
+                uint64_t changed = 0;
+                auto t0 = BenchClock::now();
+                for (uint64_t i = 0; i < count; ++i) {
+                    DecodeHidReport(plan, data + i * kBenchGamepadReportSize, kBenchGamepadReportSize, cur);
+                    if (DiffStates(prev, cur) != kChangedNone) {
+                        prev = cur;
+                        ++changed;
+                    }
+                }
+                Report("hid", "plan+diff", count, ElapsedNs(t0));
+                sink += changed;
+            }
+
+            std::printf("%-16s plan: %zu ops, %u-byte reports (checksum %llu)\n", "hid",
+                plan.ops.size(), plan.reports[0].sizeBytes, (unsigned long long)sink);
+            return 0;
+        }
+
+        /**
+         * @brief Descriptor equivalent to the first 11 bytes of the DualSense USB report 0x01, for the
+         *        generic path: six 8-bit axes, a vendor counter, a hat and 14 buttons.
+         */
+        const uint8_t kBenchDualSenseDescriptor[] = {
+            0x05, 0x01, 0x09, 0x05, 0xA1, 0x01, 0x85, 0x01,             // GD, Game Pad, Application, Report ID (1)
+            0x09, 0x30, 0x09, 0x31, 0x09, 0x32, 0x09, 0x35,             //   X, Y, Z, Rz
+            0x09, 0x33, 0x09, 0x34,                                     //   Rx, Ry (triggers)
+            0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08, 0x95, 0x06,       //   0..255, 8 bits x 6
+            0x81, 0x02,
+            0x06, 0x00, 0xFF, 0x09, 0x20, 0x95, 0x01, 0x81, 0x02,       //   Vendor counter (8 bits, unmapped)
+            0x05, 0x01, 0x09, 0x39, 0x25, 0x07, 0x75, 0x04, 0x95, 0x01, //   Hat, 0..7, 4 bits
+            0x81, 0x42,
+            0x05, 0x09, 0x19, 0x01, 0x29, 0x0E, 0x25, 0x01,             //   Buttons 1..14
+            0x75, 0x01, 0x95, 0x0E, 0x81, 0x02,
+            0x75, 0x02, 0x95, 0x01, 0x81, 0x03,                         //   2 bits padding
+            0xC0
+        };
+        constexpr size_t kBenchDualSenseReportSize = 11;
+
+        /**
+         * @brief Byte-for-byte mirror of DIJOYSTATE2 (272 bytes), so the RunDirectInputReader copy can be
+         *        measured without DirectInput.
+         */
+        struct DIJoyState2Mirror {
+            int32_t lX, lY, lZ, lRx, lRy, lRz;
+            int32_t rglSlider[2];
+            uint32_t rgdwPOV[4];
+            uint8_t rgbButtons[128];
+            int32_t extra[24]; // velocity, acceleration and force axes
+        };
+        static_assert(sizeof(DIJoyState2Mirror) == 272, "DIJOYSTATE2 is 272 bytes");
+
+        /// Same conversion as ConvertDIState in WindowsBackends.cpp.
+        void ConvertDIMirror(const DIJoyState2Mirror& js, InputState& out) {
+            out.axes[0] = js.lX;
+            out.axes[1] = js.lY;
+            out.axes[2] = js.lZ;
+            out.axes[3] = js.lRx;
+            out.axes[4] = js.lRy;
+            out.axes[5] = js.lRz;
+            out.axes[6] = js.rglSlider[0];
+            out.axes[7] = js.rglSlider[1];
+            for (int i = 0; i < kMaxPovs; ++i) {
+                out.povs[i] = js.rgdwPOV[i];
+            }
+            out.buttons[0] = 0;
+            out.buttons[1] = 0;
+            for (int i = 0; i < kMaxButtons; ++i) {
+                if (js.rgbButtons[i] & 0x80) {
+                    out.buttons[i >> 6] |= uint64_t(1) << (i & 63);
+                }
+            }
+        }
+
+        /// Random DualSense USB reports (first 11 bytes), back to back.
+        std::vector<uint8_t> MakeDualSenseReports(uint64_t count, uint64_t seed) {
+            std::vector<uint8_t> out(count * kBenchDualSenseReportSize);
+            uint64_t r = seed ? seed : 1;
+            for (uint64_t i = 0; i < count; ++i) {
+                r ^= r << 13; r ^= r >> 7; r ^= r << 17;
+                uint8_t* p = &out[i * kBenchDualSenseReportSize];
+                p[0] = 0x01;
+                for (size_t b = 1; b < kBenchDualSenseReportSize; ++b) p[b] = static_cast<uint8_t>(r >> (b * 5));
+                p[7] = static_cast<uint8_t>(i);
+                p[8] = static_cast<uint8_t>((p[8] & 0xF0) | ((r >> 60) % 9));
+            }
+            return out;
+        }
+
+        /// Decodes one hand-built DualSense report with the specialized decoder and checks every field.
+        bool CheckDualSenseDecoder() {
+            const uint8_t report[kBenchDualSenseReportSize] = { 0x01, 0x00, 0xFF, 0x80, 0x7F, 0xFF, 0x10, 0x00, 0x21, 0x31, 0x00 };
+            InputState st;
+            if (!FixedLayoutDecoder<DualSenseUsbLayout>::Decode(report, sizeof(report), st)) return false;
+            // Byte 8: hat 1 (north-east) + Cross; byte 9: L1, Create, Options.
+            const uint32_t buttons = kGamepadDpadUp | kGamepadDpadRight | kGamepadA |
+                kGamepadLeftShoulder | kGamepadBack | kGamepadStart;
+            return st.axes[kAxisLeftX] == -32768 && st.axes[kAxisLeftY] == -32768 &&
+                st.axes[kAxisRightX] == 0 && st.axes[kAxisRightY] == 0 &&
+                st.axes[kAxisLeftTrigger] == 255 && st.axes[kAxisRightTrigger] == 16 &&
+                st.buttons[0] == buttons;
+        }
+
+        /**
+         * @brief Specialized fixed-layout decoding vs the generic descriptor plan vs the DIJOYSTATE2 copy.
+         */
+        int BenchFixedLayouts(const BenchOptions& opt) {
+            if (!CheckDualSenseDecoder()) {
+                std::printf("%-16s FAILED: specialized DualSense decoder self-check\n", "fixed");
+                return 1;
+            }
+            HidDecodePlan plan;
+            std::string error;
+            if (!CompileHidDescriptor(kBenchDualSenseDescriptor, sizeof(kBenchDualSenseDescriptor), plan, &error) ||
+                plan.reports[0].sizeBytes != kBenchDualSenseReportSize) {
+                std::printf("%-16s FAILED: generic descriptor: %s\n", "fixed", error.c_str());
+                return 1;
+            }
+
+            const uint64_t count = opt.samples;
+            const std::vector<uint8_t> reports = MakeDualSenseReports(count, opt.seed);
+            const uint8_t* data = reports.data();
+            uint64_t sink = 0;
+
+            {
+                InputState st;
+                auto t0 = BenchClock::now();
+                for (uint64_t i = 0; i < count; ++i) {
+                    FixedLayoutDecoder<DualSenseUsbLayout>::Decode(data + i * kBenchDualSenseReportSize, kBenchDualSenseReportSize, st);
+                }
+                Report("fixed", "specialized", count, ElapsedNs(t0));
+                sink += st.buttons[0];
+            }
+
+            {
+                const KnownController* known = FindKnownController(0x054C, 0x0CE6);
+                InputState st;
+                auto t0 = BenchClock::now();
+                for (uint64_t i = 0; i < count; ++i) {
+                    known->decode(data + i * kBenchDualSenseReportSize, kBenchDualSenseReportSize, st);
+                }
+                Report("fixed", "specialized-by-vidpid", count, ElapsedNs(t0));
+                sink += st.buttons[0];
+            }
+
+            {
+                InputState st;
+                auto t0 = BenchClock::now();
+                for (uint64_t i = 0; i < count; ++i) {
+                    DecodeHidReport(plan, data + i * kBenchDualSenseReportSize, kBenchDualSenseReportSize, st);
+                }
+                Report("fixed", "generic-plan", count, ElapsedNs(t0));
+                sink += st.buttons[0];
+            }
+
+            // What RunDirectInputReader does per event: GetDeviceState copies a DIJOYSTATE2, then
+            // ConvertDIState walks all 128 button bytes. The source states are pre-built so only the copy counts.
+            {
+                const size_t ring = 1024;
+                std::vector<DIJoyState2Mirror> driver(ring);
+                for (size_t i = 0; i < ring; ++i) {
+                    std::memset(&driver[i], 0, sizeof(DIJoyState2Mirror));
+                    driver[i].lX = static_cast<int32_t>(i * 37);
+                    driver[i].rgbButtons[i % 14] = 0x80;
+                    for (int p = 0; p < 4; ++p) driver[i].rgdwPOV[p] = kPovCentered;
+                }
+                DIJoyState2Mirror js;
+                InputState st;
+                auto t0 = BenchClock::now();
+                for (uint64_t i = 0; i < count; ++i) {
+                    std::memcpy(&js, &driver[i % ring], sizeof(js));
+                    ConvertDIMirror(js, st);
+                }
+                Report("fixed", "dijoystate2-copy", count, ElapsedNs(t0));
+                sink += st.buttons[0];
+            }
+
+            std::printf("%-16s checksum %llu\n", "fixed", (unsigned long long)sink);
+            return 0;
+        }
+
+        /// Appends one RAWINPUT record to @p block, padded as NEXTRAWINPUTBLOCK expects.
+        void AppendRawRecord(std::vector<uint8_t>& block, const RawInputLayout& layout, uint32_t type, uint64_t device,
+            const uint8_t* reports, uint32_t sizeHid, uint32_t count) {
+            // Keyboard and mouse payloads are not read; 16 bytes stands in for RAWKEYBOARD.
+            const uint32_t payload = type == kRawInputTypeHid ? 8 + sizeHid * count : 16;
+            const uint32_t size = layout.headerSize + payload;
+            const size_t start = block.size();
+            block.resize(start + ((size + layout.align - 1) & ~(layout.align - 1)), 0);
+            uint8_t* p = &block[start];
+            std::memcpy(p, &type, 4);
+            std::memcpy(p + 4, &size, 4);
+            std::memcpy(p + 8, &device, layout.pointerSize); // little-endian: the low bytes come first
+            if (type != kRawInputTypeHid) return;
+            std::memcpy(p + layout.headerSize, &sizeHid, 4);
+            std::memcpy(p + layout.headerSize + 4, &count, 4);
+            std::memcpy(p + layout.headerSize + 8, reports, size_t(sizeHid) * count);
+        }
+
+        /**
+         * @brief Checks the block walker on hand-built blocks in both layouts, and a truncated block.
+         * @return Empty string on success, else the failed check.
+         */
+        const char* CheckRawInputBatch() {
+            const uint8_t a[4] = { 1, 2, 3, 4 };
+            const uint8_t b[6] = { 5, 6, 7, 8, 9, 10 };
+            RawInputLayout layouts[2] = { RawInputLayout(), RawInputLayout() };
+            layouts[1].headerSize = 16;
+            layouts[1].pointerSize = 4;
+            layouts[1].align = 4;
+            for (const RawInputLayout& layout : layouts) {
+                std::vector<uint8_t> block;
+                AppendRawRecord(block, layout, 1, 0x10, nullptr, 0, 0);  // keyboard: skipped
+                AppendRawRecord(block, layout, kRawInputTypeHid, 0x20, a, 4, 1);
+                AppendRawRecord(block, layout, kRawInputTypeHid, 0x30, b, 3, 2);
+                RawInputBatchReader reader(block.data(), block.size(), 3, layout);
+                RawHidRecord r;
+                if (!reader.Next(r) || r.device != 0x20 || r.sizeHid != 4 || r.count != 1 || r.data[3] != 4) return "first HID record";
+                if (!reader.Next(r) || r.device != 0x30 || r.sizeHid != 3 || r.count != 2 || r.data[5] != 10) return "batched record";
+                if (reader.Next(r) || reader.Malformed() || reader.Walked() != 3) return "end of block";
+
+                RawHidQueue queue;
+                queue.Append(r);
+                const uint8_t* report = nullptr;
+                uint32_t size = 0;
+                if (!queue.Pop(report, size) || size != 3 || report[0] != 5) return "queue first report";
+                if (!queue.Pop(report, size) || report[0] != 8 || queue.Pop(report, size)) return "queue second report";
+
+                RawInputBatchReader truncated(block.data(), block.size() - layout.align, 3, layout);
+                while (truncated.Next(r)) {}
+                if (!truncated.Malformed()) return "truncated block";
+            }
+
+            // The decoder dispatches to the descriptor plan like DecodeHidReport does.
+            HidDecodePlan plan;
+            if (!CompileHidDescriptor(kBenchGamepadDescriptor, sizeof(kBenchGamepadDescriptor), plan)) return "gamepad plan";
+            RawHidDecoder decoder;
+            decoder.UsePlan(plan);
+            const std::vector<uint8_t> pad = MakeGamepadReports(1, 7);
+            InputState viaDecoder, direct;
+            if (!decoder.Decode(pad.data(), pad.size(), viaDecoder) || !DecodeHidReport(plan, pad.data(), pad.size(), direct) ||
+                DiffStates(viaDecoder, direct) != kChangedNone || decoder.Layout() != StateLayout::Joystick) {
+                return "plan decoder";
+            }
+            if (!decoder.UseKnown(0x054C, 0x0CE6) || decoder.Layout() != StateLayout::Gamepad) return "known decoder";
+            return "";
+        }
+
+        /**
+         * @brief GetRawInputBuffer batches vs one GetRawInputData per WM_INPUT, on modelled DualSense traffic.
+         * @details The traffic is cut into blocks of 16 records. Every fourth record carries two reports
+         *          (dwCount = 2), and every eighth one comes from a second pad. "per-message" copies each
+         *          record out of the block as GetRawInputData does and parses it alone. "batched" walks
+         *          the block in place and queues the reports. Both decode with the DualSense fixed layout.
+         *          The kernel transitions are not modelled here; they are counted as calls.
+         */
+        int BenchRawInput(const BenchOptions& opt) {
+            const char* failed = CheckRawInputBatch();
+            if (*failed) {
+                std::printf("%-16s FAILED: batch check '%s'\n", "rawinput", failed);
+                return 1;
+            }
+
+            const uint64_t count = opt.samples;
+            const std::vector<uint8_t> reports = MakeDualSenseReports(count, opt.seed);
+            const RawInputLayout layout = RawInputLayout::Native();
+            const uint64_t ours = 0x1234, other = 0x5678;
+            const uint32_t kRecordsPerBlock = 16;
+
+            struct Block {
+                size_t offset;
+                size_t bytes;
+                uint32_t records;
+            };
+            struct Record {
+                size_t offset;
+                size_t bytes;
+            };
+            std::vector<uint8_t> buffer;
+            std::vector<Block> blocks;
+            std::vector<Record> records;
+            uint64_t used = 0, recordIndex = 0, foreignRecords = 0;
+            while (used < count) {
+                Block blk = { buffer.size(), 0, 0 };
+                while (blk.records < kRecordsPerBlock && used < count) {
+                    const size_t before = buffer.size();
+                    if (recordIndex % 8 == 7) {
+                        AppendRawRecord(buffer, layout, kRawInputTypeHid, other, &reports[0], kBenchDualSenseReportSize, 1);
+                        ++foreignRecords;
+                    }
+                    else {
+                        const uint32_t n = (recordIndex % 4 == 1 && used + 1 < count) ? 2 : 1;
+                        AppendRawRecord(buffer, layout, kRawInputTypeHid, ours, &reports[used * kBenchDualSenseReportSize], kBenchDualSenseReportSize, n);
+                        used += n;
+                    }
+                    records.push_back(Record{ before, buffer.size() - before });
+                    ++blk.records;
+                    ++recordIndex;
+                }
+                blk.bytes = buffer.size() - blk.offset;
+                blocks.push_back(blk);
+            }
+
+            RawHidDecoder decoder;
+            decoder.UseKnown(0x054C, 0x0CE6);
+
+            // Reference: the reports decoded back to back.
+            InputState expected;
+            for (uint64_t i = 0; i < count; ++i) {
+                decoder.Decode(&reports[i * kBenchDualSenseReportSize], kBenchDualSenseReportSize, expected);
+            }
+
+            InputState perMessage;
+            uint64_t perMessageReports = 0;
+            {
+                std::vector<uint64_t> scratch(64);
+                auto t0 = BenchClock::now();
+                for (const Record& rec : records) {
+                    std::memcpy(scratch.data(), &buffer[rec.offset], rec.bytes);
+                    RawInputBatchReader reader(reinterpret_cast<const uint8_t*>(scratch.data()), rec.bytes, 1, layout);
+                    RawHidRecord r;
+                    if (!reader.Next(r) || r.device != ours) continue;
+                    for (uint32_t k = 0; k < r.count; ++k) decoder.Decode(r.data + k * r.sizeHid, r.sizeHid, perMessage);
+                    perMessageReports += r.count;
+                }
+                Report("rawinput", "per-message", perMessageReports, ElapsedNs(t0));
+            }
+
+            InputState batched;
+            uint64_t batchedReports = 0, foreign = 0;
+            {
+                RawHidQueue queue;
+                auto t0 = BenchClock::now();
+                for (const Block& blk : blocks) {
+                    RawInputBatchReader reader(&buffer[blk.offset], blk.bytes, blk.records, layout);
+                    RawHidRecord r;
+                    while (reader.Next(r)) {
+                        if (r.device != ours) {
+                            ++foreign;
+                            continue;
+                        }
+                        queue.Append(r);
+                    }
+                    const uint8_t* report = nullptr;
+                    uint32_t size = 0;
+                    while (queue.Pop(report, size)) {
+                        decoder.Decode(report, size, batched);
+                        ++batchedReports;
+                    }
+                }
+                Report("rawinput", "batched", batchedReports, ElapsedNs(t0));
+            }
+
+            if (perMessageReports != count || batchedReports != count || foreign != foreignRecords ||
+                DiffStates(perMessage, expected) != kChangedNone || DiffStates(batched, expected) != kChangedNone) {
+                std::printf("%-16s FAILED: batched or per-message decode differs from the report stream\n", "rawinput");
+                return 1;
+            }
+            std::printf("%-16s calls: per-message %zu GetRawInputData + %zu messages, batched %zu GetRawInputBuffer "
+                "(%.1f reports per call, %llu foreign records dropped)\n",
+                "rawinput", records.size(), records.size(), blocks.size(),
+                (double)count / (double)blocks.size(), (unsigned long long)foreign);
+            return 0;
+        }
+
+        /// One change as a reader of the comparison sees it.
+        struct ComparedSample {
+            uint64_t timeNs;
+            int path;
+            uint32_t controls;
+        };
+
+        /**
+         * @brief XInput vs DirectInput comparison on a modelled pad: matching, unmatched edges, delay distribution.
+         * @details The pad reports at 1 kHz. Path 0 polls it at 500 Hz (grid offset 0.25 ms) and sees
+         *          the latest report; path 1 gets every changed report 1 ms later, as an event. One
+         *          change in ten is a 1.2 ms tap, which polling can miss entirely. Checked: every edge
+         *          of the polled path is matched, the event path's extra edges are left unmatched, and
+         *          every delay lies between 1 ms minus the largest and the smallest poll wait. The
+         *          10 ms window keeps a missed tap from pairing with the next press of its button.
+         */
+        int BenchLatencyCompare(const BenchOptions& opt) {
+            const uint64_t kMs = 1000000;
+            const uint64_t reportNs = kMs, pollNs = 2 * kMs, pollPhaseNs = kMs / 4, eventDelayNs = kMs;
+            const uint64_t changes = std::max<uint64_t>(100, std::min<uint64_t>(opt.samples / 100, 20000));
+
+            // Device timeline: (time, controls) steps, 20..30 ms apart.
+            std::vector<std::pair<uint64_t, uint32_t>> steps;
+            uint32_t lcg = opt.seed ? static_cast<uint32_t>(opt.seed) : 1u;
+            auto next = [&lcg]() { lcg = lcg * 1664525u + 1013904223u; return lcg >> 8; };
+            uint32_t controls = 0;
+            uint64_t t = 10 * kMs;
+            for (uint64_t i = 0; i < changes; ++i) {
+                t += 20 * kMs + (next() % 10000) * 1000;
+                uint32_t bit;
+                do bit = 1u << (next() % 16); while (!(bit & kComparedControls));
+                if (i % 10 == 9 && !(controls & bit)) {
+                    steps.emplace_back(t, controls | bit);
+                    steps.emplace_back(t + 1200000, controls);
+                    continue;
+                }
+                controls ^= bit;
+                steps.emplace_back(t, controls);
+            }
+            const uint64_t endNs = t + 10 * kMs;
+
+            // Device state at each report, then what each path delivers.
+            std::vector<uint32_t> reportState(endNs / reportNs + 1);
+            size_t step = 0;
+            uint32_t cur = 0;
+            for (size_t k = 0; k < reportState.size(); ++k) {
+                while (step < steps.size() && steps[step].first <= k * reportNs) cur = steps[step++].second;
+                reportState[k] = cur;
+            }
+            std::vector<ComparedSample> samples;
+            for (size_t k = 1; k < reportState.size(); ++k) {
+                if (reportState[k] != reportState[k - 1]) samples.push_back(ComparedSample{ k * reportNs + eventDelayNs, 1, reportState[k] });
+            }
+            uint32_t polled = 0;
+            for (uint64_t p = pollPhaseNs; p < endNs; p += pollNs) {
+                const uint32_t s = reportState[p / reportNs];
+                if (s != polled) samples.push_back(ComparedSample{ p, 0, s });
+                polled = s;
+            }
+            std::stable_sort(samples.begin(), samples.end(),
+                [](const ComparedSample& a, const ComparedSample& b) { return a.timeNs < b.timeNs; });
+
+            LatencyComparer comparer(10 * kMs);
+            comparer.Feed(0, 0, 0);
+            comparer.Feed(1, 0, 0);
+            const auto t0 = BenchClock::now();
+            for (const ComparedSample& s : samples) comparer.Feed(s.path, s.controls, s.timeNs);
+            comparer.Expire(UINT64_MAX);
+            Report("compare", "feed + match", samples.size(), ElapsedNs(t0));
+            const char* const names[2] = { "polled-500Hz", "event+1ms" };
+            std::fflush(stdout);
+            PrintLatencyComparison(comparer, names);
+
+            // Poll waits after a report are 0.25 or 1.25 ms on this grid.
+            const int64_t lo = int64_t(eventDelayNs) - int64_t(pollPhaseNs + reportNs), hi = int64_t(eventDelayNs) - int64_t(pollPhaseNs);
+            bool inRange = !comparer.Deltas().empty();
+            for (int64_t d : comparer.Deltas()) inRange = inRange && d >= lo && d <= hi;
+            if (comparer.Unmatched(0) != 0 || comparer.Matched() != comparer.Edges(0) ||
+                comparer.Unmatched(1) != comparer.Edges(1) - comparer.Edges(0) || comparer.Unmatched(1) == 0 || !inRange) {
+                std::printf("%-16s FAILED: edges mismatched or delays outside [%.2f, %.2f] ms\n", "compare", lo / 1e6, hi / 1e6);
+                return 1;
+            }
+            return 0;
+        }
+
+        /// Prints one scheduler result row.
+        void ReportPoll(const char* stage, uint32_t hz, const PollStats& st) {
+            std::printf("%-16s %-22s %5u Hz target %8.1f Hz achieved  lateness mean %7.1f us max %8.1f us  missed %llu\n",
+                "scheduler", stage, hz, st.AchievedHz(), st.MeanLatenessUs(), (double)st.latenessMaxNs / 1000.0,
+                (unsigned long long)st.missed);
+        }
+
+        /**
+         * @brief Deterministic checks of the scheduling logic on MockTimer.
+         * @return Empty string on success, else the failed check.
+         */
+        const char* CheckPollSchedulerMock() {
+            // Exact grid with an ideal timer.
+            {
+                BasicPollScheduler<MockTimer> s(500);
+                for (int i = 0; i < 1001; ++i) s.WaitNext();
+                if (s.Stats().AchievedHz() != 500.0 || s.Stats().latenessMaxNs != 0) return "ideal timer";
+            }
+            // Constant timer slack must not lower the rate (absolute deadlines).
+            {
+                BasicPollScheduler<MockTimer> s(500);
+                s.GetTimer().overshootNs = 100000;
+                for (int i = 0; i < 1001; ++i) s.WaitNext();
+                if (s.Stats().AchievedHz() < 499.0 || s.Stats().MeanLatenessUs() < 99.0 || s.Stats().missed != 0) return "timer slack";
+            }
+            // A 10 ms stall at 500 Hz skips 4 ticks instead of bursting through them.
+            {
+                BasicPollScheduler<MockTimer> s(500);
+                for (int i = 0; i < 10; ++i) s.WaitNext();
+                s.GetTimer().Advance(10000000);
+                s.WaitNext();
+                s.WaitNext();
+                if (s.Stats().missed != 4 || s.Stats().latenessMaxNs != 0) return "stall";
+            }
+            return "";
+        }
+
+        /**
+         * @brief PollScheduler on the real timer vs the original relative sleep_for(period), at 250/500/1000 Hz.
+         * @details Checks the scheduling logic on MockTimer first. count bounds the ticks per rate (at most half a second each).
+         */
+        int BenchPollScheduler(const BenchOptions& opt) {
+            const char* failed = CheckPollSchedulerMock();
+            if (*failed) {
+                std::printf("%-16s FAILED: mock-clock check '%s'\n", "scheduler", failed);
+                return 1;
+            }
+            std::printf("%-16s mock-clock checks passed\n", "scheduler");
+
+            const uint32_t rates[] = { 250, 500, 1000 };
+            for (uint32_t hz : rates) {
+                const uint64_t ticks = std::min<uint64_t>(std::max<uint64_t>(opt.samples, 2), hz / 2);
+
+                PollScheduler sched(hz);
+                for (uint64_t i = 0; i < ticks; ++i) sched.WaitNext();
+                ReportPoll("scheduler", hz, sched.Stats());
+
+                // Baseline: what RunXInputReader did before (relative sleep after each poll).
+                PollStats naive;
+                SystemTimer clock;
+                const auto period = std::chrono::nanoseconds(1000000000ull / hz);
+                uint64_t expected = clock.NowNs();
+                naive.startNs = expected;
+                for (uint64_t i = 0; i < ticks; ++i) {
+                    if (i > 0) {
+                        std::this_thread::sleep_for(period);
+                        expected += (uint64_t)period.count();
+                    }
+                    const uint64_t now = clock.NowNs();
+                    const uint64_t late = now > expected ? now - expected : 0;
+                    naive.latenessSumNs += late;
+                    if (late > naive.latenessMaxNs) naive.latenessMaxNs = late;
+                    naive.lastNs = now;
+                    ++naive.ticks;
+                }
+                ReportPoll("sleep_for", hz, naive);
+            }
+            return 0;
+        }
+
+        /**
+         * @brief Simulated kiosk pad: idle most of the time, with periodic bursts of use.
+         * @details Within each cycle the pad is picked up at burstStartNs and reports a new packet every
+         *          reportNs for burstNs, then sits still.
+         */
+        struct SimulatedPad {
+            uint64_t cycleNs = 10000000000ull;
+            uint64_t burstStartNs = 3000000000ull;
+            uint64_t burstNs = 1500000000ull;
+            uint64_t reportNs = 4000000;
+
+            /// Packet number at time @p t (ns since the simulation started).
+            uint64_t PacketAt(uint64_t t) const {
+                const uint64_t perBurst = burstNs / reportNs;
+                const uint64_t cycle = t / cycleNs;
+                const uint64_t in = t % cycleNs;
+                uint64_t packets = cycle * perBurst;
+                if (in >= burstStartNs) {
+                    const uint64_t active = in - burstStartNs;
+                    packets += active >= burstNs ? perBurst : active / reportNs + 1;
+                }
+                return packets;
+            }
+
+            /// Start of the burst that contains or precedes @p t.
+            uint64_t BurstStart(uint64_t t) const {
+                return (t / cycleNs) * cycleNs + burstStartNs;
+            }
+        };
+
+        /**
+         * @brief Result of one simulated polling run.
+         */
+        struct PollSimResult {
+            uint64_t polls = 0;
+            uint64_t firstInputs = 0;
+            uint64_t firstInputSumNs = 0;
+            uint64_t firstInputMaxNs = 0;
+        };
+
+        /**
+         * @brief Polls a SimulatedPad on MockTimer for @p durationNs, at a fixed rate or adaptively.
+         * @param adaptive nullptr for a fixed activeHz poller.
+         */
+        PollSimResult SimulatePolling(const SimulatedPad& pad, uint64_t durationNs, uint32_t activeHz, AdaptiveRate* adaptive) {
+            BasicPollScheduler<MockTimer> sched(activeHz);
+            sched.GetTimer().overshootNs = 50000; // typical high-resolution timer slack
+            const uint64_t t0 = sched.GetTimer().NowNs();
+            PollSimResult r;
+            uint64_t lastPacket = 0;
+            uint64_t lastBurstSeen = ~0ull;
+            while (true) {
+                sched.WaitNext();
+                const uint64_t now = sched.GetTimer().NowNs();
+                const uint64_t t = now - t0;
+                if (t >= durationNs) break;
+                ++r.polls;
+                const uint64_t packet = pad.PacketAt(t);
+                const bool changed = packet != lastPacket;
+                lastPacket = packet;
+                if (changed) {
+                    const uint64_t burst = pad.BurstStart(t);
+                    if (burst != lastBurstSeen) {
+                        // First poll that sees this pick-up: latency from the first report.
+                        lastBurstSeen = burst;
+                        const uint64_t lat = t - burst;
+                        ++r.firstInputs;
+                        r.firstInputSumNs += lat;
+                        if (lat > r.firstInputMaxNs) r.firstInputMaxNs = lat;
+                    }
+                }
+                if (adaptive) {
+                    const uint32_t hz = adaptive->OnPoll(changed, now);
+                    if (hz != sched.RateHz()) sched.SetRate(hz);
+                }
+            }
+            return r;
+        }
+
+        /// Prints one adaptive-polling row.
+        void ReportPollSim(const char* stage, const PollSimResult& r, uint64_t durationNs) {
+            std::printf("%-16s %-22s %8.1f polls/s  first-input latency mean %7.2f ms max %7.2f ms (%llu pick-ups)\n",
+                "adaptive", stage, (double)r.polls * 1e9 / (double)durationNs,
+                r.firstInputs ? (double)r.firstInputSumNs / (double)r.firstInputs / 1e6 : 0.0,
+                (double)r.firstInputMaxNs / 1e6, (unsigned long long)r.firstInputs);
+        }
+
+        /**
+         * @brief Fixed 500 Hz polling vs AdaptiveRate at several idle rates on a simulated kiosk pad.
+         * @details Runs on MockTimer (count = simulated seconds, at most 600), so results are exact and
+         *          instantaneous. Checks that adaptive mode polls less and notices a pick-up within one idle period.
+         */
+        int BenchAdaptivePolling(const BenchOptions& opt) {
+            const SimulatedPad pad;
+            const uint64_t seconds = std::min<uint64_t>(std::max<uint64_t>(opt.samples, 20), 600);
+            const uint64_t duration = seconds * 1000000000ull;
+
+            const PollSimResult fixed = SimulatePolling(pad, duration, 500, nullptr);
+            ReportPollSim("fixed-500Hz", fixed, duration);
+
+            int rc = 0;
+            const uint32_t idleRates[] = { 125, 60, 30, 10 };
+            for (uint32_t idleHz : idleRates) {
+                AdaptiveRateConfig cfg;
+                cfg.activeHz = 500;
+                cfg.idleHz = idleHz;
+                cfg.idleAfterMs = 2000;
+                AdaptiveRate adaptive(cfg);
+                const PollSimResult r = SimulatePolling(pad, duration, cfg.activeHz, &adaptive);
+                char stage[32];
+                std::snprintf(stage, sizeof(stage), "adaptive-idle-%uHz", idleHz);
+                ReportPollSim(stage, r, duration);
+                const AdaptiveRateStats& st = adaptive.Stats();
+                std::printf("%-16s %-22s active %.1f s idle %.1f s, to-idle %llu to-active %llu\n", "adaptive", "",
+                    (double)st.activeNs / 1e9, (double)st.idleNs / 1e9,
+                    (unsigned long long)st.toIdle, (unsigned long long)st.toActive);
+                const uint64_t bound = 1000000000ull / idleHz + 100000;
+                if (r.polls >= fixed.polls || r.firstInputMaxNs > bound || r.firstInputs != fixed.firstInputs) rc = 1;
+            }
+            if (rc != 0) std::printf("%-16s FAILED: adaptive polling check\n", "adaptive");
+            return rc;
+        }
+
+        /**
+         * @brief Report timing of a simulated polled controller: fixed period with clock drift and jitter;
+         *        only some reports carry a state change (new packet number).
+         */
+        struct SimulatedReportStream {
+            double periodNs = 4000000.0 * (1.0 + 100e-6); //!< 4 ms nominal, device clock 100 ppm slow.
+            double offsetNs = 1300000.0;                  //!< Phase against the host clock.
+            double jitterNs = 50000.0;                    //!< +- uniform jitter per report.
+            uint32_t changePercent = 70;                  //!< Reports that change the state.
+            uint64_t seed = 1;
+
+            uint64_t Hash(uint64_t j) const {
+                uint64_t x = (j + 1) * 0x9E3779B97F4A7C15ull ^ seed;
+                x ^= x >> 31; x *= 0xBF58476D1CE4E5B9ull; x ^= x >> 29;
+                return x;
+            }
+
+            double ReportTime(uint64_t j) const {
+                const double u = (double)(Hash(j) & 0xFFFF) / 65535.0;
+                return offsetNs + (double)j * periodNs + (2.0 * u - 1.0) * jitterNs;
+            }
+
+            bool Changes(uint64_t j) const { return (Hash(j) >> 20) % 100 < changePercent; }
+        };
+
+        /**
+         * @brief Latency of noticing state changes, measured against the true report times.
+         */
+        struct ReportLatencySim {
+            const SimulatedReportStream& stream;
+            uint64_t next = 0;          //!< First report not yet delivered.
+            uint64_t polls = 0;
+            uint64_t seen = 0;          //!< Polls that returned a new packet.
+            uint64_t merged = 0;        //!< Changing reports overwritten before any poll saw them.
+            double latencySum = 0;
+            double latencyMax = 0;
+
+            explicit ReportLatencySim(const SimulatedReportStream& s) : stream(s) {}
+
+            /// Poll at @p t (ns since the start); returns whether the packet number changed.
+            bool Poll(double t) {
+                ++polls;
+                bool changed = false;
+                while (stream.ReportTime(next) <= t) {
+                    if (stream.Changes(next)) {
+                        if (changed) {
+                            ++merged;
+                        }
+                        else {
+                            changed = true;
+                            const double lat = t - stream.ReportTime(next);
+                            latencySum += lat;
+                            if (lat > latencyMax) latencyMax = lat;
+                        }
+                    }
+                    ++next;
+                }
+                if (changed) ++seen;
+                return changed;
+            }
+
+            void Print(const char* stage, double seconds) const {
+                std::printf("%-16s %-22s %8.1f polls/s  latency mean %6.3f ms max %6.3f ms  merged %llu\n",
+                    "phaselock", stage, (double)polls / seconds, seen ? latencySum / (double)seen / 1e6 : 0.0,
+                    latencyMax / 1e6, (unsigned long long)merged);
+            }
+        };
+
+        /**
+         * @brief Fixed-rate polling vs phase-locked polling on a simulated 4 ms controller (MockTimer).
+         * @details count = simulated seconds (at most 600). Checks that the loop locks, estimates the
+         *          period within 0.1 %, and beats 1 kHz polling on latency with fewer polls.
+         */
+        int BenchPhaseLock(const BenchOptions& opt) {
+            const double seconds = (double)std::min<uint64_t>(std::max<uint64_t>(opt.samples, 10), 600);
+            const double duration = seconds * 1e9;
+            SimulatedReportStream stream;
+            stream.seed = opt.seed;
+            const uint64_t slackNs = 30000;
+
+            ReportLatencySim fixed1k(stream), fixed500(stream), fixed8k(stream);
+            const struct { uint32_t hz; ReportLatencySim* sim; const char* name; } fixedRuns[] = {
+                { 500, &fixed500, "fixed-500Hz" }, { 1000, &fixed1k, "fixed-1000Hz" }, { 8000, &fixed8k, "fixed-8000Hz" },
+            };
+            for (const auto& run : fixedRuns) {
+                BasicPollScheduler<MockTimer> sched(run.hz);
+                sched.GetTimer().overshootNs = slackNs;
+                const uint64_t t0 = sched.GetTimer().NowNs();
+                while (true) {
+                    sched.WaitNext();
+                    const double t = (double)(sched.GetTimer().NowNs() - t0);
+                    if (t >= duration) break;
+                    run.sim->Poll(t);
+                }
+                run.sim->Print(run.name, seconds);
+            }
+
+            ReportLatencySim locked(stream);
+            PhaseLock pl{ PhaseLockConfig() };
+            MockTimer timer;
+            timer.overshootNs = slackNs;
+            const uint64_t t0 = timer.NowNs();
+            while (true) {
+                timer.SleepUntilNs(pl.NextPollNs(timer.NowNs()));
+                const uint64_t now = timer.NowNs();
+                if ((double)(now - t0) >= duration) break;
+                pl.OnPoll(now, locked.Poll((double)(now - t0)));
+            }
+            locked.Print("phase-lock", seconds);
+            std::printf("%-16s ", "phaselock");
+            PrintPhaseLockMetrics(pl.Metrics(), seconds);
+
+            const PhaseLockMetrics& m = pl.Metrics();
+            const bool ok = m.locked && std::fabs(m.periodNs - stream.periodNs) < stream.periodNs * 1e-3 &&
+                locked.polls < fixed1k.polls && locked.latencySum / (double)locked.seen < fixed1k.latencySum / (double)fixed1k.seen;
+            if (!ok) std::printf("%-16s FAILED: phase lock did not converge or did not beat 1 kHz polling\n", "phaselock");
+            return ok ? 0 : 1;
+        }
+
+        /// Checks that SpinCalibrator tracks a steady overshoot and respects its bounds; returns "" on success.
+        const char* CheckSpinCalibrator() {
+            SpinCalibrator steady;
+            for (int i = 0; i < 200; ++i) steady.OnOvershoot(60000);
+            if (steady.WindowNs() < 60000 || steady.WindowNs() > 70000) return "steady overshoot";
+            SpinCalibrator quiet;
+            for (int i = 0; i < 200; ++i) quiet.OnOvershoot(0);
+            if (quiet.WindowNs() != SpinCalibrator::kMinWindowNs) return "lower bound";
+            SpinCalibrator slow;
+            for (int i = 0; i < 200; ++i) slow.OnOvershoot(15000000);
+            if (slow.WindowNs() != SpinCalibrator::kMaxWindowNs) return "upper bound";
+            return "";
+        }
+
+        /// Prints one wait-mode row.
+        void ReportWait(const char* mode, const SystemTimer& timer, uint64_t wallNs) {
+            const WaitStats& st = timer.Stats();
+            std::printf("%-16s %-8s %6llu waits  wake-up error mean %8.2f us max %8.2f us  spin %5.1f%% of wall time",
+                "hybrid", mode, (unsigned long long)st.waits,
+                st.waits ? (double)st.errorSumNs / (double)st.waits / 1000.0 : 0.0, (double)st.errorMaxNs / 1000.0,
+                wallNs ? 100.0 * (double)st.spinNs / (double)wallNs : 0.0);
+            if (timer.Mode() == WaitMode::Hybrid) std::printf("  window %.1f us", (double)timer.Calibrator().WindowNs() / 1000.0);
+            std::printf("\n");
+        }
+
+        /**
+         * @brief Sleep vs hybrid (sleep, then spin) waits on the real timer at 1000 Hz.
+         * @details count bounds the waits per mode (at most 1000). Spin time is the CPU cost of the accuracy.
+         */
+        int BenchHybridWait(const BenchOptions& opt) {
+            const char* failed = CheckSpinCalibrator();
+            if (*failed) {
+                std::printf("%-16s FAILED: calibrator check '%s'\n", "hybrid", failed);
+                return 1;
+            }
+            std::printf("%-16s calibrator checks passed\n", "hybrid");
+
+            const uint64_t waits = std::min<uint64_t>(std::max<uint64_t>(opt.samples, 10), 1000);
+            double meanErr[2] = {};
+            const WaitMode modes[2] = { WaitMode::Sleep, WaitMode::Hybrid };
+            for (int m = 0; m < 2; ++m) {
+                BasicPollScheduler<SystemTimer> sched(1000);
+                sched.GetTimer().SetWaitMode(modes[m]);
+                const uint64_t t0 = sched.GetTimer().NowNs();
+                for (uint64_t i = 0; i <= waits; ++i) sched.WaitNext();
+                const SystemTimer& timer = sched.GetTimer();
+                ReportWait(m == 0 ? "sleep" : "hybrid", timer, timer.NowNs() - t0);
+                meanErr[m] = timer.Stats().waits ? (double)timer.Stats().errorSumNs / (double)timer.Stats().waits : 0.0;
+            }
+            if (meanErr[1] > meanErr[0]) {
+                std::printf("%-16s FAILED: hybrid waits were less accurate than plain sleeps\n", "hybrid");
+                return 1;
+            }
+            return 0;
+        }
+
+#ifdef __linux__
+        /**
+         * @brief Builds a recorded-style input_event stream: each frame moves a stick axis, sometimes
+         *        toggles a button or the hat, and ends with SYN_REPORT.
+         * @param frames Number of SYN_REPORT frames.
+         * @param seed PRNG seed.
+         */
+        std::vector<input_event> MakeEvdevRecording(uint64_t frames, uint64_t seed) {
+            std::vector<input_event> out;
+            out.reserve(frames * 3);
+            uint64_t r = seed ? seed : 1;
+            auto push = [&out](uint16_t type, uint16_t code, int32_t value) {
+                input_event ev = {};
+                ev.type = type;
+                ev.code = code;
+                ev.value = value;
+                out.push_back(ev);
+            };
+            for (uint64_t f = 0; f < frames; ++f) {
+                r ^= r << 13; r ^= r >> 7; r ^= r << 17;
+                push(EV_ABS, static_cast<uint16_t>(ABS_X + (r % 6)), static_cast<int32_t>((r >> 8) & 0xFFFF));
+                if ((r >> 32) % 4 == 0) push(EV_KEY, static_cast<uint16_t>(BTN_SOUTH + (r >> 40) % 8), static_cast<int32_t>((r >> 48) & 1));
+                if ((r >> 36) % 16 == 0) push(EV_ABS, ABS_HAT0X, static_cast<int32_t>((r >> 52) % 3) - 1);
+                push(EV_SYN, SYN_REPORT, 0);
+            }
+            return out;
+        }
+
+        /**
+         * @brief Feeds a recorded stream through a socketpair into EvdevBackend and checks the final
+         *        state against a direct decode of the same stream.
+         */
+        int BenchEvdevPipe(const BenchOptions& opt) {
+            const std::vector<input_event> rec = MakeEvdevRecording(opt.samples, opt.seed);
+
+            InputState expected;
+            {
+                EvdevDecoder decoder;
+                EvdevStats ignored;
+                bool committed;
+                for (size_t i = 0; i < rec.size();) {
+                    i += decoder.Apply(rec.data() + i, rec.size() - i, expected, ignored, committed);
+                }
+            }
+
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+                std::perror("socketpair");
+                return 1;
+            }
+
+            // Write in device-sized bursts so the reader sees realistic partial batches.
+            std::thread writer([&rec, fds]() {
+                const char* p = reinterpret_cast<const char*>(rec.data());
+                size_t left = rec.size() * sizeof(input_event);
+                while (left > 0) {
+                    const size_t chunk = left < 4096 ? left : 4096;
+                    const ssize_t n = send(fds[1], p, chunk, MSG_NOSIGNAL);
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) break;
+                    p += n;
+                    left -= static_cast<size_t>(n);
+                }
+                close(fds[1]);
+            });
+
+            InputState last;
+            EvdevStats st;
+            auto t0 = BenchClock::now();
+            {
+                EvdevBackend backend(fds[0], true);
+                SampleStatus s;
+                while ((s = backend.Sample(last)) != SampleStatus::Disconnected && s != SampleStatus::Failed) {}
+                st = backend.Stats();
+            }
+            const double ns = ElapsedNs(t0);
+            writer.join();
+
+            Report("evdev/pipe", "read+decode", st.events, ns);
+            std::printf("%-16s frames=%llu reads=%llu waits=%llu events/read=%.1f\n", "evdev/pipe",
+                (unsigned long long)st.frames, (unsigned long long)st.reads, (unsigned long long)st.waits,
+                st.reads ? (double)st.events / (double)st.reads : 0.0);
+
+            if (st.frames != opt.samples || DiffStates(expected, last) != kChangedNone) {
+                std::printf("%-16s FAILED: final state does not match the recording\n", "evdev/pipe");
+                return 1;
+            }
+            return 0;
+        }
+
+        /**
+         * @brief Wake-ups and output writes of one reader run.
+         */
+        struct PowerRun {
+            uint64_t wakeups = 0;
+            uint64_t writes = 0;
+            uint64_t emitted = 0;
+            double seconds = 0;
+        };
+
+        /**
+         * @brief Streams bursty traffic (a 250 Hz frame stream for the first half of every second, then
+         *        silence) through a socketpair into the evdev reader as RunDeviceReader runs it, with output
+         *        to /dev/null line-buffered like a terminal.
+         */
+        PowerRun RunPowerTrace(bool powerSave, uint64_t seconds) {
+            PowerRun r;
+            int fds[2];
+            std::FILE* devnull = std::fopen("/dev/null", "w");
+            if (!devnull || socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+                if (devnull) std::fclose(devnull);
+                return r;
+            }
+            std::setvbuf(devnull, nullptr, _IOLBF, BUFSIZ);
+
+            std::thread writer([fds, seconds]() {
+                const auto t0 = BenchClock::now();
+                int32_t value = 0;
+                for (uint64_t s = 0; s < seconds; ++s) {
+                    for (int k = 0; k < 125; ++k) {
+                        std::this_thread::sleep_until(t0 + std::chrono::seconds(s) + std::chrono::milliseconds(4 * k));
+                        input_event frame[2] = {};
+                        frame[0].type = EV_ABS;
+                        frame[0].code = ABS_X;
+                        frame[0].value = ++value;
+                        frame[1].type = EV_SYN;
+                        frame[1].code = SYN_REPORT;
+                        if (send(fds[1], frame, sizeof(frame), MSG_NOSIGNAL) != (ssize_t)sizeof(frame)) return;
+                    }
+                }
+                std::this_thread::sleep_until(t0 + std::chrono::seconds(seconds));
+                close(fds[1]);
+            });
+
+            {
+                EvdevBackend backend(fds[0], true, powerSave ? -1 : 100);
+                ConsoleSink sink(backend.Layout(), powerSave ? 250 : 0, devnull);
+                const std::atomic_bool running{ true };
+                ReaderStats stats;
+                const WakeupMeter meter;
+                if (powerSave) RunBatchedReader(backend, sink, running, &stats);
+                else RunReader(backend, sink, running, &stats);
+                sink.Flush();
+                r.wakeups = meter.Count();
+                r.seconds = meter.Seconds();
+                r.writes = sink.Writes();
+                r.emitted = stats.emitted;
+            }
+            writer.join();
+            std::fclose(devnull);
+            return r;
+        }
+
+        /// Prints one power-save row; a negative @p writesPerSec omits the output column.
+        void ReportPower(const char* stage, double wakeupsPerSec, double writesPerSec) {
+            std::printf("%-16s %-26s %8.1f wake-ups/s", "powersave", stage, wakeupsPerSec);
+            if (writesPerSec >= 0) std::printf("  %8.1f output writes/s", writesPerSec);
+            std::printf("\n");
+        }
+
+        /**
+         * @brief Default vs power-save reader: wake-ups and output writes per second.
+         * @details Event path: real evdev reader on a socketpair for count seconds (1..3). Polled path
+         *          (XInput): the kiosk-pad model on MockTimer, where every poll is a wake-up.
+         */
+        int BenchPowerSave(const BenchOptions& opt) {
+            const uint64_t seconds = std::min<uint64_t>(std::max<uint64_t>(opt.samples, 1), 3);
+            const PowerRun normal = RunPowerTrace(false, seconds);
+            const PowerRun saver = RunPowerTrace(true, seconds);
+            if (normal.seconds <= 0 || saver.seconds <= 0) {
+                std::printf("%-16s FAILED: could not set up the socketpair\n", "powersave");
+                return 1;
+            }
+            ReportPower("evdev default", normal.wakeups / normal.seconds, normal.writes / normal.seconds);
+            ReportPower("evdev power-save", saver.wakeups / saver.seconds, saver.writes / saver.seconds);
+
+            const SimulatedPad pad;
+            const uint64_t simNs = 60ull * 1000000000ull;
+            const PollSimResult fixed = SimulatePolling(pad, simNs, 500, nullptr);
+            AdaptiveRateConfig cfg;
+            cfg.activeHz = 125;
+            cfg.idleHz = 10;
+            AdaptiveRate adaptive(cfg);
+            const PollSimResult saving = SimulatePolling(pad, simNs, cfg.activeHz, &adaptive);
+            ReportPower("xinput model 500 Hz", (double)fixed.polls * 1e9 / (double)simNs, -1);
+            ReportPower("xinput model power-save", (double)saving.polls * 1e9 / (double)simNs, -1);
+
+            const uint64_t frames = seconds * 125;
+            if (normal.emitted != frames || saver.emitted != frames) {
+                std::printf("%-16s FAILED: %llu/%llu of %llu frames printed\n", "powersave",
+                    (unsigned long long)normal.emitted, (unsigned long long)saver.emitted, (unsigned long long)frames);
+                return 1;
+            }
+            if (saver.wakeups >= normal.wakeups || saver.writes >= normal.writes || saving.polls >= fixed.polls) {
+                std::printf("%-16s FAILED: power-save did not reduce wake-ups or writes\n", "powersave");
+                return 1;
+            }
+            return 0;
+        }
+
+        /**
+         * @brief Pipe-backed fake devices driven by a writer thread at a fixed tick.
+         * @details Every tick writes one frame per device. The frame carries its send time split over
+         *          ABS_THROTTLE/ABS_RUDDER (axes 6/7) so the reader can compute delivery latency.
+         */
+        class FakeDeviceRig {
+        public:
+            FakeDeviceRig(size_t devices, uint64_t ticks, std::chrono::microseconds tick)
+                : ticks_(ticks), tick_(tick), epoch_(BenchClock::now()) {
+                for (size_t i = 0; i < devices; ++i) {
+                    int fds[2];
+                    if (pipe2(fds, O_CLOEXEC) == 0) {
+                        readers_.push_back(fds[0]);
+                        writers_.push_back(fds[1]);
+                    }
+                }
+            }
+
+            ~FakeDeviceRig() {
+                if (thread_.joinable()) thread_.join();
+                for (int fd : writers_) if (fd >= 0) close(fd);
+            }
+
+            const std::vector<int>& Readers() const { return readers_; }
+
+            void Start() {
+                thread_ = std::thread([this]() { Run(); });
+            }
+
+            /// Latency of a frame from its embedded send time.
+            uint64_t LatencyNs(const InputState& st) const {
+                const uint64_t sent = (static_cast<uint64_t>(st.axes[6]) << 30) | static_cast<uint64_t>(st.axes[7]);
+                return NowNs() - sent;
+            }
+
+        private:
+            uint64_t NowNs() const {
+                return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - epoch_).count();
+            }
+
+            void Run() {
+                input_event frame[4] = {};
+                frame[0].type = EV_ABS; frame[0].code = ABS_X;
+                frame[1].type = EV_ABS; frame[1].code = ABS_THROTTLE;
+                frame[2].type = EV_ABS; frame[2].code = ABS_RUDDER;
+                frame[3].type = EV_SYN; frame[3].code = SYN_REPORT;
+                auto next = BenchClock::now();
+                for (uint64_t t = 0; t < ticks_; ++t) {
+                    next += tick_;
+                    std::this_thread::sleep_until(next);
+                    for (size_t d = 0; d < writers_.size(); ++d) {
+                        const uint64_t now = NowNs();
+                        frame[0].value = static_cast<int32_t>(t & 0xFFFF);
+                        frame[1].value = static_cast<int32_t>(now >> 30);
+                        frame[2].value = static_cast<int32_t>(now & ((1u << 30) - 1));
+                        if (write(writers_[d], frame, sizeof(frame)) != (ssize_t)sizeof(frame)) break;
+                    }
+                }
+                for (int& fd : writers_) {
+                    close(fd);
+                    fd = -1;
+                }
+            }
+
+            uint64_t ticks_;
+            std::chrono::microseconds tick_;
+            BenchClock::time_point epoch_;
+            std::vector<int> readers_;
+            std::vector<int> writers_;
+            std::thread thread_;
+        };
+
+        /// Prints latency percentiles for one engine.
+        void ReportLatency(const char* scenario, std::vector<uint64_t>& lat) {
+            if (lat.empty()) return;
+            std::sort(lat.begin(), lat.end());
+            auto pct = [&lat](double p) { return (double)lat[(size_t)(p * (double)(lat.size() - 1))] / 1000.0; };
+            std::printf("%-16s latency us: p50=%.1f p90=%.1f p99=%.1f max=%.1f\n",
+                scenario, pct(0.50), pct(0.90), pct(0.99), (double)lat.back() / 1000.0);
+        }
+
+        /**
+         * @brief epoll vs io_uring on 16 pipe-backed devices: syscalls per frame and delivery latency.
+         * @details count / 16 ticks of 250 us each (capped at 4000 ticks, one second of traffic).
+         */
+        int BenchUringVsEpoll(const BenchOptions& opt) {
+            const size_t devices = 16;
+            const uint64_t ticks = std::min<uint64_t>(std::max<uint64_t>(opt.samples / devices, 1), 4000);
+            const uint64_t expected = ticks * devices;
+            const auto tick = std::chrono::microseconds(250);
+            int rc = 0;
+
+            // epoll + non-blocking read per ready device, the EvdevBackend pattern scaled to N fds.
+            {
+                FakeDeviceRig rig(devices, ticks, tick);
+                const int ep = epoll_create1(EPOLL_CLOEXEC);
+                std::vector<EvdevStream> streams(rig.Readers().size());
+                for (size_t i = 0; i < rig.Readers().size(); ++i) {
+                    const int fd = rig.Readers()[i];
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    epoll_event ev = {};
+                    ev.events = EPOLLIN;
+                    ev.data.u64 = i;
+                    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+                }
+                std::vector<uint64_t> lat;
+                lat.reserve(expected);
+                EvdevStats st;
+                uint64_t syscalls = 0;
+                size_t open = streams.size();
+                rig.Start();
+                epoll_event ready[64];
+                while (open > 0) {
+                    ++syscalls;
+                    const int n = epoll_wait(ep, ready, 64, 1000);
+                    if (n <= 0) break;
+                    for (int k = 0; k < n; ++k) {
+                        const size_t i = (size_t)ready[k].data.u64;
+                        const int fd = rig.Readers()[i];
+                        while (true) {
+                            size_t space = 0;
+                            uint8_t* dst = streams[i].PrepareWrite(space);
+                            ++syscalls;
+                            const ssize_t got = read(fd, dst, space);
+                            if (got > 0) {
+                                streams[i].CommitWrite((size_t)got);
+                                InputState frame;
+                                while (streams[i].NextFrame(fd, frame, st)) lat.push_back(rig.LatencyNs(frame));
+                                continue;
+                            }
+                            if (got == 0) {
+                                epoll_ctl(ep, EPOLL_CTL_DEL, fd, nullptr);
+                                --open;
+                            }
+                            break;
+                        }
+                    }
+                }
+                close(ep);
+                for (int fd : rig.Readers()) close(fd);
+                std::printf("%-16s frames=%llu syscalls=%llu syscalls/frame=%.2f\n", "uring/epoll",
+                    (unsigned long long)st.frames, (unsigned long long)syscalls,
+                    st.frames ? (double)syscalls / (double)st.frames : 0.0);
+                ReportLatency("uring/epoll", lat);
+                if (st.frames != expected) rc = 1;
+            }
+
+            // io_uring with one pre-posted read per device.
+            {
+                FakeDeviceRig rig(devices, ticks, tick);
+                UringEvdevBackend backend(static_cast<unsigned>(devices), 1000);
+                if (!backend.IsValid()) {
+                    std::printf("%-16s io_uring unavailable on this kernel; skipped\n", "uring/uring");
+                    for (int fd : rig.Readers()) close(fd);
+                    return rc;
+                }
+                for (int fd : rig.Readers()) backend.AddDevice(fd, true);
+                std::vector<uint64_t> lat;
+                lat.reserve(expected);
+                rig.Start();
+                InputState frame;
+                SampleStatus s;
+                while ((s = backend.Sample(frame)) != SampleStatus::Disconnected && s != SampleStatus::Failed) {
+                    if (s == SampleStatus::Changed) lat.push_back(rig.LatencyNs(frame));
+                }
+                const uint64_t frames = backend.Stats().frames;
+                const uint64_t syscalls = backend.EngineStats().enters;
+                std::printf("%-16s frames=%llu syscalls=%llu syscalls/frame=%.2f\n", "uring/uring",
+                    (unsigned long long)frames, (unsigned long long)syscalls,
+                    frames ? (double)syscalls / (double)frames : 0.0);
+                ReportLatency("uring/uring", lat);
+                if (frames != expected) rc = 1;
+            }
+
+            if (rc != 0) std::printf("%-16s FAILED: frame count mismatch\n", "uring");
+
+            // Teardown with a read still pending: it must be cancelled and reaped, not left to the kernel.
+            {
+                int p[2];
+                if (pipe(p) != 0) return 1;
+                double teardownNs = 0;
+                {
+                    std::unique_ptr<UringEvdevBackend> backend(new UringEvdevBackend(1, 1));
+                    backend->AddDevice(p[0], true);
+                    InputState frame;
+                    backend->Sample(frame); // posts a read that nothing will satisfy
+                    const auto t0 = BenchClock::now();
+                    backend.reset();
+                    teardownNs = ElapsedNs(t0);
+                }
+                close(p[1]);
+                std::printf("%-16s teardown with a pending read: %.1f us\n", "uring/cancel", teardownNs / 1e3);
+                if (teardownNs > 500e6) {
+                    std::printf("%-16s FAILED: pending read was not cancelled\n", "uring");
+                    rc = 1;
+                }
+            }
+            return rc;
+        }
+
+        /// Temporary directory standing in for /dev/input; removed with everything in it.
+        class TempDeviceDir {
+        public:
+            TempDeviceDir() {
+                char name[] = "/tmp/joyhotplugXXXXXX";
+                if (mkdtemp(name)) path_ = name;
+            }
+            ~TempDeviceDir() {
+                if (path_.empty()) return;
+                for (const std::string& f : created_) unlink(f.c_str());
+                rmdir(path_.c_str());
+            }
+
+            bool IsValid() const { return !path_.empty(); }
+            const std::string& Path() const { return path_; }
+
+            /// Full path of @p name; remembered for clean-up.
+            std::string Node(const std::string& name) {
+                created_.push_back(path_ + "/" + name);
+                return created_.back();
+            }
+
+        private:
+            std::string path_;
+            std::vector<std::string> created_;
+        };
+
+        /// Describes every FIFO in the stand-in directory as the same pad (no ioctl on a FIFO).
+        bool DescribeBenchNode(const std::string& path, DeviceInfo& out) {
+            struct stat st = {};
+            if (stat(path.c_str(), &st) != 0 || !S_ISFIFO(st.st_mode)) return false;
+            out.kind = DeviceKind::Evdev;
+            out.path = path;
+            out.name = "Bench Pad";
+            out.vendorId = 0x045e;
+            out.productId = 0x028e;
+            return true;
+        }
+
+        /// Waits up to @p timeoutMs for @p done().
+        template <class Done>
+        bool WaitFor(Done done, int timeoutMs) {
+            const auto end = BenchClock::now() + std::chrono::milliseconds(timeoutMs);
+            while (!done()) {
+                if (BenchClock::now() > end) return false;
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            return true;
+        }
+
+        /**
+         * @brief Hotplug in a temporary directory: watcher notifications, then a reactor attaching and
+         *        detaching FIFO-backed devices as their nodes appear and disappear.
+         * @details Watcher: eventN files are created, chmod'ed and deleted next to other names, and the
+         *          drained notifications are checked per step. Reactor: a FIFO node is renamed into
+         *          place, the hotplug handler attaches it (latency to its first frame), frames are written
+         *          through it, and deleting the node detaches it. Every plug is the
+         *          same pad, so it must come back under its first tag and reuse its reactor slot.
+         */
+        int BenchHotplug(const BenchOptions& /*opt*/) {
+            TempDeviceDir dir;
+            if (!dir.IsValid()) {
+                std::printf("%-16s FAILED: no temporary directory\n", "hotplug");
+                return 1;
+            }
+            int rc = 0;
+
+            {
+                HotplugWatcher watcher(dir.Path());
+                if (!watcher.IsValid()) {
+                    std::printf("%-16s FAILED: inotify unavailable\n", "hotplug");
+                    return 1;
+                }
+                const int cycles = 32;
+                std::vector<HotplugEvent> events;
+                std::vector<uint64_t> lat;
+                bool ok = true;
+                // One step: act, wait for the notification, check what was drained.
+                auto step = [&](HotplugAction expect, const std::string& path, bool noise, auto act) {
+                    events.clear();
+                    const auto t0 = BenchClock::now();
+                    act();
+                    if (!watcher.Wait(1000)) {
+                        ok = false;
+                        return;
+                    }
+                    lat.push_back((uint64_t)ElapsedNs(t0));
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    watcher.Drain(events);
+                    if (noise) {
+                        ok = ok && events.empty();
+                        return;
+                    }
+                    ok = ok && !events.empty() && events.back().action == expect && events.back().path == path;
+                };
+                for (int i = 0; i < cycles && ok; ++i) {
+                    const std::string node = dir.Node("event" + std::to_string(i % 8));
+                    const std::string other = dir.Node(i % 2 ? "js0" : "mouse1");
+                    step(HotplugAction::Added, node, false, [&node] { close(open(node.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0600)); });
+                    step(HotplugAction::Added, node, false, [&node] { chmod(node.c_str(), 0660); });
+                    step(HotplugAction::Added, other, true, [&other] { close(open(other.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0600)); });
+                    step(HotplugAction::Removed, node, false, [&node] { unlink(node.c_str()); });
+                    step(HotplugAction::Removed, other, true, [&other] { unlink(other.c_str()); });
+                }
+                const HotplugStats st = watcher.Stats();
+                std::printf("%-16s watcher: %llu added, %llu removed, %llu ignored\n", "hotplug",
+                    (unsigned long long)st.added, (unsigned long long)st.removed, (unsigned long long)st.ignored);
+                ReportLatency("hotplug/notify", lat);
+                if (!ok || st.removed != (uint64_t)cycles) {
+                    std::printf("%-16s FAILED: watcher notifications do not match the file operations\n", "hotplug");
+                    rc = 1;
+                }
+            }
+
+            {
+                const int cycles = 16;
+                const int frames = 50;
+                HotplugWatcher watcher(dir.Path());
+                Reactor reactor;
+                ReaderOptions options;
+                EvdevHotplug hotplug(reactor, watcher, options, true, &DescribeBenchNode, nullptr);
+                if (!watcher.IsValid() || !reactor.IsValid() || !hotplug.Start()) {
+                    std::printf("%-16s FAILED: watch setup\n", "hotplug");
+                    return 1;
+                }
+
+                std::atomic<uint64_t> received{ 0 };
+                std::atomic<uint64_t> closed{ 0 };
+                std::atomic<int> wrongTag{ 0 };
+                auto sink = [&](int tag, StateLayout, const InputState* state) {
+                    if (tag != 0) wrongTag.fetch_add(1);
+                    if (state) received.fetch_add(1);
+                    else closed.fetch_add(1);
+                };
+                std::atomic_bool running{ true };
+                std::vector<uint64_t> attachLat;
+                std::vector<uint64_t> detachLat;
+                bool ok = true;
+
+                std::thread driver([&] {
+                    for (int i = 0; i < cycles && ok; ++i) {
+                        const std::string node = dir.Node("event" + std::to_string(10 + i % 4));
+                        const std::string staging = dir.Node(".staging");
+                        const uint64_t before = received.load();
+                        // The node is prepared under another name and renamed into place, as udev does;
+                        // the write end stays open so the reader never sees end-of-file.
+                        if (mkfifo(staging.c_str(), 0600) != 0) {
+                            ok = false;
+                            break;
+                        }
+                        const int w = open(staging.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+                        auto write = [w](int32_t value) {
+                            input_event ev[2] = {};
+                            ev[0].type = EV_ABS;
+                            ev[0].code = ABS_X;
+                            ev[0].value = value;
+                            ev[1].type = EV_SYN;
+                            ev[1].code = SYN_REPORT;
+                            return ::write(w, ev, sizeof(ev)) == (ssize_t)sizeof(ev);
+                        };
+                        auto t0 = BenchClock::now();
+                        ok = w >= 0 && rename(staging.c_str(), node.c_str()) == 0 && write(i * frames + 1);
+                        // Attached once its first frame comes through.
+                        ok = ok && WaitFor([&] { return received.load() > before; }, 2000);
+                        if (!ok) break;
+                        attachLat.push_back((uint64_t)ElapsedNs(t0));
+
+                        for (int f = 1; f < frames; ++f) {
+                            ok = ok && write(i * frames + f + 1);
+                            std::this_thread::sleep_for(std::chrono::microseconds(200));
+                        }
+                        ok = ok && WaitFor([&] { return received.load() >= before + frames; }, 2000);
+
+                        const uint64_t closedBefore = closed.load();
+                        t0 = BenchClock::now();
+                        unlink(node.c_str());
+                        ok = ok && WaitFor([&] { return closed.load() > closedBefore; }, 2000);
+                        detachLat.push_back((uint64_t)ElapsedNs(t0));
+                        close(w);
+                    }
+                    running.store(false);
+                    // Wakes the reactor: with no device attached it only waits on the watch.
+                    const std::string wake = dir.Node("wake");
+                    close(open(wake.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0600));
+                });
+                reactor.Run(sink, running);
+                driver.join();
+
+                std::printf("%-16s reactor: %d plugs, %llu attached, %llu detached, %llu frames, %llu disconnects, %zu source slots\n", "hotplug",
+                    cycles, (unsigned long long)hotplug.Attached(), (unsigned long long)hotplug.Detached(),
+                    (unsigned long long)received.load(), (unsigned long long)closed.load(), reactor.SourceCount());
+                ReportLatency("hotplug/attach", attachLat);
+                ReportLatency("hotplug/detach", detachLat);
+                if (!ok || hotplug.Attached() != (uint64_t)cycles || hotplug.Detached() != (uint64_t)cycles ||
+                    received.load() != (uint64_t)cycles * frames || wrongTag.load() != 0 || reactor.SourceCount() != 1) {
+                    std::printf("%-16s FAILED: devices were not attached and detached once per plug under one tag and slot\n", "hotplug");
+                    rc = 1;
+                }
+            }
+            return rc;
+        }
+#endif
+
+        /**
+         * @brief Reactor sink that formats like TaggedConsoleSink but only counts the bytes.
+         */
+        struct CountingTaggedSink {
+            uint64_t lines = 0;
+            uint64_t bytes = 0;
+            uint64_t closed = 0;
+
+            void operator()(int /*tag*/, StateLayout layout, const InputState* state) {
+                if (!state) {
+                    ++closed;
+                    return;
+                }
+                char line[kMaxFormattedState];
+                bytes += FormatState(layout, *state, line, sizeof(line));
+                ++lines;
+            }
+        };
+
+        /// Prints one reactor scaling row.
+        void ReportReactor(const char* stage, size_t devices, const ReactorStats& st, double seconds, double targetPerDevice) {
+            const double total = (double)(st.waitNs + st.busyNs);
+            std::printf("%-16s %-7s %3zu devices  %9.0f polls/s", "reactor", stage, devices, (double)st.polls / seconds);
+            if (targetPerDevice > 0) {
+                std::printf(" (%5.1f%% of target)", 100.0 * (double)st.polls / seconds / (targetPerDevice * (double)devices));
+            }
+            std::printf("  %7.1f wake-ups/s  busy %6.2f%%  %6.2f us/poll\n",
+                (double)st.wakeups / seconds, total > 0 ? 100.0 * (double)st.busyNs / total : 0.0,
+                st.polls ? (double)st.busyNs / (double)st.polls / 1000.0 : 0.0);
+        }
+
+        /**
+         * @brief Reactor scaling from 1 to 64 devices on one thread.
+         * @details Polled: synthetic devices at 1000 Hz each for a quarter second. Event (Linux): pipe-backed
+         *          evdev devices fed at 500 Hz each, with delivery checked frame for frame and latency
+         *          measured from the send time embedded in each frame.
+         */
+        int BenchReactor(const BenchOptions& opt) {
+            const size_t counts[] = { 1, 4, 16, 64 };
+            int rc = 0;
+            for (size_t n : counts) {
+                std::vector<std::unique_ptr<SyntheticBackend>> devices;
+                Reactor reactor;
+                for (size_t i = 0; i < n; ++i) {
+                    SyntheticConfig cfg;
+                    cfg.seed = opt.seed + i;
+                    cfg.layout = i % 2 ? StateLayout::Joystick : StateLayout::Gamepad;
+                    devices.emplace_back(new SyntheticBackend(cfg));
+                    reactor.AddPolled(*devices.back(), (int)i, 1000);
+                }
+                std::atomic_bool running{ true };
+                std::thread stopper([&running]() {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+                    running.store(false);
+                });
+                CountingTaggedSink sink;
+                const auto t0 = BenchClock::now();
+                reactor.Run(sink, running);
+                const double seconds = ElapsedNs(t0) / 1e9;
+                stopper.join();
+                ReportReactor("polled", n, reactor.Stats(), seconds, 1000.0);
+                if ((double)reactor.Stats().polls < 0.5 * 1000.0 * (double)n * seconds) {
+                    std::printf("%-16s FAILED: polled devices fell below half the target rate\n", "reactor");
+                    rc = 1;
+                }
+            }
+
+#ifdef __linux__
+            const uint64_t ticks = 250;
+            for (size_t n : counts) {
+                FakeDeviceRig rig(n, ticks, std::chrono::microseconds(2000));
+                std::vector<std::unique_ptr<EvdevBackend>> devices;
+                Reactor reactor;
+                for (size_t i = 0; i < rig.Readers().size(); ++i) {
+                    devices.emplace_back(new EvdevBackend(rig.Readers()[i], true));
+                    reactor.AddEvent(*devices.back(), (int)i, rig.Readers()[i]);
+                }
+                std::vector<uint64_t> lat;
+                lat.reserve(n * ticks);
+                auto sink = [&lat, &rig](int, StateLayout, const InputState* state) {
+                    if (state) lat.push_back(rig.LatencyNs(*state));
+                };
+                const std::atomic_bool running{ true };
+                rig.Start();
+                const auto t0 = BenchClock::now();
+                reactor.Run(sink, running);
+                const double seconds = ElapsedNs(t0) / 1e9;
+                ReportReactor("evdev", n, reactor.Stats(), seconds, 0.0);
+                const size_t frames = lat.size();
+                ReportLatency("reactor", lat);
+                if (frames != n * ticks) {
+                    std::printf("%-16s FAILED: %zu of %llu frames delivered\n", "reactor", frames, (unsigned long long)(n * ticks));
+                    rc = 1;
+                }
+            }
+#endif
+            return rc;
+        }
+
+        /**
+         * @brief Synthetic device with a read cost, for the pool benchmark.
+         * @details Every poll burns cpuNs of CPU (a connected XInput pad costs on the order of 10 us);
+         *          "stalling" devices additionally block for stallNs, like an empty XInput slot or a
+         *          HID driver that holds the call. The state changes on every fourth poll.
+         */
+        class CostlyBackend : public InputBackend<CostlyBackend> {
+        public:
+            CostlyBackend(uint64_t cpuNs, uint64_t stallNs) : cpuNs_(cpuNs), stallNs_(stallNs) {}
+
+            SampleStatus PollImpl(InputState& state) {
+                const auto t0 = BenchClock::now();
+                while (ElapsedNs(t0) < (double)cpuNs_) CpuRelax();
+                if (stallNs_) std::this_thread::sleep_for(std::chrono::nanoseconds(stallNs_));
+                if (++polls_ % 4 != 0) return SampleStatus::Unchanged;
+                state.packet = static_cast<uint32_t>(polls_ / 4);
+                state.axes[0] = static_cast<int32_t>(polls_ & 0x7fff);
+                return SampleStatus::Changed;
+            }
+
+            SampleStatus SampleImpl(InputState& state) { return PollImpl(state); }
+
+            StateLayout OutputLayout() const { return StateLayout::Gamepad; }
+
+        private:
+            uint64_t cpuNs_;
+            uint64_t stallNs_;
+            uint64_t polls_ = 0;
+        };
+
+        /// Prints one pool scaling row.
+        void ReportPool(size_t devices, size_t workers, const PoolStats& st, double seconds, double targetPerDevice, bool oversubscribed) {
+            const double total = (double)(st.waitNs + st.busyNs);
+            std::printf("%-16s %3zu devices %2zu workers  %7.0f polls/s (%5.1f%% of target)  steals %6.0f/s  "
+                "lag mean %7.1f us max %8.1f us  busy %5.1f%%%s\n",
+                "pool", devices, workers, (double)st.polls / seconds,
+                100.0 * (double)st.polls / seconds / (targetPerDevice * (double)devices), (double)st.steals / seconds,
+                st.polls ? (double)st.lagSumNs / (double)st.polls / 1000.0 : 0.0, (double)st.lagMaxNs / 1000.0,
+                total > 0 ? 100.0 * (double)st.busyNs / total : 0.0, oversubscribed ? "  (oversubscribed)" : "");
+        }
+
+        /**
+         * @brief Reader pool scaling: 1..64 devices on 1..N workers.
+         * @details Devices are polled at 500 Hz for a quarter second. Each poll costs 10 us of CPU and
+         *          every eighth device also stalls for 300 us, so one thread cannot keep up with 64
+         *          devices and stealing has uneven work to spread. N is the hardware thread count;
+         *          on machines with fewer than four, rows up to four workers are still run (marked
+         *          oversubscribed) since stalls block rather than spin.
+         */
+        int BenchReaderPool(const BenchOptions& /*opt*/) {
+            const size_t counts[] = { 1, 4, 16, 64 };
+            const uint32_t rateHz = 500;
+            const size_t cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+            std::vector<size_t> workerCounts;
+            for (size_t w = 1; w <= std::max<size_t>(cores, 4); w *= 2) workerCounts.push_back(w);
+            if (workerCounts.back() < cores) workerCounts.push_back(cores);
+            std::printf("%-16s %zu hardware threads\n", "pool", cores);
+
+            int rc = 0;
+            for (size_t n : counts) {
+                for (size_t w : workerCounts) {
+                    if (w > n) break;
+                    std::vector<std::unique_ptr<CostlyBackend>> devices;
+                    ReaderPool pool(w, rateHz);
+                    for (size_t i = 0; i < n; ++i) {
+                        devices.emplace_back(new CostlyBackend(10000, i % 8 == 7 ? 300000 : 0));
+                        pool.Add(*devices.back(), (int)i);
+                    }
+                    std::atomic_bool running{ true };
+                    std::thread stopper([&running]() {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+                        running.store(false);
+                    });
+                    CountingTaggedSink sink;
+                    const auto t0 = BenchClock::now();
+                    pool.Run(sink, running);
+                    const double seconds = ElapsedNs(t0) / 1e9;
+                    stopper.join();
+                    ReportPool(n, w, pool.Stats(), seconds, rateHz, w > cores);
+
+                    // Stealing must not starve anyone: every device gets at least half the mean poll count.
+                    uint64_t sum = 0;
+                    uint64_t least = UINT64_MAX;
+                    for (size_t i = 0; i < n; ++i) {
+                        sum += pool.DevicePolls(i);
+                        least = std::min(least, pool.DevicePolls(i));
+                    }
+                    if (least * 2 * n < sum || sink.lines == 0) {
+                        std::printf("%-16s FAILED: device starved (%llu polls vs mean %.1f)\n", "pool",
+                            (unsigned long long)least, (double)sum / (double)n);
+                        rc = 1;
+                    }
+                }
+            }
+            return rc;
+        }
+
+        /**
+         * @brief Output stage that stands in for a slow terminal or a pipe nobody drains.
+         * @details Every stallEvery-th line blocks for stallMs; the last packet written is kept (also per
+         *          tag 0/1, with whether the tag disconnected) so the benchmark can check that the final
+         *          states arrived.
+         */
+        struct StallingOutput {
+            uint32_t stallEvery;
+            uint32_t stallMs;
+            uint64_t lines = 0;
+            uint32_t lastPacket = 0;
+            uint32_t lastPacketOf[2] = {};
+            bool closedOf[2] = {};
+
+            void operator()(int tag, StateLayout /*layout*/, const InputState* state) {
+                ++lines;
+                if (tag == 0 || tag == 1) {
+                    if (!state) closedOf[tag] = true;
+                    else if (closedOf[tag]) lastPacketOf[tag] = ~0u; // a state after the disconnect
+                    else lastPacketOf[tag] = state->packet;
+                }
+                if (!state) return;
+                lastPacket = state->packet;
+                if (lines % stallEvery == 0) std::this_thread::sleep_for(std::chrono::milliseconds(stallMs));
+            }
+
+            void Flush() {}
+        };
+
+        /// Reader-side result of one ring benchmark run.
+        struct ProducerRun {
+            uint64_t samples = 0;  //!< Samples taken.
+            uint64_t missed = 0;   //!< Device reports that came and went between two samples.
+            uint64_t maxGapNs = 0; //!< Longest time between two samples.
+            uint32_t lastPacket = 0;
+        };
+
+        /**
+         * @brief Reader loop of a simulated pad that reports every period; every sample is a change.
+         * @details A sample taken more than one period after the previous one has missed the reports in
+         *          between, as XInputGetState does when the reader thread is held up.
+         */
+        template <class Sink>
+        ProducerRun RunProducer(Sink& sink, uint32_t hz, uint32_t ms) {
+            const uint64_t period = 1000000000ull / hz;
+            ProducerRun run;
+            InputState state;
+            const auto t0 = BenchClock::now();
+            auto next = t0;
+            uint64_t lastTick = 0;
+            uint64_t lastNs = 0;
+            while (ElapsedNs(t0) < ms * 1e6) {
+                std::this_thread::sleep_until(next);
+                const uint64_t now = (uint64_t)ElapsedNs(t0);
+                const uint64_t tick = now / period + 1;
+                if (run.samples > 0) {
+                    if (tick > lastTick + 1) run.missed += tick - lastTick - 1;
+                    run.maxGapNs = std::max(run.maxGapNs, now - lastNs);
+                }
+                lastTick = tick;
+                lastNs = now;
+                state.packet = static_cast<uint32_t>(tick);
+                state.axes[0] = static_cast<int32_t>(tick & 0x7fff);
+                sink(state);
+                ++run.samples;
+                run.lastPacket = state.packet;
+                next += std::chrono::nanoseconds(period);
+                if (next < BenchClock::now()) next = BenchClock::now();
+            }
+            return run;
+        }
+
+        /// Prints one ring benchmark row.
+        void ReportRing(const char* stage, const ProducerRun& run, uint32_t hz, uint32_t ms, const RingStats* st) {
+            std::printf("%-16s %-8s %6.0f samples/s (%5.1f%% of %u Hz)  missed %5llu  max gap %7.2f ms",
+                "ring", stage, (double)run.samples / (ms / 1000.0), 100.0 * (double)run.samples / (hz * ms / 1000.0), hz,
+                (unsigned long long)run.missed, (double)run.maxGapNs / 1e6);
+            if (st) {
+                std::printf("  overflows %5llu dropped %5llu blocked %6.1f ms", (unsigned long long)st->overflows,
+                    (unsigned long long)st->dropped, (double)st->blockedNs / 1e6);
+            }
+            std::printf("\n");
+        }
+
+        /**
+         * @brief Output on the reader thread vs behind the SPSC ring, with a stalling output stage.
+         * @details A simulated pad is sampled at 1000 Hz for half a second while every 50th line blocks
+         *          the output for 20 ms. Inline output stalls the sampler; behind a 16-slot ring the
+         *          sampler keeps its rate and the policy decides what is lost. Two devices then share one
+         *          KeepLatest ring: the overflow mailbox must keep each one's final state and its
+         *          disconnect. Afterwards, cross-thread push/pop cost is measured with the Block policy.
+         */
+        int BenchStateRing(const BenchOptions& opt) {
+            const uint32_t hz = 1000;
+            const uint32_t ms = 500;
+            int rc = 0;
+
+            {
+                StallingOutput out{ 50, 20 };
+                auto inlineSink = [&out](const InputState& st) { out(0, StateLayout::Gamepad, &st); };
+                const ProducerRun run = RunProducer(inlineSink, hz, ms);
+                ReportRing("inline", run, hz, ms, nullptr);
+            }
+
+            const OverflowPolicy policies[] = { OverflowPolicy::KeepLatest, OverflowPolicy::DropNewest, OverflowPolicy::Block };
+            for (OverflowPolicy policy : policies) {
+                StallingOutput out{ 50, 20 };
+                ProducerRun run;
+                RingStats st;
+                {
+                    AsyncSink<StallingOutput> sink(out, StateLayout::Gamepad, 16, policy);
+                    run = RunProducer(sink, hz, ms);
+                    sink.Close();
+                    st = sink.Ring().Stats();
+                }
+                ReportRing(OverflowPolicyName(policy), run, hz, ms, &st);
+
+                bool ok = st.pushed == run.samples && st.popped + st.dropped == st.pushed && out.lines == st.popped;
+                if (policy == OverflowPolicy::KeepLatest) ok = ok && out.lastPacket == run.lastPacket;
+                if (policy == OverflowPolicy::Block) ok = ok && st.dropped == 0;
+                if (!ok) {
+                    std::printf("%-16s FAILED: %s lost track (pushed %llu, written %llu, dropped %llu, last %u of %u)\n", "ring",
+                        OverflowPolicyName(policy), (unsigned long long)st.pushed, (unsigned long long)st.popped,
+                        (unsigned long long)st.dropped, out.lastPacket, run.lastPacket);
+                    rc = 1;
+                }
+            }
+
+            // Two tags: tag 0 disconnects while tag 1 keeps reporting, both while the ring overflows.
+            {
+                StateRing ring(2, OverflowPolicy::KeepLatest);
+                StateRecord rec;
+                auto push = [&ring, &rec](int tag, uint32_t packet, bool closed) {
+                    rec.tag = tag;
+                    rec.state.packet = packet;
+                    rec.closed = closed;
+                    ring.Push(rec);
+                };
+                push(0, 1, false);
+                push(1, 1, false); // ring full from here on
+                push(0, 2, false);
+                push(1, 2, false);
+                push(0, 0, true);
+                push(1, 3, false);
+                push(1, 4, false);
+                StallingOutput out{ 1000, 0 };
+                StateRecord r;
+                while (ring.Pop(r)) out(r.tag, r.layout, r.closed ? nullptr : &r.state);
+                const RingStats st = ring.Stats();
+                const bool ok = out.lastPacketOf[0] == 2 && out.closedOf[0] && out.lastPacketOf[1] == 4 &&
+                    !out.closedOf[1] && st.dropped == 2 && st.popped + st.dropped == st.pushed;
+                std::printf("%-16s %-8s mailbox: %llu of %llu records written, dropped %llu\n", "ring", "2 tags",
+                    (unsigned long long)st.popped, (unsigned long long)st.pushed, (unsigned long long)st.dropped);
+                if (!ok) {
+                    std::printf("%-16s FAILED: mailbox lost a tag's final state or disconnect (last %u/%u, closed %d/%d)\n", "ring",
+                        out.lastPacketOf[0], out.lastPacketOf[1], out.closedOf[0] ? 1 : 0, out.closedOf[1] ? 1 : 0);
+                    rc = 1;
+                }
+            }
+            {
+                StallingOutput out{ 50, 20 };
+                ProducerRun run;
+                RingStats st;
+                uint32_t last0 = 0;
+                {
+                    AsyncSink<StallingOutput> sink(out, StateLayout::Gamepad, 16, OverflowPolicy::KeepLatest);
+                    uint64_t n = 0;
+                    auto tagged = [&sink, &n, &last0](const InputState& state) {
+                        const int tag = static_cast<int>(n++ & 1);
+                        if (tag == 0) last0 = state.packet;
+                        sink(tag, StateLayout::Gamepad, &state);
+                    };
+                    run = RunProducer(tagged, hz, ms);
+                    sink(0, StateLayout::Gamepad, nullptr);
+                    InputState final1;
+                    final1.packet = run.lastPacket + 1;
+                    sink(1, StateLayout::Gamepad, &final1);
+                    run.lastPacket = final1.packet;
+                    sink.Close();
+                    st = sink.Ring().Stats();
+                }
+                ReportRing("2 tags", run, hz, ms, &st);
+                if (out.lastPacketOf[0] != last0 || !out.closedOf[0] || out.lastPacketOf[1] != run.lastPacket || out.closedOf[1]) {
+                    std::printf("%-16s FAILED: 2 tags lost a final state or disconnect (last %u/%u of %u/%u, closed %d)\n", "ring",
+                        out.lastPacketOf[0], out.lastPacketOf[1], last0, run.lastPacket, out.closedOf[0] ? 1 : 0);
+                    rc = 1;
+                }
+            }
+
+            // Raw throughput: one producer, one consumer, nothing formatted.
+            const uint64_t n = std::min<uint64_t>(opt.samples, 1000000);
+            StateRing ring(1024, OverflowPolicy::Block);
+            uint64_t received = 0;
+            bool ordered = true;
+            const auto t0 = BenchClock::now();
+            std::thread consumer([&ring, &received, &ordered, n]() {
+                StateRecord r;
+                while (received < n) {
+                    if (!ring.Pop(r)) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    if (r.state.packet != static_cast<uint32_t>(received)) ordered = false;
+                    ++received;
+                }
+            });
+            StateRecord rec;
+            for (uint64_t i = 0; i < n; ++i) {
+                rec.state.packet = static_cast<uint32_t>(i);
+                ring.Push(rec);
+            }
+            consumer.join();
+            Report("ring", "spsc push+pop", n, ElapsedNs(t0));
+            if (!ordered || received != n) {
+                std::printf("%-16s FAILED: records lost or reordered\n", "ring");
+                rc = 1;
+            }
+            return rc;
+        }
+
+        /**
+         * @brief Buffered DirectInput stream of a 1 kHz stick (c_dfDIJoystick2 offsets).
+         * @details Every report moves lX; every 7th also flips button 0 and every 50th turns the hat, in
+         *          the same report (same sequence number).
+         */
+        std::vector<DiEvent> MakeDiStream(uint32_t reports) {
+            std::vector<DiEvent> out;
+            bool down = false;
+            for (uint32_t r = 1; r <= reports; ++r) {
+                DiEvent e;
+                e.timeMs = r;
+                e.sequence = r;
+                e.ofs = 0; // lX
+                e.data = static_cast<uint32_t>(static_cast<int32_t>(32767.0 * std::sin(r * 0.01)));
+                out.push_back(e);
+                if (r % 7 == 0) {
+                    down = !down;
+                    e.ofs = 48; // rgbButtons[0]
+                    e.data = down ? 0x80u : 0u;
+                    out.push_back(e);
+                }
+                if (r % 50 == 0) {
+                    e.ofs = 32; // rgdwPOV[0]
+                    e.data = (r / 50 % 5 == 4) ? 0xFFFFFFFFu : (r / 50 % 4) * 9000u;
+                    out.push_back(e);
+                }
+            }
+            return out;
+        }
+
+        /// Counts button 0 transitions in a sequence of emitted states.
+        struct EdgeCounter {
+            bool have = false;
+            bool last = false;
+            uint64_t edges = 0;
+            uint64_t states = 0;
+
+            void operator()(const InputState& st) {
+                const bool b = IsButtonDown(st, 0);
+                if (have && b != last) ++edges;
+                have = true;
+                last = b;
+                ++states;
+            }
+        };
+
+        /**
+         * @brief DirectInput snapshot reads vs event-sourced records on a modelled 1 kHz stick.
+         * @details The reader handles a notification every 8 ms (as when output or scheduling holds it
+         *          up). Snapshot mode drains the buffer and reads the state at that moment; event mode
+         *          applies every buffered sequence group. Counted: button 0 edges seen (the stream has
+         *          one per 7 ms), device calls (a GetDeviceData call returns up to 64 records) and
+         *          the cost of applying records.
+         */
+        int BenchDiEvents(const BenchOptions& opt) {
+            const uint32_t reports = 2000;
+            const uint32_t wakeEveryMs = 8;
+            const std::vector<DiEvent> stream = MakeDiStream(reports);
+            const DiObjectMap map = DiObjectMap::Joystick2();
+            const uint64_t truthEdges = reports / 7;
+
+            InputState truth;
+            EdgeCounter snap;
+            EdgeCounter events;
+            DiEventQueue queue;
+            InputState kept;
+            DiEventStats st;
+            uint64_t snapCalls = 0;
+            uint64_t eventCalls = 0;
+            size_t pos = 0;
+            for (uint32_t t = wakeEveryMs; pos < stream.size(); t += wakeEveryMs) {
+                size_t end = pos;
+                while (end < stream.size() && stream[end].timeMs <= t) ++end;
+                const size_t n = end - pos;
+                const uint64_t dataCalls = n / 64 + 1; // the last call returns fewer than 64
+
+                for (size_t i = pos; i < end; ++i) ApplyDiEvent(map, stream[i], truth);
+                snapCalls += dataCalls + 1;
+                snap(truth);
+
+                queue.Append(stream.data() + pos, n);
+                eventCalls += dataCalls;
+                while (queue.ApplyNextGroup(map, kept, &st)) events(kept);
+                pos = end;
+            }
+            const double seconds = reports / 1000.0;
+            std::printf("%-16s %-9s %6llu states  button edges %4llu of %4llu  %7.1f device calls/s\n", "dievents", "snapshot",
+                (unsigned long long)snap.states, (unsigned long long)snap.edges, (unsigned long long)truthEdges,
+                (double)snapCalls / seconds);
+            std::printf("%-16s %-9s %6llu states  button edges %4llu of %4llu  %7.1f device calls/s\n", "dievents", "events",
+                (unsigned long long)events.states, (unsigned long long)events.edges, (unsigned long long)truthEdges,
+                (double)eventCalls / seconds);
+
+            int rc = 0;
+            if (events.edges != truthEdges || DiffStates(kept, truth) != kChangedNone || kept.povs[0] != truth.povs[0]) {
+                std::printf("%-16s FAILED: event-sourced state lost transitions or diverged\n", "dievents");
+                rc = 1;
+            }
+
+            // Apply cost: replay the stream through a fresh queue.
+            const uint64_t passes = std::max<uint64_t>(1, opt.samples / stream.size());
+            uint64_t groups = 0;
+            InputState s;
+            const auto t0 = BenchClock::now();
+            for (uint64_t p = 0; p < passes; ++p) {
+                queue.Clear();
+                queue.Append(stream.data(), stream.size());
+                while (queue.ApplyNextGroup(map, s)) ++groups;
+            }
+            Report("dievents", "apply record group", groups, ElapsedNs(t0));
+            if (s.packet == 0) rc = 1; // keep the loop observable
+            return rc;
+        }
+
+        /**
+         * @brief Driver-side DirectInput buffer: holds up to @c size records; newer ones are lost when full.
+         */
+        struct DiDriverBuffer {
+            std::vector<DiEvent> records;
+            uint32_t size = 64;
+            bool overflowed = false; //!< Reported (DI_BUFFEROVERFLOW) by the next read.
+            uint64_t lost = 0;
+
+            void Push(const DiEvent& e) {
+                if (records.size() >= size) {
+                    overflowed = true;
+                    ++lost;
+                    return;
+                }
+                records.push_back(e);
+            }
+        };
+
+        /// Outcome of one buffer-sizing run.
+        struct DiBufferRun {
+            DiEventStats stats;
+            uint64_t lost = 0;
+            EdgeCounter seen;
+            bool consistent = false; //!< The kept state matched the device at the end.
+        };
+
+        /**
+         * @brief Event-sourced reader against a DiDriverBuffer sized by @p config.
+         * @details The reader wakes every 8 ms, except once a second when it is held up for
+         *          @p stallMs. A read that reports an overflow, or a resize (which discards the
+         *          buffer), is followed by a one-snapshot resync.
+         */
+        DiBufferRun RunDiBuffer(const std::vector<DiEvent>& stream, const DiBufferConfig& config, uint32_t stallMs) {
+            const DiObjectMap map = DiObjectMap::Joystick2();
+            DiBufferTuner tuner(config);
+            DiDriverBuffer driver;
+            driver.size = tuner.Size();
+            DiEventQueue queue;
+            InputState truth;
+            InputState kept;
+            DiBufferRun run;
+            bool synced = true; // both start from the idle device
+            size_t pos = 0;
+            uint32_t stalledSecond = 0;
+            for (uint32_t t = 8; pos < stream.size();) {
+                for (; pos < stream.size() && stream[pos].timeMs <= t; ++pos) {
+                    ApplyDiEvent(map, stream[pos], truth);
+                    driver.Push(stream[pos]);
+                }
+
+                const uint32_t total = static_cast<uint32_t>(driver.records.size());
+                const bool overflow = driver.overflowed;
+                queue.Append(driver.records.data(), driver.records.size());
+                driver.records.clear();
+                driver.overflowed = false;
+                run.stats.events += total;
+                if (overflow) {
+                    ++run.stats.overflows;
+                    synced = false;
+                }
+                if (tuner.OnRead(total, overflow, uint64_t(t) * 1000000ull)) {
+                    tuner.Applied(tuner.Wanted());
+                    driver.size = tuner.Size();
+                    ++run.stats.resizes;
+                    synced = false;
+                }
+                if (!synced) {
+                    queue.Clear();
+                    kept = truth;
+                    ++run.stats.snapshots;
+                    run.seen(kept);
+                    synced = true;
+                }
+                while (queue.ApplyNextGroup(map, kept, &run.stats)) run.seen(kept);
+
+                const uint32_t second = t / 1000 + 1;
+                if (t % 1000 >= 500 && stalledSecond != second) {
+                    stalledSecond = second;
+                    t += stallMs;
+                }
+                else {
+                    t += 8;
+                }
+            }
+            run.stats.bufferSize = tuner.Size();
+            run.stats.autoBuffer = config.autoTune;
+            run.lost = driver.lost;
+            run.consistent = DiffStates(kept, truth) == kChangedNone && kept.povs[0] == truth.povs[0];
+            return run;
+        }
+
+        /**
+         * @brief Fixed 64-record DirectInput buffer vs the tuned size on a reader that stalls.
+         * @details 10 s of the modelled 1 kHz stick; the reader is held up for 150 ms once a second.
+         *          Counted: overflows, resyncs, records the driver dropped and button edges seen. The
+         *          tuned buffer should stop overflowing once it has measured the rate, and both runs
+         *          must end on the device state.
+         */
+        int BenchDiBuffer(const BenchOptions&) {
+            const uint32_t reports = 10000;
+            const uint32_t stallMs = 150;
+            const std::vector<DiEvent> stream = MakeDiStream(reports);
+            DiBufferConfig fixed;
+            fixed.autoTune = false;
+            const DiBufferRun runs[2] = { RunDiBuffer(stream, fixed, stallMs), RunDiBuffer(stream, DiBufferConfig(), stallMs) };
+
+            int rc = 0;
+            for (const DiBufferRun& r : runs) {
+                std::printf("%-16s %-5s buffer %5u (%llu resizes)  overflows %3llu  resyncs %3llu  records lost %6llu  "
+                    "button edges %4llu of %4u\n", "dibuffer", r.stats.autoBuffer ? "auto" : "fixed", r.stats.bufferSize,
+                    (unsigned long long)r.stats.resizes, (unsigned long long)r.stats.overflows,
+                    (unsigned long long)r.stats.snapshots, (unsigned long long)r.lost,
+                    (unsigned long long)r.seen.edges, reports / 7);
+                if (!r.consistent) {
+                    std::printf("%-16s FAILED: %s buffer ended out of sync with the device\n", "dibuffer",
+                        r.stats.autoBuffer ? "auto" : "fixed");
+                    rc = 1;
+                }
+            }
+            if (runs[1].stats.overflows >= runs[0].stats.overflows || runs[1].stats.overflows > 2) {
+                std::printf("%-16s FAILED: tuned buffer kept overflowing\n", "dibuffer");
+                rc = 1;
+            }
+            return rc;
+        }
+
+        /**
+         * @brief DIJOYSTATE2 reads vs a compact data format for a 4-axis, 1-hat, 12-button pad.
+         * @details Per report: copy the GetDeviceState block, convert it, diff against the previous
+         *          state and format the line, once with c_dfDIJoystick2 and full StateCaps and once
+         *          with the DiCompactFormat EnumObjects would produce. Both must agree on every object
+         *          the pad has, and records at compact offsets must land in the same slots.
+         */
+        int BenchDiFormat(const BenchOptions& opt) {
+            DiCompactFormat compact;
+            const uint8_t axisSlots[] = { 0, 1, 2, 5 }; // X, Y, Z, Rz
+            for (uint8_t slot : axisSlots) compact.AddAxis(slot, 0);
+            compact.AddPov(0);
+            for (int b = 0; b < 12; ++b) compact.AddButton(0);
+            compact.Finish();
+            const StateCaps caps = compact.Caps();
+            const StateCaps full;
+
+            // Pre-built driver blocks in both layouts, so only the per-report work is timed.
+            const size_t ring = 1024;
+            std::vector<DIJoyState2Mirror> big(ring);
+            std::vector<uint8_t> small(ring * compact.DataSize());
+            for (size_t i = 0; i < ring; ++i) {
+                DIJoyState2Mirror& js = big[i];
+                std::memset(&js, 0, sizeof(js));
+                for (int p = 0; p < 4; ++p) js.rgdwPOV[p] = kPovCentered;
+                js.lX = static_cast<int32_t>(32767.0 * std::sin(i * 0.05));
+                js.lY = static_cast<int32_t>(i * 31);
+                js.lZ = static_cast<int32_t>(i % 255);
+                js.lRz = -js.lX;
+                js.rgdwPOV[0] = (i / 64 % 5 == 4) ? kPovCentered : static_cast<uint32_t>(i / 64 % 4) * 9000u;
+                js.rgbButtons[i % 12] = 0x80;
+
+                const int32_t axes[kMaxAxes] = { js.lX, js.lY, js.lZ, js.lRx, js.lRy, js.lRz, js.rglSlider[0], js.rglSlider[1] };
+                uint8_t* block = &small[i * compact.DataSize()];
+                for (const DiFormatObject& o : compact.Objects()) {
+                    if (o.kind == DiObjectKind::Axis) std::memcpy(block + o.ofs, &axes[o.index], 4);
+                    else if (o.kind == DiObjectKind::Pov) std::memcpy(block + o.ofs, &js.rgdwPOV[o.index], 4);
+                    else block[o.ofs] = js.rgbButtons[o.index];
+                }
+            }
+
+            int rc = 0;
+            for (size_t i = 0; i < ring && rc == 0; ++i) {
+                InputState a;
+                InputState b;
+                ConvertDIMirror(big[i], a);
+                compact.Convert(&small[i * compact.DataSize()], b);
+                if (DiffStates(a, b) != kChangedNone) rc = 1;
+            }
+            const DiObjectMap& map = compact.Map();
+            DiEvent e;
+            e.ofs = compact.Objects().back().ofs; // button 11
+            e.data = 0x80;
+            InputState viaRecord;
+            if (!ApplyDiEvent(map, e, viaRecord) || !IsButtonDown(viaRecord, 11)) rc = 1;
+            if (rc) {
+                std::printf("%-16s FAILED: compact format disagrees with DIJOYSTATE2\n", "diformat");
+                return 1;
+            }
+
+            const uint64_t count = opt.samples;
+            char line[kMaxFormattedState];
+            uint64_t sink = 0;
+            uint64_t bytes = 0;
+            {
+                DIJoyState2Mirror js;
+                InputState prev;
+                InputState cur;
+                const auto t0 = BenchClock::now();
+                for (uint64_t i = 0; i < count; ++i) {
+                    std::memcpy(&js, &big[i % ring], sizeof(js));
+                    ConvertDIMirror(js, cur);
+                    if (DiffStates(prev, cur, full) != kChangedNone) {
+                        bytes += FormatState(StateLayout::Joystick, cur, full, line, sizeof(line));
+                        prev = cur;
+                    }
+                }
+                Report("diformat", "dijoystate2", count, ElapsedNs(t0));
+                std::printf("%-16s %-22s %5u bytes/read %6.1f output bytes/report\n", "diformat", "", (unsigned)sizeof(js),
+                    count ? (double)bytes / (double)count : 0.0);
+                sink += prev.buttons[0];
+            }
+            {
+                std::vector<uint8_t> block(compact.DataSize());
+                InputState prev;
+                InputState cur;
+                bytes = 0;
+                const auto t0 = BenchClock::now();
+                for (uint64_t i = 0; i < count; ++i) {
+                    std::memcpy(block.data(), &small[(i % ring) * compact.DataSize()], block.size());
+                    compact.Convert(block.data(), cur);
+                    if (DiffStates(prev, cur, caps) != kChangedNone) {
+                        bytes += FormatState(StateLayout::Joystick, cur, caps, line, sizeof(line));
+                        prev = cur;
+                    }
+                }
+                Report("diformat", "compact", count, ElapsedNs(t0));
+                std::printf("%-16s %-22s %5u bytes/read %6.1f output bytes/report\n", "diformat", "", compact.DataSize(),
+                    count ? (double)bytes / (double)count : 0.0);
+                sink += prev.buttons[0];
+            }
+            std::printf("%-16s checksum %llu\n", "diformat", (unsigned long long)sink);
+            return 0;
+        }
+
+        /**
+         * @brief Software axis normalization: DirectInput reference points, then cost per state.
+         * @details The checks use DIPROP semantics on a 0..65535 axis mapped to -1000..1000 with a 20 %
+         *          dead zone and 90 % saturation. The timed loop normalizes all eight axes of each
+         *          state, which is what the fallback path adds per sample; with driver properties
+         *          DirectInput delivers the same values at no cost to the reader.
+         */
+        int BenchAxisNormalize(const BenchOptions& opt) {
+            AxisConfig c;
+            c.min = -1000;
+            c.max = 1000;
+            c.deadzone = 2000;
+            c.saturation = 9000;
+            AxisNormalizer n;
+            n.Configure(0, 0, 65535, c);
+            struct Point { int32_t raw; int32_t want; };
+            const Point points[] = {
+                { 32767, 0 }, { 32768, 0 },   // center
+                { 39321, 0 }, { 26214, 0 },   // 10 % either way: inside the dead zone
+                { 65535, 1000 }, { 0, -1000 }, // ends
+                { 63000, 1000 }, { 2535, -1000 }, // beyond 90 %: saturated
+                { 50790, 500 }, { 14745, -500 }, // halfway between dead zone and saturation
+            };
+            int rc = 0;
+            for (const Point& p : points) {
+                const int32_t got = n.Normalize(0, p.raw);
+                if (got != p.want) {
+                    std::printf("%-16s FAILED: raw %d -> %d, expected %d\n", "axes", p.raw, got, p.want);
+                    rc = 1;
+                }
+            }
+            // Monotonic over the whole raw range.
+            int32_t last = INT32_MIN;
+            for (int32_t raw = 0; raw <= 65535; ++raw) {
+                const int32_t v = n.Normalize(0, raw);
+                if (v < last) {
+                    std::printf("%-16s FAILED: not monotonic at raw %d\n", "axes", raw);
+                    rc = 1;
+                    break;
+                }
+                last = v;
+            }
+
+            AxisNormalizer all;
+            for (int i = 0; i < kMaxAxes; ++i) all.Configure(i, -32768, 32767, AxisConfig());
+            SyntheticConfig cfg;
+            cfg.layout = StateLayout::Joystick;
+            cfg.changePercent = 100;
+            SyntheticBackend gen(cfg);
+            const size_t ring = 1024;
+            std::vector<InputState> states(ring);
+            for (InputState& st : states) gen.Poll(st);
+            uint64_t sink = 0;
+            InputState st;
+            const auto t0 = BenchClock::now();
+            for (uint64_t i = 0; i < opt.samples; ++i) {
+                st = states[i % ring];
+                all.Apply(st);
+                sink += static_cast<uint32_t>(st.axes[i & 7]);
+            }
+            Report("axes", "software normalize", opt.samples, ElapsedNs(t0));
+            std::printf("%-16s checksum %llu\n", "axes", (unsigned long long)sink);
+            return rc;
+        }
+
+        /// Mock device list: @p pads XInput slots, then @p sticks DirectInput instances of which @p proxies are hidden.
+        void FillMockDevices(MockDeviceSource& source, int pads, int sticks, int proxies) {
+            source.devices.clear();
+            for (int i = 0; i < pads + sticks; ++i) {
+                MockDeviceSource::Device d;
+                const bool pad = i < pads;
+                d.key = (pad ? "xinput:" : "di:") + std::to_string(i);
+                d.info.kind = pad ? DeviceKind::XInput : DeviceKind::DirectInput;
+                d.info.name = (pad ? "XInput Controller " : "Mock Stick ") + std::to_string(i);
+                d.info.xinputUser = pad ? static_cast<uint32_t>(i) : 0;
+                d.hidden = !pad && i - pads < proxies;
+                d.probeNs = pad ? 20000 : 0;
+                source.devices.push_back(d);
+            }
+        }
+
+        /// Prints one registry timing row.
+        void ReportRegistry(const char* stage, double ns, uint64_t probes) {
+            std::printf("%-16s %-22s %10.3f ms  %3llu devices probed\n", "registry", stage, ns / 1e6, (unsigned long long)probes);
+        }
+
+        /**
+         * @brief Cached device registry vs enumerating from scratch, on a mock source.
+         * @details 2 XInput pads and 8 DirectInput instances, 2 of them XInput proxies. Listing an
+         *          entry costs 20 us (slot probe, EnumDevices callback); describing one costs 400 us
+         *          (CreateDevice, GetCapabilities, name conversion). "uncached x2" is the old start-up,
+         *          which enumerated for the selection and again for the usage listing. Then: the
+         *          first registry call, repeated calls without a notification, and refreshes after
+         *          an arrival, a removal and a notification with nothing changed.
+         */
+        int BenchDeviceRegistry(const BenchOptions& opt) {
+            MockDeviceSource source;
+            FillMockDevices(source, 2, 8, 2);
+            source.listCostNs = 20000;
+            source.describeCostNs = 400000;
+
+            const char* failed = "";
+            {
+                const auto t0 = BenchClock::now();
+                for (int i = 0; i < 2; ++i) {
+                    BasicDeviceRegistry<MockDeviceSource> fresh(source);
+                    if (fresh.Devices().size() != 8) failed = "uncached listing";
+                }
+                ReportRegistry("uncached x2", ElapsedNs(t0), source.described);
+            }
+
+            source.described = 0;
+            BasicDeviceRegistry<MockDeviceSource> registry(source);
+            {
+                const auto t0 = BenchClock::now();
+                const std::vector<DeviceInfo>& d = registry.Devices();
+                ReportRegistry("first call", ElapsedNs(t0), source.described);
+                if (d.size() != 8 || d[0].kind != DeviceKind::XInput || d[2].name != "Mock Stick 4" || d[7].index != 7 ||
+                    source.described != 10 || registry.CachedCount() != 10) failed = "first call";
+            }
+            {
+                const uint64_t lookups = std::max<uint64_t>(1000, opt.samples / 100);
+                const uint64_t listedBefore = source.listed, describedBefore = source.described;
+                size_t total = 0;
+                const auto t0 = BenchClock::now();
+                for (uint64_t i = 0; i < lookups; ++i) {
+                    const std::vector<DeviceInfo> copy = registry.Devices();
+                    total += copy.size();
+                }
+                Report("registry", "cached list (copy)", lookups, ElapsedNs(t0));
+                if (total != lookups * 8 || source.listed != listedBefore || source.described != describedBefore) failed = "cached list";
+            }
+            {
+                MockDeviceSource::Device arrived;
+                arrived.key = "di:new";
+                arrived.info.kind = DeviceKind::DirectInput;
+                arrived.info.name = "Arrived Stick";
+                source.devices.push_back(arrived);
+                const uint64_t before = source.described;
+                registry.NotifyChanged();
+                const auto t0 = BenchClock::now();
+                const std::vector<DeviceInfo>& d = registry.Devices();
+                ReportRegistry("after arrival", ElapsedNs(t0), source.described - before);
+                if (source.described != before + 1 || d.size() != 9 || d.back().name != "Arrived Stick" || d.back().index != 8) failed = "arrival";
+            }
+            {
+                source.devices.erase(source.devices.begin() + 5);
+                const uint64_t before = source.described, evicted = registry.Stats().evicted;
+                registry.NotifyChanged();
+                const auto t0 = BenchClock::now();
+                const std::vector<DeviceInfo>& d = registry.Devices();
+                ReportRegistry("after removal", ElapsedNs(t0), source.described - before);
+                if (source.described != before || d.size() != 8 || registry.Stats().evicted != evicted + 1) failed = "removal";
+            }
+            {
+                const uint64_t before = source.described;
+                registry.NotifyChanged();
+                const auto t0 = BenchClock::now();
+                registry.Devices();
+                ReportRegistry("nothing changed", ElapsedNs(t0), source.described - before);
+                if (source.described != before) failed = "unchanged refresh";
+            }
+            std::fflush(stdout);
+            PrintRegistryStats(registry.Stats());
+            if (*failed) {
+                std::printf("%-16s FAILED: %s\n", "registry", failed);
+                return 1;
+            }
+            return 0;
+        }
+
+        /**
+         * @brief Serial vs concurrent start-up probing on a mock source: time to the first list, stable indices.
+         * @details 4 XInput slots with a pad in slot 1. Each slot probe blocks for about 1 ms (the slow
+         *          empty-slot case), with up to 0.4 ms of jitter so the probes finish in a different
+         *          order from run to run. 6 DirectInput instances, 2 of them proxies, cost 300 us each
+         *          to enumerate and 400 us each to describe. Every run starts from a fresh registry,
+         *          and each concurrent list must equal the serial one.
+         */
+        int BenchStartupProbe(const BenchOptions& /*opt*/) {
+            const uint32_t runs = 10;
+            double ns[2] = {};
+            std::vector<DeviceInfo> reference;
+            bool stable = true;
+            for (uint32_t run = 0; run < runs; ++run) {
+                for (int parallel = 0; parallel < 2; ++parallel) {
+                    MockDeviceSource source;
+                    FillMockDevices(source, 4, 6, 2);
+                    source.listCostNs = 300000;
+                    source.describeCostNs = 400000;
+                    source.parallel = parallel != 0;
+                    for (uint32_t k = 0; k < 4; ++k) {
+                        source.devices[k].attached = k == 1;
+                        source.devices[k].probeNs = 1000000 + ((run * 7 + k * 13) % 5) * 100000;
+                    }
+                    BasicDeviceRegistry<MockDeviceSource> registry(source);
+                    const auto t0 = BenchClock::now();
+                    const std::vector<DeviceInfo>& d = registry.Devices();
+                    ns[parallel] += ElapsedNs(t0);
+                    if (reference.empty()) reference = d;
+                    bool same = d.size() == reference.size() && d.size() == 5;
+                    for (size_t i = 0; same && i < d.size(); ++i) {
+                        same = d[i].index == reference[i].index && d[i].kind == reference[i].kind && d[i].name == reference[i].name;
+                    }
+                    stable = stable && same;
+                }
+            }
+            std::printf("%-16s %-22s %10.3f ms to first list\n", "startup", "serial probes", ns[0] / runs / 1e6);
+            std::printf("%-16s %-22s %10.3f ms to first list (%.2fx)\n", "startup", "concurrent probes", ns[1] / runs / 1e6,
+                ns[1] > 0 ? ns[0] / ns[1] : 0.0);
+            if (!stable || reference[0].kind != DeviceKind::XInput || reference[0].xinputUser != 1) {
+                std::printf("%-16s FAILED: concurrent probing changed the device list or its order\n", "startup");
+                return 1;
+            }
+            return 0;
+        }
+
+#ifdef __linux__
+        /**
+         * @brief Arrival notification -> re-attach in a temporary directory: a FIFO node comes back
+         *        under a new event number and only that node is described.
+         * @return false if a round did not come back after exactly one probe.
+         */
+        bool BenchReconnectNotify() {
+            TempDeviceDir dir;
+            if (!dir.IsValid()) return false;
+            HotplugWatcher watcher(dir.Path());
+            if (!watcher.IsValid()) return false;
+
+            DeviceInfo pad;
+            pad.kind = DeviceKind::Evdev;
+            pad.name = "Bench Pad";
+            pad.vendorId = 0x045e;
+            pad.productId = 0x028e;
+            std::atomic_bool running{ true };
+            std::vector<uint64_t> lat;
+            bool ok = true;
+            for (int i = 0; i < 32 && ok; ++i) {
+                const std::string node = dir.Node("event" + std::to_string(20 + i % 4));
+                std::thread plug([&node] {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    mkfifo(node.c_str(), 0600);
+                });
+                ReconnectTiming timing;
+                ok = WaitForArrival(watcher, [&pad](const HotplugEvent& e) {
+                    DeviceInfo info;
+                    return DescribeBenchNode(e.path, info) && IsSameDevice(info, pad);
+                }, running, &timing, 0);
+                plug.join();
+                ok = ok && timing.probes == 1;
+                lat.push_back(timing.latencyNs);
+                unlink(node.c_str());
+                // Drops the removal so the next round starts from an empty queue.
+                std::vector<HotplugEvent> drop;
+                while (watcher.Wait(5)) watcher.Drain(drop);
+            }
+            ReportLatency("reconnect/attach", lat);
+            return ok;
+        }
+#endif
+
+        /**
+         * @brief Re-attaching a returning device: full listing vs identity cache and one targeted probe.
+         * @details Mock source of 4 XInput pads and 28 DirectInput instances (2 proxies), costed like
+         *          the registry bench. "full scan" lists and describes everything, then looks the
+         *          identity up in the list, as selecting by index after a re-plug did; "targeted" finds
+         *          the identity in the cache and describes that device alone. Then the cache is saved
+         *          and loaded back and compared, and identities are checked to survive a node or index
+         *          change. On Linux, the time from an arrival notification to the re-attach.
+         */
+        int BenchReconnect(const BenchOptions& /*opt*/) {
+            MockDeviceSource source;
+            FillMockDevices(source, 4, 28, 2);
+            source.listCostNs = 20000;
+            source.describeCostNs = 400000;
+            for (size_t i = 4; i < source.devices.size(); ++i) {
+                source.devices[i].info.diGuid.data1 = 0x6f1d2b60u + (uint32_t)i;
+                source.devices[i].info.diGuid.data4[7] = (uint8_t)i;
+            }
+            const size_t target = source.devices.size() - 3;
+            const std::string identity = DeviceIdentity(source.devices[target].info);
+            const int rounds = 20;
+            const char* failed = "";
+
+            IdentityCache cache;
+            {
+                const auto t0 = BenchClock::now();
+                for (int r = 0; r < rounds; ++r) {
+                    BasicDeviceRegistry<MockDeviceSource> registry(source);
+                    bool found = false;
+                    for (const DeviceInfo& d : registry.Devices()) {
+                        if (DeviceIdentity(d) != identity) continue;
+                        cache.Remember(d);
+                        found = true;
+                    }
+                    if (!found) failed = "full scan did not find the device";
+                }
+                std::printf("%-16s %-22s %10.3f ms  %3llu devices probed per re-attach\n", "reconnect", "full scan", ElapsedNs(t0) / rounds / 1e6,
+                    (unsigned long long)(source.described / rounds));
+            }
+            {
+                source.described = 0;
+                const auto t0 = BenchClock::now();
+                for (int r = 0; r < rounds; ++r) {
+                    const DeviceInfo* known = cache.Find(identity);
+                    if (!known) {
+                        failed = "identity not cached";
+                        break;
+                    }
+                    DeviceProbe probe;
+                    probe.kind = known->kind;
+                    probe.key = identity;
+                    probe.native = &source.devices[target];
+                    DeviceInfo info = *known;
+                    if (!source.Describe(probe, info) || DeviceIdentity(info) != identity) failed = "targeted probe";
+                }
+                std::printf("%-16s %-22s %10.3f ms  %3llu devices probed per re-attach\n", "reconnect", "targeted", ElapsedNs(t0) / rounds / 1e6,
+                    (unsigned long long)(source.described / rounds));
+                if (source.described != (uint64_t)rounds) failed = "targeted probe opened more than one device";
+            }
+
+            {
+                DeviceInfo pad;
+                pad.xinputUser = 2;
+                DeviceInfo stick;
+                stick.kind = DeviceKind::DirectInput;
+                stick.name = "Flight\tStick";
+                stick.polled = true;
+                stick.vendorId = 0x044f;
+                stick.productId = 0xb10a;
+                ParseGuid("{6F1D2B61-D5A0-11CF-BFC7-444553540000}", stick.diGuid);
+                DeviceInfo serial;
+                serial.kind = DeviceKind::Evdev;
+                serial.name = "Wireless Controller";
+                serial.path = "/dev/input/event7";
+                serial.vendorId = 0x054c;
+                serial.productId = 0x0ce6;
+                serial.serial = "a0:5a:5c:11:22:33";
+                serial.location = "usb-0000:00:14.0-2/input3";
+                DeviceInfo port = serial;
+                port.serial.clear();
+                port.path = "/dev/input/event9";
+
+                IdentityCache saved;
+                for (const DeviceInfo* d : { &pad, &stick, &serial, &port }) saved.Remember(*d);
+                std::stringstream file;
+                saved.Save(file);
+                file << "garbage line\n" << "evdev:0001:0002:x\t2\t0\t\t/dev/input/event1\t0001:0002\t0\tother\t\tstale\n";
+                IdentityCache loaded;
+                loaded.Load(file);
+                const DeviceInfo* s = loaded.Find(DeviceIdentity(stick));
+                const DeviceInfo* p = loaded.Find(DeviceIdentity(port));
+                if (loaded.Size() != 4 || !s || std::memcmp(&s->diGuid, &stick.diGuid, sizeof(DeviceGuid)) != 0 || !s->polled ||
+                    s->name != "Flight Stick" || !p || p->path != port.path || p->location != port.location ||
+                    !loaded.Find("xinput:2") || FormatGuid(stick.diGuid) != "{6F1D2B61-D5A0-11CF-BFC7-444553540000}") {
+                    failed = "cache save/load round trip";
+                }
+
+                // A re-plug renumbers the node and the list; the identity must not follow either.
+                DeviceInfo replugged = serial;
+                replugged.path = "/dev/input/event12";
+                replugged.index = 5;
+                if (DeviceIdentity(replugged) != DeviceIdentity(serial) || DeviceIdentity(serial) == DeviceIdentity(port) ||
+                    !IsIdentitySelector(DeviceIdentity(stick)) || IsIdentitySelector("3")) {
+                    failed = "identity changed with the node or list index";
+                }
+                std::printf("%-16s cache: %zu entries saved and loaded; ids %s, %s, %s\n", "reconnect", loaded.Size(),
+                    DeviceIdentity(pad).c_str(), DeviceIdentity(serial).c_str(), DeviceIdentity(port).c_str());
+
+                // A failed probe drops its entry; the others stay.
+                loaded.Forget(DeviceIdentity(stick));
+                if (loaded.Size() != 3 || loaded.Find(DeviceIdentity(stick)) || !loaded.Find(DeviceIdentity(port))) failed = "stale cache entry kept";
+            }
+#ifdef __linux__
+            if (!*failed && !BenchReconnectNotify()) failed = "arrival notification not re-attached after one probe";
+#endif
+            if (*failed) {
+                std::printf("%-16s FAILED: %s\n", "reconnect", failed);
+                return 1;
+            }
+            return 0;
+        }
+
+        /**
+         * @brief The product-name heuristic the XInput proxy filter replaced, kept as the baseline.
+         */
+        bool NameLooksLikeXInputProxy(const wchar_t* productName) {
+            std::wstring lname(productName ? productName : L"");
+            std::transform(lname.begin(), lname.end(), lname.begin(), ::towlower);
+            return lname.find(L"xinput") != std::wstring::npos || lname.find(L"(xbox") != std::wstring::npos ||
+                lname.find(L"ig_") != std::wstring::npos;
+        }
+
+        /// One DirectInput device as the proxy filter sees it.
+        struct ProxyCase {
+            const wchar_t* name;   //!< Product name.
+            uint16_t vendorId;     //!< From guidProduct; 0 if it carries none.
+            uint16_t productId;
+            const wchar_t* path;   //!< Interface path (DIPROP_GUIDANDPATH).
+            bool proxy;            //!< Expected decision.
+        };
+
+        const ProxyCase kProxyCases[] = {
+            { L"Controller (XBOX 360 For Windows)", 0x045E, 0x028E, L"\\\\?\\hid#vid_045e&pid_028e&ig_00#8&2c2e0e5&0&0000#{4d1e55b2-f16f-11cf-88cb-001111000030}", true },
+            { L"Controller (Xbox One For Windows)", 0x045E, 0x02FF, L"\\\\?\\hid#vid_045e&pid_02ff&ig_00#8&1f4a4b3&0&0000#{4d1e55b2-f16f-11cf-88cb-001111000030}", true },
+            { L"Xbox Wireless Controller", 0x045E, 0x0B13, L"\\\\?\\hid#{00001124-0000-1000-8000-00805f9b34fb}_vid&0002045e_pid&0b13&ig_00#9&18b1c9d&0&0000#{4d1e55b2-f16f-11cf-88cb-001111000030}", true },
+            { L"Controller (Gamepad F310)", 0x046D, 0xC21D, L"\\\\?\\hid#vid_046d&pid_c21d&ig_00#7&3a1b6c1&0&0000#{4d1e55b2-f16f-11cf-88cb-001111000030}", true },
+            // Unknown XInput pad: only its interface path gives it away.
+            { L"Twin USB Gamepad", 0x1234, 0xBEAD, L"\\\\?\\HID#VID_1234&PID_BEAD&IG_01#7&aa11bb2&0&0000#{4d1e55b2-f16f-11cf-88cb-001111000030}", true },
+            { L"Logitech Dual Action", 0x046D, 0xC216, L"\\\\?\\hid#vid_046d&pid_c216#7&2d1a0e11&0&0000#{4d1e55b2-f16f-11cf-88cb-001111000030}", false },
+            { L"DualSense Wireless Controller", 0x054C, 0x0CE6, L"\\\\?\\hid#vid_054c&pid_0ce6&mi_03#8&1e5b1b2&0&0000#{4d1e55b2-f16f-11cf-88cb-001111000030}", false },
+            // Names the old heuristic got wrong.
+            { L"BIG_STICK Flight Controller", 0x0738, 0x2221, L"\\\\?\\hid#vid_0738&pid_2221#7&d0c1a2f&0&0000#{4d1e55b2-f16f-11cf-88cb-001111000030}", false },
+            { L"Rig_Wheel Pro (XBOX mode off)", 0x0EB7, 0x0E04, L"\\\\?\\hid#vid_0eb7&pid_0e04#6&5a1c7d0&0&0000#{4d1e55b2-f16f-11cf-88cb-001111000030}", false },
+            { L"Generic USB Joystick", 0, 0, L"\\\\?\\root#joystick#0000#{4d1e55b2-f16f-11cf-88cb-001111000030}", false },
+        };
+
+        /**
+         * @brief XInput proxy filter: VID/PID perfect-hash table and "IG_" path marker vs the name heuristic.
+         * @details Table-driven checks of the decision on real-looking devices (names, IDs and interface
+         *          paths), every table key found and a sweep of the table's vendors for false hits, then
+         *          the cost of each filter over the cases.
+         */
+        int BenchProxyFilter(const BenchOptions& opt) {
+            const char* failed = "";
+            int nameWrong = 0;
+            for (const ProxyCase& c : kProxyCases) {
+                if (IsXInputProxy(c.vendorId, c.productId, c.path) != c.proxy) failed = "a device was classified wrongly";
+                if (NameLooksLikeXInputProxy(c.name) != c.proxy) ++nameWrong;
+            }
+            const size_t keyCount = sizeof(XInputProxyIds::kKeys) / sizeof(XInputProxyIds::kKeys[0]);
+            size_t swept = 0;
+            for (uint32_t key : XInputProxyIds::kKeys) {
+                if (!XInputProxySet::Contains(key)) failed = "a table key is not found";
+            }
+            for (uint32_t vendor : { 0x045Eu, 0x046Du, 0x0738u, 0x0F0Du, 0x24C6u, 0x28DEu }) {
+                for (uint32_t product = 0; product <= 0xFFFF; ++product) {
+                    swept += IsKnownXInputProxy(static_cast<uint16_t>(vendor), static_cast<uint16_t>(product));
+                }
+            }
+            if (swept != keyCount) failed = "the table matches IDs it does not hold";
+            std::printf("%-16s %zu cases, name heuristic wrong on %d; %zu keys in %zu slots (seed 0x%08x), %zu hits in a 6-vendor sweep\n",
+                "proxyfilter", sizeof(kProxyCases) / sizeof(kProxyCases[0]), nameWrong, keyCount,
+                sizeof(XInputProxySet::kSlots.keys) / sizeof(uint32_t), XInputProxySet::kSeed, swept);
+
+            const size_t n = sizeof(kProxyCases) / sizeof(kProxyCases[0]);
+            const uint64_t count = opt.samples;
+            uint64_t hits = 0;
+            {
+                auto t0 = BenchClock::now();
+                for (uint64_t i = 0; i < count; ++i) hits += NameLooksLikeXInputProxy(kProxyCases[i % n].name);
+                Report("proxyfilter", "name heuristic", count, ElapsedNs(t0));
+            }
+            {
+                auto t0 = BenchClock::now();
+                for (uint64_t i = 0; i < count; ++i) {
+                    const ProxyCase& c = kProxyCases[i % n];
+                    hits += IsKnownXInputProxy(c.vendorId, c.productId);
+                }
+                Report("proxyfilter", "vid/pid table", count, ElapsedNs(t0));
+            }
+            {
+                auto t0 = BenchClock::now();
+                for (uint64_t i = 0; i < count; ++i) {
+                    const ProxyCase& c = kProxyCases[i % n];
+                    hits += IsXInputProxy(c.vendorId, c.productId, c.path);
+                }
+                Report("proxyfilter", "table + IG_ path", count, ElapsedNs(t0));
+            }
+            if (hits == 0) failed = "no proxy matched";
+            if (*failed) {
+                std::printf("%-16s FAILED: %s\n", "proxyfilter", failed);
+                return 1;
+            }
+            return 0;
+        }
+
+        /**
+         * @brief One registered scenario.
+         */
+        struct BenchScenario {
+            const char* name;                     //!< Name accepted by --bench.
+            const char* description;              //!< One-line description for the listing.
+            int (*run)(const BenchOptions&);      //!< Entry point.
+        };
+
+        const BenchScenario kScenarios[] = {
+            { "pipeline", "sample/diff/format cost per stage on synthetic traffic", BenchPipeline },
+            { "hid", "HID report decoding: compiled descriptor plan vs per-report descriptor walk", BenchHidDecode },
+            { "fixed", "specialized DualSense decoder vs generic descriptor plan vs DIJOYSTATE2 copy", BenchFixedLayouts },
+            { "rawinput", "Raw Input blocks: GetRawInputBuffer batch walk vs one record per WM_INPUT, decode checked", BenchRawInput },
+            { "compare", "XInput vs DirectInput comparison on a modelled pad: edge matching and delay distribution", BenchLatencyCompare },
+            { "scheduler", "poll scheduler (mock-clock checks, then real timer) vs sleep_for at 250/500/1000 Hz", BenchPollScheduler },
+            { "adaptive", "fixed vs adaptive poll rate on a simulated kiosk pad: polls/s and first-input latency", BenchAdaptivePolling },
+            { "phaselock", "phase-locked vs fixed-rate polling of a simulated 4 ms controller: polls/s and latency", BenchPhaseLock },
+            { "hybrid", "sleep vs sleep-then-spin waits at 1000 Hz: wake-up error and spin CPU time", BenchHybridWait },
+            { "reactor", "one reactor thread streaming 1..64 devices: polled synthetic and pipe-backed evdev", BenchReactor },
+            { "dievents", "DirectInput snapshot per notification vs event-sourced records: edges kept, device calls", BenchDiEvents },
+            { "dibuffer", "fixed 64-record vs auto-sized DirectInput buffer under reader stalls: overflows, resyncs", BenchDiBuffer },
+            { "diformat", "DIJOYSTATE2 vs compact per-device data format: read, convert, diff and format cost", BenchDiFormat },
+            { "axes", "software axis normalization (DIPROP range/dead zone/saturation semantics): checks and cost", BenchAxisNormalize },
+            { "ring", "inline output vs SPSC ring + output thread under a stalling output; overflow policies", BenchStateRing },
+            { "pool", "work-stealing reader pool: 1..64 devices with uneven read cost on 1..N workers", BenchReaderPool },
+            { "registry", "cached device registry vs enumerating from scratch: start-up, repeat lists, hotplug (mock source)", BenchDeviceRegistry },
+            { "startup", "serial vs concurrent XInput slot probes and DirectInput enumeration: time to first list (mock)", BenchStartupProbe },
+            { "reconnect", "re-attach by stable identity: full listing vs cached identity + one targeted probe; cache file", BenchReconnect },
+            { "proxyfilter", "XInput proxy filter: VID/PID perfect-hash table + IG_ path vs product-name heuristic, cases checked", BenchProxyFilter },
+#ifdef __linux__
+            { "evdev", "recorded input_event stream through a socketpair into the epoll backend", BenchEvdevPipe },
+            { "powersave", "default vs power-save reader: wake-ups/s and output writes/s (evdev socketpair, XInput model)", BenchPowerSave },
+            { "uring", "io_uring vs epoll on 16 pipe-backed devices: syscalls/frame and latency", BenchUringVsEpoll },
+            { "hotplug", "inotify hotplug in a temp directory: notifications, reactor attach/detach of FIFO devices", BenchHotplug },
+#endif
+        };
+
+    } // namespace
+
+    void PrintBenchmarkList() {
+        std::printf("Benchmarks (JoystickInput --bench <name|all> [count]):\n");
+        for (const auto& s : kScenarios) {
+            std::printf("  %-16s %s\n", s.name, s.description);
+        }
+    }
+
+    int RunBenchmark(const std::string& name, const BenchOptions& options) {
+        int rc = 0;
+        bool found = false;
+        for (const auto& s : kScenarios) {
+            if (name == "all" || name == s.name) {
+                found = true;
+                if (s.run(options) != 0) rc = 1;
+            }
+        }
+        if (!found) {
+            std::fprintf(stderr, "Unknown benchmark: %s\n", name.c_str());
+            PrintBenchmarkList();
+            return 1;
+        }
+        return rc;
+    }
+
+} // namespace joystick
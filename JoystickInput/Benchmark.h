@@ -0,0 +1,33 @@
+﻿/**
+ * @file
+ * @brief Built-in benchmarks for the portable pipeline (`JoystickInput --bench ...`).
+ * @details Scenarios use SyntheticBackend or in-memory fakes so they run on any platform without devices.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace joystick {
+
+    /**
+     * @brief Parameters shared by all benchmark scenarios.
+     */
+    struct BenchOptions {
+        uint64_t samples = 1000000; //!< Work items per scenario (samples, reports, events...).
+        uint64_t seed = 1;          //!< Seed for synthetic traffic.
+    };
+
+    /**
+     * @brief Runs one scenario by name, or every scenario for "all".
+     * @param name Scenario name.
+     * @param options Shared parameters.
+     * @return 0 on success; 1 for an unknown scenario or a failed self-check.
+     */
+    int RunBenchmark(const std::string& name, const BenchOptions& options);
+
+    /// Prints the scenario names and descriptions.
+    void PrintBenchmarkList();
+
+} // namespace joystick
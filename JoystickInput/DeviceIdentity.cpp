@@ -0,0 +1,208 @@
+﻿/**
+ * @file
+ * @brief Device identities, the identity cache file and its default location.
+ */
+
+#include "DeviceIdentity.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace joystick {
+
+    namespace {
+
+        /// Value of an environment variable, or empty.
+        std::string EnvVar(const char* name) {
+#ifdef _WIN32
+            char* value = nullptr;
+            size_t len = 0;
+            if (_dupenv_s(&value, &len, name) != 0 || !value) return {};
+            std::string out(value);
+            std::free(value);
+            return out;
+#else
+            const char* value = std::getenv(name);
+            return value ? std::string(value) : std::string();
+#endif
+        }
+
+        /// Tabs and line breaks would split a cache line.
+        std::string Field(const std::string& text) {
+            std::string out(text);
+            for (char& c : out) {
+                if (c == '\t' || c == '\n' || c == '\r') c = ' ';
+            }
+            return out;
+        }
+
+        /// Parses an unsigned number of @p base that must fill @p text; false otherwise.
+        bool ParseNumber(const std::string& text, int base, unsigned long maxValue, unsigned long& out) {
+            if (text.empty()) return false;
+            char* end = nullptr;
+            out = std::strtoul(text.c_str(), &end, base);
+            return *end == '\0' && out <= maxValue;
+        }
+
+    } // namespace
+
+    std::string DeviceIdentity(const DeviceInfo& device) {
+        char ids[16];
+        switch (device.kind) {
+        case DeviceKind::XInput:
+            return "xinput:" + std::to_string(device.xinputUser);
+        case DeviceKind::DirectInput:
+            return "di:" + FormatGuid(device.diGuid);
+        case DeviceKind::Evdev:
+            std::snprintf(ids, sizeof(ids), "%04x:%04x", device.vendorId, device.productId);
+            if (!device.serial.empty()) return std::string("evdev:") + ids + ":" + device.serial;
+            if (!device.location.empty()) return std::string("evdev:") + ids + "@" + device.location;
+            return "evdev:" + device.path;
+        case DeviceKind::Synthetic:
+            break;
+        }
+        return "synthetic:" + device.name;
+    }
+
+    bool IsIdentitySelector(const std::string& text) {
+        for (const char* prefix : { "xinput:", "di:", "evdev:", "synthetic:" }) {
+            if (text.compare(0, std::strlen(prefix), prefix) == 0) return true;
+        }
+        return false;
+    }
+
+    std::string FormatGuid(const DeviceGuid& guid) {
+        char text[40];
+        std::snprintf(text, sizeof(text), "{%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X}",
+            guid.data1, guid.data2, guid.data3, guid.data4[0], guid.data4[1], guid.data4[2], guid.data4[3],
+            guid.data4[4], guid.data4[5], guid.data4[6], guid.data4[7]);
+        return text;
+    }
+
+    bool ParseGuid(const std::string& text, DeviceGuid& out) {
+        std::string s = text;
+        if (s.size() == 38 && s.front() == '{' && s.back() == '}') s = s.substr(1, 36);
+        if (s.size() != 36 || s[8] != '-' || s[13] != '-' || s[18] != '-' || s[23] != '-') return false;
+        unsigned long v = 0;
+        DeviceGuid g;
+        if (!ParseNumber(s.substr(0, 8), 16, 0xFFFFFFFFul, v)) return false;
+        g.data1 = static_cast<uint32_t>(v);
+        if (!ParseNumber(s.substr(9, 4), 16, 0xFFFF, v)) return false;
+        g.data2 = static_cast<uint16_t>(v);
+        if (!ParseNumber(s.substr(14, 4), 16, 0xFFFF, v)) return false;
+        g.data3 = static_cast<uint16_t>(v);
+        const size_t bytes[8] = { 19, 21, 24, 26, 28, 30, 32, 34 };
+        for (int i = 0; i < 8; ++i) {
+            if (!ParseNumber(s.substr(bytes[i], 2), 16, 0xFF, v)) return false;
+            g.data4[i] = static_cast<uint8_t>(v);
+        }
+        out = g;
+        return true;
+    }
+
+    bool IdentityCache::Load(const std::string& path) {
+        entries_.clear();
+        std::ifstream in(path);
+        if (!in) return false;
+        Load(in);
+        return true;
+    }
+
+    void IdentityCache::Load(std::istream& in) {
+        entries_.clear();
+        std::string line;
+        while (std::getline(in, line)) {
+            std::vector<std::string> f(1);
+            for (char c : line) {
+                if (c == '\t') f.emplace_back();
+                else if (c != '\r') f.back() += c;
+            }
+            if (f.size() != 10 || f[5].size() != 9 || f[5][4] != ':') continue;
+
+            DeviceInfo info;
+            unsigned long kind = 0, user = 0, vid = 0, pid = 0;
+            if (!ParseNumber(f[1], 10, (unsigned long)DeviceKind::Synthetic, kind) || !ParseNumber(f[2], 10, 0xFFFFFFFFul, user) ||
+                !ParseNumber(f[5].substr(0, 4), 16, 0xFFFF, vid) || !ParseNumber(f[5].substr(5), 16, 0xFFFF, pid)) continue;
+            info.kind = static_cast<DeviceKind>(kind);
+            info.xinputUser = static_cast<uint32_t>(user);
+            if (!f[3].empty() && !ParseGuid(f[3], info.diGuid)) continue;
+            info.path = f[4];
+            info.vendorId = static_cast<uint16_t>(vid);
+            info.productId = static_cast<uint16_t>(pid);
+            info.polled = f[6] == "1";
+            info.serial = f[7];
+            info.location = f[8];
+            info.name = f[9];
+            // A line whose fields no longer produce its identity is stale or hand-edited.
+            if (DeviceIdentity(info) != f[0]) continue;
+            Remember(info);
+        }
+    }
+
+    bool IdentityCache::Save(const std::string& path) const {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out) return false;
+        Save(out);
+        return static_cast<bool>(out.flush());
+    }
+
+    void IdentityCache::Save(std::ostream& out) const {
+        for (const Entry& e : entries_) {
+            const DeviceInfo& d = e.info;
+            char ids[16];
+            std::snprintf(ids, sizeof(ids), "%04x:%04x", d.vendorId, d.productId);
+            out << Field(e.identity) << '\t' << static_cast<int>(d.kind) << '\t' << d.xinputUser << '\t'
+                << (d.kind == DeviceKind::DirectInput ? FormatGuid(d.diGuid) : std::string()) << '\t'
+                << Field(d.path) << '\t' << ids << '\t' << (d.polled ? 1 : 0) << '\t'
+                << Field(d.serial) << '\t' << Field(d.location) << '\t' << Field(d.name) << '\n';
+        }
+    }
+
+    const DeviceInfo* IdentityCache::Find(const std::string& identity) const {
+        for (const Entry& e : entries_) {
+            if (e.identity == identity) return &e.info;
+        }
+        return nullptr;
+    }
+
+    void IdentityCache::Remember(const DeviceInfo& device) {
+        Entry e;
+        e.identity = DeviceIdentity(device);
+        e.info = device;
+        e.info.index = 0;
+        for (Entry& existing : entries_) {
+            if (existing.identity == e.identity) {
+                existing = std::move(e);
+                return;
+            }
+        }
+        entries_.push_back(std::move(e));
+    }
+
+    void IdentityCache::Forget(const std::string& identity) {
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->identity == identity) {
+                entries_.erase(it);
+                return;
+            }
+        }
+    }
+
+    std::string DefaultIdentityCachePath() {
+#ifdef _WIN32
+        const std::string base = EnvVar("LOCALAPPDATA");
+        return base.empty() ? std::string() : base + "\\JoystickInput-devices.txt";
+#else
+        std::string base = EnvVar("XDG_CACHE_HOME");
+        if (base.empty()) {
+            const std::string home = EnvVar("HOME");
+            if (home.empty()) return {};
+            base = home + "/.cache";
+        }
+        return base + "/joystickinput-devices";
+#endif
+    }
+
+} // namespace joystick
@@ -0,0 +1,97 @@
+﻿/**
+ * @file
+ * @brief Stable device identities and the identity -> handle cache kept between runs (portable).
+ * @details
+ *   - A list index depends on everything else that is plugged in; an identity names one device:
+ *       - XInput: `xinput:<user>` (the slot the pad holds while it is connected);
+ *       - DirectInput: `di:{instance GUID}` (DirectInput keeps it per device across sessions);
+ *       - evdev: `evdev:<vid>:<pid>:<serial>` (EVIOCGUNIQ), else `evdev:<vid>:<pid>@<phys>` (the
+ *         port, EVIOCGPHYS), else `evdev:<path>`.
+ *   - IdentityCache maps identities to what opening the device needs (kind, slot, GUID, node) and
+ *     is saved as a text file. Selecting a device by identity then probes that one entry
+ *     (ProbeDevice()) instead of enumerating every device; only a miss falls back to a listing.
+ *     A failed probe drops the entry: its handle is empty or holds another device, and the listing
+ *     re-adds the device if it moved.
+ */
+
+#pragma once
+
+#include "InputCore.h"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace joystick {
+
+    /// Stable identity of @p device (see file notes).
+    std::string DeviceIdentity(const DeviceInfo& device);
+
+    /// true if @p text is an identity rather than a list index (it has a kind prefix).
+    bool IsIdentitySelector(const std::string& text);
+
+    /// Registry form of a GUID: `{XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}`.
+    std::string FormatGuid(const DeviceGuid& guid);
+
+    /// Parses FormatGuid() output (braces optional, either case); false if malformed.
+    bool ParseGuid(const std::string& text, DeviceGuid& out);
+
+    /**
+     * @brief Identity -> device handle entries, loaded from and saved to a text file.
+     * @details One line per device: identity, kind, XInput user, GUID, node, VID:PID, polled flag,
+     *          serial, location and name, tab-separated. Entries keep the order they were first seen.
+     */
+    class IdentityCache {
+    public:
+        /**
+         * @brief Replaces the entries with the file's.
+         * @return false if the file cannot be read (a missing file leaves the cache empty); malformed
+         *         lines are skipped.
+         */
+        bool Load(const std::string& path);
+
+        /// Replaces the entries with the lines of @p in.
+        void Load(std::istream& in);
+
+        /// Writes every entry; false if the file cannot be written.
+        bool Save(const std::string& path) const;
+
+        /// Writes every entry to @p out.
+        void Save(std::ostream& out) const;
+
+        /// The entry for @p identity, or nullptr.
+        const DeviceInfo* Find(const std::string& identity) const;
+
+        /// Adds or updates the entry of @p device (its index is not kept).
+        void Remember(const DeviceInfo& device);
+
+        /// Drops the entry for @p identity, e.g. after a probe found another device at its handle.
+        void Forget(const std::string& identity);
+
+        size_t Size() const { return entries_.size(); }
+
+    private:
+        struct Entry {
+            std::string identity;
+            DeviceInfo info;
+        };
+        std::vector<Entry> entries_;
+    };
+
+    /**
+     * @brief Where the cache lives: `%LOCALAPPDATA%\JoystickInput-devices.txt` on Windows,
+     *        `$XDG_CACHE_HOME/joystickinput-devices` (default `~/.cache`) elsewhere.
+     * @return Empty if no base directory is set.
+     */
+    std::string DefaultIdentityCachePath();
+
+    /**
+     * @brief Re-describes the device a cache entry names, opening only that device.
+     * @param device In: a cache entry; out: its current description (name, capabilities, node).
+     * @return false if it is not attached, or another device now holds its handle (identity differs).
+     * @details XInput: one slot probe. DirectInput: GetDeviceStatus, then CreateDevice on the GUID.
+     *          evdev: the cached node is opened and described.
+     */
+    bool ProbeDevice(DeviceInfo& device);
+
+} // namespace joystick
@@ -0,0 +1,18 @@
+﻿/**
+ * @file
+ * @brief Device registry reporting.
+ */
+
+#include "DeviceRegistry.h"
+
+#include <cstdio>
+
+namespace joystick {
+
+    void PrintRegistryStats(const RegistryStats& stats) {
+        std::printf("registry: %llu lookups, %llu refreshes, %llu devices probed, %llu cache hits, %llu evicted\n",
+            (unsigned long long)stats.lookups, (unsigned long long)stats.refreshes, (unsigned long long)stats.probes,
+            (unsigned long long)stats.hits, (unsigned long long)stats.evicted);
+    }
+
+} // namespace joystick
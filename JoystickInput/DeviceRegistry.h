@@ -0,0 +1,241 @@
+﻿/**
+ * @file
+ * @brief Cached device list: enumerate once, re-probe only after a device-change notification (portable).
+ * @details
+ *   - A device source lists what is attached cheaply (XInput slots, DirectInput instances, event
+ *     nodes) and describes one entry expensively (open it, read capabilities, convert its name).
+ *     BasicDeviceRegistry keeps the described entries by identity key, so a refresh only describes
+ *     devices it has not seen before; entries the listing no longer returns are evicted.
+ *   - Entries a source hides (XInput proxies in DirectInput, event nodes that are not controllers)
+ *     are cached too, so they are not opened again on the next refresh.
+ *   - Devices() refreshes only when NotifyChanged() was called since the last refresh (a
+ *     HotplugWatcher notification); the first call always enumerates.
+ *   - ProbeSlotsConcurrently() lets a source overlap slow per-slot probes (XInputGetState on an empty
+ *     slot) with the rest of its listing; entries are still visited in a fixed order.
+ *   - MockDeviceSource models listing and describing costs for the benchmarks.
+ */
+
+#pragma once
+
+#include "InputCore.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace joystick {
+
+    /**
+     * @brief One entry of a source listing, before it is described.
+     */
+    struct DeviceProbe {
+        DeviceKind kind = DeviceKind::XInput;
+        std::string key;              //!< Identity: equal keys mean the same attached device.
+        uint32_t slot = 0;            //!< XInput user index, event number, or listing position.
+        const void* native = nullptr; //!< Source data, valid during the visit only (e.g. DIDEVICEINSTANCEW).
+    };
+
+    /// Called by a source for every listed entry, in presentation order.
+    using ProbeVisitor = void (*)(void* context, const DeviceProbe& probe);
+
+    /**
+     * @brief Runs @p probe(0..count-1) on one thread each while @p other runs on the calling thread.
+     * @return Bit i set when probe(i) returned true (count <= 32).
+     * @details Returns after all of them finish. The result does not depend on which probe finishes
+     *          first, so a listing merged from it keeps its order, and the indices stay stable.
+     */
+    template <class SlotProbe, class Other>
+    uint32_t ProbeSlotsConcurrently(uint32_t count, SlotProbe probe, Other other) {
+        std::atomic<uint32_t> found{ 0 };
+        std::vector<std::thread> threads;
+        threads.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            threads.emplace_back([&found, &probe, i] {
+                if (probe(i)) found.fetch_or(1u << i, std::memory_order_relaxed);
+            });
+        }
+        other();
+        for (std::thread& t : threads) t.join();
+        return found.load();
+    }
+
+    /**
+     * @brief Counters of BasicDeviceRegistry.
+     */
+    struct RegistryStats {
+        uint64_t lookups = 0;    //!< Devices() calls.
+        uint64_t refreshes = 0;  //!< Listings run (first call and after each notification).
+        uint64_t probes = 0;     //!< Entries described (opened) by the source.
+        uint64_t hits = 0;       //!< Listed entries served from the cache.
+        uint64_t evicted = 0;    //!< Cached entries dropped because the listing no longer returned them.
+    };
+
+    /**
+     * @brief Device list cached across calls and updated incrementally.
+     * @tparam Source Provides `void List(ProbeVisitor, void*)` and
+     *         `bool Describe(const DeviceProbe&, DeviceInfo&)`; Describe() is called during the visit
+     *         of its entry and returns false for entries that are not listed.
+     * @details Devices() and Refresh() belong to one thread; NotifyChanged() may be called from any.
+     */
+    template <class Source>
+    class BasicDeviceRegistry {
+    public:
+        explicit BasicDeviceRegistry(Source& source) : source_(source) {}
+
+        /// The current list with indices assigned; refreshed first if a change was notified.
+        const std::vector<DeviceInfo>& Devices() {
+            ++stats_.lookups;
+            if (dirty_.exchange(false)) Refresh();
+            return devices_;
+        }
+
+        /// Marks the list stale; the next Devices() call re-lists.
+        void NotifyChanged() { dirty_.store(true); }
+
+        bool IsStale() const { return dirty_.load(); }
+
+        /// Re-lists now, describing only entries not in the cache.
+        void Refresh() {
+            ++generation_;
+            ++stats_.refreshes;
+            devices_.clear();
+            source_.List(&BasicDeviceRegistry::Visit, this);
+            for (auto it = cache_.begin(); it != cache_.end();) {
+                if (it->second.generation != generation_) {
+                    it = cache_.erase(it);
+                    ++stats_.evicted;
+                }
+                else {
+                    ++it;
+                }
+            }
+            for (int i = 0; i < (int)devices_.size(); ++i) devices_[i].index = i;
+        }
+
+        const RegistryStats& Stats() const { return stats_; }
+
+        /// Entries in the cache, listed or hidden.
+        size_t CachedCount() const { return cache_.size(); }
+
+    private:
+        struct Entry {
+            DeviceInfo info;
+            bool listed = false;
+            uint64_t generation = 0;  //!< Last refresh that listed the entry.
+        };
+
+        static void Visit(void* context, const DeviceProbe& probe) {
+            auto* self = static_cast<BasicDeviceRegistry*>(context);
+            auto it = self->cache_.find(probe.key);
+            if (it == self->cache_.end()) {
+                Entry entry;
+                entry.listed = self->source_.Describe(probe, entry.info);
+                ++self->stats_.probes;
+                it = self->cache_.emplace(probe.key, std::move(entry)).first;
+            }
+            else {
+                ++self->stats_.hits;
+            }
+            it->second.generation = self->generation_;
+            if (it->second.listed) self->devices_.push_back(it->second.info);
+        }
+
+        Source& source_;
+        std::atomic_bool dirty_{ true };
+        std::vector<DeviceInfo> devices_;
+        std::unordered_map<std::string, Entry> cache_;
+        uint64_t generation_ = 0;
+        RegistryStats stats_;
+    };
+
+    /**
+     * @brief Generated devices with spun listing and describing costs.
+     * @details XInput-kind entries model slots: each probe blocks for its own probeNs, like the
+     *          driver round trip of XInputGetState (empty slots are probed but not listed), serially
+     *          or with ProbeSlotsConcurrently(). Other entries
+     *          model an enumeration pass of listCostNs per entry. Slots are listed first.
+     */
+    class MockDeviceSource {
+    public:
+        struct Device {
+            std::string key;
+            DeviceInfo info;
+            bool hidden = false;    //!< Describe() returns false (an XInput proxy, a non-controller node).
+            bool attached = true;   //!< XInput-kind: the slot probe finds a pad.
+            uint64_t probeNs = 0;   //!< XInput-kind: slot probe time (blocking, not CPU).
+        };
+
+        std::vector<Device> devices;
+        uint64_t listCostNs = 0;      //!< Per non-slot entry.
+        uint64_t describeCostNs = 0;  //!< Per described entry.
+        bool parallel = false;        //!< Probe the slots concurrently with the enumeration pass.
+        uint64_t listed = 0;
+        uint64_t described = 0;
+
+        void List(ProbeVisitor visit, void* context) {
+            std::vector<uint32_t> slots;
+            std::vector<uint32_t> others;
+            for (uint32_t i = 0; i < devices.size(); ++i) (devices[i].info.kind == DeviceKind::XInput ? slots : others).push_back(i);
+
+            auto probe = [this, &slots](uint32_t k) {
+                if (devices[slots[k]].probeNs) std::this_thread::sleep_for(std::chrono::nanoseconds(devices[slots[k]].probeNs));
+                return devices[slots[k]].attached;
+            };
+            auto enumerate = [this, &others] {
+                for (size_t k = 0; k < others.size(); ++k) Spin(listCostNs);
+            };
+            uint32_t found = 0;
+            if (parallel) {
+                found = ProbeSlotsConcurrently(static_cast<uint32_t>(slots.size()), probe, enumerate);
+            }
+            else {
+                for (uint32_t k = 0; k < slots.size(); ++k) {
+                    if (probe(k)) found |= 1u << k;
+                }
+                enumerate();
+            }
+
+            for (uint32_t k = 0; k < slots.size(); ++k) {
+                if (found & (1u << k)) Visit(slots[k], visit, context);
+            }
+            for (uint32_t i : others) Visit(i, visit, context);
+        }
+
+        bool Describe(const DeviceProbe& probe, DeviceInfo& out) {
+            Spin(describeCostNs);
+            ++described;
+            const Device& d = *static_cast<const Device*>(probe.native);
+            out = d.info;
+            return !d.hidden;
+        }
+
+    private:
+        void Visit(uint32_t i, ProbeVisitor visit, void* context) {
+            ++listed;
+            DeviceProbe probe;
+            probe.kind = devices[i].info.kind;
+            probe.key = devices[i].key;
+            probe.slot = i;
+            probe.native = &devices[i];
+            visit(context, probe);
+        }
+
+        static void Spin(uint64_t ns) {
+            if (ns == 0) return;
+            const auto end = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+            while (std::chrono::steady_clock::now() < end) {
+            }
+        }
+    };
+
+    /**
+     * @brief Prints the registry counters on one line ("registry: ...").
+     */
+    void PrintRegistryStats(const RegistryStats& stats);
+
+} // namespace joystick
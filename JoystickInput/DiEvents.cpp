@@ -0,0 +1,212 @@
+﻿/**
+ * @file
+ * @brief DirectInput offset map, event queue and reporting.
+ */
+
+#include "DiEvents.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace joystick {
+
+    namespace {
+
+        // DIJOYSTATE2 layout (dinput.h): six LONG axes, LONG rglSlider[2], DWORD rgdwPOV[4],
+        // BYTE rgbButtons[128], then velocity/acceleration/force fields that are not tracked.
+        constexpr uint32_t kJs2Axes = 0;
+        constexpr uint32_t kJs2Sliders = 24;
+        constexpr uint32_t kJs2Povs = 32;
+        constexpr uint32_t kJs2Buttons = 48;
+        constexpr uint32_t kJs2Size = 272;
+
+    } // namespace
+
+    DiObjectMap DiObjectMap::Joystick2() {
+        DiObjectMap map;
+        for (uint8_t i = 0; i < 6; ++i) map.Set(kJs2Axes + 4u * i, DiObjectKind::Axis, i);
+        for (uint8_t i = 0; i < 2; ++i) map.Set(kJs2Sliders + 4u * i, DiObjectKind::Axis, static_cast<uint8_t>(6 + i));
+        for (uint8_t i = 0; i < kMaxPovs; ++i) map.Set(kJs2Povs + 4u * i, DiObjectKind::Pov, i);
+        for (int i = 0; i < kMaxButtons; ++i) map.Set(kJs2Buttons + i, DiObjectKind::Button, static_cast<uint8_t>(i));
+        map.kinds_.resize(kJs2Size, DiObjectKind::None);
+        map.indices_.resize(kJs2Size, 0);
+        return map;
+    }
+
+    void DiObjectMap::Set(uint32_t ofs, DiObjectKind kind, uint8_t index) {
+        if (ofs >= kinds_.size()) {
+            kinds_.resize(ofs + 1, DiObjectKind::None);
+            indices_.resize(ofs + 1, 0);
+        }
+        kinds_[ofs] = kind;
+        indices_[ofs] = index;
+    }
+
+    bool DiCompactFormat::AddAxis(uint8_t slot, uint32_t type) {
+        if (slot >= kMaxAxes) return false;
+        for (const DiFormatObject& o : objects_) {
+            if (o.kind == DiObjectKind::Axis && o.index == slot) return false;
+        }
+        DiFormatObject o;
+        o.kind = DiObjectKind::Axis;
+        o.index = slot;
+        o.type = type;
+        objects_.push_back(o);
+        return true;
+    }
+
+    bool DiCompactFormat::AddPov(uint32_t type) {
+        uint8_t count = 0;
+        for (const DiFormatObject& o : objects_) count += o.kind == DiObjectKind::Pov;
+        if (count >= kMaxPovs) return false;
+        DiFormatObject o;
+        o.kind = DiObjectKind::Pov;
+        o.index = count;
+        o.type = type;
+        objects_.push_back(o);
+        return true;
+    }
+
+    bool DiCompactFormat::AddButton(uint32_t type) {
+        int count = 0;
+        for (const DiFormatObject& o : objects_) count += o.kind == DiObjectKind::Button;
+        if (count >= kMaxButtons) return false;
+        DiFormatObject o;
+        o.kind = DiObjectKind::Button;
+        o.index = static_cast<uint8_t>(count);
+        o.type = type;
+        objects_.push_back(o);
+        return true;
+    }
+
+    void DiCompactFormat::Finish() {
+        // Axis < Pov < Button in DiObjectKind, so this orders the block as axes, POVs, buttons.
+        std::stable_sort(objects_.begin(), objects_.end(), [](const DiFormatObject& a, const DiFormatObject& b) {
+            return a.kind != b.kind ? a.kind < b.kind : a.index < b.index;
+        });
+        map_ = DiObjectMap();
+        caps_.axisMask = 0;
+        caps_.povCount = 0;
+        caps_.buttonCount = 0;
+        uint32_t ofs = 0;
+        for (DiFormatObject& o : objects_) {
+            switch (o.kind) {
+            case DiObjectKind::Axis:
+                caps_.axisMask = static_cast<uint8_t>(caps_.axisMask | (1u << o.index));
+                break;
+            case DiObjectKind::Pov:
+                if (caps_.povCount == 0) povOfs_ = ofs;
+                ++caps_.povCount;
+                break;
+            case DiObjectKind::Button:
+                if (caps_.buttonCount == 0) buttonOfs_ = ofs;
+                ++caps_.buttonCount;
+                break;
+            case DiObjectKind::None:
+            default:
+                continue;
+            }
+            o.ofs = ofs;
+            map_.Set(ofs, o.kind, o.index);
+            ofs += o.kind == DiObjectKind::Button ? 1 : 4;
+        }
+        size_ = (ofs + 3) & ~3u;
+    }
+
+    void DiCompactFormat::Convert(const uint8_t* data, InputState& out) const {
+        const uint8_t* p = data;
+        for (int i = 0; i < kMaxAxes; ++i) {
+            if (!((caps_.axisMask >> i) & 1u)) continue;
+            std::memcpy(&out.axes[i], p, sizeof(int32_t));
+            p += sizeof(int32_t);
+        }
+        p = data + povOfs_;
+        for (int i = 0; i < caps_.povCount; ++i, p += sizeof(uint32_t)) {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            out.povs[i] = (v & 0xFFFFu) == 0xFFFFu ? kPovCentered : v;
+        }
+        p = data + buttonOfs_;
+        for (int i = 0; i < caps_.buttonCount; ++i) SetButton(out, i, (p[i] & 0x80u) != 0);
+    }
+
+    void DiEventQueue::Append(const DiEvent* events, size_t count) {
+        if (pos_ == events_.size()) Clear();
+        events_.insert(events_.end(), events, events + count);
+    }
+
+    bool DiEventQueue::ApplyNextGroup(const DiObjectMap& map, InputState& state, DiEventStats* stats) {
+        if (Empty()) return false;
+        const DiEvent& first = events_[pos_];
+        state.packet = first.sequence;
+        state.timeMs = first.timeMs;
+        const uint32_t sequence = first.sequence;
+        while (pos_ < events_.size() && events_[pos_].sequence == sequence) {
+            if (!ApplyDiEvent(map, events_[pos_], state) && stats) ++stats->ignored;
+            ++pos_;
+        }
+        if (stats) ++stats->records;
+        return true;
+    }
+
+    namespace {
+
+        uint32_t RoundUpPow2(uint64_t v) {
+            uint32_t p = 1;
+            while (p < v && p < 0x80000000u) p <<= 1;
+            return p;
+        }
+
+    } // namespace
+
+    DiBufferTuner::DiBufferTuner(const DiBufferConfig& config)
+        : config_(config), size_(config.initial), wanted_(config.initial) {}
+
+    bool DiBufferTuner::OnRead(uint32_t records, bool overflow, uint64_t nowNs) {
+        if (!config_.autoTune) return false;
+        if (windowStartNs_ == 0) windowStartNs_ = nowNs;
+        windowRecords_ += records;
+        if (records > peakRead_) peakRead_ = records;
+
+        uint64_t want = size_;
+        if (overflow) want = uint64_t(size_) * 2;
+        if (nowNs - windowStartNs_ >= 1000000000ull) {
+            rate_ = (double)windowRecords_ * 1e9 / (double)(nowNs - windowStartNs_);
+            const uint64_t hold = static_cast<uint64_t>(rate_ * config_.holdMs / 1000.0);
+            want = std::max<uint64_t>(want, std::max<uint64_t>(hold, uint64_t(peakRead_) * 2));
+            windowStartNs_ = nowNs;
+            windowRecords_ = 0;
+            peakRead_ = 0;
+        }
+        if (want <= size_) return false;
+        wanted_ = std::min(RoundUpPow2(want), config_.maxSize);
+        return wanted_ > size_;
+    }
+
+    void DiBufferTuner::Applied(uint32_t size) {
+        // A driver that clamps the request sets the real ceiling; asking again would not help.
+        if (size < wanted_) config_.maxSize = size;
+        size_ = size;
+        wanted_ = size;
+    }
+
+    void PrintDiEventStats(const DiEventStats& stats, bool eventSourced, double seconds) {
+        const double callRate = seconds > 0 ? (double)stats.deviceCalls / seconds : 0.0;
+        if (eventSourced) {
+            std::printf("directinput: event-sourced, %llu buffered records -> %llu states (%llu untracked), "
+                "%llu resyncs, %llu device calls (%.1f/s), buffer %u (%s, %llu resizes), overflows %llu\n",
+                (unsigned long long)stats.events, (unsigned long long)stats.records, (unsigned long long)stats.ignored,
+                (unsigned long long)stats.snapshots, (unsigned long long)stats.deviceCalls, callRate,
+                stats.bufferSize, stats.autoBuffer ? "auto" : "fixed", (unsigned long long)stats.resizes,
+                (unsigned long long)stats.overflows);
+        }
+        else {
+            std::printf("directinput: snapshot, %llu buffered records discarded, %llu state reads, "
+                "%llu device calls (%.1f/s), buffer %u, overflows %llu\n",
+                (unsigned long long)stats.events, (unsigned long long)stats.snapshots,
+                (unsigned long long)stats.deviceCalls, callRate, stats.bufferSize, (unsigned long long)stats.overflows);
+        }
+    }
+
+} // namespace joystick
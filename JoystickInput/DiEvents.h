@@ -0,0 +1,243 @@
+﻿/**
+ * @file
+ * @brief Event-sourced DirectInput state: buffered DIDEVICEOBJECTDATA records applied to an InputState.
+ * @details
+ *   - Platform-neutral (no dinput.h): DiEvent mirrors the fields of DIDEVICEOBJECTDATA the reader
+ *     uses, so the logic also runs in the benchmarks on Linux.
+ *   - DiObjectMap translates a data-format byte offset (dwOfs) into the InputState field it feeds;
+ *     Joystick2() describes c_dfDIJoystick2.
+ *   - DirectInput gives events that happened simultaneously the same sequence number. DiEventQueue
+ *     applies one such group per call, so every report the driver buffered becomes one record
+ *     (packet = sequence, timeMs = driver timestamp) and press/release pairs between two
+ *     notifications survive.
+ *   - Axis, POV and button records carry absolute values, so re-applying a record that is already
+ *     reflected in a GetDeviceState snapshot is harmless; resyncs rely on this.
+ *   - DiCompactFormat lays out a custom data format holding only the objects EnumObjects reported
+ *     (LONG axes, DWORD POVs, BYTE buttons), so a 4-axis, 12-button pad reads 32 bytes instead of the
+ *     272 of c_dfDIJoystick2, and its map and StateCaps limit diffing and output to those objects.
+ *   - DiBufferTuner sizes DIPROP_BUFFERSIZE from the observed record rate, so a fast device does not
+ *     overflow the driver buffer while the reader is held up; an overflow still forces a resync.
+ */
+
+#pragma once
+
+#include "InputCore.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace joystick {
+
+    /**
+     * @brief One buffered DirectInput record (the DIDEVICEOBJECTDATA fields the reader uses).
+     */
+    struct DiEvent {
+        uint32_t ofs = 0;       //!< dwOfs: byte offset of the object in the data format.
+        uint32_t data = 0;      //!< dwData: axis value (LONG), POV hundredths of a degree, or button byte (0x80 = down).
+        uint32_t timeMs = 0;    //!< dwTimeStamp: system tick count when the driver saw the change.
+        uint32_t sequence = 0;  //!< dwSequence: equal for events that happened simultaneously.
+    };
+
+    /**
+     * @brief InputState field fed by a data-format offset.
+     */
+    enum class DiObjectKind : uint8_t {
+        None,   //!< Not tracked (velocity/force fields, padding).
+        Axis,   //!< axes[index]
+        Pov,    //!< povs[index]
+        Button  //!< button bit index
+    };
+
+    /**
+     * @brief Data-format offset -> InputState field table.
+     */
+    class DiObjectMap {
+    public:
+        /// Map of c_dfDIJoystick2: lX..lRz, two sliders, four POVs and 128 buttons.
+        static DiObjectMap Joystick2();
+
+        /// Routes offset @p ofs to @p kind / @p index.
+        void Set(uint32_t ofs, DiObjectKind kind, uint8_t index);
+
+        DiObjectKind Kind(uint32_t ofs) const { return ofs < kinds_.size() ? kinds_[ofs] : DiObjectKind::None; }
+        uint8_t Index(uint32_t ofs) const { return ofs < indices_.size() ? indices_[ofs] : 0; }
+
+    private:
+        std::vector<DiObjectKind> kinds_;   //!< Indexed by byte offset.
+        std::vector<uint8_t> indices_;
+    };
+
+    /**
+     * @brief One object of a custom data format (becomes a DIOBJECTDATAFORMAT).
+     */
+    struct DiFormatObject {
+        DiObjectKind kind = DiObjectKind::None;
+        uint8_t index = 0;  //!< InputState slot (axis slot, POV or button number).
+        uint32_t type = 0;  //!< dwType from EnumObjects (type bits and instance).
+        uint32_t ofs = 0;   //!< Byte offset in the data block; set by Finish().
+    };
+
+    /**
+     * @brief Compact data format built from a device's enumerated objects.
+     * @details Axes map to their InputState slot by object type (X..Rz, then two sliders); POVs and
+     *          buttons are numbered in enumeration order. Objects beyond the InputState slots are left
+     *          out of the format.
+     */
+    class DiCompactFormat {
+    public:
+        /// Adds an axis for InputState slot @p slot; false if the slot is taken or out of range.
+        bool AddAxis(uint8_t slot, uint32_t type);
+        /// Adds the next POV; false once kMaxPovs are present.
+        bool AddPov(uint32_t type);
+        /// Adds the next button; false once kMaxButtons are present.
+        bool AddButton(uint32_t type);
+
+        /// Assigns offsets (axes in slot order, then POVs, then buttons) and builds the map and caps.
+        void Finish();
+
+        bool Empty() const { return objects_.empty(); }
+        /// Data block size in bytes, a multiple of 4 as DIDATAFORMAT requires.
+        uint32_t DataSize() const { return size_; }
+        const std::vector<DiFormatObject>& Objects() const { return objects_; }
+        const DiObjectMap& Map() const { return map_; }
+        const StateCaps& Caps() const { return caps_; }
+
+        /**
+         * @brief Converts a GetDeviceState block of DataSize() bytes.
+         * @details Only present objects are written; other slots of @p out keep their values.
+         */
+        void Convert(const uint8_t* data, InputState& out) const;
+
+    private:
+        std::vector<DiFormatObject> objects_;
+        DiObjectMap map_;
+        StateCaps caps_;
+        uint32_t size_ = 0;
+        uint32_t povOfs_ = 0;     //!< Offset of the first POV (axes start at 0).
+        uint32_t buttonOfs_ = 0;  //!< Offset of the first button.
+    };
+
+    /**
+     * @brief Applies one record to @p state.
+     * @return false if the offset is not tracked.
+     */
+    inline bool ApplyDiEvent(const DiObjectMap& map, const DiEvent& e, InputState& state) {
+        switch (map.Kind(e.ofs)) {
+        case DiObjectKind::Axis:
+            state.axes[map.Index(e.ofs)] = static_cast<int32_t>(e.data);
+            return true;
+        case DiObjectKind::Pov:
+            // Centered is any value with 0xFFFF in the low word.
+            state.povs[map.Index(e.ofs)] = (e.data & 0xFFFFu) == 0xFFFFu ? kPovCentered : e.data;
+            return true;
+        case DiObjectKind::Button:
+            SetButton(state, map.Index(e.ofs), (e.data & 0x80u) != 0);
+            return true;
+        case DiObjectKind::None:
+        default:
+            return false;
+        }
+    }
+
+    /**
+     * @brief Counters of the event-sourced DirectInput path.
+     */
+    struct DiEventStats {
+        uint64_t events = 0;     //!< Buffered records read with GetDeviceData.
+        uint64_t records = 0;    //!< Sequence groups applied and returned as states.
+        uint64_t ignored = 0;    //!< Records for offsets the map does not track.
+        uint64_t snapshots = 0;  //!< GetDeviceState reads: resyncs (first read, re-acquire, overflow), or every sample in snapshot mode.
+        uint64_t deviceCalls = 0; //!< GetDeviceData + GetDeviceState round trips.
+        uint64_t overflows = 0;  //!< Reads that returned DI_BUFFEROVERFLOW (records were lost in the driver).
+        uint64_t resizes = 0;    //!< DIPROP_BUFFERSIZE changes made by the tuner.
+        uint32_t bufferSize = 0; //!< Current driver buffer size in records.
+        bool autoBuffer = false; //!< The buffer size is tuned.
+    };
+
+    /**
+     * @brief Buffer sizing settings.
+     */
+    struct DiBufferConfig {
+        uint32_t initial = 64;     //!< Size set at open.
+        uint32_t maxSize = 8192;   //!< Upper bound for tuning.
+        uint32_t holdMs = 250;     //!< Reader stall the buffer should absorb at the observed rate.
+        bool autoTune = true;      //!< false = keep the initial size.
+    };
+
+    /**
+     * @brief Chooses the driver buffer size from the observed record rate (only grows).
+     * @details The record rate is measured over one-second windows. The wanted size holds holdMs of
+     *          records, and at least twice the largest single read, rounded up to a power of two. An
+     *          overflow doubles the size straight away.
+     */
+    class DiBufferTuner {
+    public:
+        explicit DiBufferTuner(const DiBufferConfig& config = DiBufferConfig());
+
+        /**
+         * @brief Records one read.
+         * @param records Records the read returned.
+         * @param overflow The read reported DI_BUFFEROVERFLOW.
+         * @param nowNs Monotonic time.
+         * @return true if the buffer should be resized to Wanted().
+         */
+        bool OnRead(uint32_t records, bool overflow, uint64_t nowNs);
+
+        /// Tells the tuner the size now in effect (the driver may clamp the request).
+        void Applied(uint32_t size);
+
+        uint32_t Size() const { return size_; }
+        uint32_t Wanted() const { return wanted_; }
+        /// Records per second in the last full window.
+        double Rate() const { return rate_; }
+        const DiBufferConfig& Config() const { return config_; }
+
+    private:
+        DiBufferConfig config_;
+        uint32_t size_;
+        uint32_t wanted_;
+        uint64_t windowStartNs_ = 0;
+        uint64_t windowRecords_ = 0;
+        uint32_t peakRead_ = 0;
+        double rate_ = 0;
+    };
+
+    /**
+     * @brief Pending buffered records, consumed one sequence group at a time.
+     */
+    class DiEventQueue {
+    public:
+        /// Appends records in the order GetDeviceData returned them.
+        void Append(const DiEvent* events, size_t count);
+
+        /// Drops everything pending (after a resync snapshot).
+        void Clear() {
+            events_.clear();
+            pos_ = 0;
+        }
+
+        bool Empty() const { return pos_ == events_.size(); }
+        size_t Pending() const { return events_.size() - pos_; }
+
+        /**
+         * @brief Applies the oldest group of records that share a sequence number.
+         * @param map Offset table.
+         * @param state Updated in place; packet and timeMs are set from the group.
+         * @param stats Optional counters (records, ignored).
+         * @return false if nothing is pending.
+         */
+        bool ApplyNextGroup(const DiObjectMap& map, InputState& state, DiEventStats* stats = nullptr);
+
+    private:
+        std::vector<DiEvent> events_;
+        size_t pos_ = 0;
+    };
+
+    /**
+     * @brief Prints the DirectInput read counters on one line ("directinput: ...").
+     * @param eventSourced false for snapshot mode, where buffered records are discarded.
+     */
+    void PrintDiEventStats(const DiEventStats& stats, bool eventSourced, double seconds);
+
+} // namespace joystick
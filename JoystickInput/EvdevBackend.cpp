@@ -0,0 +1,682 @@
+﻿/**
+ * @file
+ * @brief EvdevBackend, device enumeration and replay (Linux only).
+ */
+
+#ifdef __linux__
+
+#include "EvdevBackend.h"
+
+#include "DeviceIdentity.h"
+#include "Reactor.h"
+#include "ReaderPool.h"
+#include "StateRing.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace joystick {
+
+    namespace {
+
+        constexpr uint8_t kUnmapped = 0xFF;
+
+        /// Number of longs needed for a bit array of @p bits.
+        constexpr size_t BitsToLongs(size_t bits) {
+            return (bits + 8 * sizeof(unsigned long) - 1) / (8 * sizeof(unsigned long));
+        }
+
+        bool TestBit(const unsigned long* bits, size_t bit) {
+            return (bits[bit / (8 * sizeof(unsigned long))] >> (bit % (8 * sizeof(unsigned long)))) & 1ul;
+        }
+
+        bool IsHat(uint16_t code) {
+            return code >= ABS_HAT0X && code <= ABS_HAT3Y;
+        }
+
+        /**
+         * @brief Converts a hat's (x, y) in {-1, 0, 1} to a DirectInput-style POV angle.
+         */
+        uint32_t HatToPov(int32_t x, int32_t y) {
+            static const uint32_t kPov[3][3] = {
+                { 31500, 0, 4500 },                // y = -1 (up)
+                { 27000, kPovCentered, 9000 },     // y = 0
+                { 22500, 18000, 13500 },           // y = +1 (down)
+            };
+            const int xi = x < 0 ? 0 : (x > 0 ? 2 : 1);
+            const int yi = y < 0 ? 0 : (y > 0 ? 2 : 1);
+            return kPov[yi][xi];
+        }
+
+        /**
+         * @brief Checks the capability bits for a joystick/gamepad button block.
+         */
+        bool IsJoystickNode(int fd) {
+            unsigned long keyBits[BitsToLongs(KEY_CNT)] = {};
+            if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keyBits)), keyBits) < 0) return false;
+            for (size_t code = BTN_JOYSTICK; code <= BTN_THUMBR; ++code) {
+                if (TestBit(keyBits, code)) return true;
+            }
+            return false;
+        }
+
+        /// Parses the N of "eventN", or -1.
+        int EventNumber(const char* name) {
+            int n = -1;
+            if (std::sscanf(name, "event%d", &n) != 1) return -1;
+            return n;
+        }
+
+    } // namespace
+
+    EvdevDecoder::EvdevDecoder() {
+        std::memset(keyMap_, kUnmapped, sizeof(keyMap_));
+        std::memset(absMap_, kUnmapped, sizeof(absMap_));
+        for (int i = 0; i < 64; ++i) keyMap_[BTN_JOYSTICK + i] = static_cast<uint8_t>(i);
+        for (int i = 0; i < 40; ++i) keyMap_[BTN_TRIGGER_HAPPY + i] = static_cast<uint8_t>(64 + i);
+        const uint16_t axes[kMaxAxes] = { ABS_X, ABS_Y, ABS_Z, ABS_RX, ABS_RY, ABS_RZ, ABS_THROTTLE, ABS_RUDDER };
+        for (int i = 0; i < kMaxAxes; ++i) absMap_[axes[i]] = static_cast<uint8_t>(i);
+    }
+
+    bool EvdevDecoder::ConfigureFromDevice(int fd) {
+        unsigned long keyBits[BitsToLongs(KEY_CNT)] = {};
+        unsigned long absBits[BitsToLongs(ABS_CNT)] = {};
+        if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keyBits)), keyBits) < 0) return false;
+        if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(absBits)), absBits) < 0) return false;
+
+        std::memset(keyMap_, kUnmapped, sizeof(keyMap_));
+        std::memset(absMap_, kUnmapped, sizeof(absMap_));
+
+        // Joystick/gamepad buttons first, then the misc block, like DirectInput's HID button order.
+        int next = 0;
+        for (size_t code = BTN_JOYSTICK; code < KEY_CNT && next < kMaxButtons; ++code) {
+            if (TestBit(keyBits, code)) keyMap_[code] = static_cast<uint8_t>(next++);
+        }
+        for (size_t code = BTN_MISC; code < BTN_JOYSTICK && next < kMaxButtons; ++code) {
+            if (TestBit(keyBits, code)) keyMap_[code] = static_cast<uint8_t>(next++);
+        }
+
+        next = 0;
+        for (size_t code = 0; code < ABS_CNT && next < kMaxAxes; ++code) {
+            if (!IsHat(static_cast<uint16_t>(code)) && TestBit(absBits, code)) {
+                absMap_[code] = static_cast<uint8_t>(next++);
+            }
+        }
+        return true;
+    }
+
+    bool EvdevDecoder::AxisRange(int fd, int axis, int32_t& min, int32_t& max) const {
+        for (uint16_t code = 0; code < ABS_CNT; ++code) {
+            if (absMap_[code] != axis || IsHat(code)) continue;
+            input_absinfo info = {};
+            if (ioctl(fd, EVIOCGABS(code), &info) < 0) return false;
+            min = info.minimum;
+            max = info.maximum;
+            return true;
+        }
+        return false;
+    }
+
+    void EvdevDecoder::SetAbs(uint16_t code, int32_t value) {
+        if (IsHat(code)) {
+            const int hat = (code - ABS_HAT0X) / 2;
+            if ((code - ABS_HAT0X) & 1) hatY_[hat] = value;
+            else hatX_[hat] = value;
+            pending_.povs[hat] = HatToPov(hatX_[hat], hatY_[hat]);
+            return;
+        }
+        const uint8_t axis = absMap_[code];
+        if (axis != kUnmapped) pending_.axes[axis] = value;
+    }
+
+    void EvdevDecoder::Commit(InputState& state) {
+        pending_.packet = ++packet_;
+        state = pending_;
+    }
+
+    size_t EvdevDecoder::Apply(const input_event* events, size_t count, InputState& state, EvdevStats& stats, bool& committed) {
+        committed = false;
+        size_t i = 0;
+        while (i < count && !committed) {
+            const input_event& ev = events[i++];
+            if (ev.type == EV_SYN) {
+                if (ev.code == SYN_REPORT) {
+                    if (dropping_) {
+                        dropping_ = false;
+                        needResync_ = true;
+                    }
+                    else {
+                        Commit(state);
+                        committed = true;
+                        ++stats.frames;
+                    }
+                }
+                else if (ev.code == SYN_DROPPED) {
+                    dropping_ = true;
+                    ++stats.dropped;
+                }
+                continue;
+            }
+            if (dropping_) continue;
+
+            if (ev.type == EV_KEY) {
+                if (ev.code < KEY_CNT && keyMap_[ev.code] != kUnmapped) {
+                    // value 2 is autorepeat; treat it as still pressed.
+                    SetButton(pending_, keyMap_[ev.code], ev.value != 0);
+                }
+            }
+            else if (ev.type == EV_ABS) {
+                if (ev.code < ABS_CNT) SetAbs(ev.code, ev.value);
+            }
+        }
+        stats.events += i;
+        return i;
+    }
+
+    void EvdevDecoder::Resync(int fd, InputState& state) {
+        needResync_ = false;
+
+        unsigned long keyBits[BitsToLongs(KEY_CNT)] = {};
+        if (ioctl(fd, EVIOCGKEY(sizeof(keyBits)), keyBits) >= 0) {
+            for (size_t code = 0; code < KEY_CNT; ++code) {
+                if (keyMap_[code] != kUnmapped) SetButton(pending_, keyMap_[code], TestBit(keyBits, code));
+            }
+        }
+        for (uint16_t code = 0; code < ABS_CNT; ++code) {
+            if (absMap_[code] == kUnmapped && !IsHat(code)) continue;
+            input_absinfo info = {};
+            if (ioctl(fd, EVIOCGABS(code), &info) >= 0) SetAbs(code, info.value);
+        }
+        Commit(state);
+    }
+
+    EvdevBackend::EvdevBackend(int fd, bool ownsFd, int timeoutMs)
+        : fd_(fd), ownsFd_(ownsFd), timeoutMs_(timeoutMs) {
+        const int flags = fcntl(fd_, F_GETFL);
+        if (flags >= 0) fcntl(fd_, F_SETFL, flags | O_NONBLOCK);
+
+        epoll_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_ >= 0) {
+            epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.fd = fd_;
+            if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd_, &ev) < 0) {
+                close(epoll_);
+                epoll_ = -1;
+            }
+        }
+    }
+
+    EvdevBackend::~EvdevBackend() {
+        if (epoll_ >= 0) close(epoll_);
+        if (ownsFd_ && fd_ >= 0) close(fd_);
+    }
+
+    uint8_t* EvdevStream::PrepareWrite(size_t& space) {
+        const size_t partial = end_ - pos_;
+        if (partial && pos_) std::memmove(buf_, buf_ + pos_, partial);
+        pos_ = 0;
+        end_ = partial;
+        space = sizeof(buf_) - end_;
+        return buf_ + end_;
+    }
+
+    bool EvdevStream::NextFrame(int fd, InputState& state, EvdevStats& stats) {
+        while (true) {
+            const size_t whole = (end_ - pos_) / sizeof(input_event);
+            if (whole == 0) return false;
+
+            bool committed = false;
+            const size_t used = decoder_.Apply(reinterpret_cast<const input_event*>(buf_ + pos_), whole, state, stats, committed);
+            pos_ += used * sizeof(input_event);
+            if (decoder_.NeedsResync()) {
+                ++stats.resyncs;
+                decoder_.Resync(fd, state);
+                return true;
+            }
+            if (committed) return true;
+        }
+    }
+
+    int EvdevBackend::ReadMore() {
+        size_t space = 0;
+        uint8_t* dst = stream_.PrepareWrite(space);
+        while (true) {
+            ++stats_.reads;
+            const ssize_t got = read(fd_, dst, space);
+            if (got > 0) {
+                stream_.CommitWrite(static_cast<size_t>(got));
+                return 1;
+            }
+            if (got == 0) return -1;
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1; // ENODEV: device unplugged
+        }
+    }
+
+    SampleStatus EvdevBackend::SampleImpl(InputState& state) {
+        bool waited = false;
+        const int limit = waitLimitMs_;
+        waitLimitMs_ = -1;
+        const int timeout = limit < 0 ? timeoutMs_ : (timeoutMs_ < 0 ? limit : std::min(limit, timeoutMs_));
+        while (true) {
+            const SampleStatus status = PollImpl(state);
+            if (status != SampleStatus::Unchanged || waited) return status;
+
+            epoll_event ev;
+            ++stats_.waits;
+            const int n = epoll_wait(epoll_, &ev, 1, timeout);
+            CountWakeup();
+            if (n < 0) {
+                if (errno == EINTR) return SampleStatus::Unchanged;
+                std::cerr << "epoll_wait failed: " << std::strerror(errno) << "\n";
+                return SampleStatus::Failed;
+            }
+            if (n == 0) return SampleStatus::Unchanged;
+            waited = true;
+        }
+    }
+
+    SampleStatus EvdevBackend::PollImpl(InputState& state) {
+        while (true) {
+            if (stream_.NextFrame(fd_, state, stats_)) {
+                if (normalizer_.Active()) normalizer_.Apply(state);
+                return SampleStatus::Changed;
+            }
+
+            const int r = ReadMore();
+            if (r > 0) continue;
+            return r < 0 ? SampleStatus::Disconnected : SampleStatus::Unchanged;
+        }
+    }
+
+    int EvdevBackend::SetAxisProfile(const AxisProfile& profile) {
+        normalizer_ = AxisNormalizer();
+        if (!profile.enabled) return 0;
+        for (int axis = 0; axis < kMaxAxes; ++axis) {
+            int32_t min = 0;
+            int32_t max = 0;
+            if (stream_.Decoder().AxisRange(fd_, axis, min, max)) normalizer_.Configure(axis, min, max, profile.axes[axis]);
+        }
+        return normalizer_.AxisCount();
+    }
+
+    void EvdevDeviceSource::List(ProbeVisitor visit, void* context) {
+        std::vector<DeviceProbe> found;
+        DIR* d = opendir(dir_.c_str());
+        if (!d) return;
+
+        while (dirent* entry = readdir(d)) {
+            const int number = EventNumber(entry->d_name);
+            if (number < 0) continue;
+
+            DeviceProbe probe;
+            probe.kind = DeviceKind::Evdev;
+            probe.key = dir_ + "/" + entry->d_name;
+            probe.slot = static_cast<uint32_t>(number);
+            struct stat st = {};
+            if (stat(probe.key.c_str(), &st) != 0) continue;
+            probe.key += "#" + std::to_string(st.st_ino);
+            found.push_back(std::move(probe));
+        }
+        closedir(d);
+
+        std::sort(found.begin(), found.end(), [](const DeviceProbe& a, const DeviceProbe& b) { return a.slot < b.slot; });
+        for (const DeviceProbe& probe : found) visit(context, probe);
+    }
+
+    bool EvdevDeviceSource::Describe(const DeviceProbe& probe, DeviceInfo& out) {
+        return DescribeEvdevNode(probe.key.substr(0, probe.key.rfind('#')), out);
+    }
+
+    bool DescribeEvdevNode(const std::string& path, DeviceInfo& out) {
+        const int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) return false;
+
+        const bool joystick = IsJoystickNode(fd);
+        if (joystick) {
+            out.kind = DeviceKind::Evdev;
+            out.path = path;
+
+            char name[256] = {};
+            if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name) < 0) std::strcpy(name, "Evdev Device");
+            out.name = name;
+
+            input_id id = {};
+            if (ioctl(fd, EVIOCGID, &id) >= 0) {
+                out.vendorId = id.vendor;
+                out.productId = id.product;
+            }
+            char text[256] = {};
+            out.serial = ioctl(fd, EVIOCGUNIQ(sizeof(text) - 1), text) >= 0 ? text : "";
+            std::memset(text, 0, sizeof(text));
+            out.location = ioctl(fd, EVIOCGPHYS(sizeof(text) - 1), text) >= 0 ? text : "";
+        }
+        close(fd);
+        return joystick;
+    }
+
+    std::vector<DeviceInfo> EnumerateEvdevDevices(const std::string& dir) {
+        EvdevDeviceSource source(dir);
+        BasicDeviceRegistry<EvdevDeviceSource> registry(source);
+        return registry.Devices();
+    }
+
+    namespace {
+
+        /// Cached device list of this process.
+        using DeviceRegistry = BasicDeviceRegistry<EvdevDeviceSource>;
+
+        DeviceRegistry& PlatformRegistry() {
+            static EvdevDeviceSource source("/dev/input");
+            static DeviceRegistry registry(source);
+            return registry;
+        }
+
+    } // namespace
+
+    std::vector<DeviceInfo> EnumerateDevices() {
+        return PlatformRegistry().Devices();
+    }
+
+    void NotifyDevicesChanged() {
+        PlatformRegistry().NotifyChanged();
+    }
+
+    bool ProbeDevice(DeviceInfo& device) {
+        if (device.kind != DeviceKind::Evdev || device.path.empty()) return false;
+        // After a re-plug the node number may differ; the caller then falls back to a listing.
+        DeviceInfo info;
+        if (!DescribeEvdevNode(device.path, info) || DeviceIdentity(info) != DeviceIdentity(device)) return false;
+        info.index = device.index;
+        device = info;
+        return true;
+    }
+
+    namespace {
+
+        /// Opens an event node for the multi-device reader: compact maps, current state, axis profile.
+        std::unique_ptr<EvdevBackend> OpenEvdevDevice(const DeviceInfo& d, const ReaderOptions& options) {
+            const int fd = open(d.path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if (fd < 0) {
+                std::cerr << "[" << d.index << "] open " << d.path << " failed: " << std::strerror(errno) << "\n";
+                return nullptr;
+            }
+            std::unique_ptr<EvdevBackend> b(new EvdevBackend(fd, true));
+            b->Decoder().ConfigureFromDevice(fd);
+            InputState initial;
+            b->Decoder().Resync(fd, initial);
+            b->SetAxisProfile(options.axisProfile);
+            return b;
+        }
+
+        /// Streams one device until it is gone or the reader is stopped.
+        int ReadEvdevDevice(const DeviceInfo& device, const ReaderOptions& options, bool& disconnected) {
+            std::cout << "Reading evdev device " << device.path << " (Ctrl+C to stop)...\n";
+
+            const int fd = open(device.path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if (fd < 0) {
+                std::cerr << "open " << device.path << " failed: " << std::strerror(errno) << "\n";
+                return 2;
+            }
+
+            // Power-save: no timeout at all; SIGINT interrupts epoll_wait, so Ctrl+C still stops the reader.
+            EvdevBackend backend(fd, true, options.powerSave ? -1 : 100);
+            if (!backend.IsValid()) {
+                std::cerr << "epoll setup failed.\n";
+                return 3;
+            }
+            backend.Decoder().ConfigureFromDevice(fd);
+            InputState initial;
+            backend.Decoder().Resync(fd, initial);
+            if (options.axisProfile.enabled) PrintAxisProfile(options.axisProfile, 0, backend.SetAxisProfile(options.axisProfile));
+
+            if (options.powerSave) {
+                std::cout << "Power-save mode: untimed event waits, output flushed every " << options.flushMs << " ms.\n";
+            }
+            std::cout.flush();
+            ConsoleSink sink(backend.Layout(), options.powerSave ? options.flushMs : 0);
+            const WakeupMeter meter;
+            const ReaderExit exit = RunConsoleReader(backend, sink, options);
+            sink.Flush();
+            std::cout.flush();
+            PrintWakeups(meter, sink);
+            disconnected = exit == ReaderExit::Disconnected;
+            if (disconnected) {
+                std::cout << "Device disconnected or error.\n";
+            }
+            return 0;
+        }
+
+    } // namespace
+
+    void EvdevHotplug::Adopt(std::unique_ptr<EvdevBackend> backend, const DeviceInfo& device) {
+        Device d;
+        d.tag = device.index;
+        d.info = device;
+        d.backend = std::move(backend);
+        d.present = true;
+        devices_.push_back(std::move(d));
+        if (device.index >= nextTag_) nextTag_ = device.index + 1;
+    }
+
+    void EvdevHotplug::Update() {
+        events_.clear();
+        drained_ = std::chrono::steady_clock::now();
+        watcher_.Drain(events_);
+        for (const HotplugEvent& e : events_) {
+            if (e.action == HotplugAction::Added) Added(e.path);
+            else Removed(e.path);
+        }
+    }
+
+    void EvdevHotplug::Added(const std::string& path) {
+        for (const Device& d : devices_) {
+            if (d.present && d.info.path == path) return;
+        }
+        DeviceInfo info;
+        // Not a controller, or not readable yet: udev fixes the mode next, which arrives as IN_ATTRIB.
+        if (!describe_(path, info)) return;
+
+        Device* slot = nullptr;
+        for (Device& d : devices_) {
+            if (!d.present && IsSameDevice(d.info, info)) {
+                slot = &d;
+                break;
+            }
+        }
+        if (!slot) {
+            if (!attachNew_) return;
+            devices_.emplace_back();
+            slot = &devices_.back();
+            slot->tag = nextTag_++;
+        }
+        info.index = slot->tag;
+        slot->info = info;
+
+        slot->backend = OpenEvdevDevice(info, options_);
+        if (!slot->backend) return;
+        if (!reactor_.AddEvent(*slot->backend, slot->tag, slot->backend->Fd())) {
+            std::cerr << "[" << slot->tag << "] epoll registration failed.\n";
+            slot->backend.reset();
+            return;
+        }
+        slot->present = true;
+        ++attached_;
+        if (log_) {
+            const double ms = (double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - drained_).count() / 1000.0;
+            std::fprintf(log_, "[%d] attached in %.2f ms: %s (%s)\n", slot->tag, ms, info.name.c_str(), info.path.c_str());
+        }
+    }
+
+    void EvdevHotplug::Removed(const std::string& path) {
+        for (Device& d : devices_) {
+            if (!d.present || d.info.path != path) continue;
+            // false when a failed read already closed it; the reactor no longer touches the backend either way.
+            reactor_.Detach(d.tag);
+            d.backend.reset();
+            d.present = false;
+            ++detached_;
+        }
+    }
+
+    int RunDeviceReader(const DeviceInfo& device, const ReaderOptions& options) {
+        // Watch before the first open so a quick unplug and re-plug is not missed.
+        const size_t slash = device.path.rfind('/');
+        HotplugWatcher watcher(slash == std::string::npos ? std::string(".") : device.path.substr(0, slash));
+        DeviceInfo current = device;
+        int rc;
+        for (;;) {
+            bool disconnected = false;
+            rc = ReadEvdevDevice(current, options, disconnected);
+            if (rc != 0 || !disconnected || !g_Running.load() || !watcher.IsValid()) break;
+
+            std::cout << "Waiting for it to be plugged back in (Ctrl+C to stop)...\n";
+            std::cout.flush();
+            // Only the node the notification names is described; the directory is not listed again.
+            ReconnectTiming timing;
+            const bool back = WaitForArrival(watcher, [&current](const HotplugEvent& e) {
+                DeviceInfo info;
+                if (!DescribeEvdevNode(e.path, info) || !IsSameDevice(info, current)) return false;
+                current.path = info.path;
+                return true;
+            }, g_Running, &timing);
+            if (!back) break;
+            PrintReconnectTiming(timing);
+        }
+        return rc;
+    }
+
+    int RunMultiDeviceReader(const std::vector<DeviceInfo>& devices, const ReaderOptions& options) {
+        // Backends are declared before the reactor / pool so they outlive it.
+        std::vector<std::unique_ptr<EvdevBackend>> backends;
+        std::vector<const DeviceInfo*> opened;
+        for (const DeviceInfo& d : devices) {
+            std::unique_ptr<EvdevBackend> b = OpenEvdevDevice(d, options);
+            if (!b) continue;
+            backends.push_back(std::move(b));
+            opened.push_back(&d);
+        }
+        if (backends.empty() && !options.attachNew) {
+            std::cerr << "No device could be opened.\n";
+            return 2;
+        }
+
+        TaggedConsoleSink console;
+        AsyncSink<TaggedConsoleSink> sink(console, StateLayout::Gamepad, options.ringSlots, options.overflow);
+        const WakeupMeter meter;
+        ReaderExit exit;
+        if (options.poolWorkers > 0) {
+            if (backends.empty()) {
+                std::cerr << "No device could be opened.\n";
+                return 2;
+            }
+            // The pool polls every fd at pollHz and drains the frames queued since the last tick.
+            // Its device set is fixed: unplugged devices stay gone.
+            ReaderPool pool(options.poolWorkers, options.pollHz);
+            for (size_t i = 0; i < backends.size(); ++i) pool.Add(*backends[i], opened[i]->index, true);
+            std::cout << "Reading " << pool.DeviceCount() << " evdev devices at " << options.pollHz << " Hz on "
+                << (pool.DeviceCount() < options.poolWorkers ? pool.DeviceCount() : options.poolWorkers)
+                << " workers (Ctrl+C to stop)...\n";
+            std::cout.flush();
+            exit = pool.Run(sink, g_Running);
+            sink.Close();
+            std::fflush(stdout);
+            PrintPoolStats(pool.Stats(), pool.ActiveWorkers(), meter.Seconds());
+            PrintRingStats(sink.Ring());
+        }
+        else {
+            Reactor reactor;
+            if (!reactor.IsValid()) {
+                std::cerr << "epoll setup failed.\n";
+                return 3;
+            }
+            // Attached and detached devices are owned by the hotplug handler from here on.
+            HotplugWatcher watcher;
+            EvdevHotplug hotplug(reactor, watcher, options, options.attachNew);
+            for (size_t i = 0; i < backends.size(); ++i) {
+                if (!reactor.AddEvent(*backends[i], opened[i]->index, backends[i]->Fd())) {
+                    // Not read, so not adopted either: the handler would count it attached and never retry it.
+                    std::cerr << "[" << opened[i]->index << "] epoll registration failed; device closed.\n";
+                    backends[i].reset();
+                    continue;
+                }
+                hotplug.Adopt(std::move(backends[i]), *opened[i]);
+            }
+            const bool hot = watcher.IsValid() && hotplug.Start();
+            std::cout << "Reading " << reactor.OpenCount() << " evdev devices"
+                << (hot ? (options.attachNew ? ", attaching controllers as they are plugged in" : ", re-attaching unplugged devices") : "")
+                << " (Ctrl+C to stop)...\n";
+            std::cout.flush();
+            exit = reactor.Run(sink, g_Running);
+            sink.Close();
+            std::fflush(stdout);
+            PrintReactorStats(reactor.Stats(), meter.Seconds());
+            PrintRingStats(sink.Ring());
+            if (hot) PrintHotplugStats(watcher.Stats());
+        }
+        if (exit == ReaderExit::Disconnected) std::cout << "All devices disconnected.\n";
+        return exit == ReaderExit::Failed ? 1 : 0;
+    }
+
+    int RunEvdevReplay(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            std::cerr << "Cannot open " << path << "\n";
+            return 1;
+        }
+        std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        // A socketpair rather than a file: epoll does not accept regular files, and MSG_NOSIGNAL
+        // keeps an early Ctrl+C from killing the writer with SIGPIPE.
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+            std::cerr << "socketpair failed.\n";
+            return 1;
+        }
+
+        std::thread writer([&data, fds]() {
+            size_t off = 0;
+            while (off < data.size()) {
+                const ssize_t n = send(fds[1], data.data() + off, data.size() - off, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                off += static_cast<size_t>(n);
+            }
+            close(fds[1]);
+        });
+
+        EvdevStats st;
+        {
+            EvdevBackend backend(fds[0], true);
+            ConsoleSink sink(backend.Layout());
+            RunReader(backend, sink, g_Running);
+            st = backend.Stats();
+        }
+        writer.join();
+
+        std::cout << "Replayed " << st.events << " events, " << st.frames << " frames, "
+            << st.reads << " reads, " << st.waits << " waits.\n";
+        return 0;
+    }
+
+} // namespace joystick
+
+#endif // __linux__
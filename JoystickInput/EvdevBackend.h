@@ -0,0 +1,302 @@
+﻿/**
+ * @file
+ * @brief Linux evdev backend: non-blocking reads of struct input_event batches multiplexed with epoll.
+ * @details
+ *   - Works on any readable fd carrying an input_event stream: a /dev/input/event* node, or a pipe /
+ *     socketpair fed with a recorded stream (no device or ioctl support needed in that case).
+ *   - Events accumulate into a pending frame; each SYN_REPORT commits it as one packet.
+ *   - SYN_DROPPED discards events up to the next SYN_REPORT and then re-reads key/abs state via ioctl.
+ */
+
+#pragma once
+
+#ifdef __linux__
+
+#include "AxisNormalizer.h"
+#include "DeviceRegistry.h"
+#include "Hotplug.h"
+#include "InputCore.h"
+#include "Reactor.h"
+
+#include <linux/input.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace joystick {
+
+    /**
+     * @brief Counters kept by EvdevBackend (syscalls are the ones issued on the sampling path).
+     */
+    struct EvdevStats {
+        uint64_t waits = 0;      //!< epoll_wait calls.
+        uint64_t reads = 0;      //!< read() calls, including the one that returns EAGAIN.
+        uint64_t events = 0;     //!< input_event records decoded.
+        uint64_t frames = 0;     //!< SYN_REPORT frames committed.
+        uint64_t dropped = 0;    //!< SYN_DROPPED notifications from the kernel.
+        uint64_t resyncs = 0;    //!< State re-reads after a drop.
+    };
+
+    /**
+     * @brief Maps input_event records onto the portable Joystick layout.
+     * @details
+     *   - Default mapping (usable on pipes): ABS_X..ABS_RZ -> axes 0..5, ABS_THROTTLE/ABS_RUDDER -> 6/7,
+     *     ABS_HAT0..3 -> POV 0..3, BTN_JOYSTICK..BTN_JOYSTICK+63 -> buttons 0..63,
+     *     BTN_TRIGGER_HAPPY1..40 -> buttons 64..103.
+     *   - ConfigureFromDevice() replaces the button map with a compact one (first present button is
+     *     button 0, as DirectInput numbers them), and axes with the device's present ABS codes in order.
+     */
+    class EvdevDecoder {
+    public:
+        EvdevDecoder();
+
+        /**
+         * @brief Builds compact button/axis maps from the device's capability bits.
+         * @param fd Event device fd.
+         * @return true if the fd answered EVIOCGBIT (a real event node); false leaves the default maps.
+         */
+        bool ConfigureFromDevice(int fd);
+
+        /**
+         * @brief Applies events up to and including the next frame boundary.
+         * @param events Event records.
+         * @param count Number of records.
+         * @param state Receives the committed frame on SYN_REPORT.
+         * @param stats Counters to update.
+         * @param committed Set to true if a frame was committed.
+         * @return Number of records consumed; stops right after the first committed frame so
+         *         press/release pairs inside one batch are reported as separate packets.
+         */
+        size_t Apply(const input_event* events, size_t count, InputState& state, EvdevStats& stats, bool& committed);
+
+        /**
+         * @brief Raw range of the ABS code mapped to axis @p axis (EVIOCGABS).
+         * @return false if the axis is unmapped or the fd answers no ioctl (pipes).
+         */
+        bool AxisRange(int fd, int axis, int32_t& min, int32_t& max) const;
+
+        /// True after a SYN_DROPPED once the following SYN_REPORT arrived; call Resync().
+        bool NeedsResync() const { return needResync_; }
+
+        /**
+         * @brief Re-reads key and absolute axis state from the device (EVIOCGKEY / EVIOCGABS).
+         * @param fd Event device fd; ioctl failures (pipes) leave the last known state.
+         * @param state Receives the resynchronized state as a new packet.
+         */
+        void Resync(int fd, InputState& state);
+
+    private:
+        void SetAbs(uint16_t code, int32_t value);
+        void Commit(InputState& state);
+
+        uint8_t keyMap_[KEY_CNT];   //!< Key code -> button index, 0xFF when unmapped.
+        uint8_t absMap_[ABS_CNT];   //!< Abs code -> axis index, 0xFF when unmapped (hats handled separately).
+        int32_t hatX_[kMaxPovs] = {};
+        int32_t hatY_[kMaxPovs] = {};
+        InputState pending_;
+        uint32_t packet_ = 0;
+        bool dropping_ = false;
+        bool needResync_ = false;
+    };
+
+    /**
+     * @brief Byte buffer plus decoder for one input_event stream, shared by every read engine.
+     * @details Stream fds may split records; a trailing partial record stays buffered until the next write.
+     */
+    class EvdevStream {
+    public:
+        /**
+         * @brief Compacts the buffer and returns where the next read should land.
+         * @param space Receives the free byte count.
+         * @return Write pointer; stays valid until CommitWrite().
+         */
+        uint8_t* PrepareWrite(size_t& space);
+
+        /// Marks @p n bytes at the PrepareWrite() pointer as valid.
+        void CommitWrite(size_t n) { end_ += n; }
+
+        /**
+         * @brief Decodes buffered records up to the next frame.
+         * @param fd Device fd used for ioctl resync after SYN_DROPPED.
+         * @param state Receives the frame.
+         * @param stats Counters to update.
+         * @return true if a frame (or a resynchronized state) was produced.
+         */
+        bool NextFrame(int fd, InputState& state, EvdevStats& stats);
+
+        EvdevDecoder& Decoder() { return decoder_; }
+
+    private:
+        EvdevDecoder decoder_;
+        alignas(input_event) uint8_t buf_[64 * sizeof(input_event)];
+        size_t pos_ = 0;     //!< First undecoded byte in buf_.
+        size_t end_ = 0;     //!< One past the last valid byte in buf_ (may end in a partial record).
+    };
+
+    /**
+     * @brief Event-driven evdev backend.
+     */
+    class EvdevBackend : public InputBackend<EvdevBackend> {
+    public:
+        /**
+         * @param fd Readable fd carrying input_event records; switched to non-blocking.
+         * @param ownsFd Close @p fd in the destructor.
+         * @param timeoutMs epoll timeout per Sample() call; bounds how late a cleared run flag is noticed.
+         *        -1 waits for input only (the run flag is then noticed when a signal interrupts the wait).
+         */
+        EvdevBackend(int fd, bool ownsFd, int timeoutMs = 100);
+        ~EvdevBackend();
+        EvdevBackend(const EvdevBackend&) = delete;
+        EvdevBackend& operator=(const EvdevBackend&) = delete;
+
+        /// false if the epoll set could not be created.
+        bool IsValid() const { return epoll_ >= 0; }
+
+        /**
+         * @brief Returns the next frame: decodes already-read records first, then reads without
+         *        waiting, and only calls epoll_wait when the fd is empty.
+         */
+        SampleStatus SampleImpl(InputState& state);
+
+        /// Returns the next decoded frame, reading without waiting; see InputBackend::Poll.
+        SampleStatus PollImpl(InputState& state);
+
+        StateLayout OutputLayout() const { return StateLayout::Joystick; }
+
+        /// Bounds the next epoll wait (batched output flush); -1 leaves timeoutMs in force.
+        void LimitNextWaitImpl(int timeoutMs) { waitLimitMs_ = timeoutMs; }
+
+        /// Decoder, e.g. to call ConfigureFromDevice() on a real event node.
+        EvdevDecoder& Decoder() { return stream_.Decoder(); }
+
+        /**
+         * @brief Normalizes axes in software from their EVIOCGABS ranges (evdev has no driver-side
+         *        equivalent of DIPROP_RANGE). Call after ConfigureFromDevice().
+         * @return Number of axes normalized.
+         */
+        int SetAxisProfile(const AxisProfile& profile);
+
+        const EvdevStats& Stats() const { return stats_; }
+
+        int Fd() const { return fd_; }
+
+    private:
+        /// Returns 1 if bytes were read, 0 on EAGAIN, -1 on EOF/device loss.
+        int ReadMore();
+
+        int fd_;
+        bool ownsFd_;
+        int timeoutMs_;
+        int waitLimitMs_ = -1;
+        int epoll_ = -1;
+        EvdevStream stream_;
+        EvdevStats stats_;
+        AxisNormalizer normalizer_;
+    };
+
+    /**
+     * @brief Event nodes of a directory, as a BasicDeviceRegistry source.
+     * @details Listing reads the directory and stats each eventN node; the key is the path plus the
+     *          node's inode, so a node re-created for another device is probed again. Describing
+     *          opens the node, keeps only joystick/gamepad nodes and reads the name and IDs.
+     */
+    class EvdevDeviceSource {
+    public:
+        explicit EvdevDeviceSource(std::string dir) : dir_(std::move(dir)) {}
+
+        void List(ProbeVisitor visit, void* context);
+        bool Describe(const DeviceProbe& probe, DeviceInfo& out);
+
+    private:
+        std::string dir_;
+    };
+
+    /**
+     * @brief Describes one event node: true for joystick/gamepad nodes, with the name and IDs filled in.
+     * @details Fails for nodes that cannot be opened yet (udev sets their permissions after creating them).
+     */
+    bool DescribeEvdevNode(const std::string& path, DeviceInfo& out);
+
+    /**
+     * @brief Attaches and detaches the event nodes of a running reactor as a HotplugWatcher reports them.
+     * @details
+     *   - An added node is described on its own, without rescanning the directory. It is attached when
+     *     it brings back a device that went away (IsSameDevice(); it keeps its tag), or, with
+     *     attachNew, when it is any other controller (next free tag).
+     *   - A removed node detaches its source; the sink prints it as disconnected.
+     *   - Repeated arrivals of an attached node (IN_CREATE, then IN_ATTRIB) are ignored.
+     */
+    class EvdevHotplug {
+    public:
+        /// Describes one node; DescribeEvdevNode() for real devices.
+        using DescribeFn = bool (*)(const std::string& path, DeviceInfo& out);
+
+        /**
+         * @param attachNew Also attach controllers that were not selected (`--all`).
+         * @param log Receives "[tag] attached in X ms: ..." lines (from the notification); nullptr for none.
+         */
+        EvdevHotplug(Reactor& reactor, HotplugWatcher& watcher, const ReaderOptions& options, bool attachNew,
+            DescribeFn describe = &DescribeEvdevNode, std::FILE* log = stdout)
+            : reactor_(reactor), watcher_(watcher), options_(options), describe_(describe), log_(log), attachNew_(attachNew) {}
+
+        /// Takes over a device the reactor already reads; its tag is device.index.
+        void Adopt(std::unique_ptr<EvdevBackend> backend, const DeviceInfo& device);
+
+        /// Registers the watcher with the reactor; false if the wait set refused it.
+        bool Start() { return reactor_.AddWatch(watcher_.Handle(), &OnReady, this); }
+
+        /// Drains the watcher and applies its notifications (the reactor watch callback).
+        void Update();
+
+        uint64_t Attached() const { return attached_; }
+        uint64_t Detached() const { return detached_; }
+
+    private:
+        struct Device {
+            int tag = 0;
+            DeviceInfo info;
+            std::unique_ptr<EvdevBackend> backend;
+            bool present = false;
+        };
+
+        static void OnReady(void* context) { static_cast<EvdevHotplug*>(context)->Update(); }
+        void Added(const std::string& path);
+        void Removed(const std::string& path);
+
+        Reactor& reactor_;
+        HotplugWatcher& watcher_;
+        ReaderOptions options_;
+        DescribeFn describe_;
+        std::FILE* log_;
+        bool attachNew_;
+        int nextTag_ = 0;
+        std::vector<Device> devices_;
+        std::vector<HotplugEvent> events_;
+        std::chrono::steady_clock::time_point drained_;  //!< When Update() drained the current notifications.
+        uint64_t attached_ = 0;
+        uint64_t detached_ = 0;
+    };
+
+    /**
+     * @brief Enumerates joystick/gamepad event nodes under a directory (uncached).
+     * @param dir Directory to scan (normally /dev/input).
+     * @return Devices sorted by event number.
+     */
+    std::vector<DeviceInfo> EnumerateEvdevDevices(const std::string& dir);
+
+    /**
+     * @brief Streams a recorded input_event file through a socketpair into EvdevBackend (`--replay`).
+     * @param path Capture file (raw input_event records, e.g. from `cat /dev/input/eventN > file`).
+     * @return Process exit code.
+     */
+    int RunEvdevReplay(const std::string& path);
+
+} // namespace joystick
+
+#endif // __linux__
@@ -0,0 +1,479 @@
+﻿/**
+ * @file
+ * @brief HID report descriptor compiler and plan-driven report decoder.
+ */
+
+#include "HidDescriptor.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace joystick {
+
+    namespace {
+
+        // Item tags (HID 1.11, 6.2.2), keyed by (tag << 2 | type) with the size bits masked off.
+        enum : uint8_t {
+            kItemInput = 0x80,
+            kItemOutput = 0x90,
+            kItemFeature = 0xB0,
+            kItemCollection = 0xA0,
+            kItemEndCollection = 0xC0,
+            kItemUsagePage = 0x04,
+            kItemLogicalMin = 0x14,
+            kItemLogicalMax = 0x24,
+            kItemReportSize = 0x74,
+            kItemReportId = 0x84,
+            kItemReportCount = 0x94,
+            kItemPush = 0xA4,
+            kItemPop = 0xB4,
+            kItemUsage = 0x08,
+            kItemUsageMin = 0x18,
+            kItemUsageMax = 0x28,
+            kItemLong = 0xFC
+        };
+
+        // Main item data bits.
+        constexpr uint32_t kMainConstant = 0x01;
+        constexpr uint32_t kMainVariable = 0x02;
+
+        constexpr uint16_t kPageGenericDesktop = 0x01;
+        constexpr uint16_t kPageSimulation = 0x02;
+        constexpr uint16_t kPageButton = 0x09;
+
+        constexpr uint32_t kMaxReportBits = 8 * 4096;
+
+        struct GlobalState {
+            uint16_t usagePage = 0;
+            int32_t logicalMin = 0;
+            int32_t logicalMax = 0;
+            uint32_t reportSize = 0;
+            uint32_t reportCount = 0;
+            uint8_t reportId = 0;
+        };
+
+        struct LocalState {
+            std::vector<uint32_t> usages;   //!< Page in the high 16 bits when given as an extended usage.
+            uint32_t usageMin = 0;
+            uint32_t usageMax = 0;
+            bool hasMin = false;
+            bool hasMax = false;
+
+            void Clear() {
+                usages.clear();
+                usageMin = usageMax = 0;
+                hasMin = hasMax = false;
+            }
+        };
+
+        /// Report under construction.
+        struct PendingReport {
+            uint8_t reportId = 0;
+            uint32_t bits = 0;
+            std::vector<HidOp> ops;
+        };
+
+        uint32_t ItemData(const uint8_t* p, size_t size) {
+            uint32_t v = 0;
+            for (size_t i = 0; i < size; ++i) v |= static_cast<uint32_t>(p[i]) << (8 * i);
+            return v;
+        }
+
+        int32_t SignExtend(uint32_t v, size_t bytes) {
+            if (bytes == 0 || bytes >= 4) return static_cast<int32_t>(v);
+            const uint32_t bits = static_cast<uint32_t>(bytes * 8);
+            const uint32_t sign = 1u << (bits - 1);
+            return static_cast<int32_t>((v ^ sign) - sign);
+        }
+
+        /// Usage of field @p i of a main item, resolved against the current usage page.
+        uint32_t FieldUsage(const LocalState& local, uint16_t page, uint32_t i) {
+            uint32_t u = 0;
+            if (!local.usages.empty()) {
+                u = local.usages[i < local.usages.size() ? i : local.usages.size() - 1];
+            }
+            else if (local.hasMin) {
+                u = local.usageMin + i;
+                if (local.hasMax && u > local.usageMax) u = local.usageMax;
+            }
+            return (u >> 16) ? u : (static_cast<uint32_t>(page) << 16) | u;
+        }
+
+        /// Appends an op for one variable field, merging adjacent buttons into a run.
+        void AddVariableField(PendingReport& report, HidSlotAllocator& slots, const GlobalState& g, uint32_t usage, uint32_t bitOffset) {
+            const uint16_t page = static_cast<uint16_t>(usage >> 16);
+            const uint16_t id = static_cast<uint16_t>(usage & 0xFFFF);
+
+            HidOp op;
+            op.bitOffset = bitOffset;
+            op.bitSize = static_cast<uint8_t>(g.reportSize);
+            op.usagePage = page;
+            op.usage = id;
+            op.logicalMin = g.logicalMin;
+            op.logicalMax = g.logicalMax;
+            op.isSigned = g.logicalMin < 0;
+
+            if (page == kPageButton && id >= 1 && id <= kMaxButtons) {
+                if (g.reportSize != 1) return; // multi-bit "buttons" (pressure) are not representable
+                op.kind = HidOpKind::ButtonRun;
+                op.target = static_cast<uint8_t>(id - 1);
+                if (!report.ops.empty()) {
+                    HidOp& last = report.ops.back();
+                    if (last.kind == HidOpKind::ButtonRun && last.count < 255 &&
+                        last.bitOffset + last.count == bitOffset && last.target + last.count == op.target) {
+                        ++last.count;
+                        return;
+                    }
+                }
+                report.ops.push_back(op);
+                return;
+            }
+
+            if (MapHidValue(slots, page, id, g.logicalMin, g.logicalMax, op)) report.ops.push_back(op);
+        }
+
+        /// Appends an op for a button array (selector slots holding usage indices).
+        void AddButtonArray(PendingReport& report, const GlobalState& g, const LocalState& local, uint32_t bitOffset) {
+            uint32_t first = local.hasMin ? local.usageMin : (local.usages.empty() ? 0 : local.usages.front());
+            uint32_t last = local.hasMax ? local.usageMax : (local.usages.empty() ? 0 : local.usages.back());
+            const uint16_t page = (first >> 16) ? static_cast<uint16_t>(first >> 16) : g.usagePage;
+            first &= 0xFFFF;
+            last &= 0xFFFF;
+            if (page != kPageButton || first == 0 || last < first || first > kMaxButtons) return;
+            if (last > kMaxButtons) last = kMaxButtons;
+
+            HidOp op;
+            op.kind = HidOpKind::ButtonArray;
+            op.bitOffset = bitOffset;
+            op.bitSize = static_cast<uint8_t>(g.reportSize);
+            op.target = static_cast<uint8_t>(first - 1);
+            op.count = static_cast<uint8_t>(g.reportCount > 255 ? 255 : g.reportCount);
+            op.span = static_cast<uint8_t>(last - first + 1);
+            op.usagePage = page;
+            op.usage = static_cast<uint16_t>(first);
+            op.logicalMin = g.logicalMin;
+            op.logicalMax = g.logicalMax;
+            report.ops.push_back(op);
+        }
+
+        bool Fail(std::string* error, const char* what) {
+            if (error) *error = what;
+            return false;
+        }
+
+        /**
+         * @brief Reads up to 32 bits at an arbitrary bit offset (little-endian, as HID reports are).
+         * @details The caller has checked that the report covers the field, so only the 8-byte
+         *          fast load needs a bounds test.
+         */
+        inline uint32_t ExtractBits(const uint8_t* data, size_t len, uint32_t bitOffset, uint32_t bitSize) {
+            const size_t byte = bitOffset >> 3;
+            uint64_t word = 0;
+            if (byte + sizeof(word) <= len) {
+                std::memcpy(&word, data + byte, sizeof(word));
+            }
+            else {
+                for (size_t i = 0; byte + i < len && i < sizeof(word); ++i) word |= static_cast<uint64_t>(data[byte + i]) << (8 * i);
+            }
+            word >>= (bitOffset & 7);
+            return static_cast<uint32_t>(word & ((uint64_t(1) << bitSize) - 1));
+        }
+
+        inline int32_t RawValue(const HidOp& op, uint32_t bits) {
+            if (!op.isSigned || op.bitSize >= 32) return static_cast<int32_t>(bits);
+            const uint32_t sign = 1u << (op.bitSize - 1);
+            return static_cast<int32_t>((bits ^ sign) - sign);
+        }
+
+        /// Writes @p count button bits (count <= 32) starting at button @p first.
+        inline void WriteButtonBits(InputState& state, uint32_t first, uint32_t bits, uint32_t count) {
+            const uint32_t word = first >> 6;
+            const uint32_t shift = first & 63;
+            const uint64_t mask = (count == 64 ? ~uint64_t(0) : ((uint64_t(1) << count) - 1));
+            state.buttons[word] = (state.buttons[word] & ~(mask << shift)) | (static_cast<uint64_t>(bits) << shift);
+            if (shift + count > 64 && word + 1 < kMaxButtons / 64) {
+                const uint32_t spill = 64 - shift;
+                state.buttons[word + 1] = (state.buttons[word + 1] & ~(mask >> spill)) | (static_cast<uint64_t>(bits) >> spill);
+            }
+        }
+
+        const char* OpKindName(HidOpKind kind) {
+            switch (kind) {
+            case HidOpKind::Axis: return "axis";
+            case HidOpKind::Hat: return "hat";
+            case HidOpKind::ButtonRun: return "buttons";
+            case HidOpKind::ButtonArray: return "btn-array";
+            }
+            return "?";
+        }
+
+        bool ReadFile(const std::string& path, std::vector<uint8_t>& out) {
+            std::ifstream in(path, std::ios::binary);
+            if (!in) return false;
+            out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            return true;
+        }
+
+    } // namespace
+
+    int HidSlotAllocator::Axis(uint16_t page, uint16_t usage) {
+        int slot = -1;
+        if (page == kPageGenericDesktop && usage >= 0x30 && usage <= 0x35) {
+            slot = usage - 0x30;
+        }
+        else if ((page == kPageGenericDesktop && usage >= 0x36 && usage <= 0x38) ||
+            (page == kPageSimulation && (usage == 0xBA || usage == 0xBB || usage == 0xC4 || usage == 0xC5))) {
+            slot = !axes[6] ? 6 : 7;
+        }
+        if (slot < 0 || axes[slot]) return -1;
+        axes[slot] = true;
+        return slot;
+    }
+
+    bool MapHidValue(HidSlotAllocator& slots, uint16_t page, uint16_t usage, int32_t logicalMin, int32_t logicalMax, HidOp& op) {
+        op.usagePage = page;
+        op.usage = usage;
+        op.logicalMin = logicalMin;
+        op.logicalMax = logicalMax;
+
+        if (page == kPageGenericDesktop && usage == 0x39) {
+            if (logicalMax < logicalMin) return false;
+            const int pov = slots.Pov();
+            if (pov < 0) return false;
+            op.kind = HidOpKind::Hat;
+            op.target = static_cast<uint8_t>(pov);
+            op.hatStep = 36000u / static_cast<uint32_t>(logicalMax - logicalMin + 1);
+            return true;
+        }
+
+        if (logicalMax <= logicalMin) return false;
+        const int axis = slots.Axis(page, usage);
+        if (axis < 0) return false;
+        op.kind = HidOpKind::Axis;
+        op.target = static_cast<uint8_t>(axis);
+        // Rounded up so the logical maximum lands exactly on 65535 (the decoder clamps the overshoot
+        // that wide ranges can produce).
+        const int64_t range = int64_t(logicalMax) - logicalMin;
+        op.scale = ((int64_t(65535) << 16) + range - 1) / range;
+        return true;
+    }
+
+    HidDecodePlan::HidDecodePlan() {
+        std::memset(reportIndex, 0xFF, sizeof(reportIndex));
+    }
+
+    bool CompileHidDescriptor(const uint8_t* desc, size_t len, HidDecodePlan& plan, std::string* error) {
+        plan = HidDecodePlan();
+
+        GlobalState g;
+        std::vector<GlobalState> stack;
+        LocalState local;
+        HidSlotAllocator slots;
+        std::vector<PendingReport> pending;
+        int depth = 0;
+
+        auto reportFor = [&pending](uint8_t id) -> PendingReport& {
+            for (auto& r : pending) {
+                if (r.reportId == id) return r;
+            }
+            pending.push_back(PendingReport());
+            pending.back().reportId = id;
+            pending.back().bits = id ? 8 : 0;
+            return pending.back();
+        };
+
+        size_t pos = 0;
+        while (pos < len) {
+            const uint8_t prefix = desc[pos];
+            if ((prefix & 0xFC) == kItemLong) {
+                if (prefix != 0xFE || pos + 1 >= len) return Fail(error, "truncated long item");
+                pos += 3 + desc[pos + 1];
+                continue;
+            }
+            const size_t size = (prefix & 3) == 3 ? 4 : (prefix & 3);
+            if (pos + 1 + size > len) return Fail(error, "truncated item");
+            const uint32_t data = ItemData(desc + pos + 1, size);
+            pos += 1 + size;
+
+            switch (prefix & 0xFC) {
+            case kItemUsagePage: g.usagePage = static_cast<uint16_t>(data); break;
+            case kItemLogicalMin: g.logicalMin = SignExtend(data, size); break;
+            case kItemLogicalMax:
+                g.logicalMax = SignExtend(data, size);
+                // Common descriptor bug: an unsigned maximum encoded with its top bit set.
+                if (g.logicalMin >= 0 && g.logicalMax < 0) g.logicalMax = static_cast<int32_t>(data);
+                break;
+            case kItemReportSize: g.reportSize = data; break;
+            case kItemReportCount: g.reportCount = data; break;
+            case kItemReportId:
+                if (data == 0 || data > 255) return Fail(error, "invalid report ID");
+                g.reportId = static_cast<uint8_t>(data);
+                plan.usesReportIds = true;
+                break;
+            case kItemPush: stack.push_back(g); break;
+            case kItemPop:
+                if (stack.empty()) return Fail(error, "Pop without Push");
+                g = stack.back();
+                stack.pop_back();
+                break;
+            case kItemUsage: local.usages.push_back(size == 4 ? data : data & 0xFFFF); break;
+            case kItemUsageMin: local.usageMin = data; local.hasMin = true; break;
+            case kItemUsageMax: local.usageMax = data; local.hasMax = true; break;
+            case kItemCollection: ++depth; local.Clear(); break;
+            case kItemEndCollection:
+                if (--depth < 0) return Fail(error, "unbalanced End Collection");
+                local.Clear();
+                break;
+            case kItemInput: {
+                if (g.reportSize == 0 || g.reportSize > 32) return Fail(error, "unsupported report size");
+                if (plan.usesReportIds && g.reportId == 0) return Fail(error, "input item before the first report ID");
+                // Checked before any per-field loop: the count comes from untrusted descriptor bytes.
+                if (g.reportCount > kMaxReportBits) return Fail(error, "report count too large");
+                PendingReport& report = reportFor(g.reportId);
+                const uint64_t bits = uint64_t(g.reportSize) * g.reportCount;
+                if (report.bits + bits > kMaxReportBits) return Fail(error, "report too large");
+                if (!(data & kMainConstant)) {
+                    if (data & kMainVariable) {
+                        for (uint32_t i = 0; i < g.reportCount; ++i) {
+                            AddVariableField(report, slots, g, FieldUsage(local, g.usagePage, i), report.bits + i * g.reportSize);
+                        }
+                    }
+                    else {
+                        AddButtonArray(report, g, local, report.bits);
+                    }
+                }
+                report.bits += static_cast<uint32_t>(bits);
+                local.Clear();
+                break;
+            }
+            case kItemOutput:
+            case kItemFeature:
+                local.Clear();
+                break;
+            default:
+                break; // physical range, units, designators, strings, delimiters: not needed to decode
+            }
+        }
+
+        if (depth != 0) return Fail(error, "unbalanced collections");
+
+        for (auto& r : pending) {
+            if (r.ops.empty()) continue;
+            if (plan.reports.size() >= 255) return Fail(error, "too many reports");
+            HidReportPlan rp;
+            rp.reportId = r.reportId;
+            rp.sizeBytes = (r.bits + 7) / 8;
+            rp.firstOp = static_cast<uint32_t>(plan.ops.size());
+            rp.opCount = static_cast<uint32_t>(r.ops.size());
+            plan.ops.insert(plan.ops.end(), r.ops.begin(), r.ops.end());
+            plan.reportIndex[r.reportId] = static_cast<uint8_t>(plan.reports.size());
+            plan.reports.push_back(rp);
+        }
+        if (plan.reports.empty()) return Fail(error, "no mappable input fields");
+        return true;
+    }
+
+    bool DecodeHidReport(const HidDecodePlan& plan, const uint8_t* report, size_t len, InputState& state) {
+        const HidReportPlan* rp = plan.Find(report, len);
+        if (!rp || len < rp->sizeBytes) return false;
+
+        const HidOp* op = plan.ops.data() + rp->firstOp;
+        const HidOp* end = op + rp->opCount;
+        for (; op != end; ++op) {
+            switch (op->kind) {
+            case HidOpKind::Axis:
+            case HidOpKind::Hat:
+                ApplyHidValue(*op, RawValue(*op, ExtractBits(report, len, op->bitOffset, op->bitSize)), state);
+                break;
+            case HidOpKind::ButtonRun: {
+                for (uint32_t done = 0; done < op->count; done += 32) {
+                    const uint32_t n = op->count - done < 32 ? op->count - done : 32;
+                    WriteButtonBits(state, op->target + done, ExtractBits(report, len, op->bitOffset + done, n), n);
+                }
+                break;
+            }
+            case HidOpKind::ButtonArray: {
+                for (uint32_t b = 0; b < op->span; ++b) SetButton(state, op->target + b, false);
+                for (uint32_t s = 0; s < op->count; ++s) {
+                    const int32_t v = RawValue(*op, ExtractBits(report, len, op->bitOffset + s * op->bitSize, op->bitSize));
+                    const int32_t index = v - op->logicalMin;
+                    if (v >= op->logicalMin && v <= op->logicalMax && index < op->span) SetButton(state, op->target + index, true);
+                }
+                break;
+            }
+            }
+        }
+        ++state.packet;
+        return true;
+    }
+
+    void PrintHidPlan(const HidDecodePlan& plan) {
+        for (const auto& rp : plan.reports) {
+            std::printf("report id=%u size=%u bytes ops=%u\n", rp.reportId, rp.sizeBytes, rp.opCount);
+            for (uint32_t i = 0; i < rp.opCount; ++i) {
+                const HidOp& op = plan.ops[rp.firstOp + i];
+                std::printf("  %-9s -> %-3u bit=%-5u size=%-2u count=%-3u usage=%02X:%02X logical=%d..%d\n",
+                    OpKindName(op.kind), op.target, op.bitOffset, op.bitSize, op.count,
+                    op.usagePage, op.usage, op.logicalMin, op.logicalMax);
+            }
+        }
+    }
+
+    int RunHidDecode(const std::string& descriptorPath, const std::string& reportsPath) {
+        std::vector<uint8_t> desc;
+        if (!ReadFile(descriptorPath, desc)) {
+            std::cerr << "Cannot open " << descriptorPath << "\n";
+            return 1;
+        }
+        HidDecodePlan plan;
+        std::string error;
+        if (!CompileHidDescriptor(desc.data(), desc.size(), plan, &error)) {
+            std::cerr << "Descriptor rejected: " << error << "\n";
+            return 1;
+        }
+        PrintHidPlan(plan);
+        if (reportsPath.empty()) return 0;
+
+        std::vector<uint8_t> data;
+        if (!ReadFile(reportsPath, data)) {
+            std::cerr << "Cannot open " << reportsPath << "\n";
+            return 1;
+        }
+
+        // Pass 1: decode everything for timing. Pass 2: print the distinct states.
+        uint64_t reports = 0;
+        InputState state;
+        const auto t0 = std::chrono::steady_clock::now();
+        for (size_t pos = 0; pos < data.size();) {
+            const HidReportPlan* rp = plan.Find(data.data() + pos, data.size() - pos);
+            if (!rp || !DecodeHidReport(plan, data.data() + pos, data.size() - pos, state)) break;
+            pos += rp->sizeBytes;
+            ++reports;
+        }
+        const double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+
+        InputState prev, cur;
+        ConsoleSink sink(StateLayout::Joystick);
+        bool emittedAny = false;
+        size_t pos = 0;
+        while (pos < data.size()) {
+            const HidReportPlan* rp = plan.Find(data.data() + pos, data.size() - pos);
+            if (!rp || !DecodeHidReport(plan, data.data() + pos, data.size() - pos, cur)) break;
+            pos += rp->sizeBytes;
+            if (!emittedAny || DiffStates(prev, cur) != kChangedNone) {
+                sink(cur);
+                prev = cur;
+                emittedAny = true;
+            }
+        }
+        std::printf("decoded %llu reports (%.1f ns/report)", (unsigned long long)reports, reports ? ns / (double)reports : 0.0);
+        if (pos < data.size()) std::printf(", stopped at byte %zu (unknown report ID or truncated report)", pos);
+        std::printf("\n");
+        return pos < data.size() ? 1 : 0;
+    }
+
+} // namespace joystick
@@ -0,0 +1,165 @@
+﻿/**
+ * @file
+ * @brief HID report descriptor compiler and plan-driven report decoder (portable).
+ * @details
+ *   - CompileHidDescriptor() walks a report descriptor once and produces a flat HidDecodePlan:
+ *     per input report a contiguous list of ops (bit offset, bit size, logical range, usage, target slot).
+ *   - DecodeHidReport() runs the plan over a raw report (hidraw read, Raw Input RAWHID payload, capture
+ *     file) into the portable Joystick layout; nothing from the descriptor is re-parsed per report.
+ *   - Usage mapping follows DIJOYSTATE2: GD X/Y/Z/Rx/Ry/Rz -> axes 0..5; Slider/Dial/Wheel and
+ *     Simulation Throttle/Rudder/Accelerator/Brake -> axes 6/7 (first free); Hat switch -> POV 0..3;
+ *     Button page usage N -> button N-1. Axes are scaled to the DirectInput default range 0..65535.
+ *   - MapHidValue() and ApplyHidValue() expose the same mapping and scaling for fields that are read
+ *     by other means (Raw Input devices decoded through HidP_GetUsageValue).
+ */
+
+#pragma once
+
+#include "InputCore.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace joystick {
+
+    /**
+     * @brief What one plan op writes.
+     */
+    enum class HidOpKind : uint8_t {
+        Axis,        //!< One value scaled to 0..65535 into axes[target].
+        Hat,         //!< One value converted to hundredths of a degree into povs[target].
+        ButtonRun,   //!< count consecutive 1-bit buttons starting at buttons[target] (merged at compile time).
+        ButtonArray  //!< count array slots of usage indices selecting buttons in [target, target + span).
+    };
+
+    /**
+     * @brief One precompiled decode step.
+     */
+    struct HidOp {
+        uint32_t bitOffset = 0;     //!< Bit position in the report, report ID byte included.
+        uint8_t bitSize = 0;        //!< Bits per value (1..32).
+        HidOpKind kind = HidOpKind::Axis;
+        uint8_t target = 0;         //!< First axis / POV / button slot written.
+        uint8_t count = 1;          //!< Buttons in a run, or slots in an array.
+        uint8_t span = 0;           //!< ButtonArray: number of buttons the slots can select.
+        bool isSigned = false;      //!< Sign-extend raw values (logical minimum < 0).
+        uint16_t usagePage = 0;     //!< Usage page of the (first) usage.
+        uint16_t usage = 0;         //!< Usage ID of the (first) usage.
+        int32_t logicalMin = 0;
+        int32_t logicalMax = 0;
+        int64_t scale = 0;          //!< Axis: 16.16 fixed-point factor mapping the logical range onto 0..65535.
+        uint32_t hatStep = 0;       //!< Hat: hundredths of a degree per logical step.
+    };
+
+    /**
+     * @brief Ops of one input report.
+     */
+    struct HidReportPlan {
+        uint8_t reportId = 0;       //!< 0 when the descriptor declares no report IDs.
+        uint32_t sizeBytes = 0;     //!< Report length in bytes, report ID byte included.
+        uint32_t firstOp = 0;       //!< Index into HidDecodePlan::ops.
+        uint32_t opCount = 0;
+    };
+
+    /**
+     * @brief Compiled form of a report descriptor.
+     */
+    struct HidDecodePlan {
+        std::vector<HidOp> ops;             //!< All ops, grouped by report.
+        std::vector<HidReportPlan> reports; //!< Input reports that carry at least one field.
+        bool usesReportIds = false;         //!< First report byte is the report ID.
+        uint8_t reportIndex[256];           //!< Report ID -> index into reports, 0xFF if unknown.
+
+        HidDecodePlan();
+
+        /// Plan of the report a raw buffer belongs to, or nullptr.
+        const HidReportPlan* Find(const uint8_t* report, size_t len) const {
+            if (len == 0 || reports.empty()) return nullptr;
+            const uint8_t idx = reportIndex[usesReportIds ? report[0] : 0];
+            return idx == 0xFF ? nullptr : &reports[idx];
+        }
+    };
+
+    /**
+     * @brief Tracks which axis and POV slots are taken while fields are mapped.
+     */
+    struct HidSlotAllocator {
+        bool axes[kMaxAxes] = {};
+        int povs = 0;
+
+        /// Axis slot for a usage, or -1 when the usage is not an axis or its slot is taken.
+        int Axis(uint16_t page, uint16_t usage);
+
+        /// Next free POV slot, or -1.
+        int Pov() { return povs < kMaxPovs ? povs++ : -1; }
+    };
+
+    /**
+     * @brief Maps one value field (axis or hat switch) onto a Joystick slot.
+     * @param slots Slots taken so far; the chosen slot is marked.
+     * @param page Usage page.
+     * @param usage Usage ID.
+     * @param logicalMin Logical minimum of the field.
+     * @param logicalMax Logical maximum of the field.
+     * @param op Receives kind, target, usage, logical range, scale or hatStep; the bit position is left to the caller.
+     * @return false if the usage has no slot (or none is free) or the range is empty.
+     */
+    bool MapHidValue(HidSlotAllocator& slots, uint16_t page, uint16_t usage, int32_t logicalMin, int32_t logicalMax, HidOp& op);
+
+    /**
+     * @brief Writes one logical value of an Axis or Hat op into @p state.
+     * @details Axes are clamped to the logical range and scaled onto 0..65535; hat values outside
+     *          the range are the null state (centered).
+     */
+    inline void ApplyHidValue(const HidOp& op, int32_t value, InputState& state) {
+        if (op.kind == HidOpKind::Axis) {
+            if (value < op.logicalMin) value = op.logicalMin;
+            else if (value > op.logicalMax) value = op.logicalMax;
+            const int64_t scaled = ((int64_t(value) - op.logicalMin) * op.scale) >> 16;
+            state.axes[op.target] = scaled > 65535 ? 65535 : static_cast<int32_t>(scaled);
+        }
+        else if (op.kind == HidOpKind::Hat) {
+            state.povs[op.target] = (value < op.logicalMin || value > op.logicalMax)
+                ? kPovCentered
+                : static_cast<uint32_t>(value - op.logicalMin) * op.hatStep;
+        }
+    }
+
+    /**
+     * @brief Compiles a HID report descriptor into a decode plan.
+     * @param desc Descriptor bytes (e.g. /sys/class/hidraw/hidrawN/device/report_descriptor,
+     *             or RIDI_PREPARSEDDATA's source descriptor).
+     * @param len Descriptor length.
+     * @param plan Receives the plan.
+     * @param error Receives a description when compilation fails (optional).
+     * @return true on success; false for malformed descriptors or ones without usable input fields.
+     */
+    bool CompileHidDescriptor(const uint8_t* desc, size_t len, HidDecodePlan& plan, std::string* error = nullptr);
+
+    /**
+     * @brief Decodes one raw input report with a compiled plan.
+     * @param plan Plan from CompileHidDescriptor().
+     * @param report Report bytes, report ID first when the plan uses IDs.
+     * @param len Report length; must be at least the planned size.
+     * @param state Updated in place (fields of other reports are kept); the packet number is incremented.
+     * @return false if the report ID is unknown or the report is too short.
+     */
+    bool DecodeHidReport(const HidDecodePlan& plan, const uint8_t* report, size_t len, InputState& state);
+
+    /**
+     * @brief Prints the plan, one line per op (for `--hid` and debugging).
+     */
+    void PrintHidPlan(const HidDecodePlan& plan);
+
+    /**
+     * @brief Decodes a capture file with a descriptor file and prints the resulting states (`--hid`).
+     * @param descriptorPath Binary report descriptor.
+     * @param reportsPath Concatenated raw reports (e.g. `cat /dev/hidrawN > file`); empty prints the plan only.
+     * @return Process exit code.
+     * @details Report boundaries are recovered from the plan: the report ID (if any) selects the size.
+     */
+    int RunHidDecode(const std::string& descriptorPath, const std::string& reportsPath);
+
+} // namespace joystick
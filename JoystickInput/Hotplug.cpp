@@ -0,0 +1,234 @@
+﻿/**
+ * @file
+ * @brief Hotplug watchers: inotify (Linux) and a WM_DEVICECHANGE pump thread (Windows).
+ */
+
+#include "Hotplug.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include "WindowsBackends.h"
+
+#include <dbt.h>
+#include <future>
+#elif defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <chrono>
+#endif
+
+namespace joystick {
+
+#ifdef _WIN32
+    /**
+     * @brief Message-only window of the watcher thread.
+     */
+    struct HotplugWindow {
+        static constexpr const wchar_t* kClassName = L"JoystickInputHotplugWnd";
+
+        static LRESULT CALLBACK Proc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+            switch (msg) {
+            case WM_DEVICECHANGE: {
+                auto* self = reinterpret_cast<HotplugWatcher*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+                const auto* hdr = reinterpret_cast<const DEV_BROADCAST_HDR*>(lParam);
+                if (self) {
+                    if ((wParam == DBT_DEVICEARRIVAL || wParam == DBT_DEVICEREMOVECOMPLETE) && hdr &&
+                        hdr->dbch_devicetype == DBT_DEVTYP_DEVICEINTERFACE) {
+                        const auto* iface = reinterpret_cast<const DEV_BROADCAST_DEVICEINTERFACE_W*>(hdr);
+                        Push(*self, wParam == DBT_DEVICEARRIVAL ? HotplugAction::Added : HotplugAction::Removed,
+                            WToUtf8(iface->dbcc_name));
+                    }
+                    else {
+                        std::lock_guard<std::mutex> lock(self->lock_);
+                        ++self->stats_.ignored;
+                    }
+                }
+                NotifyDevicesChanged();
+                return TRUE;
+            }
+            case WM_CLOSE:
+                DestroyWindow(hwnd);
+                return 0;
+            case WM_DESTROY:
+                PostQuitMessage(0);
+                return 0;
+            }
+            return DefWindowProcW(hwnd, msg, wParam, lParam);
+        }
+
+        static void Push(HotplugWatcher& self, HotplugAction action, std::string path) {
+            std::lock_guard<std::mutex> lock(self.lock_);
+            ++(action == HotplugAction::Added ? self.stats_.added : self.stats_.removed);
+            HotplugEvent e;
+            e.action = action;
+            e.path = std::move(path);
+            self.pending_.push_back(std::move(e));
+            SetEvent(reinterpret_cast<HANDLE>(self.handle_));
+        }
+
+        /// Watcher thread: creates the window, registers for interface notifications and pumps until WM_CLOSE.
+        static void Pump(HotplugWatcher* self, std::promise<bool>* ready) {
+            WNDCLASSW wc = {};
+            wc.lpfnWndProc = &Proc;
+            wc.hInstance = GetModuleHandleW(nullptr);
+            wc.lpszClassName = kClassName;
+            RegisterClassW(&wc); // fails harmlessly when a previous watcher registered it
+
+            HWND hwnd = CreateWindowExW(0, kClassName, L"", 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr, wc.hInstance, nullptr);
+            HDEVNOTIFY notify = nullptr;
+            if (hwnd) {
+                SetWindowLongPtrW(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(self));
+                // All interface classes: XInput pads do not always expose a HID interface.
+                DEV_BROADCAST_DEVICEINTERFACE_W filter = {};
+                filter.dbcc_size = sizeof(filter);
+                filter.dbcc_devicetype = DBT_DEVTYP_DEVICEINTERFACE;
+                notify = RegisterDeviceNotificationW(hwnd, &filter, DEVICE_NOTIFY_WINDOW_HANDLE | DEVICE_NOTIFY_ALL_INTERFACE_CLASSES);
+                if (!notify) DestroyWindow(hwnd);
+            }
+            self->window_ = notify ? hwnd : nullptr;
+            ready->set_value(notify != nullptr);
+            if (!notify) return;
+
+            MSG msg;
+            while (GetMessageW(&msg, nullptr, 0, 0) > 0) {
+                TranslateMessage(&msg);
+                DispatchMessageW(&msg);
+            }
+            UnregisterDeviceNotification(notify);
+        }
+    };
+
+    HotplugWatcher::HotplugWatcher(const std::string& dir) : dir_(dir) {
+        HANDLE event = CreateEventW(nullptr, TRUE, FALSE, nullptr); // manual reset: signaled while pending_ is not empty
+        if (!event) return;
+        handle_ = reinterpret_cast<intptr_t>(event);
+
+        std::promise<bool> ready;
+        std::future<bool> started = ready.get_future();
+        pump_ = std::thread(&HotplugWindow::Pump, this, &ready);
+        if (!started.get()) pump_.join();
+    }
+
+    HotplugWatcher::~HotplugWatcher() {
+        if (window_) PostMessageW(static_cast<HWND>(window_), WM_CLOSE, 0, 0);
+        if (pump_.joinable()) pump_.join();
+        if (handle_ != -1) CloseHandle(reinterpret_cast<HANDLE>(handle_));
+    }
+
+    bool HotplugWatcher::IsValid() const {
+        return handle_ != -1 && window_ != nullptr;
+    }
+
+    size_t HotplugWatcher::Drain(std::vector<HotplugEvent>& out) {
+        std::lock_guard<std::mutex> lock(lock_);
+        const size_t n = pending_.size();
+        for (HotplugEvent& e : pending_) out.push_back(std::move(e));
+        pending_.clear();
+        if (handle_ != -1) ResetEvent(reinterpret_cast<HANDLE>(handle_));
+        return n;
+    }
+
+    bool HotplugWatcher::Wait(int timeoutMs) {
+        if (!IsValid()) {
+            Sleep(static_cast<DWORD>(timeoutMs));
+            return false;
+        }
+        return WaitForSingleObject(reinterpret_cast<HANDLE>(handle_), static_cast<DWORD>(timeoutMs)) == WAIT_OBJECT_0;
+    }
+#elif defined(__linux__)
+    HotplugWatcher::HotplugWatcher(const std::string& dir) : dir_(dir) {
+        const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) return;
+        watch_ = inotify_add_watch(fd, dir.c_str(), IN_CREATE | IN_ATTRIB | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM);
+        if (watch_ < 0) {
+            close(fd);
+            return;
+        }
+        handle_ = fd;
+    }
+
+    HotplugWatcher::~HotplugWatcher() {
+        if (handle_ >= 0) close(static_cast<int>(handle_));
+    }
+
+    bool HotplugWatcher::IsValid() const {
+        return handle_ >= 0;
+    }
+
+    size_t HotplugWatcher::Drain(std::vector<HotplugEvent>& out) {
+        if (handle_ < 0) return 0;
+        size_t n = 0;
+        alignas(inotify_event) char buf[4096];
+        for (;;) {
+            const ssize_t len = read(static_cast<int>(handle_), buf, sizeof(buf));
+            if (len < 0 && errno == EINTR) continue;
+            if (len <= 0) break;
+            for (ssize_t pos = 0; pos + (ssize_t)sizeof(inotify_event) <= len;) {
+                const auto* ev = reinterpret_cast<const inotify_event*>(buf + pos);
+                pos += sizeof(inotify_event) + ev->len;
+                std::lock_guard<std::mutex> lock(lock_);
+                // Only eventN nodes: jsN and the by-id / by-path links describe the same devices.
+                if (ev->len == 0 || std::strncmp(ev->name, "event", 5) != 0 || ev->name[5] < '0' || ev->name[5] > '9') {
+                    ++stats_.ignored;
+                    continue;
+                }
+                HotplugEvent e;
+                e.action = (ev->mask & (IN_DELETE | IN_MOVED_FROM)) ? HotplugAction::Removed : HotplugAction::Added;
+                e.path = dir_ + "/" + ev->name;
+                ++(e.action == HotplugAction::Added ? stats_.added : stats_.removed);
+                out.push_back(std::move(e));
+                ++n;
+            }
+        }
+        if (n) NotifyDevicesChanged();
+        return n;
+    }
+
+    bool HotplugWatcher::Wait(int timeoutMs) {
+        if (handle_ < 0) {
+            usleep(static_cast<useconds_t>(timeoutMs) * 1000);
+            return false;
+        }
+        pollfd p = { static_cast<int>(handle_), POLLIN, 0 };
+        return poll(&p, 1, timeoutMs) > 0;
+    }
+#else
+    HotplugWatcher::HotplugWatcher(const std::string& dir) : dir_(dir) {}
+
+    HotplugWatcher::~HotplugWatcher() {}
+
+    bool HotplugWatcher::IsValid() const {
+        return false;
+    }
+
+    size_t HotplugWatcher::Drain(std::vector<HotplugEvent>& /*out*/) {
+        return 0;
+    }
+
+    bool HotplugWatcher::Wait(int timeoutMs) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+        return false;
+    }
+#endif
+
+    HotplugStats HotplugWatcher::Stats() const {
+        std::lock_guard<std::mutex> lock(lock_);
+        return stats_;
+    }
+
+    void PrintReconnectTiming(const ReconnectTiming& timing) {
+        std::printf("reconnect: back %.2f ms after its arrival notification (%llu probes)\n",
+            (double)timing.latencyNs / 1e6, (unsigned long long)timing.probes);
+    }
+
+    void PrintHotplugStats(const HotplugStats& stats) {
+        std::printf("hotplug: %llu added, %llu removed, %llu ignored notifications\n",
+            (unsigned long long)stats.added, (unsigned long long)stats.removed, (unsigned long long)stats.ignored);
+    }
+
+} // namespace joystick
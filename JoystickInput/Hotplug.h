@@ -0,0 +1,183 @@
+﻿/**
+ * @file
+ * @brief Device arrival / removal notifications pushed to the readers (no rescans).
+ * @details
+ *   - Linux: inotify on the event node directory (/dev/input). IN_CREATE and IN_ATTRIB (udev fixes
+ *     the node's permissions after creating it) report an arrival, IN_DELETE a removal; only eventN
+ *     names are reported.
+ *   - Windows: WM_DEVICECHANGE for every device interface class, received by a message-only window
+ *     on a watcher thread with its own message pump. The readers block in WaitForMultipleObjects on
+ *     their own thread and never pump the hidden DirectInput window, so its messages would otherwise
+ *     queue unread while a device is streamed.
+ *   - Handle() signals while notifications are pending, so a reactor can wait on it next to the device
+ *     handles (Reactor::AddWatch()); Wait() serves readers that have nothing else to wait for.
+ *   - Each drained notification also marks the cached device list stale (NotifyDevicesChanged()).
+ *   - A notification names one device interface (HotplugEvent::path), and the readers act on that
+ *     device alone instead of enumerating everything again. Linux opens and describes the new node.
+ *     Windows re-probes the closed devices, then looks up only the game controller with that path;
+ *     arrivals of other interface classes touch the XInput slots alone.
+ */
+
+#pragma once
+
+#include "InputCore.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace joystick {
+
+    enum class HotplugAction {
+        Added,
+        Removed
+    };
+
+    /**
+     * @brief One arrival or removal.
+     */
+    struct HotplugEvent {
+        HotplugAction action = HotplugAction::Added;
+        std::string path;  //!< Event node (Linux) or device interface path (Windows, UTF-8).
+    };
+
+    /**
+     * @brief Counters kept by HotplugWatcher.
+     */
+    struct HotplugStats {
+        uint64_t added = 0;     //!< Arrivals reported.
+        uint64_t removed = 0;   //!< Removals reported.
+        uint64_t ignored = 0;   //!< Notifications for other entries (non-event nodes, other broadcasts).
+    };
+
+    /**
+     * @brief Watches for devices coming and going (see file notes).
+     * @details Drain() and Wait() belong to one thread.
+     */
+    class HotplugWatcher {
+    public:
+        /**
+         * @param dir Directory of event nodes to watch (Linux; ignored on Windows).
+         */
+        explicit HotplugWatcher(const std::string& dir = "/dev/input");
+        ~HotplugWatcher();
+        HotplugWatcher(const HotplugWatcher&) = delete;
+        HotplugWatcher& operator=(const HotplugWatcher&) = delete;
+
+        /// false if notifications could not be set up; readers then run without hotplug.
+        bool IsValid() const;
+
+        /// inotify fd (Linux) or manual-reset event HANDLE (Windows), readable / signaled while notifications are pending.
+        intptr_t Handle() const { return handle_; }
+
+        /**
+         * @brief Appends the pending notifications to @p out without blocking.
+         * @return Number appended.
+         */
+        size_t Drain(std::vector<HotplugEvent>& out);
+
+        /**
+         * @brief Blocks until a notification is pending or @p timeoutMs passes.
+         * @return true if Drain() has something to return.
+         */
+        bool Wait(int timeoutMs);
+
+        /// Counters so far (any thread).
+        HotplugStats Stats() const;
+
+    private:
+        friend struct HotplugWindow;
+
+#ifdef _WIN32
+        std::thread pump_;
+        void* window_ = nullptr;
+        std::vector<HotplugEvent> pending_;  //!< Queued by the watcher thread under lock_.
+#endif
+        std::string dir_;
+        intptr_t handle_ = -1;
+        int watch_ = -1;          //!< inotify watch descriptor (Linux).
+        HotplugStats stats_;
+        mutable std::mutex lock_;
+    };
+
+    /**
+     * @brief How long a device took to come back, measured by WaitForArrival().
+     */
+    struct ReconnectTiming {
+        uint64_t probes = 0;     //!< reattach calls (targeted probes) until it was back.
+        uint64_t latencyNs = 0;  //!< First arrival notification drained -> reattach returned true.
+    };
+
+    /**
+     * @brief Waits for notifications until @p reattach accepts one or @p running is cleared.
+     * @param reattach Called as `bool reattach(const HotplugEvent&)` for arrivals; re-probes the device
+     *        it waits for (the path tells which node appeared on Linux; on Windows any arrival may be
+     *        it) and returns true once it is back.
+     * @param timing Receives the probe count and the time from the first arrival to the re-attach; may be nullptr.
+     * @param settleMs The last arrival is retried every 100 ms for this long: a device may only answer
+     *        once its driver stack is up (XInput), or once udev has set its node's permissions.
+     * @return true if the device is back.
+     */
+    template <class Reattach>
+    bool WaitForArrival(HotplugWatcher& watcher, Reattach reattach, const std::atomic_bool& running,
+        ReconnectTiming* timing = nullptr, int settleMs = 2000) {
+        using Clock = std::chrono::steady_clock;
+        std::vector<HotplugEvent> events;
+        HotplugEvent last;
+        int retryMs = 0;
+        uint64_t probes = 0;
+        Clock::time_point arrival;
+        auto back = [&] {
+            if (!timing) return true;
+            timing->probes = probes;
+            timing->latencyNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - arrival).count();
+            return true;
+        };
+        while (running.load(std::memory_order_relaxed)) {
+            if (!watcher.Wait(100)) {
+                if (retryMs > 0) {
+                    retryMs -= 100;
+                    ++probes;
+                    if (reattach(last)) return back();
+                }
+                continue;
+            }
+            events.clear();
+            watcher.Drain(events);
+            for (const HotplugEvent& e : events) {
+                if (e.action != HotplugAction::Added) continue;
+                if (probes == 0) arrival = Clock::now();
+                ++probes;
+                if (reattach(e)) return back();
+                last = e;
+                retryMs = settleMs;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Prints "reconnect: back X ms after its arrival notification (N probes)".
+     */
+    void PrintReconnectTiming(const ReconnectTiming& timing);
+
+    /**
+     * @brief true if @p a and @p b look like the same physical device: name, IDs and serial number
+     *        (two identical pads without serial numbers still match). The node and the port may
+     *        differ after a re-plug.
+     */
+    inline bool IsSameDevice(const DeviceInfo& a, const DeviceInfo& b) {
+        return a.kind == b.kind && a.name == b.name && a.vendorId == b.vendorId && a.productId == b.productId &&
+            a.serial == b.serial;
+    }
+
+    /**
+     * @brief Prints the watcher counters on one line ("hotplug: ...").
+     */
+    void PrintHotplugStats(const HotplugStats& stats);
+
+} // namespace joystick
@@ -0,0 +1,212 @@
+﻿/**
+ * @file
+ * @brief Platform-neutral pieces of the input pipeline: diffing and text output.
+ */
+
+#include "InputCore.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace joystick {
+
+    std::atomic_bool g_Running{ true };
+    std::atomic<uint64_t> g_Wakeups{ 0 };
+    std::atomic_bool g_FirstSampleSeen{ false };
+
+    namespace {
+
+        /// Steady-clock time of each StartupStage in ns since the clock's epoch; 0 = not reached.
+        std::atomic<int64_t> g_StartupNs[3] = {};
+
+    } // namespace
+
+    void* CacheAligned::operator new(size_t size) {
+        // Room for the padding plus the original pointer, stored just below the aligned block.
+        void* raw = std::malloc(size + kCacheLineSize + sizeof(void*));
+        if (!raw) throw std::bad_alloc();
+        const uintptr_t base = reinterpret_cast<uintptr_t>(raw) + sizeof(void*);
+        const uintptr_t aligned = (base + kCacheLineSize - 1) & ~static_cast<uintptr_t>(kCacheLineSize - 1);
+        reinterpret_cast<void**>(aligned)[-1] = raw;
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    void CacheAligned::operator delete(void* p) {
+        if (p) std::free(static_cast<void**>(p)[-1]);
+    }
+
+    uint32_t DiffStates(const InputState& a, const InputState& b) {
+        uint32_t mask = kChangedNone;
+        if (std::memcmp(a.axes, b.axes, sizeof(a.axes)) != 0) mask |= kChangedAxes;
+        if (std::memcmp(a.povs, b.povs, sizeof(a.povs)) != 0) mask |= kChangedPovs;
+        if (std::memcmp(a.buttons, b.buttons, sizeof(a.buttons)) != 0) mask |= kChangedButtons;
+        return mask;
+    }
+
+    uint32_t DiffStates(const InputState& a, const InputState& b, const StateCaps& caps) {
+        if (caps.IsFull()) return DiffStates(a, b);
+        uint32_t mask = kChangedNone;
+        for (int i = 0; i < kMaxAxes; ++i) {
+            if (((caps.axisMask >> i) & 1u) && a.axes[i] != b.axes[i]) {
+                mask |= kChangedAxes;
+                break;
+            }
+        }
+        if (std::memcmp(a.povs, b.povs, caps.povCount * sizeof(a.povs[0])) != 0) mask |= kChangedPovs;
+        const int words = caps.buttonCount >> 6;
+        const int rest = caps.buttonCount & 63;
+        uint64_t bits = 0;
+        for (int w = 0; w < words; ++w) bits |= a.buttons[w] ^ b.buttons[w];
+        if (rest) bits |= (a.buttons[words] ^ b.buttons[words]) & ((uint64_t(1) << rest) - 1);
+        if (bits) mask |= kChangedButtons;
+        return mask;
+    }
+
+    namespace {
+
+        /**
+         * @brief Formats in the same shape as the original PrintXInputState.
+         */
+        size_t FormatGamepad(const InputState& s, char* buf, size_t cap) {
+            const uint32_t b = static_cast<uint32_t>(s.buttons[0] & 0xFFFFu);
+            int n = std::snprintf(buf, cap,
+                "LX=%6d  LY=%6d  RX=%6d  RY=%6d  LT=%3d  RT=%3d  Buttons=0x%04x  DPad(U/D/L/R)=%d/%d/%d/%d\n",
+                s.axes[kAxisLeftX], s.axes[kAxisLeftY], s.axes[kAxisRightX], s.axes[kAxisRightY],
+                s.axes[kAxisLeftTrigger], s.axes[kAxisRightTrigger], b,
+                (b & kGamepadDpadUp) ? 1 : 0, (b & kGamepadDpadDown) ? 1 : 0,
+                (b & kGamepadDpadLeft) ? 1 : 0, (b & kGamepadDpadRight) ? 1 : 0);
+            if (n < 0) return 0;
+            return (size_t)n < cap ? (size_t)n : cap - 1;
+        }
+
+        /**
+         * @brief Formats in the same shape as the original PrintDIState, limited to the objects in @p caps.
+         * @note For brevity at most 32 buttons are printed. States with a driver timestamp end with
+         *       " | t=<ms> seq=<sequence>".
+         */
+        size_t FormatJoystick(const InputState& s, const StateCaps& caps, char* buf, size_t cap) {
+            static const char* const kAxisNames[kMaxAxes] = { "lX", "lY", "lZ", "lRx", "lRy", "lRz", "S0", "S1" };
+            if (cap < 8) return 0;
+            std::memcpy(buf, "AXES:", 5);
+            size_t len = 5;
+            int n;
+            for (int i = 0; i < kMaxAxes; ++i) {
+                if (!((caps.axisMask >> i) & 1u)) continue;
+                n = std::snprintf(buf + len, cap - len, " %s=%6d", kAxisNames[i], s.axes[i]);
+                if (n > 0) len += (size_t)n < cap - len ? (size_t)n : cap - len - 1;
+            }
+
+            if (caps.povCount > 0 && len + 8 < cap) {
+                std::memcpy(buf + len, " | POV: ", 8);
+                len += 8;
+                for (int i = 0; i < caps.povCount && len + 6 < cap; ++i) {
+                    if (s.povs[i] == kPovCentered) {
+                        std::memcpy(buf + len, "---- ", 5);
+                        len += 5;
+                    }
+                    else {
+                        n = std::snprintf(buf + len, cap - len, "%4u ", s.povs[i]);
+                        if (n > 0) len += (size_t)n < cap - len ? (size_t)n : cap - len - 1;
+                    }
+                }
+            }
+            else if (len + 1 < cap) {
+                buf[len++] = ' ';
+            }
+
+            const int buttons = caps.buttonCount < 32 ? caps.buttonCount : 32;
+            if (len + 7 + buttons + 1 < cap) {
+                std::memcpy(buf + len, "| BTN: ", 7);
+                len += 7;
+                for (int i = 0; i < buttons; ++i) {
+                    buf[len++] = IsButtonDown(s, i) ? '1' : '0';
+                }
+                if (s.timeMs != 0) {
+                    // Event records: driver timestamp and sequence number.
+                    n = std::snprintf(buf + len, cap - len, " | t=%u seq=%u", s.timeMs, s.packet);
+                    if (n > 0) len += (size_t)n < cap - len - 1 ? (size_t)n : cap - len - 2;
+                }
+                buf[len++] = '\n';
+            }
+            return len;
+        }
+
+    } // namespace
+
+    size_t FormatState(StateLayout layout, const InputState& state, char* buf, size_t cap) {
+        if (!buf || cap == 0) return 0;
+        return layout == StateLayout::Gamepad ? FormatGamepad(state, buf, cap) : FormatJoystick(state, StateCaps(), buf, cap);
+    }
+
+    size_t FormatState(StateLayout layout, const InputState& state, const StateCaps& caps, char* buf, size_t cap) {
+        if (!buf || cap == 0) return 0;
+        return layout == StateLayout::Gamepad ? FormatGamepad(state, buf, cap) : FormatJoystick(state, caps, buf, cap);
+    }
+
+    void ConsoleSink::operator()(const InputState& state) {
+        char line[kMaxFormattedState];
+        const size_t len = FormatState(layout_, state, caps_, line, sizeof(line));
+        if (flushMs_ == 0) {
+            std::fwrite(line, 1, len, out_);
+            ++writes_;
+            return;
+        }
+        if (pending_.empty()) firstPending_ = std::chrono::steady_clock::now();
+        pending_.append(line, len);
+    }
+
+    int ConsoleSink::FlushDueInMs() const {
+        if (pending_.empty()) return -1;
+        const auto age = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - firstPending_).count();
+        return age >= (long long)flushMs_ ? 0 : (int)(flushMs_ - age);
+    }
+
+    void ConsoleSink::Flush() {
+        if (!pending_.empty()) {
+            std::fwrite(pending_.data(), 1, pending_.size(), out_);
+            ++writes_;
+            pending_.clear();
+        }
+        std::fflush(out_);
+    }
+
+    void PrintWakeups(const WakeupMeter& meter, const ConsoleSink& sink) {
+        const double s = meter.Seconds();
+        std::printf("wake-ups: %llu in %.1f s (%.1f/s), output writes %llu (%.1f/s)\n",
+            (unsigned long long)meter.Count(), s, meter.PerSecond(),
+            (unsigned long long)sink.Writes(), s > 0 ? (double)sink.Writes() / s : 0.0);
+    }
+
+    void MarkStartup(StartupStage stage) {
+        const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t unset = 0;
+        g_StartupNs[static_cast<int>(stage)].compare_exchange_strong(unset, now);
+        if (stage == StartupStage::FirstSample) g_FirstSampleSeen.store(true, std::memory_order_relaxed);
+    }
+
+    void PrintStartupTimes() {
+        const int64_t start = g_StartupNs[static_cast<int>(StartupStage::Start)].load();
+        if (start == 0) return;
+        const int64_t list = g_StartupNs[static_cast<int>(StartupStage::ListReady)].load();
+        const int64_t sample = g_StartupNs[static_cast<int>(StartupStage::FirstSample)].load();
+        std::printf("startup:");
+        if (list) std::printf(" device list %.1f ms", (double)(list - start) / 1e6);
+        if (list && sample) std::printf(",");
+        if (sample) std::printf(" first sample %.1f ms", (double)(sample - start) / 1e6);
+        std::printf("%s\n", list || sample ? "" : " no device listed");
+    }
+
+    const char* DeviceKindTag(DeviceKind kind) {
+        switch (kind) {
+        case DeviceKind::XInput: return "XInput   ";
+        case DeviceKind::DirectInput: return "DirectInp";
+        case DeviceKind::Evdev: return "Evdev    ";
+        case DeviceKind::Synthetic: return "Synthetic";
+        }
+        return "Unknown  ";
+    }
+
+} // namespace joystick
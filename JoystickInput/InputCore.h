@@ -0,0 +1,602 @@
+﻿/**
+ * @file
+ * @brief Platform-neutral input core: device/state model, diffing, formatting and the static backend interface.
+ * @details
+ *   - Build: C++14, no platform headers; compiles on Windows and Linux.
+ *   - Backends derive from InputBackend<Derived> (CRTP); the reader loop is a template so the
+ *     per-sample call into a backend is resolved at compile time (no virtual dispatch).
+ *   - Pipeline stages: sample (backend) -> diff (DiffStates) -> output (FormatState + sink).
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace joystick {
+
+    /**
+     * @enum DeviceKind
+     * @brief Identifies the API used to communicate with a controller.
+     * @details
+     *   @par Alternative options and trade-offs
+     *   - XInput:
+     *     - For Xbox family controllers and XInput-compatible pads.
+     *     - Pros: Standardized layout (A/B/X/Y, triggers, sticks), vibration support, simple polling API.
+     *     - Cons: Max 4 users (0..3), no event notifications (polling only), limited button/axis count.
+     *   - DirectInput:
+     *     - For generic HID gamepads/joysticks, flight sticks, wheels, etc.
+     *     - Pros: Works with many legacy/non-XInput devices, supports more buttons/axes, event-driven via buffered data.
+     *     - Cons: Layout varies by device, force feedback varies, some XInput devices also expose DI “proxy” devices (often filtered).
+     *   - Evdev:
+     *     - Linux input subsystem (/dev/input/event*), any joystick/gamepad the kernel drives.
+     *     - Pros: Event-driven (epoll), kernel timestamps, no polling.
+     *     - Cons: Linux only; the caller needs read access to the event node (input group or udev rule).
+     *   - Synthetic:
+     *     - Deterministic generated traffic for profiling and benchmarking the pipeline off-device.
+     */
+    enum class DeviceKind {
+        XInput,      //!< Use XInput API (Xbox controllers); polled reads; limited to 4 users.
+        DirectInput, //!< Use DirectInput API (generic HID controllers); event-driven with buffered data.
+        Evdev,       //!< Use Linux evdev (/dev/input/event*); event-driven via epoll.
+        Synthetic    //!< Generated traffic (SyntheticBackend); available on every platform.
+    };
+
+    /**
+     * @brief Binary layout of a Windows GUID without depending on Windows headers.
+     */
+    struct DeviceGuid {
+        uint32_t data1 = 0;
+        uint16_t data2 = 0;
+        uint16_t data3 = 0;
+        uint8_t data4[8] = {};
+    };
+
+    /**
+     * @brief Basic information about a discovered device in the merged list.
+     */
+    struct DeviceInfo {
+        int index = 0;                          //!< Zero-based stable index in the merged list presented to users.
+        DeviceKind kind = DeviceKind::XInput;   //!< Selected API for this device (see DeviceKind for alternatives).
+        std::string name;                       //!< Human-readable device name (UTF-8).
+        // For XInput
+        uint32_t xinputUser = 0;                //!< XInput user index (0..3) when kind == DeviceKind::XInput.
+        // For DirectInput
+        DeviceGuid diGuid;                      //!< DirectInput instance GUID when kind == DeviceKind::DirectInput.
+        bool polled = false;                    //!< DirectInput: DIDC_POLLEDDEVICE, never signals its event; read on a poll schedule.
+        // For evdev
+        std::string path;                       //!< Event node (e.g. /dev/input/event5) when kind == DeviceKind::Evdev.
+        uint16_t vendorId = 0;                  //!< USB/Bluetooth vendor ID when known, else 0.
+        uint16_t productId = 0;                 //!< USB/Bluetooth product ID when known, else 0.
+        std::string serial;                     //!< Serial number when the device reports one (evdev EVIOCGUNIQ), else empty.
+        std::string location;                   //!< Physical location, e.g. the USB port (evdev EVIOCGPHYS), else empty.
+    };
+
+    /**
+     * @brief Selects how a state is rendered by FormatState.
+     */
+    enum class StateLayout {
+        Gamepad,  //!< XInput-style pad: sticks, triggers and a 16-bit button mask.
+        Joystick  //!< DirectInput-style joystick: 8 axes, 4 POV hats and up to 128 buttons.
+    };
+
+    constexpr int kMaxAxes = 8;                  //!< Axis slots in InputState (DIJOYSTATE2 lX..rglSlider[1]).
+    constexpr int kMaxPovs = 4;                  //!< POV hat slots in InputState.
+    constexpr int kMaxButtons = 128;             //!< Button slots in InputState.
+    constexpr uint32_t kPovCentered = 0xFFFFFFFFu; //!< POV value for a centered hat (DirectInput convention).
+
+    /// Axis slots used by StateLayout::Gamepad.
+    enum GamepadAxis {
+        kAxisLeftX = 0,
+        kAxisLeftY,
+        kAxisRightX,
+        kAxisRightY,
+        kAxisLeftTrigger,
+        kAxisRightTrigger
+    };
+
+    /// Button bits used by StateLayout::Gamepad in InputState::buttons[0] (same values as XINPUT_GAMEPAD_*).
+    enum GamepadButton : uint32_t {
+        kGamepadDpadUp = 0x0001,
+        kGamepadDpadDown = 0x0002,
+        kGamepadDpadLeft = 0x0004,
+        kGamepadDpadRight = 0x0008,
+        kGamepadStart = 0x0010,
+        kGamepadBack = 0x0020,
+        kGamepadLeftThumb = 0x0040,
+        kGamepadRightThumb = 0x0080,
+        kGamepadLeftShoulder = 0x0100,
+        kGamepadRightShoulder = 0x0200,
+        kGamepadA = 0x1000,
+        kGamepadB = 0x2000,
+        kGamepadX = 0x4000,
+        kGamepadY = 0x8000
+    };
+
+    /**
+     * @brief Portable snapshot of a controller, shared by all backends.
+     * @details Fixed size and trivially copyable so it can be diffed, queued and copied cheaply.
+     */
+    struct InputState {
+        uint32_t packet = 0;                     //!< Backend sequence number; changes when the device reports new data.
+        uint32_t timeMs = 0;                     //!< Driver timestamp of the report (DirectInput event records); 0 = none.
+        int32_t axes[kMaxAxes] = {};             //!< Axis values in backend units.
+        uint32_t povs[kMaxPovs] = { kPovCentered, kPovCentered, kPovCentered, kPovCentered }; //!< Hundredths of a degree or kPovCentered.
+        uint64_t buttons[kMaxButtons / 64] = {}; //!< One bit per button; bit 0 of buttons[0] is button 0.
+    };
+
+    /**
+     * @brief Sets or clears one button bit.
+     * @param state State to modify.
+     * @param button Button index in [0, kMaxButtons).
+     * @param pressed New button state.
+     */
+    inline void SetButton(InputState& state, int button, bool pressed) {
+        const uint64_t bit = uint64_t(1) << (button & 63);
+        if (pressed) state.buttons[button >> 6] |= bit;
+        else state.buttons[button >> 6] &= ~bit;
+    }
+
+    /**
+     * @brief Reads one button bit.
+     * @param state State to read.
+     * @param button Button index in [0, kMaxButtons).
+     * @return true if pressed.
+     */
+    inline bool IsButtonDown(const InputState& state, int button) {
+        return (state.buttons[button >> 6] >> (button & 63)) & 1u;
+    }
+
+    /**
+     * @brief Objects a device actually has, so diffing and formatting can skip empty slots.
+     * @details Axes keep their InputState slots (lX..lRz, S0, S1); POVs and buttons are the first
+     *          povCount and buttonCount slots. The default describes a full DIJOYSTATE2 device.
+     */
+    struct StateCaps {
+        uint8_t axisMask = 0xFF;             //!< Bit i set: axes[i] is present.
+        uint8_t povCount = kMaxPovs;         //!< POV hats present.
+        uint16_t buttonCount = kMaxButtons;  //!< Buttons present.
+
+        bool IsFull() const { return axisMask == 0xFF && povCount == kMaxPovs && buttonCount == kMaxButtons; }
+    };
+
+    /// Bits returned by DiffStates.
+    enum ChangeMask : uint32_t {
+        kChangedNone = 0,
+        kChangedAxes = 1u << 0,
+        kChangedPovs = 1u << 1,
+        kChangedButtons = 1u << 2
+    };
+
+    /**
+     * @brief Compares two states field group by field group.
+     * @param a Previous state.
+     * @param b Current state.
+     * @return Combination of ChangeMask bits; kChangedNone if the states are equivalent.
+     * @note The packet number and timestamp are ignored; only observable input is compared.
+     */
+    uint32_t DiffStates(const InputState& a, const InputState& b);
+
+    /// DiffStates restricted to the objects in @p caps.
+    uint32_t DiffStates(const InputState& a, const InputState& b, const StateCaps& caps);
+
+    /// Upper bound on the bytes FormatState writes (including the terminating newline).
+    constexpr size_t kMaxFormattedState = 320;
+
+    /**
+     * @brief Renders a state as one text line.
+     * @param layout Gamepad (PrintXInputState format) or Joystick (PrintDIState format).
+     * @param state State to render.
+     * @param buf Destination buffer.
+     * @param cap Capacity of @p buf; kMaxFormattedState is always sufficient.
+     * @return Number of bytes written, newline included, no terminator counted.
+     */
+    size_t FormatState(StateLayout layout, const InputState& state, char* buf, size_t cap);
+
+    /// FormatState printing only the objects in @p caps (Joystick layout; Gamepad ignores @p caps).
+    size_t FormatState(StateLayout layout, const InputState& state, const StateCaps& caps, char* buf, size_t cap);
+
+    /**
+     * @brief Output stage that formats states and writes them to stdout.
+     * @details With a flush interval, lines are collected and written in one batch once the interval
+     *          has passed since the first pending line (see RunBatchedReader), so a moving stick costs a
+     *          few writes per second instead of one per report.
+     */
+    class ConsoleSink {
+    public:
+        /**
+         * @param layout Output format.
+         * @param flushMs Batch interval; 0 writes every line immediately.
+         * @param out Destination stream.
+         */
+        explicit ConsoleSink(StateLayout layout, uint32_t flushMs = 0, std::FILE* out = stdout)
+            : layout_(layout), flushMs_(flushMs), out_(out) {}
+        ~ConsoleSink() { Flush(); }
+        ConsoleSink(const ConsoleSink&) = delete;
+        ConsoleSink& operator=(const ConsoleSink&) = delete;
+
+        /// Formats and writes (or queues) one state line.
+        void operator()(const InputState& state);
+
+        /// Restricts the printed objects to those the device has (see InputBackend::Caps()).
+        void SetCaps(const StateCaps& caps) { caps_ = caps; }
+
+        /// Multi-device sink form (see AsyncSink); the tag is not printed and nullptr is ignored.
+        void operator()(int /*tag*/, StateLayout /*layout*/, const InputState* state) {
+            if (state) (*this)(*state);
+        }
+
+        /// Milliseconds until pending output is due (0 = now), or -1 when nothing is pending.
+        int FlushDueInMs() const;
+
+        /// Writes pending lines if the batch interval has passed.
+        void FlushIfDue() {
+            if (FlushDueInMs() == 0) Flush();
+        }
+
+        /// Writes pending lines and flushes the stream.
+        void Flush();
+
+        /// Writes issued to the stream (one per line unbatched, one per batch otherwise).
+        uint64_t Writes() const { return writes_; }
+
+    private:
+        StateLayout layout_;
+        StateCaps caps_;
+        uint32_t flushMs_;
+        std::FILE* out_;
+        std::string pending_;
+        std::chrono::steady_clock::time_point firstPending_;
+        uint64_t writes_ = 0;
+    };
+
+    /**
+     * @brief Result of one InputBackend::Sample call.
+     */
+    enum class SampleStatus {
+        Changed,      //!< The device reported new data; the state was updated.
+        Unchanged,    //!< Nothing new (poll without a new packet, wait timeout, transient re-acquire).
+        Disconnected, //!< The device is gone or the stream ended.
+        Failed        //!< Unrecoverable backend error.
+    };
+
+    /**
+     * @brief Start-up milestones, for tracking start-up regressions.
+     */
+    enum class StartupStage {
+        Start,       //!< main() entered.
+        ListReady,   //!< The device list is available.
+        FirstSample  //!< A backend returned its first Changed sample.
+    };
+
+    /// Records the time @p stage is first reached (later calls for the same stage are ignored).
+    void MarkStartup(StartupStage stage);
+
+    /// Set once the first sample was marked; keeps the per-sample check to one relaxed load.
+    extern std::atomic_bool g_FirstSampleSeen;
+
+    /// Marks StartupStage::FirstSample on the first Changed sample of the process.
+    inline void NoteSample(SampleStatus status) {
+        if (status == SampleStatus::Changed && !g_FirstSampleSeen.load(std::memory_order_relaxed)) {
+            MarkStartup(StartupStage::FirstSample);
+        }
+    }
+
+    /**
+     * @brief Prints "startup: device list X ms, first sample Y ms" relative to StartupStage::Start.
+     * @details Stages not reached are left out; prints nothing if Start was never marked.
+     */
+    void PrintStartupTimes();
+
+    /**
+     * @brief Static backend interface (CRTP).
+     * @tparam Derived Concrete backend providing:
+     *   - `StateLayout OutputLayout() const;`
+     *   - `SampleStatus SampleImpl(InputState& state);` which waits for the next sampling opportunity
+     *     (poll interval or event) and updates @p state in place.
+     *   - Optionally `SampleStatus PollImpl(InputState& state);` which reads what the device has now
+     *     without waiting; needed to run the backend under Reactor.
+     *   - Optionally `StateCaps CapsImpl() const;` when the device has fewer objects than
+     *     InputState holds (DirectInput custom data formats).
+     * @details Readers take InputBackend<Derived>&, so Sample() inlines into the loop.
+     */
+    template <class Derived>
+    class InputBackend {
+    public:
+        /// Waits for and reads the next sample; see SampleStatus.
+        SampleStatus Sample(InputState& state) {
+            const SampleStatus status = static_cast<Derived*>(this)->SampleImpl(state);
+            NoteSample(status);
+            return status;
+        }
+
+        /// Reads the next pending sample without waiting (Unchanged when nothing is pending).
+        SampleStatus Poll(InputState& state) {
+            const SampleStatus status = static_cast<Derived*>(this)->PollImpl(state);
+            NoteSample(status);
+            return status;
+        }
+
+        /// Output layout of the states this backend produces.
+        StateLayout Layout() const { return static_cast<const Derived*>(this)->OutputLayout(); }
+
+        /// Objects the device has; readers diff and print only these.
+        StateCaps Caps() const { return static_cast<const Derived*>(this)->CapsImpl(); }
+
+        /// Default for Caps(): every InputState slot.
+        StateCaps CapsImpl() const { return StateCaps(); }
+
+        /**
+         * @brief Bounds the blocking wait of the next Sample() call (-1 = no extra bound).
+         * @details Lets an event-driven backend that otherwise waits indefinitely wake up in time to
+         *          flush batched output. Backends that never block long keep the default no-op.
+         */
+        void LimitNextWait(int timeoutMs) { static_cast<Derived*>(this)->LimitNextWaitImpl(timeoutMs); }
+
+        /// Default for LimitNextWait(); backends with unbounded waits hide it.
+        void LimitNextWaitImpl(int /*timeoutMs*/) {}
+
+    protected:
+        InputBackend() = default;
+        ~InputBackend() = default;
+    };
+
+    /**
+     * @brief Counters collected by RunReader.
+     */
+    struct ReaderStats {
+        uint64_t samples = 0; //!< Sample() calls.
+        uint64_t changes = 0; //!< Samples reported as Changed by the backend.
+        uint64_t emitted = 0; //!< States passed to the sink after diffing.
+    };
+
+    /**
+     * @brief Why RunReader returned.
+     */
+    enum class ReaderExit {
+        Stopped,      //!< The run flag was cleared.
+        Disconnected, //!< Backend reported SampleStatus::Disconnected.
+        Failed        //!< Backend reported SampleStatus::Failed.
+    };
+
+    namespace detail {
+
+        /// Per-iteration hooks of RunReaderLoop(); the plain reader has none.
+        struct NoReaderHooks {
+            template <class Backend>
+            void BeforeSample(InputBackend<Backend>& /*backend*/) {}
+            void AfterSample() {}
+        };
+
+        /// Hooks of RunBatchedReader(): bound each wait by the next flush deadline, flush when due.
+        struct FlushReaderHooks {
+            ConsoleSink& sink;
+
+            template <class Backend>
+            void BeforeSample(InputBackend<Backend>& backend) { backend.LimitNextWait(sink.FlushDueInMs()); }
+            void AfterSample() { sink.FlushIfDue(); }
+        };
+
+        /// The sample -> diff -> output loop shared by RunReader() and RunBatchedReader().
+        template <class Backend, class Sink, class Hooks>
+        ReaderExit RunReaderLoop(InputBackend<Backend>& backend, Sink& sink, const std::atomic_bool& running, ReaderStats* stats, Hooks& hooks) {
+            InputState prev;
+            InputState cur;
+            bool emittedAny = false;
+            ReaderStats local;
+            const StateCaps caps = backend.Caps();
+
+            ReaderExit exit = ReaderExit::Stopped;
+            while (running.load(std::memory_order_relaxed)) {
+                hooks.BeforeSample(backend);
+                const SampleStatus status = backend.Sample(cur);
+                ++local.samples;
+                if (status == SampleStatus::Changed) {
+                    ++local.changes;
+                    if (!emittedAny || DiffStates(prev, cur, caps) != kChangedNone) {
+                        sink(cur);
+                        prev = cur;
+                        emittedAny = true;
+                        ++local.emitted;
+                    }
+                }
+                else if (status == SampleStatus::Disconnected) {
+                    exit = ReaderExit::Disconnected;
+                    break;
+                }
+                else if (status == SampleStatus::Failed) {
+                    exit = ReaderExit::Failed;
+                    break;
+                }
+                hooks.AfterSample();
+            }
+
+            if (stats) *stats = local;
+            return exit;
+        }
+
+    } // namespace detail
+
+    /**
+     * @brief Generic sample -> diff -> output loop.
+     * @param backend Source of samples.
+     * @param sink Callable invoked with each state that differs from the previously emitted one.
+     * @param running Loop runs while this flag is true.
+     * @param stats Optional counters.
+     * @return Reason the loop ended.
+     */
+    template <class Backend, class Sink>
+    ReaderExit RunReader(InputBackend<Backend>& backend, Sink& sink, const std::atomic_bool& running, ReaderStats* stats = nullptr) {
+        detail::NoReaderHooks hooks;
+        return detail::RunReaderLoop(backend, sink, running, stats, hooks);
+    }
+
+    /**
+     * @brief RunReader for a batching ConsoleSink: each wait is bounded by the next flush deadline, so
+     *        event-driven backends can wait without a timeout while nothing is pending.
+     */
+    template <class Backend>
+    ReaderExit RunBatchedReader(InputBackend<Backend>& backend, ConsoleSink& sink, const std::atomic_bool& running, ReaderStats* stats = nullptr) {
+        detail::FlushReaderHooks hooks{ sink };
+        const ReaderExit exit = detail::RunReaderLoop(backend, sink, running, stats, hooks);
+        sink.Flush();
+        return exit;
+    }
+
+    /// Destructive interference size assumed for padding (x86-64 and ARM64 cores).
+    constexpr size_t kCacheLineSize = 64;
+
+    /**
+     * @brief Base for heap objects that must start on a cache line.
+     * @details C++14 operator new only guarantees alignof(max_align_t), so alignas() on its own is
+     *          not honoured for heap objects; these overloads over-allocate and align by hand.
+     */
+    struct CacheAligned {
+        static void* operator new(size_t size);
+        static void operator delete(void* p);
+    };
+
+    /// Returns from blocking waits (timer, device event, epoll) in this process; see WakeupMeter.
+    extern std::atomic<uint64_t> g_Wakeups;
+
+    /// Called by backends and timers each time a blocking wait returns.
+    inline void CountWakeup() {
+        g_Wakeups.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Wake-ups per second since construction (the figure that keeps a CPU out of deep idle states).
+     */
+    class WakeupMeter {
+    public:
+        WakeupMeter() : start_(g_Wakeups.load(std::memory_order_relaxed)), t0_(std::chrono::steady_clock::now()) {}
+
+        uint64_t Count() const { return g_Wakeups.load(std::memory_order_relaxed) - start_; }
+
+        double Seconds() const {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0_).count();
+        }
+
+        double PerSecond() const {
+            const double s = Seconds();
+            return s > 0 ? (double)Count() / s : 0.0;
+        }
+
+    private:
+        uint64_t start_;
+        std::chrono::steady_clock::time_point t0_;
+    };
+
+    /**
+     * @brief Prints "wake-ups: N in S s (X/s)" and the sink's output writes.
+     */
+    void PrintWakeups(const WakeupMeter& meter, const ConsoleSink& sink);
+
+    /**
+     * @brief How readers wait for a poll deadline or an expected event.
+     */
+    enum class WaitMode {
+        Sleep,  //!< Block in the OS until the deadline (lowest CPU).
+        Hybrid  //!< Block until shortly before the deadline, then spin with a pause hint (lowest wake-up error).
+    };
+
+    /**
+     * @brief What a reader does with an output record that finds the output ring full (see StateRing).
+     */
+    enum class OverflowPolicy {
+        KeepLatest, //!< Coalesce; intermediate states are lost, the newest one always reaches the output.
+        DropNewest, //!< Discard the incoming record.
+        Block       //!< Wait for the output thread to make room.
+    };
+
+    /**
+     * @brief Output range, dead zone and saturation of one axis (DirectInput DIPROP_* semantics).
+     * @details Dead zone and saturation are in 1/10000 of the distance from the center of the raw
+     *          range to either end: inside the dead zone the axis reports the center of [min, max],
+     *          beyond saturation it reports min or max, and in between it scales linearly.
+     */
+    struct AxisConfig {
+        int32_t min = -32768;          //!< Output value at full negative deflection.
+        int32_t max = 32767;           //!< Output value at full positive deflection.
+        uint32_t deadzone = 0;         //!< 0..10000.
+        uint32_t saturation = 10000;   //!< 0..10000.
+    };
+
+    /**
+     * @brief Per-axis normalization requested for a reader; DirectInput applies it in the driver,
+     *        other backends through AxisNormalizer.
+     */
+    struct AxisProfile {
+        bool enabled = false;          //!< false = axes keep backend units.
+        AxisConfig axes[kMaxAxes];     //!< Indexed by InputState axis slot.
+    };
+
+    /**
+     * @brief Reader settings chosen on the command line.
+     */
+    struct ReaderOptions {
+        uint32_t pollHz = 500;        //!< Poll rate of polled backends (XInput); event-driven backends ignore it.
+        bool adaptive = false;        //!< Drop polled backends to idleHz while the device is quiet.
+        uint32_t idleHz = 30;         //!< Poll rate while idle (adaptive mode).
+        uint32_t idleAfterMs = 2000;  //!< Quiet time before switching to idleHz (adaptive mode).
+        bool phaseLock = false;       //!< Align polls to the device's estimated report cadence (overrides adaptive).
+        WaitMode waitMode = WaitMode::Sleep; //!< Poll deadline / event wait strategy.
+        bool powerSave = false;       //!< Minimize wake-ups: coalesced timers, untimed event waits, batched output.
+        uint32_t flushMs = 250;       //!< Output batch interval in power-save mode.
+        uint32_t poolWorkers = 0;     //!< Multi-device mode: worker threads of the reader pool; 0 = single reactor thread.
+        uint32_t ringSlots = 1024;    //!< Output ring between the reader and the output thread (not in power-save mode).
+        OverflowPolicy overflow = OverflowPolicy::KeepLatest; //!< What happens when the output thread falls behind.
+        bool diSnapshot = false;      //!< DirectInput: read GetDeviceState per notification instead of applying buffered records.
+        uint32_t diBufferSize = 0;    //!< DirectInput driver buffer in records; 0 = start at 64 and tune from the record rate.
+        AxisProfile axisProfile;      //!< Axis range / dead zone / saturation (--axis-range, --deadzone, --saturation).
+        uint32_t diPollHz = 250;      //!< Poll rate of DirectInput devices that report DIDC_POLLEDDEVICE.
+        bool rawInput = false;        //!< Read DirectInput devices through Raw Input (GetRawInputBuffer) instead.
+        bool compareApis = false;     //!< XInput devices: read XInput and the DirectInput proxy side by side and compare latency.
+        bool attachNew = false;       //!< Multi-device mode (--all): also attach controllers plugged in while reading.
+    };
+
+    /// Global run flag toggled by the console control / signal handler.
+    extern std::atomic_bool g_Running;
+
+    /**
+     * @brief Enumerates the devices available on this platform.
+     * @return A merged list of DeviceInfo with stable indices.
+     * @details The list is cached (see DeviceRegistry.h): repeated calls return it without probing
+     *          again until NotifyDevicesChanged() is called.
+     */
+    std::vector<DeviceInfo> EnumerateDevices();
+
+    /// Marks the cached device list stale (device arrival or removal); safe from any thread.
+    void NotifyDevicesChanged();
+
+    /**
+     * @brief Streams input from the given device to stdout until interrupted.
+     * @param device Entry from EnumerateDevices().
+     * @param options Reader settings.
+     * @return Process exit code.
+     */
+    int RunDeviceReader(const DeviceInfo& device, const ReaderOptions& options);
+
+    /**
+     * @brief Streams several devices; output lines are tagged with the device index.
+     * @details One reactor thread, or a ReaderPool when options.poolWorkers is set (every device is
+     *          then polled at pollHz).
+     * @param devices Entries from EnumerateDevices().
+     * @param options Reader settings (pollHz and poolWorkers; other per-reader modes do not apply).
+     * @return Process exit code.
+     */
+    int RunMultiDeviceReader(const std::vector<DeviceInfo>& devices, const ReaderOptions& options);
+
+    /**
+     * @brief Short fixed-width tag for listings ("XInput   ", "DirectInp", ...).
+     * @param kind Device kind.
+     * @return Static string.
+     */
+    const char* DeviceKindTag(DeviceKind kind);
+
+} // namespace joystick
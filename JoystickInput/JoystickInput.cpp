@@ -2,568 +2,527 @@
  * @file
  * @brief Lists game controllers and streams input for the selected device via XInput or DirectInput.
  * @details
- *   - Build: C++14, Windows desktop console
- *   - Links: xinput9_1_0.lib, dinput8.lib, dxguid.lib, user32.lib, ole32.lib
+ *   - Build: C++14; Windows desktop console (full) or any platform with a C++14 compiler (portable core only).
+ *   - Links: xinput9_1_0.lib, dinput8.lib, dxguid.lib, user32.lib, ole32.lib, hid.lib (Windows, see WindowsBackends.cpp)
  *   - Behavior:
- *       - No args: list controllers with integer indices.
+ *       - No args: list controllers with integer indices and stable identities.
  *       - One int arg: select that controller and stream inputs.
+ *       - An identity (xinput:0, di:{GUID}, evdev:...) selects a device through the identity cache
+ *         (DeviceIdentity.h): one targeted probe instead of enumerating every device.
+ *       - --bench [name|all] [count]: run pipeline benchmarks on synthetic devices.
+ *       - --replay <file> (Linux): stream a recorded input_event capture through the evdev backend.
  *   - API notes:
  *       - XInput devices (Xbox 360/One/Series) are polled; there is no event API in XInput.
  *       - DirectInput devices (generic USB gamepads/joysticks) are event-driven via SetEventNotification + buffered data.
+ *       - With --raw-input, a DirectInput-listed HID controller is read through Raw Input (GetRawInputBuffer batches).
+ *       - With --compare, an XInput pad is read through XInput and its DirectInput proxy at once to compare latency.
+ *       - Linux evdev devices (/dev/input/event*) are event-driven via epoll (EvdevBackend.cpp).
+ *       - Unplugged devices are picked up again when they come back (Hotplug.h); --all also attaches new ones.
+ *       - The sampling, diffing and output stages live in the portable core (InputCore.h) and are shared by all backends.
  */
 
-#define WIN32_LEAN_AND_MEAN 
-#include <windows.h>
-#include <Xinput.h>
-#define DIRECTINPUT_VERSION 0x0800
-#include <dinput.h>
+#ifdef _WIN32
+#include "WindowsBackends.h"
+#else
+#include <csignal>
+#endif
+#ifdef __linux__
+#include "EvdevBackend.h"
+#endif
+
+#include "AxisNormalizer.h"
+#include "Benchmark.h"
+#include "DeviceIdentity.h"
+#include "HidDescriptor.h"
+#include "InputCore.h"
+#include "StateRing.h"
 
-#include <atomic>
+#include <algorithm>
 #include <chrono>
-#include <cstdint>
-#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
-#include <iomanip>
-#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
-#include <algorithm>
 
-#pragma comment(lib, "xinput9_1_0.lib")
-#pragma comment(lib, "dinput8.lib")
-#pragma comment(lib, "dxguid.lib")
-#pragma comment(lib, "user32.lib")
-#pragma comment(lib, "ole32.lib")
+using namespace joystick;
 
 namespace {
 
+#ifdef _WIN32
     /**
-     * @enum DeviceKind
-     * @brief Identifies the API used to communicate with a controller.
-     * @details
-     *   @par Alternative options and trade-offs
-     *   - XInput:
-     *     - For Xbox family controllers and XInput-compatible pads.
-     *     - Pros: Standardized layout (A/B/X/Y, triggers, sticks), vibration support, simple polling API.
-     *     - Cons: Max 4 users (0..3), no event notifications (polling only), limited button/axis count.
-     *   - DirectInput:
-     *     - For generic HID gamepads/joysticks, flight sticks, wheels, etc.
-     *     - Pros: Works with many legacy/non-XInput devices, supports more buttons/axes, event-driven via buffered data.
-     *     - Cons: Layout varies by device, force feedback varies, some XInput devices also expose DI “proxy” devices (often filtered).
-     */
-    enum class DeviceKind {
-        XInput,      //!< Use XInput API (Xbox controllers); polled reads; limited to 4 users.
-        DirectInput  //!< Use DirectInput API (generic HID controllers); event-driven with buffered data.
-    };
-
-    /**
-     * @brief Basic information about a discovered device in the merged list.
-     */
-    struct DeviceInfo {
-        int index;                   //!< Zero-based stable index in the merged list presented to users.
-        DeviceKind kind;             //!< Selected API for this device (see DeviceKind for alternatives).
-        std::wstring name;           //!< Human-readable device name (UTF-16).
-        // For XInput
-        DWORD xinputUser = 0;        //!< XInput user index (0..3) when kind == DeviceKind::XInput.
-        // For DirectInput
-        GUID diGuid = GUID_NULL;     //!< DirectInput instance GUID when kind == DeviceKind::DirectInput.
-    };
-
-    /// Global run flag toggled by console control handler.
-    std::atomic_bool g_Running{ true };
-    /// Minimal hidden window required by DirectInput SetCooperativeLevel.
-    HWND g_HiddenWnd = nullptr;
-
-    /**
-     * @brief Window procedure for the hidden helper window used by DirectInput.
-     * @param hwnd Window handle.
-     * @param msg Message.
-     * @param wParam WPARAM.
-     * @param lParam LPARAM.
-     * @return LRESULT from processed message or DefWindowProc.
-     * @remarks Only minimal handling is implemented; the window stays hidden.
-     */
-    LRESULT CALLBACK HiddenWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
-        switch (msg) {
-        case WM_CLOSE:
-            DestroyWindow(hwnd);
-            return 0;
-        case WM_DESTROY:
-            return 0;
-        }
-        return DefWindowProc(hwnd, msg, wParam, lParam);
-    }
-
-    /**
-     * @brief Creates a hidden message-only window required by DirectInput cooperative level setup.
-     * @return HWND of the created window, or nullptr on failure.
-     * @note The class is registered once; subsequent calls reuse it.
+     * @brief Console control handler to gracefully stop streaming on Ctrl+C/Ctrl+Break.
+     * @param ctrlType One of the CTRL_* console events.
+     * @return TRUE if handled; FALSE otherwise.
      */
-    HWND CreateHiddenWindow() {
-        HINSTANCE hInst = GetModuleHandleW(nullptr);
-        const wchar_t* kClassName = L"JoystickInputHiddenWnd";
-
-        WNDCLASSW wc = {};
-        wc.lpfnWndProc = HiddenWndProc;
-        wc.hInstance = hInst;
-        wc.lpszClassName = kClassName;
-        wc.hCursor = LoadCursor(nullptr, IDC_ARROW);
-
-        if (!RegisterClassW(&wc)) {
-            // If already registered, continue
-            if (GetLastError() != ERROR_CLASS_ALREADY_EXISTS) {
-                return nullptr;
-            }
-        }
-
-        HWND hwnd = CreateWindowExW(
-            0, kClassName, L"Hidden", WS_OVERLAPPED,
-            CW_USEDEFAULT, CW_USEDEFAULT, 100, 100,
-            nullptr, nullptr, hInst, nullptr);
-
-        if (hwnd) {
-            ShowWindow(hwnd, SW_HIDE);
+    BOOL WINAPI ConsoleCtrlHandler(DWORD ctrlType) {
+        switch (ctrlType) {
+        case CTRL_C_EVENT:
+        case CTRL_BREAK_EVENT:
+        case CTRL_CLOSE_EVENT:
+            g_Running.store(false);
+            if (g_StopEvent) SetEvent(g_StopEvent);
+            return TRUE;
+        default:
+            return FALSE;
         }
-        return hwnd;
-    }
-
-    /**
-     * @brief Converts a UTF-16 wide string to UTF-8.
-     * @param ws Source wide string.
-     * @return UTF-8 encoded std::string.
-     */
-    std::string WToUtf8(const std::wstring& ws) {
-        if (ws.empty()) return {};
-        int len = WideCharToMultiByte(CP_UTF8, 0, ws.c_str(), (int)ws.size(), nullptr, 0, nullptr, nullptr);
-        std::string out(len, '\0');
-        WideCharToMultiByte(CP_UTF8, 0, ws.c_str(), (int)ws.size(), &out[0], len, nullptr, nullptr);
-        return out;
-    }
-
-    /**
-     * @brief Converts a UTF-8 string to UTF-16.
-     * @param s Source UTF-8 string.
-     * @return UTF-16 std::wstring.
-     */
-    std::wstring Utf8ToW(const std::string& s) {
-        if (s.empty()) return {};
-        int len = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), nullptr, 0);
-        std::wstring out(len, L'\0');
-        MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), &out[0], len);
-        return out;
     }
-
+#else
     /**
-     * @brief Detects if an XInput user index is currently connected.
-     * @param userIdx XInput user index in [0, 3].
-     * @return true if connected; otherwise false.
+     * @brief SIGINT/SIGTERM handler to gracefully stop streaming.
+     * @param sig Signal number (unused).
      */
-    bool IsXInputConnected(DWORD userIdx) {
-        XINPUT_STATE state = {};
-        DWORD res = XInputGetState(userIdx, &state);
-        return (res == ERROR_SUCCESS);
+    void SignalHandler(int /*sig*/) {
+        g_Running.store(false);
     }
+#endif
 
     /**
-     * @brief Heuristic to skip likely XInput duplicates in DirectInput enumeration.
-     * @param inst DirectInput device instance.
-     * @return true if the device appears to be an XInput proxy; otherwise false.
-     * @details Filters names containing "XInput", "(XBOX", or "IG_" (common DI proxies for XInput).
+     * @brief Adds @p devices to the identity cache file.
      */
-    bool IsLikelyXInputDuplicate(const DIDEVICEINSTANCEW& inst) {
-        std::wstring name(inst.tszProductName ? inst.tszProductName : L"");
-        std::wstring lname = name;
-        std::transform(lname.begin(), lname.end(), lname.begin(), ::towlower);
-        if (lname.find(L"xinput") != std::wstring::npos) return true;
-        if (lname.find(L"(xbox") != std::wstring::npos) return true;
-        // Many DI proxies for XInput include "IG_"
-        if (lname.find(L"ig_") != std::wstring::npos) return true;
-        return false;
+    void RememberIdentities(const std::vector<DeviceInfo>& devices) {
+        const std::string path = DefaultIdentityCachePath();
+        if (path.empty()) return;
+        IdentityCache cache;
+        cache.Load(path);
+        for (const DeviceInfo& d : devices) cache.Remember(d);
+        cache.Save(path);
     }
 
-    /// Context passed to DirectInput device enumeration.
-    struct DIEnumContext {
-        IDirectInput8W* di = nullptr;                 //!< Owning DirectInput interface.
-        std::vector<DeviceInfo>* out = nullptr;       //!< Output list to append devices to.
-    };
-
     /**
-     * @brief Callback for DirectInput device enumeration (game controllers only).
-     * @param pdidInstance Device instance provided by DirectInput.
-     * @param pContext Pointer to DIEnumContext used to append results.
-     * @return DIENUM_CONTINUE to continue enumeration.
-     * @note Devices that appear to be XInput proxies are filtered out.
+     * @brief Prints usage and lists all available devices with their indices.
+     * @details The list merges XInput and DirectInput devices; XInput proxies in DirectInput are filtered.
      */
-    BOOL CALLBACK EnumDIEnumDevicesCallback(const DIDEVICEINSTANCEW* pdidInstance, VOID* pContext) {
-        auto* ctx = reinterpret_cast<DIEnumContext*>(pContext);
-        if (!ctx || !ctx->out) return DIENUM_CONTINUE;
+    void PrintUsageAndList() {
+        std::cout << "Usage: JoystickInput <deviceIndex> [--rate <Hz>] [--adaptive [--idle-rate <Hz>] [--idle-after <ms>]] [--phase-lock] [--wait sleep|hybrid] [--power-save [--flush <ms>]] [--ring <slots>] [--overflow latest|drop|block] [--di-snapshot] [--di-buffer <records|auto>] [--axis-range <min>:<max>] [--deadzone <0-10000>] [--saturation <0-10000>] [--di-poll-rate <Hz>] [--raw-input] [--compare]\n";
+        std::cout << "       JoystickInput <index> <index>... | --all [--rate <Hz>] [--pool <workers|auto>]   (lines tagged [index])\n";
+        std::cout << "       JoystickInput <identity>... [options]   (identities as listed, e.g. xinput:0 or di:{GUID}; lines tagged by position)\n";
+        std::cout << "       JoystickInput --bench [name|all] [count]\n";
+        std::cout << "       JoystickInput --hid <report descriptor> [raw reports]\n";
+#ifdef __linux__
+        std::cout << "       JoystickInput --replay <input_event capture>\n";
+#endif
+        std::cout << "No argument: lists available devices with their integer index and identity.\n";
+        std::cout << "Identities stay the same when other devices come and go; a known one is opened without listing every device.\n";
+        std::cout << "--rate: poll rate for polled devices (XInput), default 500 Hz.\n";
+        std::cout << "--adaptive: drop to the idle rate (default 30 Hz) after a quiet period (default 2000 ms).\n";
+        std::cout << "--phase-lock: poll just after each expected report of the pad (estimated from packet changes).\n";
+        std::cout << "--wait hybrid: sleep until shortly before each poll or expected DirectInput event, then spin.\n";
+        std::cout << "--power-save: minimize wake-ups (125/10 Hz adaptive coalesced polls, untimed event waits, output batched every 250 ms).\n";
+        std::cout << "--ring/--overflow: output runs on its own thread behind a ring (default 1024 slots); when it falls behind,\n";
+        std::cout << "  keep the latest state (default), drop new states, or block the reader.\n";
+        std::cout << "--di-snapshot: read a full DirectInput state per notification instead of applying each buffered event.\n";
+        std::cout << "--axis-range/--deadzone/--saturation: normalize every axis (DirectInput sets them in the driver,\n";
+        std::cout << "  other devices in software); dead zone and saturation in 1/100 %, e.g. --deadzone 1500.\n";
+        std::cout << "--di-poll-rate: rate for DirectInput devices listed as (polled), which never signal events; default 250 Hz.\n";
+        std::cout << "--di-buffer: DirectInput driver buffer in records (default auto: 64, grown from the event rate and on overflow).\n";
+        std::cout << "--raw-input: read a DirectInput-listed HID controller through Raw Input (GetRawInputBuffer batches) instead.\n";
+        std::cout << "--compare: read an XInput pad through XInput and its DirectInput proxy at once; report which API sees each\n";
+        std::cout << "  button change first and the delay distribution.\n";
+        std::cout << "--pool: spread several devices over worker threads with work stealing (default: one reactor thread).\n\n";
 
-        if (IsLikelyXInputDuplicate(*pdidInstance)) {
-            // Skip XInput proxies; XInput will cover those.
-            return DIENUM_CONTINUE;
+        auto devices = EnumerateDevices();
+        MarkStartup(StartupStage::ListReady);
+        if (devices.empty()) {
+            std::cout << "No game controllers detected.\n";
+            return;
         }
+        RememberIdentities(devices);
 
-        DeviceInfo dev;
-        dev.kind = DeviceKind::DirectInput;
-        dev.name = pdidInstance->tszProductName ? pdidInstance->tszProductName : L"DirectInput Device";
-        dev.diGuid = pdidInstance->guidInstance;
-        ctx->out->push_back(std::move(dev));
-        return DIENUM_CONTINUE;
-    }
-
-    /**
-     * @brief Enumerates available input devices using XInput (users 0..3) and DirectInput.
-     * @return A merged list of DeviceInfo with stable indices.
-     * @details
-     *   - XInput users [0..3] are added if connected.
-     *   - DirectInput devices are enumerated via DI8 and filtered to avoid XInput duplicates.
-     */
-    std::vector<DeviceInfo> EnumerateDevices() {
-        std::vector<DeviceInfo> devices;
-
-        // 1) XInput users 0..3
-        for (DWORD i = 0; i < 4; ++i) {
-            if (IsXInputConnected(i)) {
-                DeviceInfo dev;
-                dev.kind = DeviceKind::XInput;
-                dev.xinputUser = i;
-                dev.name = L"XInput Controller " + std::to_wstring(i);
-                devices.push_back(std::move(dev));
+        std::cout << "Available devices:\n";
+        for (const auto& d : devices) {
+            std::cout << "  [" << d.index << "] "
+                << DeviceKindTag(d.kind)
+                << "  " << d.name;
+            if (d.kind == DeviceKind::XInput) {
+                std::cout << " (user=" << d.xinputUser << ", polled)";
             }
+            else {
+                std::cout << (d.polled ? " (polled)" : " (events)");
+            }
+            std::cout << "  " << DeviceIdentity(d) << "\n";
         }
-
-        // 2) DirectInput devices
-        IDirectInput8W* di = nullptr;
-        if (SUCCEEDED(DirectInput8Create(GetModuleHandleW(nullptr), DIRECTINPUT_VERSION, IID_IDirectInput8W, (void**)&di, nullptr))) {
-            DIEnumContext ctx{ di, &devices };
-            di->EnumDevices(DI8DEVCLASS_GAMECTRL, EnumDIEnumDevicesCallback, &ctx, DIEDFL_ATTACHEDONLY);
-            di->Release();
-        }
-
-        // Assign stable indices
-        for (int i = 0; i < (int)devices.size(); ++i) {
-            devices[i].index = i;
-        }
-        return devices;
     }
 
     /**
-     * @brief Prints a compact representation of an XInput state line to stdout.
-     * @param s XINPUT_STATE to print.
+     * @brief Handles `--bench [name|all] [count]`.
+     * @param argc Argument count.
+     * @param argv Argument vector; argv[1] is "--bench".
+     * @return Process exit code.
      */
-    void PrintXInputState(const XINPUT_STATE& s) {
-        const XINPUT_GAMEPAD& g = s.Gamepad;
-        std::cout
-            << "LX=" << std::setw(6) << (int)g.sThumbLX << "  "
-            << "LY=" << std::setw(6) << (int)g.sThumbLY << "  "
-            << "RX=" << std::setw(6) << (int)g.sThumbRX << "  "
-            << "RY=" << std::setw(6) << (int)g.sThumbRY << "  "
-            << "LT=" << std::setw(3) << (int)g.bLeftTrigger << "  "
-            << "RT=" << std::setw(3) << (int)g.bRightTrigger << "  "
-            << "Buttons=0x" << std::hex << std::setw(4) << std::setfill('0') << g.wButtons << std::dec << std::setfill(' ') << "  "
-            << "DPad(U/D/L/R)="
-            << ((g.wButtons & XINPUT_GAMEPAD_DPAD_UP) ? 1 : 0) << "/"
-            << ((g.wButtons & XINPUT_GAMEPAD_DPAD_DOWN) ? 1 : 0) << "/"
-            << ((g.wButtons & XINPUT_GAMEPAD_DPAD_LEFT) ? 1 : 0) << "/"
-            << ((g.wButtons & XINPUT_GAMEPAD_DPAD_RIGHT) ? 1 : 0)
-            << "\n";
-    }
-
-    /**
-     * @brief Prints a compact representation of a DirectInput DIJOYSTATE2 line to stdout.
-     * @param js DirectInput state structure.
-     * @note For brevity only the first 32 buttons are printed.
-     */
-    void PrintDIState(const DIJOYSTATE2& js) {
-        std::cout
-            << "AXES: "
-            << "lX=" << std::setw(6) << js.lX << " "
-            << "lY=" << std::setw(6) << js.lY << " "
-            << "lZ=" << std::setw(6) << js.lZ << " "
-            << "lRx=" << std::setw(6) << js.lRx << " "
-            << "lRy=" << std::setw(6) << js.lRy << " "
-            << "lRz=" << std::setw(6) << js.lRz << " "
-            << "S0=" << std::setw(6) << js.rglSlider[0] << " "
-            << "S1=" << std::setw(6) << js.rglSlider[1] << " | ";
-
-        std::cout << "POV: ";
-        for (int i = 0; i < 4; ++i) {
-            DWORD pov = js.rgdwPOV[i];
-            if (pov == 0xFFFFFFFF) std::cout << "---- ";
-            else std::cout << std::setw(4) << pov << " ";
+    int RunBenchCommand(int argc, char* argv[]) {
+        if (argc < 3) {
+            PrintBenchmarkList();
+            return 0;
         }
-        std::cout << "| BTN: ";
-        for (int i = 0; i < 32; ++i) { // print first 32 buttons for brevity
-            std::cout << ((js.rgbButtons[i] & 0x80) ? '1' : '0');
+        BenchOptions options;
+        if (argc >= 4) {
+            try {
+                options.samples = std::stoull(argv[3]);
+            }
+            catch (...) {
+                std::cerr << "Invalid benchmark count.\n";
+                return 1;
+            }
         }
-        std::cout << "\n";
+        return RunBenchmark(argv[2], options);
     }
 
     /**
-     * @brief Console control handler to gracefully stop streaming on Ctrl+C/Ctrl+Break.
-     * @param ctrlType One of the CTRL_* console events.
-     * @return TRUE if handled; FALSE otherwise.
+     * @brief Parses an unsigned option value within [minValue, maxValue].
+     * @return false if the text is not a number or out of range.
      */
-    BOOL WINAPI ConsoleCtrlHandler(DWORD ctrlType) {
-        switch (ctrlType) {
-        case CTRL_C_EVENT:
-        case CTRL_BREAK_EVENT:
-        case CTRL_CLOSE_EVENT:
-            g_Running.store(false);
-            return TRUE;
-        default:
-            return FALSE;
+    bool ParseRange(const char* text, uint32_t minValue, uint32_t maxValue, uint32_t& out) {
+        try {
+            const unsigned long v = std::stoul(text);
+            if (v < minValue || v > maxValue) return false;
+            out = static_cast<uint32_t>(v);
+            return true;
+        }
+        catch (...) {
+            return false;
         }
     }
 
     /**
-     * @brief Polls and prints input for a given XInput controller until interrupted.
-     * @param userIndex XInput user index [0..3].
-     * @return 0 on graceful exit, non-zero on disconnects or errors.
-     * @details Uses packet numbers to only print on state changes; sleeps briefly to reduce CPU usage.
+     * @brief Parses the options that follow the device indices.
+     * @param argc Argument count.
+     * @param argv Argument vector.
+     * @param first Index of the first option in @p argv.
+     * @param options Receives the parsed settings.
+     * @return false on an unknown option or a bad value.
      */
-    int RunXInputReader(DWORD userIndex) {
-        std::cout << "Reading XInput controller " << userIndex << " (Ctrl+C to stop)...\n";
-        XINPUT_STATE prev = {};
-        DWORD lastPacket = 0;
-
-        while (g_Running.load()) {
-            XINPUT_STATE st = {};
-            DWORD res = XInputGetState(userIndex, &st);
-            if (res != ERROR_SUCCESS) {
-                std::cout << "Controller disconnected.\n";
-                return 1;
+    bool ParseReaderOptions(int argc, char* argv[], int first, ReaderOptions& options) {
+        bool rateSet = false;
+        bool idleRateSet = false;
+        for (int i = first; i < argc; ++i) {
+            const bool hasValue = i + 1 < argc;
+            if (std::strcmp(argv[i], "--rate") == 0 && hasValue) {
+                if (!ParseRange(argv[++i], 1, 8000, options.pollHz)) return false;
+                rateSet = true;
             }
-
-            if (st.dwPacketNumber != lastPacket) {
-                lastPacket = st.dwPacketNumber;
-                PrintXInputState(st);
+            else if (std::strcmp(argv[i], "--power-save") == 0) {
+                options.powerSave = true;
+            }
+            else if (std::strcmp(argv[i], "--flush") == 0 && hasValue) {
+                if (!ParseRange(argv[++i], 1, 10000, options.flushMs)) return false;
+            }
+            else if (std::strcmp(argv[i], "--raw-input") == 0) {
+                options.rawInput = true;
+            }
+            else if (std::strcmp(argv[i], "--compare") == 0) {
+                options.compareApis = true;
+            }
+            else if (std::strcmp(argv[i], "--di-snapshot") == 0) {
+                options.diSnapshot = true;
+            }
+            else if (std::strcmp(argv[i], "--axis-range") == 0 && hasValue) {
+                AxisConfig range;
+                if (!ParseAxisRange(argv[++i], range)) return false;
+                for (AxisConfig& a : options.axisProfile.axes) {
+                    a.min = range.min;
+                    a.max = range.max;
+                }
+                options.axisProfile.enabled = true;
+            }
+            else if (std::strcmp(argv[i], "--deadzone") == 0 && hasValue) {
+                uint32_t v = 0;
+                if (!ParseRange(argv[++i], 0, 10000, v)) return false;
+                for (AxisConfig& a : options.axisProfile.axes) a.deadzone = v;
+                options.axisProfile.enabled = true;
+            }
+            else if (std::strcmp(argv[i], "--saturation") == 0 && hasValue) {
+                uint32_t v = 0;
+                if (!ParseRange(argv[++i], 0, 10000, v)) return false;
+                for (AxisConfig& a : options.axisProfile.axes) a.saturation = v;
+                options.axisProfile.enabled = true;
+            }
+            else if (std::strcmp(argv[i], "--di-poll-rate") == 0 && hasValue) {
+                if (!ParseRange(argv[++i], 1, 8000, options.diPollHz)) return false;
+            }
+            else if (std::strcmp(argv[i], "--di-buffer") == 0 && hasValue) {
+                ++i;
+                if (std::strcmp(argv[i], "auto") == 0) options.diBufferSize = 0;
+                else if (!ParseRange(argv[i], 1, 65536, options.diBufferSize)) return false;
+            }
+            else if (std::strcmp(argv[i], "--ring") == 0 && hasValue) {
+                if (!ParseRange(argv[++i], 2, 1u << 20, options.ringSlots)) return false;
+            }
+            else if (std::strcmp(argv[i], "--overflow") == 0 && hasValue) {
+                if (!ParseOverflowPolicy(argv[++i], options.overflow)) return false;
+            }
+            else if (std::strcmp(argv[i], "--pool") == 0 && hasValue) {
+                ++i;
+                if (std::strcmp(argv[i], "auto") == 0) {
+                    const unsigned cores = std::thread::hardware_concurrency();
+                    options.poolWorkers = cores ? cores : 1;
+                }
+                else if (!ParseRange(argv[i], 1, 256, options.poolWorkers)) {
+                    return false;
+                }
+            }
+            else if (std::strcmp(argv[i], "--adaptive") == 0) {
+                options.adaptive = true;
+            }
+            else if (std::strcmp(argv[i], "--phase-lock") == 0) {
+                options.phaseLock = true;
+            }
+            else if (std::strcmp(argv[i], "--wait") == 0 && hasValue) {
+                ++i;
+                if (std::strcmp(argv[i], "sleep") == 0) options.waitMode = WaitMode::Sleep;
+                else if (std::strcmp(argv[i], "hybrid") == 0) options.waitMode = WaitMode::Hybrid;
+                else return false;
+            }
+            else if (std::strcmp(argv[i], "--idle-rate") == 0 && hasValue) {
+                if (!ParseRange(argv[++i], 1, 8000, options.idleHz)) return false;
+                options.adaptive = true;
+                idleRateSet = true;
+            }
+            else if (std::strcmp(argv[i], "--idle-after") == 0 && hasValue) {
+                if (!ParseRange(argv[++i], 1, 3600000, options.idleAfterMs)) return false;
+                options.adaptive = true;
+            }
+            else {
+                return false;
             }
-
-            // XInput is inherently polled; sleep briefly to reduce CPU.
-            // Using packet number ensures we print only on state changes.
-            std::this_thread::sleep_for(std::chrono::milliseconds(2));
         }
-        return 0;
+        if (options.powerSave) {
+            // Fewer, coalesced polls; explicit rates still win. Spinning defeats the purpose.
+            if (!rateSet) options.pollHz = 125;
+            if (!idleRateSet) options.idleHz = 10;
+            options.adaptive = true;
+            options.waitMode = WaitMode::Sleep;
+        }
+        return true;
     }
 
     /**
-     * @brief Reads and prints input from a DirectInput device using event notification and buffered data.
-     * @param guidInstance DirectInput device instance GUID.
-     * @return 0 on success; non-zero error code on failure.
-     * @details
-     *   - Sets joystick data format (DIJOYSTATE2).
-     *   - Uses non-exclusive, background cooperative level.
-     *   - Enables buffered input and attaches an event for notifications.
-     *   - Acquires the device and loops until interrupted, handling re-acquire on input loss.
+     * @brief Resolves device selectors (list indices or identities) to devices.
+     * @param chosen Receives the devices in selection order, duplicates removed.
+     * @return false with a message on stderr if a selector matches no device.
+     * @details An identity found in the cache is probed on its own (ProbeDevice()); the device list
+     *          is only enumerated for indices and cache misses. With any identity among the
+     *          selectors, devices are tagged by their position in the selection, since list indices
+     *          may not be known.
      */
-    int RunDirectInputReader(const GUID& guidInstance) {
-        std::cout << "Reading DirectInput device (Ctrl+C to stop)...\n";
+    bool ResolveSelection(const std::vector<std::string>& selectors, std::vector<DeviceInfo>& chosen) {
+        const auto t0 = std::chrono::steady_clock::now();
+        const std::string cachePath = DefaultIdentityCachePath();
+        IdentityCache cache;
+        if (!cachePath.empty()) cache.Load(cachePath);
 
-        IDirectInput8W* di = nullptr;
-        if (FAILED(DirectInput8Create(GetModuleHandleW(nullptr), DIRECTINPUT_VERSION, IID_IDirectInput8W, (void**)&di, nullptr))) {
-            std::cerr << "DirectInput8Create failed.\n";
-            return 2;
-        }
-
-        IDirectInputDevice8W* dev = nullptr;
-        if (FAILED(di->CreateDevice(guidInstance, &dev, nullptr))) {
-            std::cerr << "CreateDevice failed.\n";
-            di->Release();
-            return 3;
+        std::vector<DeviceInfo> devices;
+        bool listed = false;
+        int probed = 0;
+        bool byIdentity = false;
+        for (const std::string& selector : selectors) {
+            if (IsIdentitySelector(selector)) byIdentity = true;
         }
 
-        if (!g_HiddenWnd) {
-            g_HiddenWnd = CreateHiddenWindow();
-            if (!g_HiddenWnd) {
-                std::cerr << "Failed to create hidden window for DirectInput.\n";
-                dev->Release();
-                di->Release();
-                return 4;
+        for (const std::string& selector : selectors) {
+            DeviceInfo device;
+            bool found = false;
+            if (IsIdentitySelector(selector)) {
+                if (const DeviceInfo* known = cache.Find(selector)) {
+                    device = *known;
+                    ++probed;
+                    found = ProbeDevice(device) && DeviceIdentity(device) == selector;
+                    // Its handle is empty or holds another device: the listing below re-adds it if it moved.
+                    if (!found) cache.Forget(selector);
+                }
             }
-        }
-
-        if (FAILED(dev->SetDataFormat(&c_dfDIJoystick2))) {
-            std::cerr << "SetDataFormat failed.\n";
-            dev->Release(); di->Release();
-            return 5;
-        }
-
-        if (FAILED(dev->SetCooperativeLevel(g_HiddenWnd, DISCL_NONEXCLUSIVE | DISCL_BACKGROUND))) {
-            std::cerr << "SetCooperativeLevel failed.\n";
-            dev->Release(); di->Release();
-            return 6;
-        }
+            if (!found) {
+                if (!listed) {
+                    devices = EnumerateDevices();
+                    listed = true;
+                    for (const DeviceInfo& d : devices) cache.Remember(d);
+                }
+                if (IsIdentitySelector(selector)) {
+                    for (const DeviceInfo& d : devices) {
+                        if (DeviceIdentity(d) != selector) continue;
+                        device = d;
+                        found = true;
+                        break;
+                    }
+                    if (!found) {
+                        if (!cachePath.empty()) cache.Save(cachePath);
+                        std::cerr << "No attached device has the identity " << selector << ".\n\n";
+                        return false;
+                    }
+                }
+                else {
+                    int index = -1;
+                    try {
+                        index = std::stoi(selector);
+                    }
+                    catch (...) {
+                        std::cerr << "Invalid argument. Must be an integer device index or a device identity.\n\n";
+                        return false;
+                    }
+                    if (index < 0 || index >= (int)devices.size()) {
+                        std::cerr << "Device index out of range.\n\n";
+                        return false;
+                    }
+                    device = devices[index];
+                }
+            }
+            cache.Remember(device);
 
-        // Enable buffered data so we can get event notifications
-        DIPROPDWORD dipdw;
-        dipdw.diph.dwSize = sizeof(DIPROPDWORD);
-        dipdw.diph.dwHeaderSize = sizeof(DIPROPHEADER);
-        dipdw.diph.dwObj = 0;
-        dipdw.diph.dwHow = DIPH_DEVICE;
-        dipdw.dwData = 64; // buffer size
-        dev->SetProperty(DIPROP_BUFFERSIZE, &dipdw.diph);
-
-        HANDLE hEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr); // auto-reset
-        if (!hEvent) {
-            std::cerr << "CreateEvent failed.\n";
-            dev->Release(); di->Release();
-            return 7;
+            const std::string identity = DeviceIdentity(device);
+            if (std::find_if(chosen.begin(), chosen.end(), [&identity](const DeviceInfo& d) { return DeviceIdentity(d) == identity; }) != chosen.end()) {
+                continue;
+            }
+            if (byIdentity) device.index = (int)chosen.size();
+            chosen.push_back(device);
         }
+        MarkStartup(StartupStage::ListReady);
+        if (!cachePath.empty()) cache.Save(cachePath);
 
-        if (FAILED(dev->SetEventNotification(hEvent))) {
-            std::cerr << "SetEventNotification failed.\n";
-            CloseHandle(hEvent);
-            dev->Release(); di->Release();
-            return 8;
+        if (byIdentity) {
+            const double ms = (double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count() / 1000.0;
+            std::cout << "Resolved " << chosen.size() << " device(s) in " << ms << " ms (" << probed << " targeted probe(s)"
+                << (listed ? ", device list enumerated" : ", no enumeration") << ").\n";
         }
+        return true;
+    }
 
-        HRESULT hr = dev->Acquire();
-        if (FAILED(hr)) {
-            std::cerr << "Acquire failed.\n";
-            dev->SetEventNotification(nullptr);
-            CloseHandle(hEvent);
-            dev->Release(); di->Release();
-            return 9;
-        }
+} // namespace
 
-        // Main event loop: wait for device event, then read state
-        while (g_Running.load()) {
-            DWORD wait = WaitForSingleObject(hEvent, 100);
-            if (wait == WAIT_OBJECT_0) {
-                // Drain buffered events (optional) to keep buffer fresh
-                DIDEVICEOBJECTDATA data[64];
-                DWORD dwItems = 64;
-                while (true) {
-                    dwItems = 64;
-                    hr = dev->GetDeviceData(sizeof(DIDEVICEOBJECTDATA), data, &dwItems, 0);
-                    if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED) {
-                        dev->Acquire();
-                        continue;
-                    }
-                    if (FAILED(hr) || dwItems == 0) break;
-                    // We don't print per-event; we print the full current state below.
-                }
+#if !defined(_WIN32) && !defined(__linux__)
+namespace joystick {
 
-                DIJOYSTATE2 js = {};
-                hr = dev->GetDeviceState(sizeof(DIJOYSTATE2), &js);
-                if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED) {
-                    dev->Acquire();
-                    continue;
-                }
-                if (SUCCEEDED(hr)) {
-                    PrintDIState(js);
-                }
-            }
-            else if (wait == WAIT_TIMEOUT) {
-                // Periodic check to handle disconnections
-                DIJOYSTATE2 js = {};
-                hr = dev->GetDeviceState(sizeof(DIJOYSTATE2), &js);
-                if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED) {
-                    dev->Acquire();
-                }
-                else if (FAILED(hr)) {
-                    std::cout << "Device disconnected or error.\n";
-                    break;
-                }
-            }
-            else {
-                // WAIT_FAILED
-                std::cerr << "WaitForSingleObject failed.\n";
-                break;
-            }
-        }
+    // No native device backend on this platform yet; only benchmarks are available.
+    std::vector<DeviceInfo> EnumerateDevices() {
+        return {};
+    }
 
-        dev->Unacquire();
-        dev->SetEventNotification(nullptr);
-        CloseHandle(hEvent);
-        dev->Release();
-        di->Release();
-        return 0;
+    void NotifyDevicesChanged() {
     }
 
-    /**
-     * @brief Prints usage and lists all available devices with their indices.
-     * @details The list merges XInput and DirectInput devices; XInput proxies in DirectInput are filtered.
-     */
-    void PrintUsageAndList() {
-        std::cout << "Usage: JoystickInput <deviceIndex>\n";
-        std::cout << "No argument: lists available devices with their integer index.\n\n";
+    bool ProbeDevice(DeviceInfo& /*device*/) {
+        return false;
+    }
 
-        auto devices = EnumerateDevices();
-        if (devices.empty()) {
-            std::cout << "No game controllers detected.\n";
-            return;
-        }
+    int RunDeviceReader(const DeviceInfo& /*device*/, const ReaderOptions& /*options*/) {
+        std::cerr << "No input backend available on this platform.\n";
+        return 1;
+    }
 
-        std::cout << "Available devices:\n";
-        for (const auto& d : devices) {
-            std::cout << "  [" << d.index << "] "
-                << (d.kind == DeviceKind::XInput ? "XInput   " : "DirectInp")
-                << "  " << WToUtf8(d.name);
-            if (d.kind == DeviceKind::XInput) {
-                std::cout << " (user=" << d.xinputUser << ")";
-            }
-            std::cout << "\n";
-        }
+    int RunMultiDeviceReader(const std::vector<DeviceInfo>& /*devices*/, const ReaderOptions& /*options*/) {
+        std::cerr << "No input backend available on this platform.\n";
+        return 1;
     }
 
-} // namespace
+} // namespace joystick
+#endif
 
 /**
  * @brief Program entry point.
  * @param argc Argument count.
- * @param argv Argument vector; expects an optional device index.
+ * @param argv Argument vector; expects optional device indices or identities.
  * @return Process exit code.
  * @details
  *   - Without arguments: prints usage and available devices.
- *   - With a valid index: starts streaming input using the appropriate API.
+ *   - With a valid index or identity: starts streaming input using the appropriate API.
+ *   - With --bench: runs the portable pipeline benchmarks.
+ *   - --rate <Hz> after the index sets the poll rate of polled devices; --adaptive lowers it while idle.
  */
 int main(int argc, char* argv[]) {
+    MarkStartup(StartupStage::Start);
+#ifdef _WIN32
     SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
 
     if (!g_HiddenWnd) {
         g_HiddenWnd = CreateHiddenWindow(); // prepare for DI usage if needed
     }
+    g_StopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr); // manual-reset: every waiter sees it
+#else
+    std::signal(SIGINT, SignalHandler);
+    std::signal(SIGTERM, SignalHandler);
+#endif
 
     if (argc < 2) {
         PrintUsageAndList();
+        std::cout.flush();
+        PrintStartupTimes();
         return 0;
     }
 
-    int selectedIndex = -1;
-    try {
-        selectedIndex = std::stoi(argv[1]);
+    if (std::strcmp(argv[1], "--bench") == 0) {
+        return RunBenchCommand(argc, argv);
+    }
+    if (std::strcmp(argv[1], "--hid") == 0) {
+        if (argc < 3) {
+            PrintUsageAndList();
+            return 1;
+        }
+        return RunHidDecode(argv[2], argc >= 4 ? argv[3] : "");
+    }
+#ifdef __linux__
+    if (std::strcmp(argv[1], "--replay") == 0) {
+        if (argc < 3) {
+            PrintUsageAndList();
+            return 1;
+        }
+        return RunEvdevReplay(argv[2]);
+    }
+#endif
+
+    // Device selection: one or more indices or identities, or --all.
+    const bool all = std::strcmp(argv[1], "--all") == 0;
+    std::vector<std::string> selectors;
+    int next = 1;
+    if (all) {
+        next = 2;
+    }
+    else {
+        for (; next < argc && std::strncmp(argv[next], "--", 2) != 0; ++next) selectors.push_back(argv[next]);
+        if (selectors.empty()) {
+            std::cerr << "Invalid argument. Must be an integer device index or a device identity.\n\n";
+            PrintUsageAndList();
+            return 1;
+        }
     }
-    catch (...) {
-        std::cerr << "Invalid argument. Must be an integer device index.\n\n";
+
+    ReaderOptions options;
+    if (!ParseReaderOptions(argc, argv, next, options)) {
+        std::cerr << "Invalid option or value.\n\n";
         PrintUsageAndList();
         return 1;
     }
 
-    auto devices = EnumerateDevices();
-    if (selectedIndex < 0 || selectedIndex >= (int)devices.size()) {
-        std::cerr << "Device index out of range.\n\n";
+    std::vector<DeviceInfo> chosen;
+    if (all) {
+        chosen = EnumerateDevices();
+        MarkStartup(StartupStage::ListReady);
+        RememberIdentities(chosen);
+    }
+    else if (!ResolveSelection(selectors, chosen)) {
         PrintUsageAndList();
         return 1;
     }
 
-    const DeviceInfo& sel = devices[selectedIndex];
-    std::cout << "Selected [" << sel.index << "] "
-        << (sel.kind == DeviceKind::XInput ? "XInput   " : "DirectInp") << "  "
-        << WToUtf8(sel.name) << "\n";
-
-    if (sel.kind == DeviceKind::XInput) {
-        return RunXInputReader(sel.xinputUser);
-    }
-    else {
-        // Initialize COM for safety with some DI providers
-        CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
-        int rc = RunDirectInputReader(sel.diGuid);
-        CoUninitialize();
+    if (all || chosen.size() > 1) {
+        if (chosen.empty()) {
+            std::cerr << "No devices found.\n";
+            return 1;
+        }
+        for (const DeviceInfo& d : chosen) {
+            std::cout << "Selected [" << d.index << "] " << DeviceKindTag(d.kind) << "  " << d.name << "\n";
+        }
+        options.attachNew = all;
+        const int rc = RunMultiDeviceReader(chosen, options);
+        PrintStartupTimes();
         return rc;
     }
+
+    const DeviceInfo& sel = chosen[0];
+    std::cout << "Selected [" << sel.index << "] "
+        << DeviceKindTag(sel.kind) << "  "
+        << sel.name << "\n";
+
+    const int rc = RunDeviceReader(sel, options);
+    PrintStartupTimes();
+    return rc;
 }
\ No newline at end of file
@@ -0,0 +1,32 @@
+﻿/**
+ * @file
+ * @brief Known-controller table for the specialized report decoders.
+ */
+
+#include "KnownControllers.h"
+
+namespace joystick {
+
+    // Out-of-class definitions of the layout tables (required for ODR-use in C++14).
+    constexpr FixedField DualSenseUsbLayout::kFields[];
+    constexpr FixedField XboxSeriesBtLayout::kFields[];
+    constexpr FixedField MsiClawLayout::kFields[];
+
+    namespace {
+
+        const KnownController kKnownControllers[] = {
+            { 0x054C, 0x0CE6, "DualSense (USB)", true, &FixedLayoutDecoder<DualSenseUsbLayout>::Decode },
+            { 0x045E, 0x0B13, "Xbox Series (Bluetooth)", true, &FixedLayoutDecoder<XboxSeriesBtLayout>::Decode },
+            { 0x0DB0, 0x1901, "MSI Claw (game mode)", false, &FixedLayoutDecoder<MsiClawLayout>::Decode },
+        };
+
+    } // namespace
+
+    const KnownController* FindKnownController(uint16_t vendorId, uint16_t productId) {
+        for (const auto& c : kKnownControllers) {
+            if (c.vendorId == vendorId && c.productId == productId) return &c;
+        }
+        return nullptr;
+    }
+
+} // namespace joystick
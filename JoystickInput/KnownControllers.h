@@ -0,0 +1,225 @@
+﻿/**
+ * @file
+ * @brief Compile-time specialized report decoders for controllers deployed in volume (portable).
+ * @details
+ *   - Each controller is described by a constexpr table of FixedField entries. FixedLayoutDecoder<Layout>
+ *     expands the table at compile time, so decoding a report is a fixed sequence of loads, shifts and
+ *     masks with no descriptor interpretation (compare DecodeHidReport, which runs a plan at run time).
+ *   - Output is StateLayout::Gamepad in XInput units (sticks -32768..32767 with Y up, triggers 0..255,
+ *     XINPUT_GAMEPAD_* button bits), so known pads print the same way whichever API delivered them.
+ *   - FindKnownController() selects a decoder by VID/PID when a device is opened. A report with an
+ *     unexpected ID or length is rejected so callers can fall back to the generic descriptor path.
+ */
+
+#pragma once
+
+#include "InputCore.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace joystick {
+
+    /**
+     * @brief How one field is converted.
+     */
+    enum class FixedFieldKind : uint8_t {
+        Stick,          //!< Unsigned centered value -> signed 16-bit (HID X/Rx).
+        StickInverted,  //!< As Stick, with the direction flipped (HID Y grows downwards, XInput Y upwards).
+        Trigger,        //!< Unsigned value -> 0..255.
+        Button,         //!< One bit -> XInput button mask.
+        Hat             //!< 8-way hat -> the four D-pad bits.
+    };
+
+    /**
+     * @brief One field of a fixed report layout.
+     */
+    struct FixedField {
+        FixedFieldKind kind;
+        uint16_t byteOffset;  //!< First byte of the field, report ID byte included.
+        uint8_t bitShift;     //!< Bit position within the loaded little-endian value.
+        uint8_t bits;         //!< Field width (1..16).
+        uint16_t target;      //!< Axis slot (GamepadAxis), button mask (GamepadButton), or the raw value meaning "up" for Hat.
+    };
+
+    namespace detail {
+
+        /// D-pad bits for hat positions N, NE, E, SE, S, SW, W, NW.
+        constexpr uint16_t kHatToDpad[8] = {
+            kGamepadDpadUp, kGamepadDpadUp | kGamepadDpadRight, kGamepadDpadRight, kGamepadDpadDown | kGamepadDpadRight,
+            kGamepadDpadDown, kGamepadDpadDown | kGamepadDpadLeft, kGamepadDpadLeft, kGamepadDpadUp | kGamepadDpadLeft
+        };
+
+        // Fields never span more than two bytes in the supported layouts.
+        template <class Layout, size_t I>
+        inline uint32_t Load(const uint8_t* r) {
+            constexpr FixedField F = Layout::kFields[I];
+            static_assert(F.bitShift + F.bits <= 16, "field spans more than two bytes");
+            const uint32_t raw = (F.bitShift + F.bits <= 8)
+                ? r[F.byteOffset]
+                : static_cast<uint32_t>(r[F.byteOffset]) | (static_cast<uint32_t>(r[F.byteOffset + 1]) << 8);
+            return (raw >> F.bitShift) & ((1u << F.bits) - 1);
+        }
+
+        template <class Layout, size_t I>
+        inline void DecodeField(const uint8_t* r, InputState& s, uint32_t& buttons) {
+            constexpr FixedField F = Layout::kFields[I];
+            const uint32_t v = Load<Layout, I>(r);
+            switch (F.kind) {
+            case FixedFieldKind::Stick:
+                // Scaled by multiplying: left-shifting a negative value is undefined in C++14.
+                s.axes[F.target] = (static_cast<int32_t>(v) - (1 << (F.bits - 1))) * (1 << (16 - F.bits));
+                break;
+            case FixedFieldKind::StickInverted:
+                s.axes[F.target] = ((1 << (F.bits - 1)) - 1 - static_cast<int32_t>(v)) * (1 << (16 - F.bits));
+                break;
+            case FixedFieldKind::Trigger:
+                s.axes[F.target] = static_cast<int32_t>(F.bits > 8 ? v >> (F.bits - 8) : v << (8 - F.bits));
+                break;
+            case FixedFieldKind::Button:
+                buttons |= v ? F.target : 0u;
+                break;
+            case FixedFieldKind::Hat: {
+                const uint32_t pos = (v - F.target) & 0xFFu;
+                buttons |= pos < 8 ? kHatToDpad[pos] : 0u;
+                break;
+            }
+            }
+        }
+
+        template <class Layout, size_t... I>
+        inline void DecodeFields(const uint8_t* r, InputState& s, uint32_t& buttons, std::index_sequence<I...>) {
+            const int expand[] = { 0, (DecodeField<Layout, I>(r, s, buttons), 0)... };
+            (void)expand;
+        }
+
+    } // namespace detail
+
+    /**
+     * @brief Decoder generated from a layout type.
+     * @tparam Layout Provides `kReportId` (0 = none), `kMinSize` and the `kFields` table.
+     */
+    template <class Layout>
+    struct FixedLayoutDecoder {
+        static constexpr size_t kFieldCount = sizeof(Layout::kFields) / sizeof(Layout::kFields[0]);
+
+        /**
+         * @brief Decodes one raw report.
+         * @return false if the report ID or length does not match the layout.
+         */
+        static bool Decode(const uint8_t* report, size_t len, InputState& state) {
+            if (len < Layout::kMinSize || (Layout::kReportId != 0 && report[0] != Layout::kReportId)) return false;
+            uint32_t buttons = 0;
+            detail::DecodeFields<Layout>(report, state, buttons, std::make_index_sequence<kFieldCount>());
+            state.buttons[0] = buttons;
+            ++state.packet;
+            return true;
+        }
+    };
+
+    /**
+     * @brief DualSense over USB (054C:0CE6), input report 0x01 (64 bytes).
+     */
+    struct DualSenseUsbLayout {
+        static constexpr uint8_t kReportId = 0x01;
+        static constexpr size_t kMinSize = 11;
+        static constexpr FixedField kFields[] = {
+            { FixedFieldKind::Stick, 1, 0, 8, kAxisLeftX },
+            { FixedFieldKind::StickInverted, 2, 0, 8, kAxisLeftY },
+            { FixedFieldKind::Stick, 3, 0, 8, kAxisRightX },
+            { FixedFieldKind::StickInverted, 4, 0, 8, kAxisRightY },
+            { FixedFieldKind::Trigger, 5, 0, 8, kAxisLeftTrigger },
+            { FixedFieldKind::Trigger, 6, 0, 8, kAxisRightTrigger },
+            { FixedFieldKind::Hat, 8, 0, 4, 0 },
+            { FixedFieldKind::Button, 8, 4, 1, kGamepadX },             // Square
+            { FixedFieldKind::Button, 8, 5, 1, kGamepadA },             // Cross
+            { FixedFieldKind::Button, 8, 6, 1, kGamepadB },             // Circle
+            { FixedFieldKind::Button, 8, 7, 1, kGamepadY },             // Triangle
+            { FixedFieldKind::Button, 9, 0, 1, kGamepadLeftShoulder },  // L1
+            { FixedFieldKind::Button, 9, 1, 1, kGamepadRightShoulder }, // R1
+            { FixedFieldKind::Button, 9, 4, 1, kGamepadBack },          // Create
+            { FixedFieldKind::Button, 9, 5, 1, kGamepadStart },         // Options
+            { FixedFieldKind::Button, 9, 6, 1, kGamepadLeftThumb },     // L3
+            { FixedFieldKind::Button, 9, 7, 1, kGamepadRightThumb },    // R3
+        };
+    };
+
+    /**
+     * @brief Xbox Series controller over Bluetooth (045E:0B13), input report 0x01 (firmware 5.x, 17 bytes).
+     */
+    struct XboxSeriesBtLayout {
+        static constexpr uint8_t kReportId = 0x01;
+        static constexpr size_t kMinSize = 16;
+        static constexpr FixedField kFields[] = {
+            { FixedFieldKind::Stick, 1, 0, 16, kAxisLeftX },
+            { FixedFieldKind::StickInverted, 3, 0, 16, kAxisLeftY },
+            { FixedFieldKind::Stick, 5, 0, 16, kAxisRightX },
+            { FixedFieldKind::StickInverted, 7, 0, 16, kAxisRightY },
+            { FixedFieldKind::Trigger, 9, 0, 10, kAxisLeftTrigger },
+            { FixedFieldKind::Trigger, 11, 0, 10, kAxisRightTrigger },
+            { FixedFieldKind::Hat, 13, 0, 4, 1 },
+            { FixedFieldKind::Button, 14, 0, 1, kGamepadA },
+            { FixedFieldKind::Button, 14, 1, 1, kGamepadB },
+            { FixedFieldKind::Button, 14, 3, 1, kGamepadX },
+            { FixedFieldKind::Button, 14, 4, 1, kGamepadY },
+            { FixedFieldKind::Button, 14, 6, 1, kGamepadLeftShoulder },
+            { FixedFieldKind::Button, 14, 7, 1, kGamepadRightShoulder },
+            { FixedFieldKind::Button, 15, 2, 1, kGamepadBack },         // View
+            { FixedFieldKind::Button, 15, 3, 1, kGamepadStart },        // Menu
+            { FixedFieldKind::Button, 15, 5, 1, kGamepadLeftThumb },
+            { FixedFieldKind::Button, 15, 6, 1, kGamepadRightThumb },
+        };
+    };
+
+    /**
+     * @brief MSI Claw built-in pad in GAME MODE (0DB0:1901).
+     * @details The pad enumerates as an XInput-compatible controller; this table assumes the
+     *          Xbox-style HID report (no report ID, 16-bit sticks, 10-bit triggers). It has not been
+     *          checked against a capture yet: compare with `--hid` output before relying on it.
+     */
+    struct MsiClawLayout {
+        static constexpr uint8_t kReportId = 0;
+        static constexpr size_t kMinSize = 15;
+        static constexpr FixedField kFields[] = {
+            { FixedFieldKind::Stick, 0, 0, 16, kAxisLeftX },
+            { FixedFieldKind::StickInverted, 2, 0, 16, kAxisLeftY },
+            { FixedFieldKind::Stick, 4, 0, 16, kAxisRightX },
+            { FixedFieldKind::StickInverted, 6, 0, 16, kAxisRightY },
+            { FixedFieldKind::Trigger, 8, 0, 10, kAxisLeftTrigger },
+            { FixedFieldKind::Trigger, 10, 0, 10, kAxisRightTrigger },
+            { FixedFieldKind::Button, 12, 0, 1, kGamepadA },
+            { FixedFieldKind::Button, 12, 1, 1, kGamepadB },
+            { FixedFieldKind::Button, 12, 2, 1, kGamepadX },
+            { FixedFieldKind::Button, 12, 3, 1, kGamepadY },
+            { FixedFieldKind::Button, 12, 4, 1, kGamepadLeftShoulder },
+            { FixedFieldKind::Button, 12, 5, 1, kGamepadRightShoulder },
+            { FixedFieldKind::Button, 12, 6, 1, kGamepadBack },
+            { FixedFieldKind::Button, 12, 7, 1, kGamepadStart },
+            { FixedFieldKind::Button, 13, 0, 1, kGamepadLeftThumb },
+            { FixedFieldKind::Button, 13, 1, 1, kGamepadRightThumb },
+            { FixedFieldKind::Hat, 14, 0, 4, 1 },
+        };
+    };
+
+    /// Specialized decoder entry point: decodes one report or returns false.
+    using FixedDecodeFn = bool (*)(const uint8_t* report, size_t len, InputState& state);
+
+    /**
+     * @brief A controller with a specialized decoder.
+     */
+    struct KnownController {
+        uint16_t vendorId;
+        uint16_t productId;
+        const char* name;
+        bool verified;          //!< Layout checked against captures from real hardware.
+        FixedDecodeFn decode;
+    };
+
+    /**
+     * @brief Looks up the specialized decoder for a device.
+     * @return Entry, or nullptr when the device has no fixed layout (use the generic descriptor plan).
+     */
+    const KnownController* FindKnownController(uint16_t vendorId, uint16_t productId);
+
+} // namespace joystick
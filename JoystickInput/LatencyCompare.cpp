@@ -0,0 +1,134 @@
+﻿/**
+ * @file
+ * @brief Transition matching and reporting of the XInput / DirectInput comparison.
+ */
+
+#include "LatencyCompare.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace joystick {
+
+    namespace {
+
+        /// XInput bit of DirectInput proxy buttons 0..9.
+        constexpr uint32_t kProxyButtons[10] = {
+            kGamepadA, kGamepadB, kGamepadX, kGamepadY, kGamepadLeftShoulder,
+            kGamepadRightShoulder, kGamepadBack, kGamepadStart, kGamepadLeftThumb, kGamepadRightThumb
+        };
+
+        /// D-pad bits of the eight POV directions, clockwise from north.
+        constexpr uint32_t kPovDpad[8] = {
+            kGamepadDpadUp, kGamepadDpadUp | kGamepadDpadRight, kGamepadDpadRight, kGamepadDpadDown | kGamepadDpadRight,
+            kGamepadDpadDown, kGamepadDpadDown | kGamepadDpadLeft, kGamepadDpadLeft, kGamepadDpadUp | kGamepadDpadLeft
+        };
+
+        /// Nearest-rank percentile of sorted values.
+        int64_t Percentile(const std::vector<int64_t>& sorted, double p) {
+            size_t rank = static_cast<size_t>(p * (double)sorted.size() + 0.5);
+            if (rank > 0) --rank;
+            return sorted[std::min(rank, sorted.size() - 1)];
+        }
+
+    } // namespace
+
+    uint32_t ProxyControls(const InputState& state) {
+        uint32_t mask = 0;
+        for (int i = 0; i < 10; ++i) {
+            if (IsButtonDown(state, i)) mask |= kProxyButtons[i];
+        }
+        const uint32_t pov = state.povs[0];
+        if (pov != kPovCentered && pov < 36000) mask |= kPovDpad[((pov + 2250) / 4500) % 8];
+        return mask;
+    }
+
+    void LatencyComparer::Feed(int path, uint32_t controls, uint64_t nowNs, std::vector<MatchedEdge>* matched) {
+        controls &= kComparedControls;
+        Expire(nowNs);
+        if (!seen_[path]) {
+            seen_[path] = true;
+            last_[path] = controls;
+            return;
+        }
+        uint32_t changed = controls ^ last_[path];
+        last_[path] = controls;
+        const int other = 1 - path;
+        while (changed) {
+            const uint32_t bit = changed & (0u - changed);
+            changed &= changed - 1;
+            const bool pressed = (controls & bit) != 0;
+            ++edges_[path];
+
+            std::deque<Edge>& theirs = pending_[other];
+            auto it = std::find_if(theirs.begin(), theirs.end(), [bit, pressed](const Edge& e) {
+                return e.control == bit && e.pressed == pressed;
+            });
+            if (it == theirs.end()) {
+                pending_[path].push_back(Edge{ bit, pressed, nowNs });
+                continue;
+            }
+            // The other path saw it first; the delta is always path 1 minus path 0.
+            const int64_t late = static_cast<int64_t>(nowNs) - static_cast<int64_t>(it->timeNs);
+            const int64_t delta = path == 1 ? late : -late;
+            theirs.erase(it);
+            deltas_.push_back(delta);
+            ++first_[other];
+            if (matched) matched->push_back(MatchedEdge{ bit, pressed, delta });
+        }
+    }
+
+    void LatencyComparer::Expire(uint64_t nowNs) {
+        for (int p = 0; p < 2; ++p) {
+            std::deque<Edge>& q = pending_[p];
+            // Arrival times of the two reader threads may interleave slightly out of order.
+            while (!q.empty() && nowNs > q.front().timeNs && nowNs - q.front().timeNs > windowNs_) {
+                q.pop_front();
+                ++unmatched_[p];
+            }
+        }
+    }
+
+    void PrintLatencyComparison(const LatencyComparer& comparer, const char* const names[2]) {
+        const size_t n = comparer.Matched();
+        std::printf("compare: %zu matched transitions; %s first %llu (%.1f%%), %s first %llu (%.1f%%); "
+            "unmatched %s %llu, %s %llu\n",
+            n, names[0], (unsigned long long)comparer.FirstCount(0), n ? 100.0 * (double)comparer.FirstCount(0) / (double)n : 0.0,
+            names[1], (unsigned long long)comparer.FirstCount(1), n ? 100.0 * (double)comparer.FirstCount(1) / (double)n : 0.0,
+            names[0], (unsigned long long)comparer.Unmatched(0), names[1], (unsigned long long)comparer.Unmatched(1));
+        if (n == 0) return;
+
+        std::vector<int64_t> sorted = comparer.Deltas();
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0;
+        for (int64_t d : sorted) sum += (double)d;
+        std::printf("compare: %s - %s (ms): mean %+.2f, p10 %+.2f, p50 %+.2f, p90 %+.2f, p99 %+.2f, min %+.2f, max %+.2f\n",
+            names[1], names[0], sum / (double)n / 1e6,
+            (double)Percentile(sorted, 0.10) / 1e6, (double)Percentile(sorted, 0.50) / 1e6,
+            (double)Percentile(sorted, 0.90) / 1e6, (double)Percentile(sorted, 0.99) / 1e6,
+            (double)sorted.front() / 1e6, (double)sorted.back() / 1e6);
+        const double mean = sum / (double)n;
+        std::printf("compare: %s delivers changes first on average (by %.2f ms)\n", mean >= 0 ? names[0] : names[1], (mean >= 0 ? mean : -mean) / 1e6);
+    }
+
+    const char* ControlName(uint32_t control) {
+        switch (control) {
+        case kGamepadDpadUp: return "DpadUp";
+        case kGamepadDpadDown: return "DpadDown";
+        case kGamepadDpadLeft: return "DpadLeft";
+        case kGamepadDpadRight: return "DpadRight";
+        case kGamepadStart: return "Start";
+        case kGamepadBack: return "Back";
+        case kGamepadLeftThumb: return "LS";
+        case kGamepadRightThumb: return "RS";
+        case kGamepadLeftShoulder: return "LB";
+        case kGamepadRightShoulder: return "RB";
+        case kGamepadA: return "A";
+        case kGamepadB: return "B";
+        case kGamepadX: return "X";
+        case kGamepadY: return "Y";
+        default: return "?";
+        }
+    }
+
+} // namespace joystick
@@ -0,0 +1,106 @@
+﻿/**
+ * @file
+ * @brief Side-by-side latency of two input paths of one pad (portable).
+ * @details
+ *   - An Xbox-style pad is visible through XInput and, as an "IG_" proxy, through DirectInput. Both
+ *     paths are reduced to the XInput button mask (ProxyControls() maps the proxy's buttons 0..9
+ *     and POV 0), so the same press or release can be recognised on either side.
+ *   - Sticks and triggers are not compared: the proxy combines both triggers on one axis and the
+ *     sticks move continuously, so their samples do not pair up one to one.
+ *   - LatencyComparer pairs each edge with the oldest unmatched identical edge of the other path
+ *     within a window, records which path saw it first and by how much, and counts edges left
+ *     unmatched (lost or filtered by one path).
+ */
+
+#pragma once
+
+#include "InputCore.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace joystick {
+
+    /// Buttons and D-pad bits compared between the paths (XInput mask, Guide excluded).
+    constexpr uint32_t kComparedControls = 0xF3FF;
+
+    /// Controls of a Gamepad-layout state (XInput).
+    inline uint32_t GamepadControls(const InputState& state) {
+        return static_cast<uint32_t>(state.buttons[0]) & kComparedControls;
+    }
+
+    /**
+     * @brief Controls of a DirectInput XInput proxy (Joystick layout).
+     * @details Buttons 0..9 are A, B, X, Y, LB, RB, Back, Start, LS, RS; POV 0 is the D-pad.
+     */
+    uint32_t ProxyControls(const InputState& state);
+
+    /**
+     * @brief One matched transition.
+     */
+    struct MatchedEdge {
+        uint32_t control = 0;  //!< XInput button bit.
+        bool pressed = false;
+        int64_t deltaNs = 0;   //!< Time on path 1 minus time on path 0 (positive: path 0 was first).
+    };
+
+    /**
+     * @brief Pairs identical transitions of two paths and collects the delays between them.
+     */
+    class LatencyComparer {
+    public:
+        /**
+         * @param windowNs Edges unmatched for longer than this count as missing on the other path.
+         * @details Keep it well under the time between two presses of one button, or an edge one path
+         *          dropped (a tap shorter than a poll period) pairs with the next press.
+         */
+        explicit LatencyComparer(uint64_t windowNs = 50000000ull) : windowNs_(windowNs) {}
+
+        /**
+         * @brief Feeds the controls one path reported at @p nowNs.
+         * @param path 0 or 1.
+         * @param controls Current control mask of that path.
+         * @param nowNs Arrival time on a clock shared by both paths.
+         * @param matched Receives the transitions this call paired (optional).
+         * @details The first call per path sets the baseline and produces no edges.
+         */
+        void Feed(int path, uint32_t controls, uint64_t nowNs, std::vector<MatchedEdge>* matched = nullptr);
+
+        /// Counts every pending edge older than the window (at @p nowNs) as unmatched.
+        void Expire(uint64_t nowNs);
+
+        size_t Matched() const { return deltas_.size(); }
+        uint64_t FirstCount(int path) const { return first_[path]; }
+        uint64_t Unmatched(int path) const { return unmatched_[path]; }
+        uint64_t Edges(int path) const { return edges_[path]; }
+        const std::vector<int64_t>& Deltas() const { return deltas_; }
+
+    private:
+        struct Edge {
+            uint32_t control;
+            bool pressed;
+            uint64_t timeNs;
+        };
+
+        uint64_t windowNs_;
+        bool seen_[2] = {};
+        uint32_t last_[2] = {};
+        std::deque<Edge> pending_[2];
+        std::vector<int64_t> deltas_;
+        uint64_t first_[2] = {};
+        uint64_t unmatched_[2] = {};
+        uint64_t edges_[2] = {};
+    };
+
+    /**
+     * @brief Prints the comparison ("compare: ..."): who was first, and the delay distribution.
+     * @param names Path names, e.g. { "xinput", "directinput" }.
+     */
+    void PrintLatencyComparison(const LatencyComparer& comparer, const char* const names[2]);
+
+    /// Name of one XInput button bit ("A", "DpadUp", ...).
+    const char* ControlName(uint32_t control);
+
+} // namespace joystick
@@ -0,0 +1,172 @@
+﻿/**
+ * @file
+ * @brief Phase-locked poll planner.
+ */
+
+#include "PhaseLock.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace joystick {
+
+    PhaseLock::PhaseLock(const PhaseLockConfig& config) : config_(config) {
+        if (config_.acquireSamples < 8) config_.acquireSamples = 8;
+        if (config_.probeEvery == 0) config_.probeEvery = 1;
+        marks_.reserve(config_.acquireSamples);
+    }
+
+    uint64_t PhaseLock::NextPollNs(uint64_t nowNs) {
+        if (!metrics_.locked) {
+            return havePoll_ ? lastPollNs_ + config_.acquirePeriodNs : nowNs;
+        }
+        const double period = metrics_.periodNs;
+        const double guard = static_cast<double>(config_.guardNs);
+        // Stalled for more than a period: skip the reports that were missed.
+        while (expected_ + guard + period < static_cast<double>(nowNs)) {
+            expected_ += period;
+            stage_ = Stage::Main;
+        }
+        metrics_.phaseNs = std::fmod(expected_, period);
+        const double at = stage_ == Stage::Probe ? expected_ : expected_ + guard;
+        return at > 0 ? static_cast<uint64_t>(at) : 0;
+    }
+
+    void PhaseLock::OnPoll(uint64_t pollNs, bool changed) {
+        ++metrics_.polls;
+        if (!metrics_.locked) {
+            if (changed && havePoll_) {
+                marks_.push_back(0.5 * (static_cast<double>(lastPollNs_) + static_cast<double>(pollNs)));
+                if (marks_.size() >= config_.acquireSamples) TryLock();
+            }
+            lastPollNs_ = pollNs;
+            havePoll_ = true;
+            return;
+        }
+
+        if (stage_ == Stage::Probe) {
+            ++metrics_.probes;
+            probeSaw_ = changed;
+            stage_ = Stage::Main;
+            return;
+        }
+
+        // Main poll: close the cycle; a probed cycle with a transition yields one phase decision.
+        const bool probed = cycle_ % config_.probeEvery == 0;
+        if (probed && (probeSaw_ || changed)) {
+            Detect(probeSaw_ ? -1 : +1);
+        }
+        probeSaw_ = false;
+        if (!metrics_.locked) return; // Detect() dropped the lock
+
+        expected_ += metrics_.periodNs;
+        ++cycle_;
+        stage_ = cycle_ % config_.probeEvery == 0 ? Stage::Probe : Stage::Main;
+        lastPollNs_ = pollNs;
+    }
+
+    void PhaseLock::TryLock() {
+        const size_t n = marks_.size();
+        std::vector<double> gaps(n - 1);
+        for (size_t i = 1; i < n; ++i) gaps[i - 1] = marks_[i] - marks_[i - 1];
+
+        // The shortest gaps are single periods (longer ones skip reports without a state change);
+        // take the median of the lowest quartile as the first guess.
+        std::vector<double> sorted(gaps);
+        std::sort(sorted.begin(), sorted.end());
+        const double guess = sorted[sorted.size() / 8];
+        if (guess < 2.0 * static_cast<double>(config_.acquirePeriodNs)) {
+            // The acquisition polls cannot resolve this period.
+            ++metrics_.failedFits;
+            marks_.clear();
+            return;
+        }
+
+        // Number the reports gap by gap (robust to the guess error), then fit t = a + b * index.
+        std::vector<double> index(n);
+        index[0] = 0;
+        for (size_t i = 1; i < n; ++i) {
+            const double steps = std::floor(gaps[i - 1] / guess + 0.5);
+            index[i] = index[i - 1] + (steps < 1 ? 1 : steps);
+        }
+        double sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const double x = index[i];
+            const double y = marks_[i] - marks_[0];
+            sx += x; sy += y; sxx += x * x; sxy += x * y;
+        }
+        const double dn = static_cast<double>(n);
+        const double den = dn * sxx - sx * sx;
+        if (den <= 0) {
+            ++metrics_.failedFits;
+            marks_.clear();
+            return;
+        }
+        const double b = (dn * sxy - sx * sy) / den;
+        const double a = (sy - b * sx) / dn;
+        double ss = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const double r = marks_[i] - marks_[0] - (a + b * index[i]);
+            ss += r * r;
+        }
+        const double rms = std::sqrt(ss / dn);
+        metrics_.fitResidualNs = rms;
+
+        // Bracket midpoints carry up to +-acquirePeriod/2 of error, so accept residuals up to a
+        // third of the acquisition interval beyond that but never more than an eighth of the period.
+        if (b <= 0 || rms > std::min(b / 8.0, 0.6 * static_cast<double>(config_.acquirePeriodNs))) {
+            ++metrics_.failedFits;
+            marks_.clear();
+            return;
+        }
+
+        metrics_.locked = true;
+        metrics_.periodNs = b;
+        lockedPeriod_ = b;
+        ++metrics_.locks;
+        expected_ = marks_[0] + a + b * (index[n - 1] + 1);
+        while (expected_ + static_cast<double>(config_.guardNs) < static_cast<double>(lastPollNs_)) expected_ += b;
+        cycle_ = 0;
+        stage_ = Stage::Probe;
+        probeSaw_ = false;
+        decisionCount_ = 0;
+        decisionSum_ = 0;
+        metrics_.quality = 1.0;
+        marks_.clear();
+    }
+
+    void PhaseLock::Unlock() {
+        metrics_.locked = false;
+        metrics_.quality = 0;
+        ++metrics_.unlocks;
+        marks_.clear();
+        havePoll_ = false;
+    }
+
+    void PhaseLock::Detect(int sign) {
+        // Phase step: a fraction of the guard; the period follows slowly (second-order loop).
+        const double step = static_cast<double>(config_.guardNs) / 4.0;
+        expected_ += sign * step;
+        metrics_.periodNs += sign * step / 16.0;
+        metrics_.periodNs = std::min(std::max(metrics_.periodNs, lockedPeriod_ * 0.98), lockedPeriod_ * 1.02);
+
+        const uint32_t slot = decisionCount_ % 32;
+        if (decisionCount_ >= 32) decisionSum_ -= decisions_[slot];
+        decisions_[slot] = static_cast<int8_t>(sign);
+        decisionSum_ += sign;
+        ++decisionCount_;
+        const uint32_t window = decisionCount_ < 32 ? decisionCount_ : 32;
+        metrics_.quality = 1.0 - std::fabs(static_cast<double>(decisionSum_)) / window;
+        if (window == 32 && metrics_.quality < 0.25) Unlock();
+    }
+
+    void PrintPhaseLockMetrics(const PhaseLockMetrics& m, double seconds) {
+        std::printf("phase-lock: %s, period %.3f ms, phase %.3f ms, quality %.2f, fit residual %.1f us, "
+            "%.1f polls/s (%llu probes), locks %llu, unlocks %llu, rejected fits %llu\n",
+            m.locked ? "locked" : "acquiring", m.periodNs / 1e6, m.phaseNs / 1e6, m.quality, m.fitResidualNs / 1e3,
+            seconds > 0 ? (double)m.polls / seconds : 0.0, (unsigned long long)m.probes,
+            (unsigned long long)m.locks, (unsigned long long)m.unlocks, (unsigned long long)m.failedFits);
+    }
+
+} // namespace joystick
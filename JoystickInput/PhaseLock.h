@@ -0,0 +1,104 @@
+﻿/**
+ * @file
+ * @brief Phase-locked polling: estimates a polled device's report period and phase from packet-number
+ *        transitions and schedules each poll just after the expected report (portable).
+ * @details
+ *   - Acquire: poll at acquirePeriodNs; every transition brackets a report between two polls. After
+ *     acquireSamples transitions, a least-squares fit of report index vs bracket midpoint gives the
+ *     period and phase. A fit whose residual is small against the period locks the loop.
+ *   - Locked: one poll per period at (expected report + guard). Every probeEvery-th period an extra probe
+ *     poll lands exactly at the expected report time; whether the probe or the main poll sees the
+ *     transition nudges phase and period (a bang-bang phase detector, as in clock-data recovery).
+ *   - Lock quality is 1 - |mean detector output| over the last 32 decisions: near 1 when the loop
+ *     straddles the reports, near 0 when it keeps correcting in one direction, which drops the lock.
+ *   - Idle devices (no transitions) produce no decisions; the loop coasts on the last estimate.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace joystick {
+
+    /**
+     * @brief Settings of PhaseLock.
+     */
+    struct PhaseLockConfig {
+        uint64_t acquirePeriodNs = 1000000;  //!< Poll interval while acquiring (also the fallback rate).
+        uint64_t guardNs = 250000;           //!< Main poll offset after the expected report.
+        uint32_t acquireSamples = 32;        //!< Transitions needed for the initial fit.
+        uint32_t probeEvery = 4;             //!< Probe poll every N periods while locked.
+    };
+
+    /**
+     * @brief Estimator state and counters.
+     */
+    struct PhaseLockMetrics {
+        bool locked = false;
+        double periodNs = 0;        //!< Estimated report period.
+        double phaseNs = 0;         //!< Expected report time modulo the period (host monotonic clock).
+        double fitResidualNs = 0;   //!< RMS residual of the last acquisition fit.
+        double quality = 0;         //!< 0..1, see file notes.
+        uint64_t polls = 0;
+        uint64_t probes = 0;
+        uint64_t locks = 0;
+        uint64_t unlocks = 0;
+        uint64_t failedFits = 0;    //!< Fits rejected (noisy timing, or period below two acquisition polls).
+    };
+
+    /**
+     * @brief Period/phase estimator and poll planner.
+     */
+    class PhaseLock {
+    public:
+        explicit PhaseLock(const PhaseLockConfig& config);
+
+        /**
+         * @brief Time of the next poll.
+         * @param nowNs Current time; when the caller fell behind, the plan skips ahead whole periods.
+         * @return Absolute deadline (may be <= nowNs: poll immediately).
+         */
+        uint64_t NextPollNs(uint64_t nowNs);
+
+        /**
+         * @brief Feeds the result of the poll planned by the last NextPollNs() call.
+         * @param pollNs Time the poll was made.
+         * @param changed The packet number changed since the previous poll.
+         */
+        void OnPoll(uint64_t pollNs, bool changed);
+
+        const PhaseLockMetrics& Metrics() const { return metrics_; }
+
+    private:
+        enum class Stage { Probe, Main };
+
+        void TryLock();
+        void Unlock();
+        void Detect(int sign);
+
+        PhaseLockConfig config_;
+        PhaseLockMetrics metrics_;
+
+        // Acquisition.
+        std::vector<double> marks_;  //!< Bracket midpoints of observed transitions.
+        uint64_t lastPollNs_ = 0;
+        bool havePoll_ = false;
+
+        // Tracking.
+        double expected_ = 0;        //!< Expected time of the next report.
+        double lockedPeriod_ = 0;    //!< Period at lock time; tracking stays within +-2 % of it.
+        Stage stage_ = Stage::Main;
+        uint64_t cycle_ = 0;
+        bool probeSaw_ = false;
+        int8_t decisions_[32] = {};
+        uint32_t decisionCount_ = 0;
+        int decisionSum_ = 0;
+    };
+
+    /**
+     * @brief Prints the estimator metrics on one line ("phase-lock: ...").
+     */
+    void PrintPhaseLockMetrics(const PhaseLockMetrics& m, double seconds);
+
+} // namespace joystick
@@ -0,0 +1,212 @@
+﻿/**
+ * @file
+ * @brief Platform timers for the polling scheduler.
+ */
+
+#include "PollScheduler.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <timeapi.h>
+
+#pragma comment(lib, "winmm.lib")
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#else
+#include <cerrno>
+#include <ctime>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#endif
+
+namespace joystick {
+
+#ifdef _WIN32
+    namespace {
+
+        /// QueryPerformanceCounter frequency, read once.
+        LONGLONG QpcFrequency() {
+            static const LONGLONG freq = []() {
+                LARGE_INTEGER f;
+                QueryPerformanceFrequency(&f);
+                return f.QuadPart;
+            }();
+            return freq;
+        }
+
+    } // namespace
+
+    SystemTimer::SystemTimer() {
+        // Windows 10 1803+: a high-resolution timer honours sub-millisecond due times without
+        // raising the global timer resolution.
+        timer_ = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (!timer_) {
+            highResolution_ = false;
+            raisedPeriod_ = timeBeginPeriod(1) == TIMERR_NOERROR;
+            timer_ = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+        }
+    }
+
+    SystemTimer::~SystemTimer() {
+        if (timer_) CloseHandle(static_cast<HANDLE>(timer_));
+        if (raisedPeriod_) timeEndPeriod(1);
+    }
+
+    uint64_t SystemTimer::NowNs() const {
+        LARGE_INTEGER c;
+        QueryPerformanceCounter(&c);
+        const LONGLONG freq = QpcFrequency();
+        return static_cast<uint64_t>(c.QuadPart / freq) * 1000000000ull +
+            static_cast<uint64_t>(c.QuadPart % freq) * 1000000000ull / static_cast<uint64_t>(freq);
+    }
+
+    void SystemTimer::PlatformSleepUntilNs(uint64_t deadlineNs) {
+        const uint64_t now = NowNs();
+        if (deadlineNs <= now) return;
+        if (!timer_) {
+            Sleep(static_cast<DWORD>((deadlineNs - now + 999999) / 1000000));
+            CountWakeup();
+            return;
+        }
+        LARGE_INTEGER due;
+        due.QuadPart = -static_cast<LONGLONG>((deadlineNs - now + 99) / 100); // relative, 100 ns units
+        if (ArmTimer(&due)) {
+            WaitForSingleObject(static_cast<HANDLE>(timer_), INFINITE);
+            CountWakeup();
+        }
+    }
+
+    bool SystemTimer::ArmTimer(void* due) {
+        const LARGE_INTEGER* d = static_cast<const LARGE_INTEGER*>(due);
+        if (slackNs_ >= 1000000) {
+            // Tolerable delay is in milliseconds; below 1 ms there is nothing to coalesce.
+            return SetWaitableTimerEx(static_cast<HANDLE>(timer_), d, 0, nullptr, nullptr, nullptr,
+                static_cast<ULONG>(slackNs_ / 1000000)) != FALSE;
+        }
+        return SetWaitableTimer(static_cast<HANDLE>(timer_), d, 0, nullptr, nullptr, FALSE) != FALSE;
+    }
+
+    void SystemTimer::SetSlackNs(uint64_t ns) {
+        slackNs_ = ns;
+    }
+
+    bool SystemTimer::WaitEventUntilNs(void* event, uint64_t deadlineNs) {
+        const uint64_t now = NowNs();
+        if (deadlineNs <= now) return WaitForSingleObject(static_cast<HANDLE>(event), 0) == WAIT_OBJECT_0;
+        if (!timer_) {
+            const DWORD ms = static_cast<DWORD>((deadlineNs - now + 999999) / 1000000);
+            const bool signaled = WaitForSingleObject(static_cast<HANDLE>(event), ms) == WAIT_OBJECT_0;
+            CountWakeup();
+            return signaled;
+        }
+        LARGE_INTEGER due;
+        due.QuadPart = -static_cast<LONGLONG>((deadlineNs - now + 99) / 100);
+        if (!ArmTimer(&due)) {
+            return WaitForSingleObject(static_cast<HANDLE>(event), 0) == WAIT_OBJECT_0;
+        }
+        HANDLE handles[2] = { static_cast<HANDLE>(event), static_cast<HANDLE>(timer_) };
+        const DWORD w = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+        CountWakeup();
+        if (w == WAIT_OBJECT_0) {
+            CancelWaitableTimer(static_cast<HANDLE>(timer_));
+            return true;
+        }
+        return false;
+    }
+#else
+    SystemTimer::SystemTimer() {}
+
+    SystemTimer::~SystemTimer() {}
+
+    uint64_t SystemTimer::NowNs() const {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    void SystemTimer::PlatformSleepUntilNs(uint64_t deadlineNs) {
+        if (deadlineNs <= NowNs()) return;
+        timespec ts;
+        ts.tv_sec = static_cast<time_t>(deadlineNs / 1000000000ull);
+        ts.tv_nsec = static_cast<long>(deadlineNs % 1000000000ull);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+        CountWakeup();
+    }
+
+    void SystemTimer::SetSlackNs(uint64_t ns) {
+        slackNs_ = ns;
+#ifdef __linux__
+        // 0 restores the thread's default slack (50 us).
+        prctl(PR_SET_TIMERSLACK, static_cast<unsigned long>(ns), 0, 0, 0);
+#endif
+        // Other POSIX systems have no per-thread timer slack: the value is only recorded.
+    }
+#endif
+
+    void SystemTimer::SleepUntilNs(uint64_t deadlineNs) {
+        if (mode_ == WaitMode::Hybrid) {
+            const uint64_t window = calibrator_.WindowNs();
+            const uint64_t now = NowNs();
+            if (deadlineNs > now + window) {
+                const uint64_t target = deadlineNs - window;
+                PlatformSleepUntilNs(target);
+                const uint64_t woke = NowNs();
+                calibrator_.OnOvershoot(woke > target ? woke - target : 0);
+            }
+            const uint64_t spinStart = NowNs();
+            uint64_t t = spinStart;
+            while (t < deadlineNs) {
+                CpuRelax();
+                t = NowNs();
+            }
+            stats_.spinNs += t - spinStart;
+        }
+        else {
+            PlatformSleepUntilNs(deadlineNs);
+        }
+        const uint64_t end = NowNs();
+        const uint64_t err = end > deadlineNs ? end - deadlineNs : 0;
+        ++stats_.waits;
+        stats_.errorSumNs += err;
+        if (err > stats_.errorMaxNs) stats_.errorMaxNs = err;
+    }
+
+    void PrintWaitStats(const SystemTimer& timer) {
+        const WaitStats& st = timer.Stats();
+        std::printf("wait: %s, %llu waits, wake-up error mean %.1f us max %.1f us",
+            timer.Mode() == WaitMode::Hybrid ? "hybrid" : "sleep", (unsigned long long)st.waits,
+            st.waits ? (double)st.errorSumNs / (double)st.waits / 1000.0 : 0.0, (double)st.errorMaxNs / 1000.0);
+        if (timer.Mode() == WaitMode::Hybrid) {
+            std::printf(", spin %.1f ms total, spin window %.1f us", (double)st.spinNs / 1e6,
+                (double)timer.Calibrator().WindowNs() / 1000.0);
+        }
+        std::printf("\n");
+    }
+
+    void PrintPollStats(uint32_t targetHz, const PollStats& stats) {
+        std::printf("poll: target %u Hz, achieved %.1f Hz, lateness mean %.1f us max %.1f us, late %llu, missed %llu\n",
+            targetHz, stats.AchievedHz(), stats.MeanLatenessUs(), (double)stats.latenessMaxNs / 1000.0,
+            (unsigned long long)stats.lateTicks, (unsigned long long)stats.missed);
+    }
+
+    void PrintAdaptiveStats(const AdaptiveRateConfig& config, const AdaptiveRateStats& stats) {
+        const double total = (double)(stats.activeNs + stats.idleNs);
+        std::printf("adaptive: active %u Hz %.1f s (%.0f%%, %llu polls), idle %u Hz %.1f s (%.0f%%, %llu polls), "
+            "to-idle %llu, to-active %llu\n",
+            config.activeHz, (double)stats.activeNs / 1e9, total > 0 ? 100.0 * (double)stats.activeNs / total : 0.0,
+            (unsigned long long)stats.activePolls,
+            config.idleHz, (double)stats.idleNs / 1e9, total > 0 ? 100.0 * (double)stats.idleNs / total : 0.0,
+            (unsigned long long)stats.idlePolls,
+            (unsigned long long)stats.toIdle, (unsigned long long)stats.toActive);
+    }
+
+} // namespace joystick
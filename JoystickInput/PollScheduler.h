@@ -0,0 +1,336 @@
+﻿/**
+ * @file
+ * @brief Fixed-rate polling scheduler for polled backends (XInput) with rate and lateness statistics.
+ * @details
+ *   - Ticks are placed on an absolute grid (start + n * period), so sleep overshoot does not accumulate
+ *     into a lower rate. When the caller falls more than one period behind, missed ticks are skipped
+ *     rather than run back to back.
+ *   - The waiting primitive is a template parameter: SystemTimer uses a high-resolution waitable timer on
+ *     Windows (CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, falling back to timeBeginPeriod(1)) and
+ *     clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME) on Linux. MockTimer advances a virtual clock so
+ *     the scheduling logic can be checked deterministically.
+ *   - WaitMode::Hybrid sleeps until a spin window before the deadline and spins the rest with a pause
+ *     hint; the window follows the measured sleep overshoot (SpinCalibrator).
+ *   - SetSlackNs() lets the OS coalesce timer expiries with other wake-ups (tolerable delay on Windows,
+ *     PR_SET_TIMERSLACK on Linux), trading lateness for fewer CPU wake-ups.
+ */
+
+#pragma once
+
+#include "InputCore.h"
+
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace joystick {
+
+    /**
+     * @brief Counters kept by BasicPollScheduler.
+     */
+    struct PollStats {
+        uint64_t ticks = 0;          //!< Completed waits.
+        uint64_t missed = 0;         //!< Ticks skipped because the caller fell behind.
+        uint64_t latenessSumNs = 0;  //!< Sum of (wake-up time - deadline).
+        uint64_t latenessMaxNs = 0;
+        uint64_t lateTicks = 0;      //!< Wake-ups later than a quarter period.
+        uint64_t startNs = 0;        //!< Time of the first deadline.
+        uint64_t lastNs = 0;         //!< Time of the latest wake-up.
+
+        /// Ticks per second over the measured span.
+        double AchievedHz() const {
+            return (ticks > 1 && lastNs > startNs) ? (double)(ticks - 1) * 1e9 / (double)(lastNs - startNs) : 0.0;
+        }
+
+        /// Mean wake-up lateness in microseconds.
+        double MeanLatenessUs() const {
+            return ticks ? (double)latenessSumNs / (double)ticks / 1000.0 : 0.0;
+        }
+    };
+
+    /// Spin-loop hint (PAUSE on x86, YIELD on ARM): saves power and frees the sibling hyper-thread.
+    inline void CpuRelax() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_pause();
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+        __yield();
+#elif defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    /**
+     * @brief Derives the spin window from observed sleep overshoot (mean + 4 deviations, smoothed).
+     */
+    class SpinCalibrator {
+    public:
+        static constexpr uint64_t kMinWindowNs = 20000;
+        static constexpr uint64_t kMaxWindowNs = 2000000;
+
+        /// Current spin window.
+        uint64_t WindowNs() const {
+            const double w = mean_ + 4.0 * dev_;
+            return w < kMinWindowNs ? kMinWindowNs : (w > kMaxWindowNs ? kMaxWindowNs : static_cast<uint64_t>(w));
+        }
+
+        /// Feeds how late one sleep returned past its target.
+        void OnOvershoot(uint64_t ns) {
+            const double x = static_cast<double>(ns);
+            const double d = x - mean_;
+            mean_ += d / 16.0;
+            dev_ += ((d < 0 ? -d : d) - dev_) / 16.0;
+        }
+
+    private:
+        double mean_ = 100000.0;   //!< Starts pessimistic; converges within a few dozen waits.
+        double dev_ = 50000.0;
+    };
+
+    /**
+     * @brief Wake-up accuracy and spin cost of SystemTimer.
+     */
+    struct WaitStats {
+        uint64_t waits = 0;
+        uint64_t errorSumNs = 0;    //!< Sum of (return time - deadline).
+        uint64_t errorMaxNs = 0;
+        uint64_t spinNs = 0;        //!< Time spent spinning (hybrid mode).
+    };
+
+    /**
+     * @brief Waits on the platform's best timer (see file notes).
+     */
+    class SystemTimer {
+    public:
+        SystemTimer();
+        ~SystemTimer();
+        SystemTimer(const SystemTimer&) = delete;
+        SystemTimer& operator=(const SystemTimer&) = delete;
+
+        /// Monotonic time in nanoseconds.
+        uint64_t NowNs() const;
+
+        /// Blocks until NowNs() >= @p deadlineNs (returns immediately if already past).
+        void SleepUntilNs(uint64_t deadlineNs);
+
+#ifdef _WIN32
+        /**
+         * @brief Waits for a Windows event object or the deadline, on the high-resolution timer.
+         * @param event Event HANDLE.
+         * @param deadlineNs Absolute deadline.
+         * @return true if the event was signaled, false on timeout.
+         */
+        bool WaitEventUntilNs(void* event, uint64_t deadlineNs);
+#endif
+
+        /// True when a high-resolution timer is in use (always on Linux).
+        bool IsHighResolution() const { return highResolution_; }
+
+        /**
+         * @brief Allows each expiry to be delayed by up to @p ns so the OS can coalesce wake-ups.
+         * @details On Linux the slack applies to the calling thread's sleeps.
+         */
+        void SetSlackNs(uint64_t ns);
+        uint64_t SlackNs() const { return slackNs_; }
+
+        void SetWaitMode(WaitMode mode) { mode_ = mode; }
+        WaitMode Mode() const { return mode_; }
+        const WaitStats& Stats() const { return stats_; }
+        const SpinCalibrator& Calibrator() const { return calibrator_; }
+        SpinCalibrator& Calibrator() { return calibrator_; }
+
+    private:
+        void PlatformSleepUntilNs(uint64_t deadlineNs);
+#ifdef _WIN32
+        /// Arms the waitable timer with @p due (a LARGE_INTEGER*), honouring the slack.
+        bool ArmTimer(void* due);
+#endif
+
+        void* timer_ = nullptr;        //!< Windows waitable timer handle.
+        bool highResolution_ = true;
+        bool raisedPeriod_ = false;    //!< timeBeginPeriod(1) must be undone.
+        uint64_t slackNs_ = 0;
+        WaitMode mode_ = WaitMode::Sleep;
+        SpinCalibrator calibrator_;
+        WaitStats stats_;
+    };
+
+    /**
+     * @brief Virtual clock: sleeping jumps to the deadline plus a configurable overshoot.
+     */
+    class MockTimer {
+    public:
+        uint64_t NowNs() const { return now_; }
+
+        void SleepUntilNs(uint64_t deadlineNs) {
+            if (deadlineNs > now_) now_ = deadlineNs;
+            now_ += overshootNs;
+        }
+
+        /// Simulates work done between waits.
+        void Advance(uint64_t ns) { now_ += ns; }
+
+        uint64_t overshootNs = 0;      //!< Added to every wake-up (timer slack).
+
+    private:
+        uint64_t now_ = 1000000000ull;
+    };
+
+    /**
+     * @brief Fixed-rate tick source.
+     * @tparam Timer Provides `uint64_t NowNs() const` and `void SleepUntilNs(uint64_t)`.
+     */
+    template <class Timer>
+    class BasicPollScheduler {
+    public:
+        /// @param rateHz Target tick rate; 0 is treated as 1 Hz.
+        explicit BasicPollScheduler(uint32_t rateHz) { SetRate(rateHz); }
+
+        /// Changes the period; the next deadline is placed one new period after the last one.
+        void SetRate(uint32_t rateHz) {
+            rateHz_ = rateHz ? rateHz : 1;
+            periodNs_ = 1000000000ull / rateHz_;
+        }
+
+        /**
+         * @brief Blocks until the next tick.
+         * @details The first call returns immediately and anchors the grid.
+         */
+        void WaitNext() {
+            const uint64_t now = timer_.NowNs();
+            if (stats_.ticks == 0) {
+                next_ = now;
+                stats_.startNs = now;
+            }
+            else {
+                next_ += periodNs_;
+                if (now > next_ + periodNs_) {
+                    // Fell behind (caller blocked, system stall): skip to the next slot after now.
+                    const uint64_t behind = (now - next_) / periodNs_;
+                    stats_.missed += behind;
+                    next_ += behind * periodNs_;
+                }
+                timer_.SleepUntilNs(next_);
+            }
+            const uint64_t woke = timer_.NowNs();
+            const uint64_t late = woke > next_ ? woke - next_ : 0;
+            stats_.latenessSumNs += late;
+            if (late > stats_.latenessMaxNs) stats_.latenessMaxNs = late;
+            if (late > periodNs_ / 4) ++stats_.lateTicks;
+            stats_.lastNs = woke;
+            ++stats_.ticks;
+        }
+
+        uint32_t RateHz() const { return rateHz_; }
+        uint64_t PeriodNs() const { return periodNs_; }
+        const PollStats& Stats() const { return stats_; }
+        Timer& GetTimer() { return timer_; }
+        const Timer& GetTimer() const { return timer_; }
+
+    private:
+        Timer timer_;
+        uint32_t rateHz_ = 0;
+        uint64_t periodNs_ = 0;
+        uint64_t next_ = 0;
+        PollStats stats_;
+    };
+
+    using PollScheduler = BasicPollScheduler<SystemTimer>;
+
+    /**
+     * @brief Settings of AdaptiveRate.
+     */
+    struct AdaptiveRateConfig {
+        uint32_t activeHz = 500;      //!< Rate while the pad is in use (the maximum).
+        uint32_t idleHz = 30;         //!< Rate after a quiet period.
+        uint32_t idleAfterMs = 2000;  //!< Time without a packet change before dropping to idleHz.
+    };
+
+    /**
+     * @brief Time and transitions per rate, for tuning CPU against first-input latency.
+     */
+    struct AdaptiveRateStats {
+        uint64_t toIdle = 0;          //!< Active -> idle transitions.
+        uint64_t toActive = 0;        //!< Idle -> active transitions (first input after a quiet period).
+        uint64_t activeNs = 0;        //!< Time spent at activeHz.
+        uint64_t idleNs = 0;          //!< Time spent at idleHz.
+        uint64_t activePolls = 0;
+        uint64_t idlePolls = 0;
+    };
+
+    /**
+     * @brief Chooses the poll rate from the packet-change history.
+     * @details Drops to idleHz once no change was seen for idleAfterMs and returns to activeHz on the
+     *          first change. At idle rate the first input is noticed within one idle period, which is
+     *          the latency cost to weigh against the saved polls.
+     */
+    class AdaptiveRate {
+    public:
+        explicit AdaptiveRate(const AdaptiveRateConfig& config) : config_(config) {}
+
+        /**
+         * @brief Feeds one poll result.
+         * @param changed The poll saw a new packet number.
+         * @param nowNs Poll time.
+         * @return Rate to use for the next poll.
+         */
+        uint32_t OnPoll(bool changed, uint64_t nowNs) {
+            if (lastNs_ == 0) {
+                lastNs_ = lastChangeNs_ = nowNs;
+            }
+            const uint64_t dt = nowNs - lastNs_;
+            lastNs_ = nowNs;
+            if (idle_) {
+                stats_.idleNs += dt;
+                ++stats_.idlePolls;
+            }
+            else {
+                stats_.activeNs += dt;
+                ++stats_.activePolls;
+            }
+
+            if (changed) {
+                lastChangeNs_ = nowNs;
+                if (idle_) {
+                    idle_ = false;
+                    ++stats_.toActive;
+                }
+            }
+            else if (!idle_ && nowNs - lastChangeNs_ >= uint64_t(config_.idleAfterMs) * 1000000ull) {
+                idle_ = true;
+                ++stats_.toIdle;
+            }
+            return idle_ ? config_.idleHz : config_.activeHz;
+        }
+
+        bool IsIdle() const { return idle_; }
+        const AdaptiveRateConfig& Config() const { return config_; }
+        const AdaptiveRateStats& Stats() const { return stats_; }
+
+    private:
+        AdaptiveRateConfig config_;
+        AdaptiveRateStats stats_;
+        uint64_t lastNs_ = 0;
+        uint64_t lastChangeNs_ = 0;
+        bool idle_ = false;
+    };
+
+    /**
+     * @brief Prints a one-line summary ("poll: target 500 Hz, achieved ...") to stdout.
+     */
+    void PrintPollStats(uint32_t targetHz, const PollStats& stats);
+
+    /**
+     * @brief Prints time, polls and transitions per rate of an adaptive poller.
+     */
+    void PrintAdaptiveStats(const AdaptiveRateConfig& config, const AdaptiveRateStats& stats);
+
+    /**
+     * @brief Prints wake-up error and spin cost of a timer ("wait: ...").
+     */
+    void PrintWaitStats(const SystemTimer& timer);
+
+} // namespace joystick
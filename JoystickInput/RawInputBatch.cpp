@@ -0,0 +1,111 @@
+﻿/**
+ * @file
+ * @brief Raw Input block walker, report queue and decoder selection.
+ */
+
+#include "RawInputBatch.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace joystick {
+
+    namespace {
+
+        uint32_t ReadU32(const uint8_t* p) {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        uint64_t ReadHandle(const uint8_t* p, uint32_t size) {
+            if (size == 4) return ReadU32(p);
+            uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+    } // namespace
+
+    bool RawInputBatchReader::Next(RawHidRecord& out) {
+        while (left_ > 0) {
+            if (pos_ + layout_.headerSize > bytes_) {
+                malformed_ = true;
+                return false;
+            }
+            const uint8_t* header = block_ + pos_;
+            const uint32_t type = ReadU32(header);
+            const uint32_t size = ReadU32(header + 4);
+            if (size < layout_.headerSize || pos_ + size > bytes_) {
+                malformed_ = true;
+                return false;
+            }
+            const size_t record = pos_;
+            // NEXTRAWINPUTBLOCK: the next record starts at the aligned end of this one.
+            pos_ = (pos_ + size + layout_.align - 1) & ~size_t(layout_.align - 1);
+            --left_;
+            ++walked_;
+            if (type != kRawInputTypeHid) continue;
+
+            // RAWHID: dwSizeHid, dwCount, then dwCount reports back to back.
+            if (size < layout_.headerSize + 8) {
+                malformed_ = true;
+                return false;
+            }
+            const uint8_t* hid = block_ + record + layout_.headerSize;
+            out.device = ReadHandle(header + 8, layout_.pointerSize);
+            out.sizeHid = ReadU32(hid);
+            out.count = ReadU32(hid + 4);
+            out.data = hid + 8;
+            if (uint64_t(out.sizeHid) * out.count > size - layout_.headerSize - 8) {
+                malformed_ = true;
+                return false;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    bool RawHidDecoder::UseKnown(uint16_t vendorId, uint16_t productId) {
+        const KnownController* known = FindKnownController(vendorId, productId);
+        if (!known) return false;
+        kind_ = Kind::Known;
+        known_ = known;
+        layout_ = StateLayout::Gamepad;
+        return true;
+    }
+
+    void RawHidDecoder::UsePlan(const HidDecodePlan& plan) {
+        kind_ = Kind::Plan;
+        plan_ = plan;
+        layout_ = StateLayout::Joystick;
+    }
+
+    void RawHidDecoder::UseFunction(DecodeFn fn, void* context, StateLayout layout, const char* name) {
+        kind_ = Kind::Function;
+        name_ = name;
+        fn_ = fn;
+        context_ = context;
+        layout_ = layout;
+    }
+
+    const char* RawHidDecoder::Describe() const {
+        switch (kind_) {
+        case Kind::Known: return known_->name;
+        case Kind::Plan: return "descriptor plan";
+        case Kind::Function: return name_;
+        case Kind::None:
+        default: return "none";
+        }
+    }
+
+    void PrintRawInputStats(const RawInputStats& stats, double seconds) {
+        std::printf("rawinput: %llu batches, %llu records (%.1f per batch), %llu reports (%.1f/s), "
+            "%llu foreign, %llu undecoded, %llu malformed blocks\n",
+            (unsigned long long)stats.batches, (unsigned long long)stats.records,
+            stats.batches ? (double)stats.records / (double)stats.batches : 0.0,
+            (unsigned long long)stats.reports, seconds > 0 ? (double)stats.reports / seconds : 0.0,
+            (unsigned long long)stats.foreign, (unsigned long long)stats.undecoded, (unsigned long long)stats.malformed);
+    }
+
+} // namespace joystick
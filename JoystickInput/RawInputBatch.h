@@ -0,0 +1,208 @@
+﻿/**
+ * @file
+ * @brief Raw Input batches: walking a GetRawInputBuffer block and decoding its HID reports (portable).
+ * @details
+ *   - Platform-neutral (no windows.h): RawInputLayout describes RAWINPUTHEADER and the
+ *     NEXTRAWINPUTBLOCK alignment for the reading process, so blocks captured on Windows are walked
+ *     the same way in the benchmarks on Linux.
+ *   - A 32-bit process on 64-bit Windows receives GetRawInputBuffer blocks in the 64-bit layout;
+ *     RawInputLayout::Wow64() covers that case.
+ *   - One RAWHID record carries dwCount reports of dwSizeHid bytes each. RawHidQueue hands out the
+ *     reports of one device in arrival order, in place, so every report becomes its own sample
+ *     without being copied out of the block.
+ *   - RawHidDecoder picks the fixed layout of a KnownController by VID/PID, a compiled HidDecodePlan,
+ *     or a decode function supplied by the platform (HidP_* on the preparsed data on Windows).
+ */
+
+#pragma once
+
+#include "HidDescriptor.h"
+#include "InputCore.h"
+#include "KnownControllers.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace joystick {
+
+    /**
+     * @brief Record framing of a GetRawInputBuffer block.
+     */
+    struct RawInputLayout {
+        uint32_t headerSize = 24;  //!< sizeof(RAWINPUTHEADER): dwType, dwSize, hDevice, wParam.
+        uint32_t pointerSize = 8;  //!< Size of hDevice and wParam.
+        uint32_t align = 8;        //!< RAWINPUT_ALIGN: QWORD on 64-bit Windows and WOW64, DWORD on 32-bit.
+
+        /// Layout of the running process.
+        static RawInputLayout Native() {
+            RawInputLayout l;
+            l.pointerSize = static_cast<uint32_t>(sizeof(void*));
+            l.headerSize = 8 + 2 * l.pointerSize;
+            l.align = l.pointerSize == 8 ? 8 : 4;
+            return l;
+        }
+
+        /// Layout a 32-bit process on 64-bit Windows receives from GetRawInputBuffer.
+        static RawInputLayout Wow64() { return RawInputLayout(); }
+    };
+
+    /// RAWINPUTHEADER::dwType of HID records (RIM_TYPEHID).
+    constexpr uint32_t kRawInputTypeHid = 2;
+
+    /**
+     * @brief One HID record of a block.
+     */
+    struct RawHidRecord {
+        uint64_t device = 0;           //!< hDevice of the sender.
+        uint32_t sizeHid = 0;          //!< Bytes per report.
+        uint32_t count = 0;            //!< Reports in the record.
+        const uint8_t* data = nullptr; //!< count * sizeHid report bytes (report ID first).
+    };
+
+    /**
+     * @brief Walks the records of one GetRawInputBuffer block.
+     */
+    class RawInputBatchReader {
+    public:
+        /**
+         * @param block Start of the block (aligned as GetRawInputBuffer requires).
+         * @param bytes Bytes filled in.
+         * @param records Record count GetRawInputBuffer returned.
+         * @param layout Framing of the block.
+         */
+        RawInputBatchReader(const uint8_t* block, size_t bytes, uint32_t records, const RawInputLayout& layout)
+            : block_(block), bytes_(bytes), left_(records), layout_(layout) {}
+
+        /**
+         * @brief Next HID record; mouse and keyboard records are skipped.
+         * @return false at the end of the block or when a record does not fit (see Malformed()).
+         */
+        bool Next(RawHidRecord& out);
+
+        /// A record header or payload ran past the block.
+        bool Malformed() const { return malformed_; }
+
+        /// Records walked so far, HID or not.
+        uint32_t Walked() const { return walked_; }
+
+    private:
+        const uint8_t* block_;
+        size_t bytes_;
+        size_t pos_ = 0;
+        uint32_t left_;
+        uint32_t walked_ = 0;
+        RawInputLayout layout_;
+        bool malformed_ = false;
+    };
+
+    /**
+     * @brief Pending reports of one device, consumed one at a time.
+     * @details Records are referenced, not copied: the block they point into must stay untouched
+     *          until the queue is empty (read the next block only then).
+     */
+    class RawHidQueue {
+    public:
+        /// Queues the reports of @p record.
+        void Append(const RawHidRecord& record) {
+            if (Empty()) Clear();
+            if (record.count > 0 && record.sizeHid > 0) records_.push_back(record);
+        }
+
+        /// Drops everything pending.
+        void Clear() {
+            records_.clear();
+            next_ = 0;
+            report_ = 0;
+        }
+
+        bool Empty() const { return next_ == records_.size(); }
+
+        /**
+         * @brief Oldest pending report.
+         * @return false if nothing is pending.
+         */
+        bool Pop(const uint8_t*& report, uint32_t& size) {
+            if (Empty()) return false;
+            const RawHidRecord& r = records_[next_];
+            report = r.data + size_t(report_) * r.sizeHid;
+            size = r.sizeHid;
+            if (++report_ == r.count) {
+                ++next_;
+                report_ = 0;
+            }
+            return true;
+        }
+
+    private:
+        std::vector<RawHidRecord> records_;
+        size_t next_ = 0;      //!< Record of the next report.
+        uint32_t report_ = 0;  //!< Report index within that record.
+    };
+
+    /**
+     * @brief Report decoder of one Raw Input device.
+     */
+    class RawHidDecoder {
+    public:
+        /// Platform decode function (e.g. HidP_* on the preparsed data).
+        using DecodeFn = bool (*)(void* context, const uint8_t* report, size_t len, InputState& state);
+
+        /// Uses the specialized layout of a known controller; false if the device has none.
+        bool UseKnown(uint16_t vendorId, uint16_t productId);
+
+        /// Uses a compiled descriptor plan (Joystick layout).
+        void UsePlan(const HidDecodePlan& plan);
+
+        /// Uses @p fn; @p context must outlive the decoder. @p name is shown by Describe().
+        void UseFunction(DecodeFn fn, void* context, StateLayout layout, const char* name);
+
+        bool Empty() const { return kind_ == Kind::None; }
+
+        /// Decodes one report into @p state; false for reports the decoder does not know.
+        bool Decode(const uint8_t* report, size_t len, InputState& state) const {
+            switch (kind_) {
+            case Kind::Known: return known_->decode(report, len, state);
+            case Kind::Plan: return DecodeHidReport(plan_, report, len, state);
+            case Kind::Function: return fn_(context_, report, len, state);
+            case Kind::None:
+            default: return false;
+            }
+        }
+
+        /// Gamepad for known controllers, Joystick for descriptor plans.
+        StateLayout Layout() const { return layout_; }
+
+        /// What decodes the reports, for the start-up line.
+        const char* Describe() const;
+
+    private:
+        enum class Kind : uint8_t { None, Known, Plan, Function };
+
+        Kind kind_ = Kind::None;
+        const KnownController* known_ = nullptr;
+        HidDecodePlan plan_;
+        DecodeFn fn_ = nullptr;
+        void* context_ = nullptr;
+        const char* name_ = "";
+        StateLayout layout_ = StateLayout::Joystick;
+    };
+
+    /**
+     * @brief Counters of the Raw Input reader.
+     */
+    struct RawInputStats {
+        uint64_t batches = 0;    //!< GetRawInputBuffer calls that returned records.
+        uint64_t records = 0;    //!< Records walked (all devices).
+        uint64_t reports = 0;    //!< Reports of the selected device.
+        uint64_t foreign = 0;    //!< HID records of other devices registered for the same usages.
+        uint64_t undecoded = 0;  //!< Reports the decoder rejected (unknown report ID, too short).
+        uint64_t malformed = 0;  //!< Blocks whose framing did not fit.
+    };
+
+    /**
+     * @brief Prints the Raw Input counters on one line ("rawinput: ...").
+     */
+    void PrintRawInputStats(const RawInputStats& stats, double seconds);
+
+} // namespace joystick
@@ -0,0 +1,275 @@
+﻿/**
+ * @file
+ * @brief Platform wait sets of the multi-device reactor.
+ */
+
+#include "Reactor.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#elif defined(__linux__)
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+namespace joystick {
+
+#ifdef _WIN32
+    Reactor::Reactor() {
+        HANDLE t = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (!t) t = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+        timer_ = t ? reinterpret_cast<intptr_t>(t) : -1;
+    }
+
+    Reactor::~Reactor() {
+        if (timer_ != -1) CloseHandle(reinterpret_cast<HANDLE>(timer_));
+    }
+
+    bool Reactor::IsValid() const {
+        return timer_ != -1;
+    }
+
+    bool Reactor::Register(intptr_t handle, size_t /*index*/) {
+        // Handles are collected per wait; only the count is limited. Detached sources free their slot.
+        size_t events = watches_.size();
+        for (const Source& s : sources_) {
+            if (s.open && s.handle != -1) ++events;
+        }
+        return handle != -1 && events < kMaxEventSources;
+    }
+
+    void Reactor::Unregister(const Source& /*source*/) {}
+
+    bool Reactor::Wait(uint64_t deadlineNs, std::vector<size_t>& ready) {
+        HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+        size_t owners[MAXIMUM_WAIT_OBJECTS];
+        DWORD n = 0;
+        for (size_t i = 0; i < sources_.size(); ++i) {
+            if (sources_[i].open && sources_[i].handle != -1) {
+                handles[n] = reinterpret_cast<HANDLE>(sources_[i].handle);
+                owners[n] = i;
+                ++n;
+            }
+        }
+        for (size_t w = 0; w < watches_.size(); ++w) {
+            handles[n] = reinterpret_cast<HANDLE>(watches_[w].handle);
+            owners[n] = kWatchBit | w;
+            ++n;
+        }
+
+        DWORD timeout = INFINITE;
+        if (deadlineNs != UINT64_MAX) {
+            const uint64_t now = clock_.NowNs();
+            if (deadlineNs <= now) {
+                timeout = 0;
+            }
+            else {
+                LARGE_INTEGER due;
+                due.QuadPart = -static_cast<LONGLONG>((deadlineNs - now + 99) / 100);
+                if (SetWaitableTimer(reinterpret_cast<HANDLE>(timer_), &due, 0, nullptr, nullptr, FALSE)) {
+                    handles[n] = reinterpret_cast<HANDLE>(timer_);
+                    owners[n] = SIZE_MAX;
+                    ++n;
+                }
+                else {
+                    timeout = static_cast<DWORD>((deadlineNs - now + 999999) / 1000000);
+                }
+            }
+        }
+        else if (!watches_.empty()) {
+            // Only watches left (every device unplugged): wake up now and then to notice Ctrl+C.
+            timeout = 100;
+        }
+        if (n == 0) {
+            Sleep(timeout == INFINITE ? 100 : timeout);
+            CountWakeup();
+            return true;
+        }
+
+        const DWORD w = WaitForMultipleObjects(n, handles, FALSE, timeout);
+        CountWakeup();
+        if (w == WAIT_TIMEOUT) return true;
+        if (w >= WAIT_OBJECT_0 + n) return false;
+        // WaitForMultipleObjects reports the lowest signaled index; collect the others without waiting
+        // so low-numbered devices cannot starve the rest.
+        for (DWORD k = w - WAIT_OBJECT_0; k < n; ++k) {
+            if (owners[k] == SIZE_MAX) continue;
+            if (k == w - WAIT_OBJECT_0 || WaitForSingleObject(handles[k], 0) == WAIT_OBJECT_0) {
+                ready.push_back(owners[k]);
+            }
+        }
+        // An armed timer that did not fire is simply re-armed by the next wait.
+        return true;
+    }
+#elif defined(__linux__)
+    Reactor::Reactor() {
+        const int ep = epoll_create1(EPOLL_CLOEXEC);
+        const int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (ep >= 0 && tfd >= 0) {
+            epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.u64 = UINT64_MAX;
+            if (epoll_ctl(ep, EPOLL_CTL_ADD, tfd, &ev) == 0) {
+                waitSet_ = ep;
+                timer_ = tfd;
+                return;
+            }
+        }
+        if (ep >= 0) close(ep);
+        if (tfd >= 0) close(tfd);
+    }
+
+    Reactor::~Reactor() {
+        if (waitSet_ >= 0) close(static_cast<int>(waitSet_));
+        if (timer_ >= 0) close(static_cast<int>(timer_));
+    }
+
+    bool Reactor::IsValid() const {
+        return waitSet_ >= 0;
+    }
+
+    bool Reactor::Register(intptr_t handle, size_t index) {
+        if (waitSet_ < 0 || handle < 0) return false;
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = index;
+        return epoll_ctl(static_cast<int>(waitSet_), EPOLL_CTL_ADD, static_cast<int>(handle), &ev) == 0;
+    }
+
+    void Reactor::Unregister(const Source& source) {
+        if (source.handle >= 0) epoll_ctl(static_cast<int>(waitSet_), EPOLL_CTL_DEL, static_cast<int>(source.handle), nullptr);
+    }
+
+    bool Reactor::Wait(uint64_t deadlineNs, std::vector<size_t>& ready) {
+        // Arm (or disarm) the timerfd for the earliest poll deadline; CLOCK_MONOTONIC matches SystemTimer.
+        itimerspec its = {};
+        if (deadlineNs != UINT64_MAX) {
+            const uint64_t at = deadlineNs ? deadlineNs : 1;
+            its.it_value.tv_sec = static_cast<time_t>(at / 1000000000ull);
+            its.it_value.tv_nsec = static_cast<long>(at % 1000000000ull);
+        }
+        timerfd_settime(static_cast<int>(timer_), TFD_TIMER_ABSTIME, &its, nullptr);
+
+        epoll_event events[64];
+        const int n = epoll_wait(static_cast<int>(waitSet_), events, 64, -1);
+        CountWakeup();
+        if (n < 0) return errno == EINTR;
+        for (int k = 0; k < n; ++k) {
+            if (events[k].data.u64 == UINT64_MAX) {
+                uint64_t expirations;
+                while (read(static_cast<int>(timer_), &expirations, sizeof(expirations)) > 0) {}
+                continue;
+            }
+            ready.push_back(static_cast<size_t>(events[k].data.u64));
+        }
+        return true;
+    }
+#else
+    // No native wait set: sleep until the next deadline and treat every event source as ready.
+    Reactor::Reactor() {}
+
+    Reactor::~Reactor() {}
+
+    bool Reactor::IsValid() const {
+        return true;
+    }
+
+    bool Reactor::Register(intptr_t /*handle*/, size_t /*index*/) {
+        return true;
+    }
+
+    void Reactor::Unregister(const Source& /*source*/) {}
+
+    bool Reactor::Wait(uint64_t deadlineNs, std::vector<size_t>& ready) {
+        const uint64_t cap = clock_.NowNs() + 1000000;
+        clock_.SleepUntilNs(deadlineNs < cap ? deadlineNs : cap);
+        for (size_t i = 0; i < sources_.size(); ++i) {
+            if (sources_[i].open && sources_[i].handle != -1) ready.push_back(i);
+        }
+        return true;
+    }
+#endif
+
+    bool Reactor::AddWatch(intptr_t handle, void (*onReady)(void* context), void* context) {
+        if (!Register(handle, kWatchBit | watches_.size())) return false;
+        watches_.push_back(Watch{ handle, onReady, context });
+        return true;
+    }
+
+    bool Reactor::Detach(int tag) {
+        for (size_t i = 0; i < sources_.size(); ++i) {
+            Source& s = sources_[i];
+            if (!s.open || s.tag != tag) continue;
+            s.open = false;
+            --open_;
+            Unregister(s);
+            detached_.push_back(i);
+            return true;
+        }
+        return false;
+    }
+
+    size_t Reactor::FreeSlot() const {
+        for (size_t i = 0; i < sources_.size(); ++i) {
+            if (!sources_[i].open && std::find(detached_.begin(), detached_.end(), i) == detached_.end()) return i;
+        }
+        return sources_.size();
+    }
+
+    bool Reactor::IsOpen(int tag) const {
+        for (const Source& s : sources_) {
+            if (s.open && s.tag == tag) return true;
+        }
+        return false;
+    }
+
+    void TaggedConsoleSink::SetCaps(int tag, const StateCaps& caps) {
+        for (auto& c : caps_) {
+            if (c.first == tag) {
+                c.second = caps;
+                return;
+            }
+        }
+        if (!caps.IsFull()) caps_.emplace_back(tag, caps);
+    }
+
+    void TaggedConsoleSink::operator()(int tag, StateLayout layout, const InputState* state) {
+        StateCaps caps;
+        for (const auto& c : caps_) {
+            if (c.first == tag) caps = c.second;
+        }
+        char line[kMaxFormattedState + 16];
+        int prefix = std::snprintf(line, sizeof(line), "[%d] ", tag);
+        if (prefix < 0) prefix = 0;
+        size_t len = static_cast<size_t>(prefix);
+        if (state) {
+            len += FormatState(layout, *state, caps, line + len, sizeof(line) - len);
+        }
+        else {
+            const int n = std::snprintf(line + len, sizeof(line) - len, "disconnected\n");
+            if (n > 0) len += static_cast<size_t>(n);
+        }
+        std::fwrite(line, 1, len, out_);
+    }
+
+    void PrintReactorStats(const ReactorStats& stats, double seconds) {
+        const double total = (double)(stats.waitNs + stats.busyNs);
+        std::printf("reactor: %llu wake-ups (%.1f/s), %llu polls, %llu changes, %llu emitted, busy %.2f%%\n",
+            (unsigned long long)stats.wakeups, seconds > 0 ? (double)stats.wakeups / seconds : 0.0,
+            (unsigned long long)stats.polls, (unsigned long long)stats.changes, (unsigned long long)stats.emitted,
+            total > 0 ? 100.0 * (double)stats.busyNs / total : 0.0);
+    }
+
+} // namespace joystick
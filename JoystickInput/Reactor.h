@@ -0,0 +1,303 @@
+﻿/**
+ * @file
+ * @brief Single-thread reactor that streams several devices at once (`JoystickInput 0 2 3`, `--all`).
+ * @details
+ *   - Event sources (DirectInput notification events, evdev fds) and polled sources (XInput slots,
+ *     synthetic devices) share one thread. Each iteration blocks once: on Windows in
+ *     WaitForMultipleObjects over the device events plus a high-resolution poll timer, on Linux in
+ *     epoll_wait over the device fds plus a timerfd armed for the earliest poll deadline.
+ *   - Sources are read with InputBackend::Poll(), which never blocks; the reactor does all waiting.
+ *   - Every source keeps its own previous state, so diffing is per device; the sink receives the
+ *     device tag with each state.
+ *   - Event sources are also polled every heartbeatMs, so an unplugged device is noticed even if it
+ *     never signals.
+ *   - A Windows wait covers at most MAXIMUM_WAIT_OBJECTS (64) handles, so one reactor accepts up to
+ *     kMaxEventSources event sources and watches; polled sources are unlimited.
+ *   - Watches (AddWatch(), a HotplugWatcher handle) let devices be attached and detached while Run()
+ *     is going: their callbacks run on the reactor thread between services.
+ */
+
+#pragma once
+
+#include "InputCore.h"
+#include "PollScheduler.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+namespace joystick {
+
+    /**
+     * @brief Counters kept by Reactor::Run.
+     */
+    struct ReactorStats {
+        uint64_t wakeups = 0;    //!< Returns from the blocking wait.
+        uint64_t polls = 0;      //!< InputBackend::Poll() calls.
+        uint64_t changes = 0;    //!< Polls that returned Changed.
+        uint64_t emitted = 0;    //!< States passed to the sink after diffing.
+        uint64_t waitNs = 0;     //!< Time blocked in the wait.
+        uint64_t busyNs = 0;     //!< Time spent polling, diffing and in the sink.
+    };
+
+    /**
+     * @brief Multiplexes many devices on the calling thread (see file notes).
+     */
+    class Reactor {
+    public:
+        static constexpr size_t kMaxEventSources = 63;
+
+        Reactor();
+        ~Reactor();
+        Reactor(const Reactor&) = delete;
+        Reactor& operator=(const Reactor&) = delete;
+
+        /// false if the platform wait set could not be created.
+        bool IsValid() const;
+
+        /**
+         * @brief Adds a device that is polled on a fixed grid.
+         * @param backend Source; must outlive Run().
+         * @param tag Device label passed to the sink (the device index).
+         * @param rateHz Poll rate; 0 is treated as 1 Hz.
+         */
+        template <class Backend>
+        void AddPolled(InputBackend<Backend>& backend, int tag, uint32_t rateHz) {
+            Source s = MakeSource(backend, tag);
+            s.periodNs = 1000000000ull / (rateHz ? rateHz : 1);
+            Put(FreeSlot(), s);
+            ++open_;
+        }
+
+        /**
+         * @brief Adds a device that signals readiness.
+         * @param backend Source; must outlive Run().
+         * @param tag Device label passed to the sink.
+         * @param handle Event HANDLE (Windows) or readable fd (Linux) that signals new input.
+         * @param heartbeatMs Interval of liveness polls while the device is quiet.
+         * @return false if the wait set is full or the handle could not be registered.
+         */
+        template <class Backend>
+        bool AddEvent(InputBackend<Backend>& backend, int tag, intptr_t handle, uint32_t heartbeatMs = 100) {
+            Source s = MakeSource(backend, tag);
+            s.handle = handle;
+            s.periodNs = uint64_t(heartbeatMs ? heartbeatMs : 1) * 1000000ull;
+            const size_t index = FreeSlot();
+            if (!Register(s.handle, index)) return false;
+            Put(index, s);
+            ++open_;
+            return true;
+        }
+
+        /**
+         * @brief Waits on a non-device handle and calls @p onReady on the reactor thread when it signals.
+         * @param handle Event HANDLE (Windows) or readable fd (Linux); the callback must consume what
+         *        made it ready (e.g. HotplugWatcher::Drain()).
+         * @param onReady May call AddPolled(), AddEvent() and Detach().
+         * @details While a watch is registered Run() keeps going when no device is open, waiting for one
+         *          to be attached.
+         * @return false if the wait set is full or the handle could not be registered.
+         */
+        bool AddWatch(intptr_t handle, void (*onReady)(void* context), void* context);
+
+        /**
+         * @brief Stops reading the open source tagged @p tag; the sink sees it disconnect.
+         * @return false if no open source has that tag.
+         */
+        bool Detach(int tag);
+
+        /// true if an open source has tag @p tag.
+        bool IsOpen(int tag) const;
+
+        /**
+         * @brief Streams all sources until @p running is cleared or every device is gone.
+         * @param sink Called as `sink(int tag, StateLayout layout, const InputState* state)`; @p state is
+         *        nullptr once when the device disconnects or fails.
+         * @param running Loop runs while this flag is true.
+         * @return Stopped, Disconnected (all devices gone and no watch) or Failed (the wait itself failed).
+         */
+        template <class Sink>
+        ReaderExit Run(Sink& sink, const std::atomic_bool& running);
+
+        /// Source slots: open sources plus closed ones not reused yet.
+        size_t SourceCount() const { return sources_.size(); }
+        size_t OpenCount() const { return open_; }
+        const ReactorStats& Stats() const { return stats_; }
+
+    private:
+        struct Source {
+            int tag = 0;
+            StateLayout layout = StateLayout::Gamepad;
+            StateCaps caps;
+            void* backend = nullptr;
+            SampleStatus (*poll)(void*, InputState&) = nullptr;
+            intptr_t handle = -1;        //!< -1 for polled sources.
+            uint64_t periodNs = 0;       //!< Poll period, or heartbeat for event sources.
+            uint64_t nextNs = 0;         //!< Next poll / heartbeat; 0 = immediately.
+            bool open = true;
+            bool emittedAny = false;
+            InputState prev;
+            InputState cur;
+        };
+
+        struct Watch {
+            intptr_t handle;
+            void (*onReady)(void* context);
+            void* context;
+        };
+
+        /// Wait-set index bit of watches (the rest is the watch number).
+        static constexpr size_t kWatchBit = size_t(1) << (sizeof(size_t) * 8 - 2);
+
+        template <class Backend>
+        static SampleStatus PollThunk(void* backend, InputState& state) {
+            return static_cast<InputBackend<Backend>*>(backend)->Poll(state);
+        }
+
+        template <class Backend>
+        static Source MakeSource(InputBackend<Backend>& backend, int tag) {
+            Source s;
+            s.tag = tag;
+            s.layout = backend.Layout();
+            s.caps = backend.Caps();
+            s.backend = &backend;
+            s.poll = &PollThunk<Backend>;
+            return s;
+        }
+
+        /**
+         * @brief Index for a new source: a closed slot whose disconnect the sink has seen, else the end.
+         * @details Re-plugged and newly attached devices reuse the slots of unplugged ones, so sources_
+         *          does not grow with every re-plug.
+         */
+        size_t FreeSlot() const;
+
+        void Put(size_t index, const Source& s) {
+            if (index == sources_.size()) sources_.push_back(s);
+            else sources_[index] = s;
+        }
+
+        /// Adds @p handle to the wait set, reporting @p index when it is ready.
+        bool Register(intptr_t handle, size_t index);
+
+        /// Removes a closed source's handle from the wait set.
+        void Unregister(const Source& source);
+
+        /**
+         * @brief Blocks until an event source is ready or @p deadlineNs passes (UINT64_MAX = no deadline).
+         * @param ready Receives the indices of ready event sources, and kWatchBit | n for ready watches.
+         * @return false if the wait failed; an interrupted wait returns true with nothing ready.
+         */
+        bool Wait(uint64_t deadlineNs, std::vector<size_t>& ready);
+
+        template <class Sink>
+        void Service(size_t index, Sink& sink, bool drain);
+
+        std::vector<Source> sources_;
+        size_t open_ = 0;
+        ReactorStats stats_;
+        SystemTimer clock_;
+        intptr_t waitSet_ = -1;   //!< epoll fd (Linux).
+        intptr_t timer_ = -1;     //!< timerfd (Linux) or waitable timer HANDLE (Windows).
+        std::vector<size_t> ready_;
+        std::vector<Watch> watches_;
+        std::vector<size_t> fired_;     //!< Watches ready in this iteration.
+        std::vector<size_t> detached_;  //!< Sources detached since the last sink call.
+    };
+
+    template <class Sink>
+    void Reactor::Service(size_t index, Sink& sink, bool drain) {
+        Source& s = sources_[index];
+        // Event sources hand over every queued frame; a cap keeps one busy device from starving the rest.
+        for (int n = 0; n < (drain ? 64 : 1); ++n) {
+            const SampleStatus status = s.poll(s.backend, s.cur);
+            ++stats_.polls;
+            if (status == SampleStatus::Changed) {
+                ++stats_.changes;
+                if (!s.emittedAny || DiffStates(s.prev, s.cur, s.caps) != kChangedNone) {
+                    sink(s.tag, s.layout, &s.cur);
+                    s.prev = s.cur;
+                    s.emittedAny = true;
+                    ++stats_.emitted;
+                }
+                continue;
+            }
+            if (status == SampleStatus::Disconnected || status == SampleStatus::Failed) {
+                s.open = false;
+                --open_;
+                Unregister(s);
+                sink(s.tag, s.layout, static_cast<const InputState*>(nullptr));
+            }
+            break;
+        }
+    }
+
+    template <class Sink>
+    ReaderExit Reactor::Run(Sink& sink, const std::atomic_bool& running) {
+        while (running.load(std::memory_order_relaxed) && (open_ > 0 || !watches_.empty())) {
+            uint64_t deadline = UINT64_MAX;
+            for (const Source& s : sources_) {
+                if (s.open && s.nextNs < deadline) deadline = s.nextNs;
+            }
+
+            const uint64_t t0 = clock_.NowNs();
+            ready_.clear();
+            if (!Wait(deadline, ready_)) return ReaderExit::Failed;
+            const uint64_t t1 = clock_.NowNs();
+            stats_.waitNs += t1 - t0;
+            ++stats_.wakeups;
+
+            fired_.clear();
+            for (size_t i : ready_) {
+                if (i & kWatchBit) {
+                    fired_.push_back(i & ~kWatchBit);
+                    continue;
+                }
+                if (!sources_[i].open) continue;
+                Service(i, sink, true);
+                sources_[i].nextNs = t1 + sources_[i].periodNs; // heard from it: postpone the heartbeat
+            }
+            for (size_t i = 0; i < sources_.size(); ++i) {
+                Source& s = sources_[i];
+                if (!s.open || s.nextNs > t1) continue;
+                Service(i, sink, s.handle != -1);
+                // Stay on the grid; after a stall, skip to the first slot after now.
+                s.nextNs = s.nextNs == 0 ? t1 + s.periodNs : s.nextNs + s.periodNs;
+                if (s.nextNs <= t1) s.nextNs += ((t1 - s.nextNs) / s.periodNs + 1) * s.periodNs;
+            }
+            // Callbacks last: they may add sources, which would invalidate references taken above.
+            for (size_t w : fired_) watches_[w].onReady(watches_[w].context);
+            for (size_t i : detached_) sink(sources_[i].tag, sources_[i].layout, static_cast<const InputState*>(nullptr));
+            detached_.clear();
+            stats_.busyNs += clock_.NowNs() - t1;
+        }
+        return open_ == 0 && watches_.empty() ? ReaderExit::Disconnected : ReaderExit::Stopped;
+    }
+
+    /**
+     * @brief Multi-device output: each line is prefixed with the device tag ("[2] LX=...").
+     */
+    class TaggedConsoleSink {
+    public:
+        explicit TaggedConsoleSink(std::FILE* out = stdout) : out_(out) {}
+
+        /// Prints only the objects in @p caps for device @p tag; call before streaming starts.
+        void SetCaps(int tag, const StateCaps& caps);
+
+        /// Writes one tagged state line, or "[tag] disconnected" when @p state is nullptr.
+        void operator()(int tag, StateLayout layout, const InputState* state);
+
+        void Flush() { std::fflush(out_); }
+
+    private:
+        std::FILE* out_;
+        std::vector<std::pair<int, StateCaps>> caps_; //!< Devices with fewer objects than InputState holds.
+    };
+
+    /**
+     * @brief Prints the reactor counters on one line ("reactor: ...").
+     */
+    void PrintReactorStats(const ReactorStats& stats, double seconds);
+
+} // namespace joystick
@@ -0,0 +1,69 @@
+﻿/**
+ * @file
+ * @brief Work-stealing deques and aligned storage of the reader pool.
+ */
+
+#include "ReaderPool.h"
+
+#include <cstdio>
+
+namespace joystick {
+
+    ReaderPool::ReaderPool(size_t workers, uint32_t rateHz)
+        : periodNs_(1000000000ull / (rateHz ? rateHz : 1)) {
+        if (workers == 0) workers = std::thread::hardware_concurrency();
+        if (workers == 0) workers = 1;
+        for (size_t w = 0; w < workers; ++w) workers_.emplace_back(new Worker());
+    }
+
+    bool ReaderPool::PopLocal(size_t w, Task& task) {
+        Worker& self = *workers_[w];
+        std::lock_guard<std::mutex> lock(self.lock);
+        if (self.queue.empty()) return false;
+        task = self.queue.back();
+        self.queue.pop_back();
+        return true;
+    }
+
+    bool ReaderPool::Steal(size_t w, Task& task) {
+        for (size_t k = 1; k < active_; ++k) {
+            Worker& victim = *workers_[(w + k) % active_];
+            std::lock_guard<std::mutex> lock(victim.lock);
+            if (victim.queue.empty()) continue;
+            task = victim.queue.front();
+            victim.queue.pop_front();
+            ++workers_[w]->stats.steals;
+            return true;
+        }
+        return false;
+    }
+
+    PoolStats ReaderPool::Stats() const {
+        PoolStats sum;
+        for (size_t w = 0; w < active_; ++w) {
+            const PoolStats& s = workers_[w]->stats;
+            sum.ticks += s.ticks;
+            sum.missedTicks += s.missedTicks;
+            sum.polls += s.polls;
+            sum.changes += s.changes;
+            sum.emitted += s.emitted;
+            sum.steals += s.steals;
+            sum.lagSumNs += s.lagSumNs;
+            if (s.lagMaxNs > sum.lagMaxNs) sum.lagMaxNs = s.lagMaxNs;
+            sum.busyNs += s.busyNs;
+            sum.waitNs += s.waitNs;
+        }
+        return sum;
+    }
+
+    void PrintPoolStats(const PoolStats& stats, size_t workers, double seconds) {
+        const double total = (double)(stats.waitNs + stats.busyNs);
+        std::printf("pool: %zu workers, %llu polls (%.1f/s), %llu changes, %llu emitted, %llu steals, "
+            "lag mean %.1f us max %.1f us, missed ticks %llu, busy %.2f%%\n",
+            workers, (unsigned long long)stats.polls, seconds > 0 ? (double)stats.polls / seconds : 0.0,
+            (unsigned long long)stats.changes, (unsigned long long)stats.emitted, (unsigned long long)stats.steals,
+            stats.polls ? (double)stats.lagSumNs / (double)stats.polls / 1000.0 : 0.0, (double)stats.lagMaxNs / 1000.0,
+            (unsigned long long)stats.missedTicks, total > 0 ? 100.0 * (double)stats.busyNs / total : 0.0);
+    }
+
+} // namespace joystick
@@ -0,0 +1,263 @@
+﻿/**
+ * @file
+ * @brief Work-stealing reader pool for rigs with dozens of devices (`JoystickInput --all --pool 4`).
+ * @details
+ *   - A fixed set of worker threads shares the devices. Every worker owns the devices whose index
+ *     is congruent to its own (device i -> worker i % workers) and, on each tick of the common poll
+ *     grid, pushes one sampling task per open home device onto its own deque.
+ *   - A worker pops its own tasks from the back; when it runs dry it steals from the front of the
+ *     other workers' deques. A device whose read stalls (an empty XInput slot, a wedged HID driver)
+ *     therefore delays only itself: the rest of its owner's tasks move to idle workers.
+ *   - Devices are read with InputBackend::Poll(), which never blocks; event-driven backends are
+ *     polled on the same grid and drain what they have queued.
+ *   - A device is sampled by one worker at a time (a per-device busy flag); each device keeps its
+ *     own previous state for diffing. Sink calls are serialized by the pool.
+ *   - Per-device and per-worker state is cache-line aligned, so workers updating neighbouring
+ *     devices never write to the same line.
+ */
+
+#pragma once
+
+#include "InputCore.h"
+#include "PollScheduler.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace joystick {
+
+    /**
+     * @brief Counters kept by ReaderPool::Run (summed over the workers).
+     */
+    struct PoolStats {
+        uint64_t ticks = 0;        //!< Grid ticks served (per worker, summed).
+        uint64_t missedTicks = 0;  //!< Ticks skipped because the worker was still busy with earlier ones.
+        uint64_t polls = 0;        //!< InputBackend::Poll() calls.
+        uint64_t changes = 0;      //!< Polls that returned Changed.
+        uint64_t emitted = 0;      //!< States passed to the sink after diffing.
+        uint64_t steals = 0;       //!< Tasks taken from another worker's deque.
+        uint64_t lagSumNs = 0;     //!< Sum over polls of (poll start - tick deadline).
+        uint64_t lagMaxNs = 0;     //!< Worst poll lag.
+        uint64_t busyNs = 0;       //!< Time spent running tasks.
+        uint64_t waitNs = 0;       //!< Time blocked until the next tick.
+    };
+
+    /**
+     * @brief Samples many devices on a fixed set of threads (see file notes).
+     */
+    class ReaderPool {
+    public:
+        /**
+         * @param workers Worker threads; 0 = one per hardware thread. Run() never starts more workers
+         *        than there are devices.
+         * @param rateHz Poll rate of every device; 0 is treated as 1 Hz.
+         */
+        ReaderPool(size_t workers, uint32_t rateHz);
+        ReaderPool(const ReaderPool&) = delete;
+        ReaderPool& operator=(const ReaderPool&) = delete;
+
+        /**
+         * @brief Adds a device.
+         * @param backend Source; must outlive Run(). Its Poll() may be called from any worker, but
+         *        never from two at once.
+         * @param tag Device label passed to the sink (the device index).
+         * @param drain Keep polling while Changed is returned (up to 64 states per tick); for event
+         *        backends that queue frames, such as evdev.
+         */
+        template <class Backend>
+        void Add(InputBackend<Backend>& backend, int tag, bool drain = false) {
+            std::unique_ptr<Device> d(new Device());
+            d->tag = tag;
+            d->layout = backend.Layout();
+            d->caps = backend.Caps();
+            d->backend = &backend;
+            d->poll = &PollThunk<Backend>;
+            d->drain = drain;
+            devices_.push_back(std::move(d));
+        }
+
+        /**
+         * @brief Streams all devices until @p running is cleared or every device is gone.
+         * @param sink Called as `sink(int tag, StateLayout layout, const InputState* state)`, never
+         *        concurrently; @p state is nullptr once when the device disconnects or fails.
+         * @param running Workers run while this flag is true.
+         * @return Stopped or Disconnected (all devices gone). The calling thread is worker 0.
+         */
+        template <class Sink>
+        ReaderExit Run(Sink& sink, const std::atomic_bool& running);
+
+        size_t DeviceCount() const { return devices_.size(); }
+        /// Workers used by the last Run().
+        size_t ActiveWorkers() const { return active_; }
+        /// Poll() calls made on device @p index (insertion order).
+        uint64_t DevicePolls(size_t index) const { return devices_[index]->polls; }
+        /// Counters of the last Run(), summed over the workers.
+        PoolStats Stats() const;
+
+    private:
+        /// Per-device state; written only by the worker holding @c busy.
+        struct alignas(kCacheLineSize) Device : CacheAligned {
+            std::atomic<bool> busy{ false };
+            std::atomic<bool> open{ true };
+            int tag = 0;
+            StateLayout layout = StateLayout::Gamepad;
+            StateCaps caps;
+            bool drain = false;
+            bool emittedAny = false;
+            void* backend = nullptr;
+            SampleStatus (*poll)(void*, InputState&) = nullptr;
+            uint64_t polls = 0;
+            InputState prev;
+            InputState cur;
+        };
+
+        /// One sampling task: poll @c device for the tick due at @c dueNs.
+        struct Task {
+            size_t device;
+            uint64_t dueNs;
+        };
+
+        /// Per-worker deque and counters; the deque is guarded by @c lock.
+        struct alignas(kCacheLineSize) Worker : CacheAligned {
+            std::mutex lock;
+            std::deque<Task> queue;
+            PoolStats stats;
+        };
+
+        template <class Backend>
+        static SampleStatus PollThunk(void* backend, InputState& state) {
+            return static_cast<InputBackend<Backend>*>(backend)->Poll(state);
+        }
+
+        /// Takes the newest task of worker @p w.
+        bool PopLocal(size_t w, Task& task);
+
+        /// Takes the oldest task of another worker, scanning from @p w + 1.
+        bool Steal(size_t w, Task& task);
+
+        template <class Sink>
+        void WorkerLoop(size_t w, Sink& sink, const std::atomic_bool& running);
+
+        template <class Sink>
+        void Service(const Task& task, Worker& self, SystemTimer& clock, Sink& sink);
+
+        std::vector<std::unique_ptr<Device>> devices_;
+        std::vector<std::unique_ptr<Worker>> workers_;
+        size_t active_ = 0;
+        uint64_t periodNs_;
+        uint64_t startNs_ = 0;
+        std::atomic<size_t> open_{ 0 };
+        std::mutex sinkLock_;
+    };
+
+    template <class Sink>
+    void ReaderPool::Service(const Task& task, Worker& self, SystemTimer& clock, Sink& sink) {
+        Device& d = *devices_[task.device];
+        // Already being sampled by another worker (it stole an older tick): that poll covers this one.
+        if (d.busy.exchange(true, std::memory_order_acquire)) return;
+        if (d.open.load(std::memory_order_relaxed)) {
+            const uint64_t start = clock.NowNs();
+            const uint64_t lag = start > task.dueNs ? start - task.dueNs : 0;
+            self.stats.lagSumNs += lag;
+            if (lag > self.stats.lagMaxNs) self.stats.lagMaxNs = lag;
+
+            for (int n = 0; n < (d.drain ? 64 : 1); ++n) {
+                const SampleStatus status = d.poll(d.backend, d.cur);
+                ++d.polls;
+                ++self.stats.polls;
+                if (status == SampleStatus::Changed) {
+                    ++self.stats.changes;
+                    if (!d.emittedAny || DiffStates(d.prev, d.cur, d.caps) != kChangedNone) {
+                        {
+                            std::lock_guard<std::mutex> lock(sinkLock_);
+                            sink(d.tag, d.layout, &d.cur);
+                        }
+                        d.prev = d.cur;
+                        d.emittedAny = true;
+                        ++self.stats.emitted;
+                    }
+                    continue;
+                }
+                if (status == SampleStatus::Disconnected || status == SampleStatus::Failed) {
+                    d.open.store(false, std::memory_order_relaxed);
+                    open_.fetch_sub(1, std::memory_order_acq_rel);
+                    std::lock_guard<std::mutex> lock(sinkLock_);
+                    sink(d.tag, d.layout, static_cast<const InputState*>(nullptr));
+                }
+                break;
+            }
+        }
+        d.busy.store(false, std::memory_order_release);
+    }
+
+    template <class Sink>
+    void ReaderPool::WorkerLoop(size_t w, Sink& sink, const std::atomic_bool& running) {
+        Worker& self = *workers_[w];
+        SystemTimer timer;
+        uint64_t deadline = startNs_;
+        while (running.load(std::memory_order_relaxed) && open_.load(std::memory_order_acquire) > 0) {
+            const uint64_t t0 = timer.NowNs();
+            timer.SleepUntilNs(deadline);
+            const uint64_t t1 = timer.NowNs();
+            self.stats.waitNs += t1 - t0;
+            ++self.stats.ticks;
+
+            {
+                std::lock_guard<std::mutex> lock(self.lock);
+                for (size_t i = w; i < devices_.size(); i += active_) {
+                    if (devices_[i]->open.load(std::memory_order_relaxed)) self.queue.push_back(Task{ i, deadline });
+                }
+            }
+            Task task;
+            while (PopLocal(w, task) || Steal(w, task)) {
+                Service(task, self, timer, sink);
+            }
+
+            const uint64_t now = timer.NowNs();
+            self.stats.busyNs += now - t1;
+            // Stay on the grid; ticks that already passed are skipped, not run back to back.
+            deadline += periodNs_;
+            if (deadline <= now) {
+                const uint64_t skipped = (now - deadline) / periodNs_ + 1;
+                self.stats.missedTicks += skipped;
+                deadline += skipped * periodNs_;
+            }
+        }
+    }
+
+    template <class Sink>
+    ReaderExit ReaderPool::Run(Sink& sink, const std::atomic_bool& running) {
+        active_ = workers_.size() < devices_.size() ? workers_.size() : devices_.size();
+        size_t open = 0;
+        for (const auto& d : devices_) {
+            if (d->open.load(std::memory_order_relaxed)) ++open;
+        }
+        open_.store(open);
+        if (open == 0) return ReaderExit::Disconnected;
+        for (size_t w = 0; w < active_; ++w) {
+            workers_[w]->queue.clear();
+            workers_[w]->stats = PoolStats();
+        }
+
+        startNs_ = SystemTimer().NowNs();
+        std::vector<std::thread> threads;
+        for (size_t w = 1; w < active_; ++w) {
+            threads.emplace_back([this, w, &sink, &running]() { WorkerLoop(w, sink, running); });
+        }
+        WorkerLoop(0, sink, running);
+        for (std::thread& t : threads) t.join();
+        return open_.load() == 0 ? ReaderExit::Disconnected : ReaderExit::Stopped;
+    }
+
+    /**
+     * @brief Prints the pool counters on one line ("pool: ...").
+     */
+    void PrintPoolStats(const PoolStats& stats, size_t workers, double seconds);
+
+} // namespace joystick
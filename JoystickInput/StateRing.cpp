@@ -0,0 +1,52 @@
+﻿/**
+ * @file
+ * @brief State ring construction, policy names and reporting.
+ */
+
+#include "StateRing.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace joystick {
+
+    bool ParseOverflowPolicy(const char* text, OverflowPolicy& policy) {
+        if (std::strcmp(text, "latest") == 0) policy = OverflowPolicy::KeepLatest;
+        else if (std::strcmp(text, "drop") == 0) policy = OverflowPolicy::DropNewest;
+        else if (std::strcmp(text, "block") == 0) policy = OverflowPolicy::Block;
+        else return false;
+        return true;
+    }
+
+    const char* OverflowPolicyName(OverflowPolicy policy) {
+        switch (policy) {
+        case OverflowPolicy::KeepLatest: return "latest";
+        case OverflowPolicy::DropNewest: return "drop";
+        case OverflowPolicy::Block: return "block";
+        }
+        return "?";
+    }
+
+    StateRing::StateRing(size_t capacity, OverflowPolicy policy) : policy_(policy) {
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+        slots_.resize(n);
+        mask_ = n - 1;
+    }
+
+    RingStats StateRing::Stats() const {
+        RingStats st = prod_.stats;
+        st.popped = cons_.popped;
+        return st;
+    }
+
+    void PrintRingStats(const StateRing& ring) {
+        const RingStats st = ring.Stats();
+        std::printf("output ring: %zu slots, policy %s, %llu records, %llu written, max depth %llu, overflows %llu, "
+            "dropped %llu, blocked %.1f ms\n",
+            ring.Capacity(), OverflowPolicyName(ring.Policy()), (unsigned long long)st.pushed,
+            (unsigned long long)st.popped, (unsigned long long)st.maxDepth, (unsigned long long)st.overflows,
+            (unsigned long long)st.dropped, (double)st.blockedNs / 1e6);
+    }
+
+} // namespace joystick
@@ -0,0 +1,375 @@
+﻿/**
+ * @file
+ * @brief Lock-free single-producer/single-consumer state ring and the output thread behind it.
+ * @details
+ *   - The reader thread pushes fixed-size StateRecords; a separate output thread pops, formats
+ *     and writes them, so a slow terminal or a blocked pipe no longer stalls sampling.
+ *   - The ring is a power-of-two array indexed by free-running head/tail counters, each on its own
+ *     cache line; either side keeps a cached copy of the other's counter and reloads it only when
+ *     the ring looks full (producer) or empty (consumer).
+ *   - When the ring is full, OverflowPolicy decides:
+ *     - KeepLatest (default): the record goes to an overflow mailbox (a lock-free triple buffer of
+ *       record batches) holding one record per tag, where newer records of the same tag replace it
+ *       until the output thread catches up. Intermediate states are lost; the most recent state of
+ *       every device is always delivered, disconnect records are neither replaced nor replace one,
+ *       and the order of each device's records is preserved.
+ *     - DropNewest: the record is discarded.
+ *     - Block: the reader waits for space; nothing is lost but sampling stalls with the output.
+ *   - The producer never takes a lock, except to wake the output thread when it is asleep on an
+ *     empty ring (once per burst).
+ */
+
+#pragma once
+
+#include "InputCore.h"
+#include "PollScheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace joystick {
+
+    /**
+     * @brief Parses "latest", "drop" or "block".
+     * @return false if @p text names no policy.
+     */
+    bool ParseOverflowPolicy(const char* text, OverflowPolicy& policy);
+
+    /// Short policy name for reports ("latest", "drop", "block").
+    const char* OverflowPolicyName(OverflowPolicy policy);
+
+    /**
+     * @brief One ring entry: a device state and who produced it.
+     */
+    struct StateRecord {
+        uint64_t timeNs = 0;                        //!< SystemTimer time of the push.
+        int32_t tag = 0;                            //!< Device label (multi-device readers).
+        StateLayout layout = StateLayout::Gamepad;  //!< Output format of @c state.
+        bool closed = false;                        //!< The device disconnected; @c state is unused.
+        InputState state;
+    };
+
+    /**
+     * @brief Counters of a StateRing; producer and consumer fields are each written by one side.
+     */
+    struct RingStats {
+        uint64_t pushed = 0;     //!< Records offered by the producer.
+        uint64_t overflows = 0;  //!< Pushes that found the ring full.
+        uint64_t dropped = 0;    //!< Records lost: discarded (DropNewest) or replaced by their tag's next one (KeepLatest).
+        uint64_t blockedNs = 0;  //!< Time the producer waited for space (Block).
+        uint64_t maxDepth = 0;   //!< Highest occupancy seen by the producer.
+        uint64_t popped = 0;     //!< Records taken by the consumer (ring and mailbox).
+    };
+
+    /**
+     * @brief Bounded SPSC queue of StateRecords with an overflow policy (see file notes).
+     * @details Push() may only be called from one thread at a time, and Pop() likewise; the two may run
+     *          concurrently.
+     */
+    class StateRing {
+    public:
+        /**
+         * @param capacity Slots; rounded up to a power of two, at least 2.
+         * @param policy Overflow behaviour.
+         */
+        StateRing(size_t capacity, OverflowPolicy policy);
+        StateRing(const StateRing&) = delete;
+        StateRing& operator=(const StateRing&) = delete;
+
+        /**
+         * @brief Producer: enqueues @p record according to the overflow policy.
+         * @return false if the record was discarded (DropNewest).
+         */
+        bool Push(const StateRecord& record);
+
+        /**
+         * @brief Consumer: takes the oldest record (the rest of a taken mailbox batch, the ring, then the mailbox).
+         * @return false if nothing is pending.
+         */
+        bool Pop(StateRecord& record);
+
+        /// Consumer: true if Pop() would return false.
+        bool Empty() const;
+
+        size_t Capacity() const { return mask_ + 1; }
+        OverflowPolicy Policy() const { return policy_; }
+
+        /// Combined counters; exact once both sides are idle.
+        RingStats Stats() const;
+
+    private:
+        static constexpr uint8_t kFresh = 4; //!< Mailbox flag: the middle buffer holds an unread record.
+
+        bool TryPush(const StateRecord& record);
+        void PushLatest(const StateRecord& record);
+        static bool Coalesce(std::vector<StateRecord>& batch, const StateRecord& record);
+
+        /// Producer side.
+        struct alignas(kCacheLineSize) ProducerSide {
+            std::atomic<uint64_t> head{ 0 };
+            uint64_t cachedTail = 0;
+            uint8_t back = 0;      //!< Mailbox buffer the producer writes next.
+            std::vector<StateRecord> pending; //!< Overflow records since the consumer last took the mailbox.
+            RingStats stats;
+        };
+
+        /// Consumer side.
+        struct alignas(kCacheLineSize) ConsumerSide {
+            std::atomic<uint64_t> tail{ 0 };
+            uint64_t cachedHead = 0;
+            uint8_t front = 2;     //!< Mailbox buffer the consumer read last.
+            size_t next = 0;       //!< First record of mailbox_[front] not popped yet.
+            uint64_t popped = 0;
+        };
+
+        ProducerSide prod_;
+        ConsumerSide cons_;
+        alignas(kCacheLineSize) std::atomic<uint8_t> middle_{ 1 }; //!< Mailbox middle buffer index | kFresh.
+        std::vector<StateRecord> mailbox_[3];
+        std::vector<StateRecord> slots_;
+        size_t mask_;
+        OverflowPolicy policy_;
+    };
+
+    inline bool StateRing::TryPush(const StateRecord& record) {
+        const uint64_t head = prod_.head.load(std::memory_order_relaxed);
+        if (head - prod_.cachedTail > mask_) {
+            prod_.cachedTail = cons_.tail.load(std::memory_order_acquire);
+            if (head - prod_.cachedTail > mask_) return false;
+        }
+        slots_[head & mask_] = record;
+        prod_.head.store(head + 1, std::memory_order_release);
+        const uint64_t depth = head + 1 - prod_.cachedTail;
+        if (depth > prod_.stats.maxDepth) prod_.stats.maxDepth = depth;
+        return true;
+    }
+
+    inline bool StateRing::Push(const StateRecord& record) {
+        ++prod_.stats.pushed;
+        // While the mailbox holds an unread record, newer ones must follow it there to keep the order.
+        if (!(middle_.load(std::memory_order_acquire) & kFresh) && TryPush(record)) return true;
+        ++prod_.stats.overflows;
+        switch (policy_) {
+        case OverflowPolicy::DropNewest:
+            ++prod_.stats.dropped;
+            return false;
+        case OverflowPolicy::Block: {
+            const auto t0 = std::chrono::steady_clock::now();
+            for (unsigned spins = 0; !TryPush(record); ++spins) {
+                if (spins < 64) CpuRelax();
+                else std::this_thread::yield();
+            }
+            prod_.stats.blockedNs += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
+            return true;
+        }
+        case OverflowPolicy::KeepLatest:
+        default:
+            PushLatest(record);
+            return true;
+        }
+    }
+
+    /**
+     * @brief Puts @p record in a mailbox batch: a state replaces the last record of its tag if that is
+     *        a state too; anything else is appended.
+     * @return true if a record was replaced.
+     */
+    inline bool StateRing::Coalesce(std::vector<StateRecord>& batch, const StateRecord& record) {
+        for (auto it = batch.rbegin(); it != batch.rend(); ++it) {
+            if (it->tag != record.tag) continue;
+            if (it->closed || record.closed) break;
+            *it = record;
+            return true;
+        }
+        batch.push_back(record);
+        return false;
+    }
+
+    inline void StateRing::PushLatest(const StateRecord& record) {
+        // Only the consumer clears kFresh: without it, the last published batch has been taken.
+        uint8_t published = middle_.load(std::memory_order_acquire);
+        if (!(published & kFresh)) prod_.pending.clear();
+        const bool replaced = Coalesce(prod_.pending, record);
+        mailbox_[prod_.back] = prod_.pending;
+        const uint8_t fresh = static_cast<uint8_t>(prod_.back | kFresh);
+        if (published & kFresh) {
+            // The new batch holds everything of the unread one, so replacing it loses only what Coalesce() replaced.
+            if (middle_.compare_exchange_strong(published, fresh, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                if (replaced) ++prod_.stats.dropped;
+                prod_.back = static_cast<uint8_t>(published & 3);
+                return;
+            }
+            // The consumer took the unread batch meanwhile: publish this record alone.
+            prod_.pending.assign(1, record);
+            mailbox_[prod_.back] = prod_.pending;
+        }
+        const uint8_t old = middle_.exchange(fresh, std::memory_order_acq_rel);
+        prod_.back = static_cast<uint8_t>(old & 3);
+    }
+
+    inline bool StateRing::Pop(StateRecord& record) {
+        // A taken batch is older than anything pushed to the ring after it.
+        const std::vector<StateRecord>& taken = mailbox_[cons_.front];
+        if (cons_.next < taken.size()) {
+            record = taken[cons_.next++];
+            ++cons_.popped;
+            return true;
+        }
+        const uint64_t tail = cons_.tail.load(std::memory_order_relaxed);
+        if (tail == cons_.cachedHead) cons_.cachedHead = prod_.head.load(std::memory_order_acquire);
+        if (tail != cons_.cachedHead) {
+            record = slots_[tail & mask_];
+            cons_.tail.store(tail + 1, std::memory_order_release);
+            ++cons_.popped;
+            return true;
+        }
+        // The mailbox only fills while the ring is full, so it is newer than everything drained above.
+        if (!(middle_.load(std::memory_order_acquire) & kFresh)) return false;
+        const uint8_t old = middle_.exchange(cons_.front, std::memory_order_acq_rel);
+        cons_.front = static_cast<uint8_t>(old & 3);
+        cons_.next = 0;
+        const std::vector<StateRecord>& batch = mailbox_[cons_.front];
+        if (batch.empty()) return false;
+        record = batch[cons_.next++];
+        ++cons_.popped;
+        return true;
+    }
+
+    inline bool StateRing::Empty() const {
+        return cons_.next >= mailbox_[cons_.front].size() &&
+            cons_.tail.load(std::memory_order_relaxed) == prod_.head.load(std::memory_order_acquire) &&
+            !(middle_.load(std::memory_order_acquire) & kFresh);
+    }
+
+    /**
+     * @brief Reader-side sink that hands states to an output thread through a StateRing.
+     * @tparam Out Output stage run on the output thread; called as
+     *         `out(int tag, StateLayout layout, const InputState* state)` (nullptr = disconnected)
+     *         and `out.Flush()` after each drained batch (ConsoleSink, TaggedConsoleSink).
+     * @details Usable wherever RunReader, Reactor::Run or ReaderPool::Run take a sink. Close() (or the
+     *          destructor) drains what is queued and joins the thread.
+     */
+    template <class Out>
+    class AsyncSink {
+    public:
+        /**
+         * @param out Output stage; used only by the output thread until Close() returns.
+         * @param layout Layout of states passed through the single-device operator().
+         * @param capacity Ring slots.
+         * @param policy Overflow behaviour.
+         */
+        AsyncSink(Out& out, StateLayout layout, size_t capacity, OverflowPolicy policy)
+            : out_(out), layout_(layout), ring_(capacity, policy), thread_([this]() { Consume(); }) {}
+        ~AsyncSink() { Close(); }
+        AsyncSink(const AsyncSink&) = delete;
+        AsyncSink& operator=(const AsyncSink&) = delete;
+
+        /// Single-device readers (RunReader).
+        void operator()(const InputState& state) {
+            StateRecord r;
+            r.layout = layout_;
+            r.state = state;
+            Publish(r);
+        }
+
+        /// Multi-device readers (Reactor, ReaderPool).
+        void operator()(int tag, StateLayout layout, const InputState* state) {
+            StateRecord r;
+            r.tag = tag;
+            r.layout = layout;
+            if (state) r.state = *state;
+            else r.closed = true;
+            Publish(r);
+        }
+
+        /// Writes what is still queued and stops the output thread. Idempotent.
+        void Close() {
+            if (!thread_.joinable()) return;
+            {
+                std::lock_guard<std::mutex> lock(lock_);
+                closing_.store(true);
+            }
+            wake_.notify_one();
+            thread_.join();
+        }
+
+        const StateRing& Ring() const { return ring_; }
+
+    private:
+        void Publish(StateRecord& r) {
+            r.timeNs = clock_.NowNs();
+            ring_.Push(r);
+            // Pairs with the fence in Consume(): either the consumer sees the record, or we see it asleep.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sleeping_.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> lock(lock_);
+                wake_.notify_one();
+            }
+        }
+
+        void Consume() {
+            StateRecord r;
+            for (;;) {
+                bool any = false;
+                while (ring_.Pop(r)) {
+                    out_(r.tag, r.layout, r.closed ? static_cast<const InputState*>(nullptr) : &r.state);
+                    any = true;
+                }
+                if (any) out_.Flush();
+
+                std::unique_lock<std::mutex> lock(lock_);
+                sleeping_.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                while (ring_.Empty() && !closing_.load()) {
+                    wake_.wait(lock);
+                    CountWakeup();
+                }
+                sleeping_.store(false, std::memory_order_relaxed);
+                if (closing_.load() && ring_.Empty()) return;
+            }
+        }
+
+        Out& out_;
+        StateLayout layout_;
+        StateRing ring_;
+        SystemTimer clock_;
+        std::atomic<bool> sleeping_{ false };
+        std::atomic<bool> closing_{ false };
+        std::mutex lock_;
+        std::condition_variable wake_;
+        std::thread thread_; //!< Last member: starts after everything it uses is constructed.
+    };
+
+    /**
+     * @brief Prints the ring counters on one line ("output ring: ...").
+     */
+    void PrintRingStats(const StateRing& ring);
+
+    /**
+     * @brief Single-device reader loop with output on its own thread.
+     * @details Power-save readers keep RunBatchedReader on the calling thread: batching already keeps
+     *          writes off the sampling path, and an output thread would add a wake-up per batch.
+     * @param backend Source of samples.
+     * @param console Output stage; written by the output thread while the reader runs.
+     * @param options Ring size, overflow policy and power-save mode.
+     * @return Reason the loop ended. The ring counters are printed before returning.
+     */
+    template <class Backend>
+    ReaderExit RunConsoleReader(InputBackend<Backend>& backend, ConsoleSink& console, const ReaderOptions& options) {
+        console.SetCaps(backend.Caps());
+        if (options.powerSave) return RunBatchedReader(backend, console, g_Running);
+        AsyncSink<ConsoleSink> sink(console, backend.Layout(), options.ringSlots, options.overflow);
+        const ReaderExit exit = RunReader(backend, sink, g_Running);
+        sink.Close();
+        console.Flush();
+        PrintRingStats(sink.Ring());
+        return exit;
+    }
+
+} // namespace joystick
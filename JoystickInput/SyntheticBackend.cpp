@@ -0,0 +1,89 @@
+﻿/**
+ * @file
+ * @brief SyntheticBackend implementation.
+ */
+
+#include "SyntheticBackend.h"
+
+#include <thread>
+
+namespace joystick {
+
+    SyntheticBackend::SyntheticBackend(const SyntheticConfig& config)
+        : config_(config),
+          rng_(config.seed ? config.seed : 0x9E3779B97F4A7C15ull),
+          deadline_(std::chrono::steady_clock::now()) {
+    }
+
+    /**
+     * @brief xorshift64* step.
+     */
+    uint64_t SyntheticBackend::Next() {
+        rng_ ^= rng_ >> 12;
+        rng_ ^= rng_ << 25;
+        rng_ ^= rng_ >> 27;
+        return rng_ * 0x2545F4914F6CDD1Dull;
+    }
+
+    /**
+     * @brief Applies one plausible input change: an axis moves, a button toggles or a hat turns.
+     */
+    void SyntheticBackend::Mutate(InputState& state) {
+        const uint64_t r = Next();
+        const uint32_t what = static_cast<uint32_t>(r % 4);
+
+        if (config_.layout == StateLayout::Gamepad) {
+            if (what <= 1) {
+                const int axis = static_cast<int>((r >> 8) % 4);
+                state.axes[axis] = static_cast<int16_t>(r >> 16);
+            }
+            else if (what == 2) {
+                const int trigger = kAxisLeftTrigger + static_cast<int>((r >> 8) & 1);
+                state.axes[trigger] = static_cast<int32_t>((r >> 16) & 0xFF);
+            }
+            else {
+                state.buttons[0] ^= uint64_t(1) << ((r >> 8) % 16);
+                state.buttons[0] &= 0xFFFFu;
+            }
+            return;
+        }
+
+        if (what <= 1) {
+            const int axis = static_cast<int>((r >> 8) % kMaxAxes);
+            state.axes[axis] = static_cast<int32_t>((r >> 16) & 0xFFFF);
+        }
+        else if (what == 2) {
+            const int button = static_cast<int>((r >> 8) % 32);
+            SetButton(state, button, !IsButtonDown(state, button));
+        }
+        else {
+            const uint32_t step = static_cast<uint32_t>((r >> 8) % 9);
+            state.povs[0] = step == 8 ? kPovCentered : step * 4500u;
+        }
+    }
+
+    SampleStatus SyntheticBackend::SampleImpl(InputState& state) {
+        if (config_.intervalUs && !(config_.maxSamples && samples_ >= config_.maxSamples)) {
+            deadline_ += std::chrono::microseconds(config_.intervalUs);
+            std::this_thread::sleep_until(deadline_);
+            CountWakeup();
+        }
+        return PollImpl(state);
+    }
+
+    SampleStatus SyntheticBackend::PollImpl(InputState& state) {
+        if (config_.maxSamples && samples_ >= config_.maxSamples) {
+            return SampleStatus::Disconnected;
+        }
+        ++samples_;
+
+        if (Next() % 100 >= config_.changePercent) {
+            return SampleStatus::Unchanged;
+        }
+
+        Mutate(state);
+        state.packet = ++packet_;
+        return SampleStatus::Changed;
+    }
+
+} // namespace joystick
@@ -0,0 +1,61 @@
+﻿/**
+ * @file
+ * @brief Deterministic synthetic input backend for profiling the pipeline without hardware.
+ * @details
+ *   - Traffic is generated from a seeded xorshift PRNG, so two runs with the same SyntheticConfig
+ *     produce byte-identical output.
+ *   - With intervalUs == 0 the backend never sleeps, which measures the pipeline cost alone.
+ */
+
+#pragma once
+
+#include "InputCore.h"
+
+#include <chrono>
+#include <cstdint>
+
+namespace joystick {
+
+    /**
+     * @brief Parameters for SyntheticBackend.
+     */
+    struct SyntheticConfig {
+        uint64_t seed = 1;                             //!< PRNG seed; identical seeds give identical traffic.
+        StateLayout layout = StateLayout::Gamepad;     //!< Shape of the generated states.
+        uint32_t changePercent = 50;                   //!< Probability (0..100) that a sample carries a new packet.
+        uint32_t intervalUs = 0;                       //!< Simulated report period; 0 = return immediately.
+        uint64_t maxSamples = 0;                       //!< Stream length; 0 = unbounded. Disconnected is reported at the end.
+    };
+
+    /**
+     * @brief Generates deterministic device traffic (sticks drifting, buttons toggling, hats rotating).
+     */
+    class SyntheticBackend : public InputBackend<SyntheticBackend> {
+    public:
+        /// @param config Generator parameters.
+        explicit SyntheticBackend(const SyntheticConfig& config);
+
+        /// Produces the next sample; see InputBackend::Sample.
+        SampleStatus SampleImpl(InputState& state);
+
+        /// Produces the next sample without the simulated report period; see InputBackend::Poll.
+        SampleStatus PollImpl(InputState& state);
+
+        /// Layout of the generated states (config.layout).
+        StateLayout OutputLayout() const { return config_.layout; }
+
+        /// Samples produced so far.
+        uint64_t SampleCount() const { return samples_; }
+
+    private:
+        uint64_t Next();
+        void Mutate(InputState& state);
+
+        SyntheticConfig config_;
+        uint64_t rng_;
+        uint64_t samples_ = 0;
+        uint32_t packet_ = 0;
+        std::chrono::steady_clock::time_point deadline_;
+    };
+
+} // namespace joystick
@@ -0,0 +1,275 @@
+﻿/**
+ * @file
+ * @brief UringReadEngine and UringEvdevBackend (Linux only).
+ */
+
+#ifdef __linux__
+
+#include "UringReadEngine.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace joystick {
+
+    namespace {
+
+        int SysSetup(unsigned entries, io_uring_params* p) {
+            return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+        }
+
+        int SysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, const void* arg, size_t argSize) {
+            return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+        }
+
+        /// Pointer into a mapped ring at a kernel-provided byte offset.
+        template <class T>
+        T* At(void* base, uint32_t offset) {
+            return reinterpret_cast<T*>(static_cast<uint8_t*>(base) + offset);
+        }
+
+    } // namespace
+
+    UringReadEngine::UringReadEngine(unsigned entries) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        const int fd = SysSetup(entries ? entries : 1, &p);
+        if (fd < 0) return;
+        if (!(p.features & IORING_FEAT_EXT_ARG)) {
+            close(fd);
+            return;
+        }
+
+        sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) {
+            sqRingSize_ = cqRingSize_ = (sqRingSize_ > cqRingSize_ ? sqRingSize_ : cqRingSize_);
+        }
+
+        sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing_ == MAP_FAILED) {
+            sqRing_ = nullptr;
+            close(fd);
+            return;
+        }
+        if (single) {
+            cqRing_ = sqRing_;
+        }
+        else {
+            cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqRing_ == MAP_FAILED) {
+                cqRing_ = nullptr;
+                munmap(sqRing_, sqRingSize_);
+                sqRing_ = nullptr;
+                close(fd);
+                return;
+            }
+        }
+        sqesSize_ = p.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            if (cqRing_ != sqRing_) munmap(cqRing_, cqRingSize_);
+            munmap(sqRing_, sqRingSize_);
+            sqRing_ = cqRing_ = nullptr;
+            close(fd);
+            return;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        sqHead_ = At<unsigned>(sqRing_, p.sq_off.head);
+        sqTail_ = At<unsigned>(sqRing_, p.sq_off.tail);
+        sqMask_ = *At<unsigned>(sqRing_, p.sq_off.ring_mask);
+        sqArray_ = At<unsigned>(sqRing_, p.sq_off.array);
+        sqEntries_ = p.sq_entries;
+        cqHead_ = At<unsigned>(cqRing_, p.cq_off.head);
+        cqTail_ = At<unsigned>(cqRing_, p.cq_off.tail);
+        cqMask_ = *At<unsigned>(cqRing_, p.cq_off.ring_mask);
+        cqes_ = At<io_uring_cqe>(cqRing_, p.cq_off.cqes);
+        ringFd_ = fd;
+    }
+
+    UringReadEngine::~UringReadEngine() {
+        if (sqes_) munmap(sqes_, sqesSize_);
+        if (cqRing_ && cqRing_ != sqRing_) munmap(cqRing_, cqRingSize_);
+        if (sqRing_) munmap(sqRing_, sqRingSize_);
+        if (ringFd_ >= 0) close(ringFd_);
+    }
+
+    io_uring_sqe* UringReadEngine::Reserve(unsigned& tail) {
+        if (ringFd_ < 0) return nullptr;
+        tail = *sqTail_; // only this thread writes the tail
+        const unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (tail - head >= sqEntries_) return nullptr;
+        io_uring_sqe* sqe = &sqes_[tail & sqMask_];
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    void UringReadEngine::Publish(unsigned tail) {
+        sqArray_[tail & sqMask_] = tail & sqMask_;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        ++toSubmit_;
+    }
+
+    bool UringReadEngine::QueueRead(int fd, void* buf, unsigned len, uint64_t tag) {
+        unsigned tail = 0;
+        io_uring_sqe* sqe = Reserve(tail);
+        if (!sqe) return false;
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buf);
+        sqe->len = len;
+        sqe->off = static_cast<uint64_t>(-1); // current file position; required for pipes/sockets/char devices
+        sqe->user_data = tag;
+        Publish(tail);
+        return true;
+    }
+
+    bool UringReadEngine::QueueCancel(uint64_t target, uint64_t tag) {
+        unsigned tail = 0;
+        io_uring_sqe* sqe = Reserve(tail);
+        if (!sqe) return false;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = target;
+        sqe->user_data = tag;
+        Publish(tail);
+        return true;
+    }
+
+    int UringReadEngine::Enter(int timeoutMs) {
+        __kernel_timespec ts;
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+        io_uring_getevents_arg arg;
+        std::memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+        const unsigned minComplete = timeoutMs > 0 ? 1 : 0;
+        ++stats_.enters;
+        const int r = SysEnter(ringFd_, toSubmit_, minComplete,
+            IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        if (r >= 0) {
+            const unsigned done = static_cast<unsigned>(r) < toSubmit_ ? static_cast<unsigned>(r) : toSubmit_;
+            stats_.submitted += done;
+            toSubmit_ -= done;
+            return 0;
+        }
+        // ETIME: nothing completed in time (only reported when nothing was submitted).
+        // EBUSY/EAGAIN: CQ overflow back-pressure; the caller reaps before submitting more.
+        if (errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN) return 0;
+        return -1;
+    }
+
+    bool UringReadEngine::PopCompletion(uint64_t& tag, int32_t& res) {
+        const unsigned head = *cqHead_;
+        const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        if (head == tail) return false;
+        const io_uring_cqe& cqe = cqes_[head & cqMask_];
+        tag = cqe.user_data;
+        res = cqe.res;
+        __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    UringEvdevBackend::UringEvdevBackend(unsigned maxDevices, int timeoutMs)
+        : engine_(maxDevices), timeoutMs_(timeoutMs), maxDevices_(maxDevices) {
+        devices_.reserve(maxDevices);
+    }
+
+    UringEvdevBackend::~UringEvdevBackend() {
+        CancelReads();
+        for (auto& d : devices_) {
+            if (d && d->ownsFd && d->fd >= 0) close(d->fd);
+        }
+    }
+
+    void UringEvdevBackend::CancelReads() {
+        // Closing the ring does not stop a read the kernel already started: it could still complete
+        // into the EvdevStream buffer after it is freed. Each read is cancelled and its completion reaped.
+        std::vector<bool> cancelQueued(devices_.size(), false);
+        for (int tries = 0; tries < 100; ++tries) {
+            bool pending = false;
+            for (size_t i = 0; i < devices_.size(); ++i) {
+                if (!devices_[i]->inFlight) continue;
+                pending = true;
+                if (!cancelQueued[i]) cancelQueued[i] = engine_.QueueCancel(i, kCancelTag);
+            }
+            if (!pending) return;
+            const int reaped = engine_.Wait(10, [this](uint64_t tag, int32_t /*res*/) {
+                if (tag != kCancelTag) devices_[static_cast<size_t>(tag)]->inFlight = false;
+            });
+            if (reaped < 0) break;
+        }
+        // A read that would not complete keeps its buffer: leaking it is safer than freeing it under the kernel.
+        for (auto& d : devices_) {
+            if (!d->inFlight) continue;
+            if (d->ownsFd && d->fd >= 0) close(d->fd);
+            d.release();
+        }
+    }
+
+    int UringEvdevBackend::AddDevice(int fd, bool ownsFd) {
+        if (!engine_.IsValid() || devices_.size() >= maxDevices_) return -1;
+        const int flags = fcntl(fd, F_GETFL);
+        if (flags >= 0 && (flags & O_NONBLOCK)) fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+
+        std::unique_ptr<Device> dev(new Device());
+        dev->fd = fd;
+        dev->ownsFd = ownsFd;
+        devices_.push_back(std::move(dev));
+        return static_cast<int>(devices_.size() - 1);
+    }
+
+    SampleStatus UringEvdevBackend::SampleImpl(InputState& state) {
+        bool waited = false;
+        while (true) {
+            // 1) Hand out already-read frames, rotating the start device for fairness.
+            const size_t n = devices_.size();
+            for (size_t k = 0; k < n; ++k) {
+                const size_t i = (next_ + k) % n;
+                Device& d = *devices_[i];
+                if (d.stream.NextFrame(d.fd, state, stats_)) {
+                    last_ = i;
+                    next_ = (i + 1) % n;
+                    return SampleStatus::Changed;
+                }
+            }
+            if (waited) return SampleStatus::Unchanged;
+
+            // 2) Re-post a read for every idle device, then one submit-and-wait for all of them.
+            size_t open = 0;
+            for (size_t i = 0; i < n; ++i) {
+                Device& d = *devices_[i];
+                if (d.closed) continue;
+                ++open;
+                if (d.inFlight) continue;
+                size_t space = 0;
+                uint8_t* dst = d.stream.PrepareWrite(space);
+                if (engine_.QueueRead(d.fd, dst, static_cast<unsigned>(space), i)) d.inFlight = true;
+            }
+            if (open == 0) return SampleStatus::Disconnected;
+
+            const int reaped = engine_.Wait(timeoutMs_, [this](uint64_t tag, int32_t res) {
+                Device& d = *devices_[static_cast<size_t>(tag)];
+                d.inFlight = false;
+                ++stats_.reads;
+                if (res > 0) d.stream.CommitWrite(static_cast<size_t>(res));
+                else if (res != -EAGAIN && res != -EINTR) d.closed = true; // EOF or ENODEV
+            });
+            ++stats_.waits;
+            if (reaped < 0) return SampleStatus::Failed;
+            waited = true;
+        }
+    }
+
+} // namespace joystick
+
+#endif // __linux__
@@ -0,0 +1,189 @@
+﻿/**
+ * @file
+ * @brief io_uring read engine for many evdev devices (Linux only), measured against epoll by `--bench uring`.
+ * @details
+ *   - Uses the raw io_uring syscalls (no liburing dependency); requires Linux 5.11+ for
+ *     IORING_FEAT_EXT_ARG (wait with timeout in a single io_uring_enter). On older kernels or when
+ *     io_uring is disabled, IsValid() is false.
+ *   - The readers stay on EvdevBackend/epoll: UringEvdevBackend has no per-device tags, axis
+ *     profile or hotplug, so only the benchmark drives it.
+ *   - One read is kept pre-posted per device fd. Each wakeup is one io_uring_enter that submits the
+ *     re-posted reads and waits for the next completions, instead of epoll_wait + read() per device.
+ */
+
+#pragma once
+
+#ifdef __linux__
+
+#include "EvdevBackend.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace joystick {
+
+    /**
+     * @brief Syscall and completion counters of UringReadEngine.
+     */
+    struct UringStats {
+        uint64_t enters = 0;       //!< io_uring_enter calls (the only syscall on the hot path).
+        uint64_t submitted = 0;    //!< Read SQEs submitted.
+        uint64_t completions = 0;  //!< CQEs reaped.
+    };
+
+    /**
+     * @brief Minimal io_uring wrapper: queue reads, then submit-and-wait in one syscall.
+     */
+    class UringReadEngine {
+    public:
+        /// @param entries Submission queue size; at least the number of fds with a read in flight.
+        explicit UringReadEngine(unsigned entries);
+        ~UringReadEngine();
+        UringReadEngine(const UringReadEngine&) = delete;
+        UringReadEngine& operator=(const UringReadEngine&) = delete;
+
+        /// false if io_uring is unavailable (old kernel, seccomp, sysctl kernel.io_uring_disabled).
+        bool IsValid() const { return ringFd_ >= 0; }
+
+        /**
+         * @brief Queues a read; it is submitted by the next Wait().
+         * @param fd Blocking fd (a non-blocking fd would complete immediately with -EAGAIN).
+         * @param buf Destination; must stay valid until the completion is reaped.
+         * @param len Byte count.
+         * @param tag Returned with the completion.
+         * @return false if the submission queue is full.
+         */
+        bool QueueRead(int fd, void* buf, unsigned len, uint64_t tag);
+
+        /**
+         * @brief Queues a cancel of the request queued with @p target (IORING_OP_ASYNC_CANCEL).
+         * @details Cancellation is asynchronous: the cancelled read still completes (usually with
+         *          -ECANCELED) and its buffer must stay valid until that completion is reaped.
+         * @return false if the submission queue is full.
+         */
+        bool QueueCancel(uint64_t target, uint64_t tag);
+
+        /**
+         * @brief Submits queued reads and waits for at least one completion or the timeout.
+         * @param timeoutMs Wait limit; 0 only reaps what is already complete.
+         * @param onComplete Called as onComplete(tag, res) for each completion (res = bytes, 0 = EOF, <0 = -errno).
+         * @return Completions reaped; -1 on an engine error.
+         */
+        template <class F>
+        int Wait(int timeoutMs, F&& onComplete) {
+            if (Enter(timeoutMs) < 0) return -1;
+            int reaped = 0;
+            uint64_t tag;
+            int32_t res;
+            while (PopCompletion(tag, res)) {
+                onComplete(tag, res);
+                ++reaped;
+            }
+            stats_.completions += reaped;
+            return reaped;
+        }
+
+        const UringStats& Stats() const { return stats_; }
+
+    private:
+        int Enter(int timeoutMs);
+        bool PopCompletion(uint64_t& tag, int32_t& res);
+
+        /// Zeroed SQE at the tail, or nullptr if the queue is full; Publish() makes it visible.
+        io_uring_sqe* Reserve(unsigned& tail);
+        void Publish(unsigned tail);
+
+        int ringFd_ = -1;
+        void* sqRing_ = nullptr;
+        void* cqRing_ = nullptr;
+        size_t sqRingSize_ = 0;
+        size_t cqRingSize_ = 0;
+        io_uring_sqe* sqes_ = nullptr;
+        size_t sqesSize_ = 0;
+
+        unsigned* sqHead_ = nullptr;
+        unsigned* sqTail_ = nullptr;
+        unsigned* sqArray_ = nullptr;
+        unsigned sqMask_ = 0;
+        unsigned sqEntries_ = 0;
+        unsigned* cqHead_ = nullptr;
+        unsigned* cqTail_ = nullptr;
+        unsigned cqMask_ = 0;
+        io_uring_cqe* cqes_ = nullptr;
+
+        unsigned toSubmit_ = 0;
+        UringStats stats_;
+    };
+
+    /**
+     * @brief Evdev backend over UringReadEngine for one or many devices.
+     * @details Every device keeps one read pre-posted into its EvdevStream buffer; frames are decoded
+     *          by the same EvdevDecoder as the epoll path and handed to the reader one at a time.
+     */
+    class UringEvdevBackend : public InputBackend<UringEvdevBackend> {
+    public:
+        /**
+         * @param maxDevices Ring capacity.
+         * @param timeoutMs Wait limit per Sample() call.
+         */
+        explicit UringEvdevBackend(unsigned maxDevices, int timeoutMs = 100);
+        ~UringEvdevBackend();
+        UringEvdevBackend(const UringEvdevBackend&) = delete;
+        UringEvdevBackend& operator=(const UringEvdevBackend&) = delete;
+
+        bool IsValid() const { return engine_.IsValid(); }
+
+        /**
+         * @brief Registers a device fd (switched to blocking mode for io_uring).
+         * @param fd Event node, pipe or socket carrying input_event records.
+         * @param ownsFd Close @p fd in the destructor.
+         * @return Device slot, or -1 if the ring is full.
+         */
+        int AddDevice(int fd, bool ownsFd);
+
+        /// Returns the next frame from any device; LastDevice() tells which.
+        SampleStatus SampleImpl(InputState& state);
+
+        StateLayout OutputLayout() const { return StateLayout::Joystick; }
+
+        /// Slot of the device whose frame the last Changed sample carried.
+        size_t LastDevice() const { return last_; }
+
+        /// Decoder of a slot, e.g. to call ConfigureFromDevice().
+        EvdevDecoder& Decoder(size_t slot) { return devices_[slot]->stream.Decoder(); }
+
+        const UringStats& EngineStats() const { return engine_.Stats(); }
+        const EvdevStats& Stats() const { return stats_; }
+
+    private:
+        struct Device {
+            int fd = -1;
+            bool ownsFd = false;
+            bool inFlight = false;
+            bool closed = false;
+            EvdevStream stream;
+        };
+
+        /// Completion tag of cancel requests (reads use the device index).
+        static constexpr uint64_t kCancelTag = ~uint64_t(0);
+
+        /// Cancels the reads in flight and reaps them, so none can complete into a freed buffer.
+        void CancelReads();
+
+        std::vector<std::unique_ptr<Device>> devices_;
+        UringReadEngine engine_;
+        int timeoutMs_;
+        size_t maxDevices_;
+        size_t next_ = 0;   //!< Round-robin start for frame extraction (fairness across devices).
+        size_t last_ = 0;
+        EvdevStats stats_;
+    };
+
+} // namespace joystick
+
+#endif // __linux__
@@ -0,0 +1,1842 @@
+﻿/**
+ * @file
+ * @brief XInput/DirectInput enumeration and the XInput, DirectInput and Raw Input backends (Windows only).
+ */
+
+#ifdef _WIN32
+
+#include "WindowsBackends.h"
+
+#include <hidsdi.h>
+
+#include "DeviceIdentity.h"
+#include "Hotplug.h"
+#include "LatencyCompare.h"
+#include "Reactor.h"
+#include "ReaderPool.h"
+#include "StateRing.h"
+#include "XInputProxies.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cwctype>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#pragma comment(lib, "xinput9_1_0.lib")
+#pragma comment(lib, "dinput8.lib")
+#pragma comment(lib, "dxguid.lib")
+#pragma comment(lib, "user32.lib")
+#pragma comment(lib, "ole32.lib")
+#pragma comment(lib, "hid.lib")
+
+namespace joystick {
+
+    HWND g_HiddenWnd = nullptr;
+    HANDLE g_StopEvent = nullptr;
+
+    namespace {
+
+        /**
+         * @brief Window procedure for the hidden helper window used by DirectInput.
+         * @param hwnd Window handle.
+         * @param msg Message.
+         * @param wParam WPARAM.
+         * @param lParam LPARAM.
+         * @return LRESULT from processed message or DefWindowProc.
+         * @remarks Only minimal handling is implemented; the window stays hidden.
+         */
+        LRESULT CALLBACK HiddenWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+            switch (msg) {
+            case WM_CLOSE:
+                DestroyWindow(hwnd);
+                return 0;
+            case WM_DESTROY:
+                return 0;
+            }
+            return DefWindowProc(hwnd, msg, wParam, lParam);
+        }
+
+        /**
+         * @brief Detects if an XInput user index is currently connected.
+         * @param userIdx XInput user index in [0, 3].
+         * @return true if connected; otherwise false.
+         */
+        bool IsXInputConnected(DWORD userIdx) {
+            XINPUT_STATE state = {};
+            DWORD res = XInputGetState(userIdx, &state);
+            return (res == ERROR_SUCCESS);
+        }
+
+        /// true if DirectInput reports the instance attached (cheap; no device is created).
+        bool IsDirectInputAttached(const GUID& guid) {
+            IDirectInput8W* di = SharedDirectInput();
+            return di && di->GetDeviceStatus(guid) == DI_OK;
+        }
+
+        /**
+         * @brief VID/PID of a HID instance.
+         * @return false if guidProduct does not carry them (MAKELONG(VID, PID) followed by "PIDVID" for HID devices).
+         */
+        bool ProductIds(const DIDEVICEINSTANCEW& inst, uint16_t& vendorId, uint16_t& productId) {
+            static const unsigned char kPidVid[6] = { 'P', 'I', 'D', 'V', 'I', 'D' };
+            if (std::memcmp(inst.guidProduct.Data4 + 2, kPidVid, sizeof(kPidVid)) != 0) return false;
+            vendorId = static_cast<uint16_t>(inst.guidProduct.Data1 & 0xFFFF);
+            productId = static_cast<uint16_t>(inst.guidProduct.Data1 >> 16);
+            return true;
+        }
+
+        /// Reads the device interface path of a created device (DIPROP_GUIDANDPATH) into @p prop.
+        bool ReadInterfacePath(IDirectInputDevice8W* device, DIPROPGUIDANDPATH& prop) {
+            prop = {};
+            prop.diph.dwSize = sizeof(prop);
+            prop.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+            prop.diph.dwHow = DIPH_DEVICE;
+            return SUCCEEDED(device->GetProperty(DIPROP_GUIDANDPATH, &prop.diph));
+        }
+
+        /**
+         * @brief true if a DirectInput instance is the proxy of an XInput device (see XInputProxies.h).
+         * @param device The created device, for its interface path; nullptr checks the VID/PID table only.
+         */
+        bool IsXInputProxyInstance(const DIDEVICEINSTANCEW& inst, IDirectInputDevice8W* device) {
+            uint16_t vendorId = 0;
+            uint16_t productId = 0;
+            if (ProductIds(inst, vendorId, productId) && IsKnownXInputProxy(vendorId, productId)) return true;
+            if (!device) return false;
+            DIPROPGUIDANDPATH prop;
+            return ReadInterfacePath(device, prop) && HasXInputInterfaceMarker(prop.wszPath);
+        }
+
+        /**
+         * @brief Fills @p dev from a DirectInput instance; creates the device to read its capabilities.
+         * @param di DirectInput interface (may be nullptr: the device is then listed as event-driven).
+         * @param pdidInstance Device instance provided by DirectInput.
+         * @param dev Receives kind, name, GUID, VID/PID and the read mode.
+         * @return true if the created device is an XInput proxy by its interface path ("IG_").
+         */
+        bool DescribeDirectInput(IDirectInput8W* di, const DIDEVICEINSTANCEW* pdidInstance, DeviceInfo& dev) {
+            dev.kind = DeviceKind::DirectInput;
+            dev.name = WToUtf8(pdidInstance->tszProductName ? pdidInstance->tszProductName : L"DirectInput Device");
+            dev.diGuid = ToDeviceGuid(pdidInstance->guidInstance);
+            // Left 0 when guidProduct does not carry them (not a HID device).
+            dev.vendorId = 0;
+            dev.productId = 0;
+            ProductIds(*pdidInstance, dev.vendorId, dev.productId);
+
+            // Capabilities decide the read mode; a device that cannot be created is listed as event-driven.
+            IDirectInputDevice8W* device = nullptr;
+            bool proxy = false;
+            if (di && SUCCEEDED(di->CreateDevice(pdidInstance->guidInstance, &device, nullptr))) {
+                DIDEVCAPS caps = {};
+                caps.dwSize = sizeof(caps);
+                if (SUCCEEDED(device->GetCapabilities(&caps))) {
+                    dev.polled = (caps.dwFlags & (DIDC_POLLEDDEVICE | DIDC_POLLEDDATAFORMAT)) != 0;
+                }
+                proxy = IsXInputProxyInstance(*pdidInstance, device);
+                device->Release();
+            }
+            return proxy;
+        }
+
+        /**
+         * @brief Callback for DirectInput device enumeration (game controllers only).
+         * @param pdidInstance Device instance provided by DirectInput.
+         * @param pContext Pointer to the std::vector<DIDEVICEINSTANCEW> that collects the instances.
+         * @return DIENUM_CONTINUE to continue enumeration.
+         * @note Instances are copied and visited after the enumeration, in the order DirectInput returned them.
+         */
+        BOOL CALLBACK EnumDIEnumDevicesCallback(const DIDEVICEINSTANCEW* pdidInstance, VOID* pContext) {
+            auto* out = reinterpret_cast<std::vector<DIDEVICEINSTANCEW>*>(pContext);
+            if (out) out->push_back(*pdidInstance);
+            return DIENUM_CONTINUE;
+        }
+
+        /// Context of the XInput proxy enumeration.
+        struct ProxyEnumContext {
+            IDirectInput8W* di = nullptr;
+            std::vector<DeviceInfo>* out = nullptr;
+        };
+
+        /// Keeps the instances IsXInputProxyInstance() matches, by VID/PID or by interface path.
+        BOOL CALLBACK EnumProxiesCallback(const DIDEVICEINSTANCEW* pdidInstance, VOID* pContext) {
+            auto* ctx = reinterpret_cast<ProxyEnumContext*>(pContext);
+            if (!ctx || !ctx->out) return DIENUM_CONTINUE;
+            DeviceInfo dev;
+            // A table hit needs no created device: it is described without one.
+            if (IsXInputProxyInstance(*pdidInstance, nullptr)) {
+                DescribeDirectInput(nullptr, pdidInstance, dev);
+                ctx->out->push_back(std::move(dev));
+            }
+            else if (DescribeDirectInput(ctx->di, pdidInstance, dev)) {
+                ctx->out->push_back(std::move(dev));
+            }
+            return DIENUM_CONTINUE;
+        }
+
+        /// Cached device list of this process.
+        using DeviceRegistry = BasicDeviceRegistry<WindowsDeviceSource>;
+
+        WindowsDeviceSource& PlatformSource() {
+            static WindowsDeviceSource source;
+            return source;
+        }
+
+        DeviceRegistry& PlatformRegistry() {
+            static DeviceRegistry registry(PlatformSource());
+            return registry;
+        }
+
+    } // namespace
+
+    HWND CreateHiddenWindow() {
+        HINSTANCE hInst = GetModuleHandleW(nullptr);
+        const wchar_t* kClassName = L"JoystickInputHiddenWnd";
+
+        WNDCLASSW wc = {};
+        wc.lpfnWndProc = HiddenWndProc;
+        wc.hInstance = hInst;
+        wc.lpszClassName = kClassName;
+        wc.hCursor = LoadCursor(nullptr, IDC_ARROW);
+
+        if (!RegisterClassW(&wc)) {
+            // If already registered, continue
+            if (GetLastError() != ERROR_CLASS_ALREADY_EXISTS) {
+                return nullptr;
+            }
+        }
+
+        HWND hwnd = CreateWindowExW(
+            0, kClassName, L"Hidden", WS_OVERLAPPED,
+            CW_USEDEFAULT, CW_USEDEFAULT, 100, 100,
+            nullptr, nullptr, hInst, nullptr);
+
+        if (hwnd) {
+            ShowWindow(hwnd, SW_HIDE);
+        }
+        return hwnd;
+    }
+
+    std::string WToUtf8(const std::wstring& ws) {
+        if (ws.empty()) return {};
+        int len = WideCharToMultiByte(CP_UTF8, 0, ws.c_str(), (int)ws.size(), nullptr, 0, nullptr, nullptr);
+        std::string out(len, '\0');
+        WideCharToMultiByte(CP_UTF8, 0, ws.c_str(), (int)ws.size(), &out[0], len, nullptr, nullptr);
+        return out;
+    }
+
+    std::wstring Utf8ToW(const std::string& s) {
+        if (s.empty()) return {};
+        int len = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), nullptr, 0);
+        std::wstring out(len, L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), &out[0], len);
+        return out;
+    }
+
+    DeviceGuid ToDeviceGuid(const GUID& guid) {
+        DeviceGuid out;
+        out.data1 = guid.Data1;
+        out.data2 = guid.Data2;
+        out.data3 = guid.Data3;
+        std::memcpy(out.data4, guid.Data4, sizeof(out.data4));
+        return out;
+    }
+
+    GUID ToGuid(const DeviceGuid& guid) {
+        GUID out;
+        out.Data1 = guid.data1;
+        out.Data2 = guid.data2;
+        out.Data3 = guid.data3;
+        std::memcpy(out.Data4, guid.data4, sizeof(out.Data4));
+        return out;
+    }
+
+    void ConvertXInputState(const XINPUT_STATE& s, InputState& out) {
+        const XINPUT_GAMEPAD& g = s.Gamepad;
+        out.packet = s.dwPacketNumber;
+        out.axes[kAxisLeftX] = g.sThumbLX;
+        out.axes[kAxisLeftY] = g.sThumbLY;
+        out.axes[kAxisRightX] = g.sThumbRX;
+        out.axes[kAxisRightY] = g.sThumbRY;
+        out.axes[kAxisLeftTrigger] = g.bLeftTrigger;
+        out.axes[kAxisRightTrigger] = g.bRightTrigger;
+        out.buttons[0] = g.wButtons;
+    }
+
+    void ConvertDIState(const DIJOYSTATE2& js, InputState& out) {
+        out.axes[0] = js.lX;
+        out.axes[1] = js.lY;
+        out.axes[2] = js.lZ;
+        out.axes[3] = js.lRx;
+        out.axes[4] = js.lRy;
+        out.axes[5] = js.lRz;
+        out.axes[6] = js.rglSlider[0];
+        out.axes[7] = js.rglSlider[1];
+        for (int i = 0; i < kMaxPovs; ++i) {
+            out.povs[i] = js.rgdwPOV[i];
+        }
+        out.buttons[0] = 0;
+        out.buttons[1] = 0;
+        for (int i = 0; i < kMaxButtons; ++i) {
+            if (js.rgbButtons[i] & 0x80) {
+                out.buttons[i >> 6] |= uint64_t(1) << (i & 63);
+            }
+        }
+    }
+
+    WindowsDeviceSource::~WindowsDeviceSource() {
+        if (di_) di_->Release();
+    }
+
+    IDirectInput8W* WindowsDeviceSource::DirectInput() {
+        if (!di_ && !diFailed_) {
+            if (FAILED(DirectInput8Create(GetModuleHandleW(nullptr), DIRECTINPUT_VERSION, IID_IDirectInput8W, (void**)&di_, nullptr))) {
+                di_ = nullptr;
+                diFailed_ = true;
+            }
+        }
+        return di_;
+    }
+
+    void WindowsDeviceSource::List(ProbeVisitor visit, void* context) {
+        // XInputGetState on an empty slot is slow, so the four slot probes run on their own threads
+        // while this thread enumerates DirectInput. Visiting waits for both and follows a fixed order.
+        std::vector<DIDEVICEINSTANCEW> instances;
+        const uint32_t connected = ProbeSlotsConcurrently(4, [](uint32_t i) { return IsXInputConnected(i); }, [this, &instances] {
+            if (IDirectInput8W* di = DirectInput()) {
+                di->EnumDevices(DI8DEVCLASS_GAMECTRL, EnumDIEnumDevicesCallback, &instances, DIEDFL_ATTACHEDONLY);
+            }
+        });
+
+        // 1) XInput users 0..3
+        for (DWORD i = 0; i < 4; ++i) {
+            if (connected & (1u << i)) {
+                DeviceProbe probe;
+                probe.kind = DeviceKind::XInput;
+                probe.key = "xinput:" + std::to_string(i);
+                probe.slot = i;
+                visit(context, probe);
+            }
+        }
+
+        // 2) DirectInput devices, in enumeration order
+        for (size_t i = 0; i < instances.size(); ++i) {
+            DeviceProbe probe;
+            probe.kind = DeviceKind::DirectInput;
+            probe.key.assign("di:");
+            probe.key.append(reinterpret_cast<const char*>(&instances[i].guidInstance), sizeof(GUID));
+            probe.slot = static_cast<uint32_t>(i);
+            probe.native = &instances[i];
+            visit(context, probe);
+        }
+    }
+
+    bool WindowsDeviceSource::Describe(const DeviceProbe& probe, DeviceInfo& out) {
+        if (probe.kind == DeviceKind::XInput) {
+            out.kind = DeviceKind::XInput;
+            out.xinputUser = probe.slot;
+            out.name = "XInput Controller " + std::to_string(probe.slot);
+            return true;
+        }
+        const auto* inst = static_cast<const DIDEVICEINSTANCEW*>(probe.native);
+        // Skip XInput proxies; XInput will cover those. Known products are skipped without creating the device.
+        if (IsXInputProxyInstance(*inst, nullptr)) return false;
+        return !DescribeDirectInput(DirectInput(), inst, out);
+    }
+
+    IDirectInput8W* SharedDirectInput() {
+        return PlatformSource().DirectInput();
+    }
+
+    std::vector<DeviceInfo> EnumerateDevices() {
+        return PlatformRegistry().Devices();
+    }
+
+    void NotifyDevicesChanged() {
+        PlatformRegistry().NotifyChanged();
+    }
+
+    bool ProbeDevice(DeviceInfo& device) {
+        if (device.kind == DeviceKind::XInput) {
+            // The slot is the identity: any pad connected there answers for it.
+            if (device.xinputUser > 3 || !IsXInputConnected(device.xinputUser)) return false;
+            device.name = "XInput Controller " + std::to_string(device.xinputUser);
+            return true;
+        }
+        if (device.kind != DeviceKind::DirectInput) return false;
+
+        const GUID guid = ToGuid(device.diGuid);
+        IDirectInput8W* di = SharedDirectInput();
+        IDirectInputDevice8W* created = nullptr;
+        if (!di || !IsDirectInputAttached(guid) || FAILED(di->CreateDevice(guid, &created, nullptr))) return false;
+        DIDEVICEINSTANCEW inst = {};
+        inst.dwSize = sizeof(inst);
+        DIDEVCAPS caps = {};
+        caps.dwSize = sizeof(caps);
+        const bool described = SUCCEEDED(created->GetDeviceInfo(&inst)) && !IsXInputProxyInstance(inst, created);
+        const bool polled = SUCCEEDED(created->GetCapabilities(&caps)) && (caps.dwFlags & (DIDC_POLLEDDEVICE | DIDC_POLLEDDATAFORMAT)) != 0;
+        created->Release();
+        if (!described) return false;
+        // Name and IDs from the instance; the device was already created once for the capabilities.
+        DescribeDirectInput(nullptr, &inst, device);
+        device.polled = polled;
+        return true;
+    }
+
+    std::vector<DeviceInfo> EnumerateXInputProxies() {
+        std::vector<DeviceInfo> proxies;
+        if (IDirectInput8W* di = SharedDirectInput()) {
+            ProxyEnumContext ctx{ di, &proxies };
+            di->EnumDevices(DI8DEVCLASS_GAMECTRL, EnumProxiesCallback, &ctx, DIEDFL_ATTACHEDONLY);
+        }
+        return proxies;
+    }
+
+    namespace {
+
+        AdaptiveRateConfig MakeAdaptiveConfig(const ReaderOptions& options) {
+            AdaptiveRateConfig c;
+            c.activeHz = options.pollHz;
+            c.idleHz = options.idleHz < options.pollHz ? options.idleHz : options.pollHz;
+            c.idleAfterMs = options.idleAfterMs;
+            return c;
+        }
+
+    } // namespace
+
+    XInputBackend::XInputBackend(DWORD userIndex, const ReaderOptions& options)
+        : user_(userIndex), scheduler_(options.pollHz), adaptive_(MakeAdaptiveConfig(options)),
+        adaptiveEnabled_(options.adaptive && !options.phaseLock), phaseLock_(PhaseLockConfig()),
+        phaseLockEnabled_(options.phaseLock) {
+        if (options.axisProfile.enabled) {
+            // Raw XInput ranges: sticks are signed 16-bit, triggers 0..255.
+            for (int axis = kAxisLeftX; axis <= kAxisRightY; ++axis) normalizer_.Configure(axis, -32768, 32767, options.axisProfile.axes[axis]);
+            for (int axis = kAxisLeftTrigger; axis <= kAxisRightTrigger; ++axis) normalizer_.Configure(axis, 0, 255, options.axisProfile.axes[axis]);
+        }
+        SystemTimer& timer = scheduler_.GetTimer();
+        if (options.powerSave) {
+            // A quarter period of slack lets the OS fold poll ticks into other wake-ups.
+            timer.SetSlackNs(scheduler_.PeriodNs() / 4);
+        }
+        else {
+            timer.SetWaitMode(options.waitMode);
+        }
+    }
+
+    double XInputBackend::ElapsedSeconds() const {
+        return first_ ? 0.0 : (double)(scheduler_.GetTimer().NowNs() - startNs_) / 1e9;
+    }
+
+    SampleStatus XInputBackend::SampleImpl(InputState& state) {
+        // XInput is inherently polled; the scheduler paces polls at the configured rate, or the
+        // phase lock places each poll just after the pad's expected report.
+        // Using packet number ensures we report only state changes.
+        SystemTimer& timer = scheduler_.GetTimer();
+        if (phaseLockEnabled_) {
+            if (!first_) timer.SleepUntilNs(phaseLock_.NextPollNs(timer.NowNs()));
+        }
+        else {
+            scheduler_.WaitNext();
+        }
+        if (first_) startNs_ = timer.NowNs();
+
+        const bool wasFirst = first_;
+        const SampleStatus status = PollImpl(state);
+        if (status == SampleStatus::Disconnected) return status;
+
+        const bool changed = status == SampleStatus::Changed && !wasFirst;
+        if (phaseLockEnabled_) {
+            phaseLock_.OnPoll(timer.NowNs(), changed);
+        }
+        else if (adaptiveEnabled_) {
+            const uint32_t hz = adaptive_.OnPoll(changed, timer.NowNs());
+            if (hz != scheduler_.RateHz()) scheduler_.SetRate(hz);
+        }
+        return status;
+    }
+
+    SampleStatus XInputBackend::PollImpl(InputState& state) {
+        XINPUT_STATE st = {};
+        DWORD res = XInputGetState(user_, &st);
+        if (res != ERROR_SUCCESS) {
+            return SampleStatus::Disconnected;
+        }
+        if (!first_ && st.dwPacketNumber == lastPacket_) {
+            return SampleStatus::Unchanged;
+        }
+        first_ = false;
+        lastPacket_ = st.dwPacketNumber;
+        ConvertXInputState(st, state);
+        if (normalizer_.Active()) normalizer_.Apply(state);
+        return SampleStatus::Changed;
+    }
+
+    DirectInputBackend::~DirectInputBackend() {
+        Close();
+    }
+
+    void DirectInputBackend::Close() {
+        if (dev_) {
+            if (acquired_) dev_->Unacquire();
+            dev_->SetEventNotification(nullptr);
+            dev_->Release();
+            dev_ = nullptr;
+        }
+        if (event_) {
+            CloseHandle(event_);
+            event_ = nullptr;
+        }
+        if (di_) {
+            di_->Release();
+            di_ = nullptr;
+        }
+        acquired_ = false;
+        // A reopened device starts from a fresh GetDeviceState.
+        synced_ = false;
+        polled_ = false;
+        queue_.Clear();
+    }
+
+    int DirectInputBackend::Open(const GUID& guidInstance) {
+        Close(); // reopening after an unplug
+        guid_ = guidInstance;
+        di_ = SharedDirectInput();
+        if (!di_) {
+            std::cerr << "DirectInput8Create failed.\n";
+            return 2;
+        }
+        di_->AddRef();
+
+        if (FAILED(di_->CreateDevice(guidInstance, &dev_, nullptr))) {
+            std::cerr << "CreateDevice failed.\n";
+            dev_ = nullptr;
+            Close();
+            return 3;
+        }
+
+        if (!g_HiddenWnd) {
+            g_HiddenWnd = CreateHiddenWindow();
+            if (!g_HiddenWnd) {
+                std::cerr << "Failed to create hidden window for DirectInput.\n";
+                Close();
+                return 4;
+            }
+        }
+
+        if (!SetCompactFormat() && FAILED(dev_->SetDataFormat(&c_dfDIJoystick2))) {
+            std::cerr << "SetDataFormat failed.\n";
+            Close();
+            return 5;
+        }
+
+        if (FAILED(dev_->SetCooperativeLevel(g_HiddenWnd, DISCL_NONEXCLUSIVE | DISCL_BACKGROUND))) {
+            std::cerr << "SetCooperativeLevel failed.\n";
+            Close();
+            return 6;
+        }
+
+        ApplyAxisProfile();
+
+        // Polled devices fill neither the buffer nor the event; they are read on a schedule.
+        DIDEVCAPS devCaps = {};
+        devCaps.dwSize = sizeof(devCaps);
+        polledDevice_ = SUCCEEDED(dev_->GetCapabilities(&devCaps)) &&
+            (devCaps.dwFlags & (DIDC_POLLEDDEVICE | DIDC_POLLEDDATAFORMAT)) != 0;
+        if (polledDevice_) {
+            SystemTimer& timer = scheduler_.GetTimer();
+            if (powerSave_) timer.SetSlackNs(scheduler_.PeriodNs() / 4);
+            else timer.SetWaitMode(waitMode_);
+        }
+        else {
+            // Enable buffered data so we can get event notifications
+            SetBufferSize(tuner_.Size());
+        }
+
+        event_ = CreateEventW(nullptr, FALSE, FALSE, nullptr); // auto-reset
+        if (!event_) {
+            std::cerr << "CreateEvent failed.\n";
+            Close();
+            return 7;
+        }
+
+        if (FAILED(dev_->SetEventNotification(event_))) {
+            std::cerr << "SetEventNotification failed.\n";
+            Close();
+            return 8;
+        }
+
+        HRESULT hr = dev_->Acquire();
+        if (FAILED(hr)) {
+            std::cerr << "Acquire failed.\n";
+            Close();
+            return 9;
+        }
+        acquired_ = true;
+        return 0;
+    }
+
+    DWORD DirectInputBackend::WaitEvent() {
+        if (powerSave_) {
+            HANDLE handles[2] = { event_, g_StopEvent };
+            const DWORD timeout = waitLimitMs_ < 0 ? INFINITE : static_cast<DWORD>(waitLimitMs_);
+            waitLimitMs_ = -1;
+            const DWORD w = WaitForMultipleObjects(g_StopEvent ? 2 : 1, handles, FALSE, timeout);
+            CountWakeup();
+            if (w == WAIT_OBJECT_0) ++waitStats_.blockedWakes;
+            // Stop request: report a timeout so the reader re-checks its run flag.
+            return w == WAIT_OBJECT_0 + 1 ? WAIT_TIMEOUT : w;
+        }
+
+        DWORD wait = WAIT_TIMEOUT;
+        bool done = false;
+        if (waitMode_ == WaitMode::Hybrid && waitStats_.periodNs > 0) {
+            SpinCalibrator& cal = timer_.Calibrator();
+            const uint64_t window = cal.WindowNs();
+            const uint64_t expected = lastEventNs_ + static_cast<uint64_t>(waitStats_.periodNs);
+            const uint64_t now = timer_.NowNs();
+            if (now + window < expected) {
+                const uint64_t target = expected - window;
+                if (timer_.WaitEventUntilNs(event_, target)) {
+                    ++waitStats_.blockedWakes;
+                    wait = WAIT_OBJECT_0;
+                    done = true;
+                }
+                else {
+                    const uint64_t woke = timer_.NowNs();
+                    cal.OnOvershoot(woke > target ? woke - target : 0);
+                }
+            }
+            if (!done) {
+                const uint64_t spinStart = timer_.NowNs();
+                uint64_t t = spinStart;
+                while (t < expected + window) {
+                    if (WaitForSingleObject(event_, 0) == WAIT_OBJECT_0) {
+                        ++waitStats_.spinCatches;
+                        wait = WAIT_OBJECT_0;
+                        done = true;
+                        break;
+                    }
+                    CpuRelax();
+                    t = timer_.NowNs();
+                }
+                waitStats_.spinNs += timer_.NowNs() - spinStart;
+            }
+        }
+        if (!done) {
+            wait = WaitForSingleObject(event_, 100);
+            CountWakeup();
+            if (wait == WAIT_OBJECT_0) ++waitStats_.blockedWakes;
+            else if (wait == WAIT_TIMEOUT) ++waitStats_.timeouts;
+        }
+        if (wait == WAIT_OBJECT_0) {
+            // Track the interval while the device streams; gaps over 50 ms are idle time, not cadence.
+            const uint64_t now = timer_.NowNs();
+            if (lastEventNs_ != 0 && now - lastEventNs_ < 50000000ull) {
+                const double dt = static_cast<double>(now - lastEventNs_);
+                waitStats_.periodNs = waitStats_.periodNs > 0 ? waitStats_.periodNs + (dt - waitStats_.periodNs) / 8.0 : dt;
+            }
+            else if (lastEventNs_ != 0) {
+                waitStats_.periodNs = 0; // re-learn after idle
+            }
+            lastEventNs_ = now;
+        }
+        return wait;
+    }
+
+    SampleStatus DirectInputBackend::Reacquire() {
+        if (SUCCEEDED(dev_->Acquire())) return SampleStatus::Unchanged;
+        // Acquire() keeps failing while the device is unplugged; only then ask whether it is still attached.
+        return di_->GetDeviceStatus(guid_) == DI_OK ? SampleStatus::Unchanged : SampleStatus::Disconnected;
+    }
+
+    SampleStatus DirectInputBackend::PollDevice(InputState& state) {
+        HRESULT hr = dev_->Poll();
+        ++recordStats_.deviceCalls;
+        if (SUCCEEDED(hr)) {
+            InputState read = current_;
+            hr = ReadState(read);
+            if (SUCCEEDED(hr)) {
+                if (polled_ && DiffStates(current_, read, Caps()) == kChangedNone) return SampleStatus::Unchanged;
+                polled_ = true;
+                ++recordStats_.snapshots;
+                current_ = read;
+                current_.packet = ++packet_;
+                Emit(state);
+                return SampleStatus::Changed;
+            }
+        }
+        if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED) {
+            return Reacquire();
+        }
+        return SampleStatus::Disconnected;
+    }
+
+    SampleStatus DirectInputBackend::SampleImpl(InputState& state) {
+        if (polledDevice_) {
+            scheduler_.WaitNext();
+            return PollDevice(state);
+        }
+        if (eventSourced_) {
+            // Records left from the last read come first; wait only when none are pending.
+            if (synced_ && !queue_.Empty()) return NextRecord(state, false);
+            if (synced_) {
+                const DWORD wait = WaitEvent();
+                if (wait != WAIT_OBJECT_0 && wait != WAIT_TIMEOUT) {
+                    std::cerr << "WaitForSingleObject failed.\n";
+                    return SampleStatus::Failed;
+                }
+                // A timeout reads the buffer too: it doubles as the disconnect check.
+            }
+            return NextRecord(state, true);
+        }
+
+        HRESULT hr;
+        DWORD wait = WaitEvent();
+        if (wait == WAIT_OBJECT_0) {
+            // Snapshot mode: discard the buffered records and read the full state.
+            DWORD items = 0;
+            const SampleStatus drained = Drain(items);
+            if (drained != SampleStatus::Unchanged) return drained;
+
+            hr = ReadState(state);
+            if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED) {
+                return Reacquire();
+            }
+            if (SUCCEEDED(hr)) {
+                ++recordStats_.snapshots;
+                if (normalizer_.Active()) normalizer_.Apply(state);
+                state.packet = ++packet_;
+                return SampleStatus::Changed;
+            }
+            return SampleStatus::Unchanged;
+        }
+        else if (wait == WAIT_TIMEOUT) {
+            // Periodic check to handle disconnections
+            InputState probe;
+            hr = ReadState(probe);
+            if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED) {
+                return Reacquire();
+            }
+            if (FAILED(hr)) {
+                return SampleStatus::Disconnected;
+            }
+            return SampleStatus::Unchanged;
+        }
+
+        // WAIT_FAILED
+        std::cerr << "WaitForSingleObject failed.\n";
+        return SampleStatus::Failed;
+    }
+
+    namespace {
+
+        /// EnumObjects callback: adds each axis, POV and button to the DiCompactFormat in @p ctx.
+        BOOL CALLBACK AddFormatObject(LPCDIDEVICEOBJECTINSTANCEW obj, LPVOID ctx) {
+            DiCompactFormat& format = *static_cast<DiCompactFormat*>(ctx);
+            const DWORD type = obj->dwType;
+            if (type & DIDFT_AXIS) {
+                static const GUID* const kAxes[] = { &GUID_XAxis, &GUID_YAxis, &GUID_ZAxis, &GUID_RxAxis, &GUID_RyAxis, &GUID_RzAxis };
+                for (uint8_t i = 0; i < 6; ++i) {
+                    if (obj->guidType == *kAxes[i]) {
+                        format.AddAxis(i, type);
+                        return DIENUM_CONTINUE;
+                    }
+                }
+                // Sliders take S0 then S1; other axis kinds have no InputState slot.
+                if (obj->guidType == GUID_Slider && !format.AddAxis(6, type)) format.AddAxis(7, type);
+            }
+            else if (type & DIDFT_POV) {
+                format.AddPov(type);
+            }
+            else if (type & DIDFT_BUTTON) {
+                format.AddButton(type);
+            }
+            return DIENUM_CONTINUE;
+        }
+
+    } // namespace
+
+    bool DirectInputBackend::SetCompactFormat() {
+        compact_ = DiCompactFormat();
+        if (FAILED(dev_->EnumObjects(AddFormatObject, &compact_, DIDFT_AXIS | DIDFT_POV | DIDFT_BUTTON))) return false;
+        compact_.Finish();
+        if (compact_.Empty()) return false;
+
+        std::vector<DIOBJECTDATAFORMAT> objects;
+        for (const DiFormatObject& o : compact_.Objects()) {
+            DIOBJECTDATAFORMAT odf = {};
+            odf.pguid = nullptr; // matched by type class and instance number instead
+            odf.dwOfs = o.ofs;
+            odf.dwType = (o.type & (DIDFT_AXIS | DIDFT_POV | DIDFT_BUTTON)) | DIDFT_MAKEINSTANCE(DIDFT_GETINSTANCE(o.type));
+            objects.push_back(odf);
+        }
+        DIDATAFORMAT format = {};
+        format.dwSize = sizeof(DIDATAFORMAT);
+        format.dwObjSize = sizeof(DIOBJECTDATAFORMAT);
+        format.dwFlags = DIDF_ABSAXIS;
+        format.dwDataSize = compact_.DataSize();
+        format.dwNumObjs = static_cast<DWORD>(objects.size());
+        format.rgodf = objects.data();
+        // DirectInput copies the format, so the local arrays may go.
+        if (FAILED(dev_->SetDataFormat(&format))) {
+            compact_ = DiCompactFormat();
+            return false;
+        }
+        stateBlock_.assign(compact_.DataSize(), 0);
+        objects_ = compact_.Map();
+        return true;
+    }
+
+    namespace {
+
+        /// SetProperty for a DIPROPDWORD of the axis at data-format offset @p ofs.
+        HRESULT SetAxisDword(IDirectInputDevice8W* dev, REFGUID prop, DWORD ofs, DWORD value) {
+            DIPROPDWORD p = {};
+            p.diph.dwSize = sizeof(DIPROPDWORD);
+            p.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+            p.diph.dwObj = ofs;
+            p.diph.dwHow = DIPH_BYOFFSET;
+            p.dwData = value;
+            return dev->SetProperty(prop, &p.diph);
+        }
+
+    } // namespace
+
+    void DirectInputBackend::ApplyAxisProfile() {
+        normalizer_ = AxisNormalizer();
+        driverAxes_ = 0;
+        if (!profile_.enabled) return;
+        const StateCaps caps = Caps();
+        for (int axis = 0; axis < kMaxAxes; ++axis) {
+            if (!((caps.axisMask >> axis) & 1u)) continue;
+            // DIJOYSTATE2 keeps lX..lRz and both sliders in consecutive LONGs, as InputState does.
+            DWORD ofs = static_cast<DWORD>(axis) * 4;
+            for (const DiFormatObject& o : compact_.Objects()) {
+                if (o.kind == DiObjectKind::Axis && o.index == axis) ofs = o.ofs;
+            }
+            const AxisConfig& c = profile_.axes[axis];
+            DIPROPRANGE range = {};
+            range.diph.dwSize = sizeof(DIPROPRANGE);
+            range.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+            range.diph.dwObj = ofs;
+            range.diph.dwHow = DIPH_BYOFFSET;
+            range.lMin = c.min;
+            range.lMax = c.max;
+            if (SUCCEEDED(dev_->SetProperty(DIPROP_RANGE, &range.diph)) &&
+                SUCCEEDED(SetAxisDword(dev_, DIPROP_DEADZONE, ofs, c.deadzone)) &&
+                SUCCEEDED(SetAxisDword(dev_, DIPROP_SATURATION, ofs, c.saturation))) {
+                ++driverAxes_;
+                continue;
+            }
+            // The axis exists but (part of) the profile was rejected: undo the driver dead zone and
+            // saturation, and scale from whatever range the driver reports instead.
+            if (FAILED(dev_->GetProperty(DIPROP_RANGE, &range.diph))) continue; // no such axis (DIJOYSTATE2)
+            SetAxisDword(dev_, DIPROP_DEADZONE, ofs, 0);
+            SetAxisDword(dev_, DIPROP_SATURATION, ofs, 10000);
+            normalizer_.Configure(axis, range.lMin, range.lMax, c);
+        }
+    }
+
+    HRESULT DirectInputBackend::ReadState(InputState& out) {
+        HRESULT hr;
+        if (compact_.Empty()) {
+            DIJOYSTATE2 js = {};
+            hr = dev_->GetDeviceState(sizeof(DIJOYSTATE2), &js);
+            if (SUCCEEDED(hr)) ConvertDIState(js, out);
+        }
+        else {
+            hr = dev_->GetDeviceState(compact_.DataSize(), stateBlock_.data());
+            if (SUCCEEDED(hr)) compact_.Convert(stateBlock_.data(), out);
+        }
+        ++recordStats_.deviceCalls;
+        return hr;
+    }
+
+    void DirectInputBackend::SetBufferSize(DWORD records) {
+        if (acquired_) dev_->Unacquire();
+        DIPROPDWORD dipdw;
+        dipdw.diph.dwSize = sizeof(DIPROPDWORD);
+        dipdw.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+        dipdw.diph.dwObj = 0;
+        dipdw.diph.dwHow = DIPH_DEVICE;
+        dipdw.dwData = records;
+        dev_->SetProperty(DIPROP_BUFFERSIZE, &dipdw.diph);
+        // Read back: drivers may clamp the request.
+        if (FAILED(dev_->GetProperty(DIPROP_BUFFERSIZE, &dipdw.diph))) dipdw.dwData = records;
+        tuner_.Applied(dipdw.dwData);
+        recordStats_.bufferSize = dipdw.dwData;
+        recordStats_.autoBuffer = tuner_.Config().autoTune;
+        if (acquired_) {
+            dev_->Acquire();
+            ++recordStats_.resizes;
+            synced_ = false;
+        }
+    }
+
+    SampleStatus DirectInputBackend::Drain(DWORD& total) {
+        DIDEVICEOBJECTDATA data[64];
+        total = 0;
+        bool reacquired = false;
+        while (true) {
+            DWORD dwItems = 64;
+            HRESULT hr = dev_->GetDeviceData(sizeof(DIDEVICEOBJECTDATA), data, &dwItems, 0);
+            ++recordStats_.deviceCalls;
+            if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED) {
+                if (reacquired) break; // still not acquired: the state read that follows reports it
+                const SampleStatus status = Reacquire();
+                if (status != SampleStatus::Unchanged) {
+                    recordStats_.events += total;
+                    return status;
+                }
+                reacquired = true;
+                continue;
+            }
+            if (FAILED(hr) || dwItems == 0) break;
+            // Snapshot mode reads the full state next, so an overflow loses nothing; it is only counted.
+            if (hr == DI_BUFFEROVERFLOW) ++recordStats_.overflows;
+            // We don't report per-event; we report the full current state below.
+            total += dwItems;
+        }
+        recordStats_.events += total;
+        return SampleStatus::Unchanged;
+    }
+
+    HRESULT DirectInputBackend::ReadEvents() {
+        DIDEVICEOBJECTDATA data[64];
+        DiEvent events[64];
+        DWORD total = 0;
+        bool overflow = false;
+        for (;;) {
+            DWORD items = 64;
+            const HRESULT hr = dev_->GetDeviceData(sizeof(DIDEVICEOBJECTDATA), data, &items, 0);
+            ++recordStats_.deviceCalls;
+            if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED) {
+                // Records were lost while unacquired; the next step resyncs from a snapshot.
+                dev_->Acquire();
+                synced_ = false;
+                return S_FALSE;
+            }
+            if (FAILED(hr)) return hr;
+            if (hr == DI_BUFFEROVERFLOW) overflow = true;
+            for (DWORD i = 0; i < items; ++i) {
+                events[i].ofs = data[i].dwOfs;
+                events[i].data = data[i].dwData;
+                events[i].timeMs = data[i].dwTimeStamp;
+                events[i].sequence = data[i].dwSequence;
+            }
+            queue_.Append(events, items);
+            recordStats_.events += items;
+            total += items;
+            if (items < 64) break; // buffer emptied
+        }
+
+        if (overflow) {
+            // The driver dropped records, so the queue no longer adds up to the device state.
+            ++recordStats_.overflows;
+            synced_ = false;
+        }
+        if (tuner_.OnRead(total, overflow, timer_.NowNs())) SetBufferSize(tuner_.Wanted());
+        return synced_ ? S_OK : S_FALSE;
+    }
+
+    HRESULT DirectInputBackend::Resync() {
+        // Flush before the snapshot: older records would roll the state back. Records that arrive
+        // between the flush and the snapshot are applied again afterwards, which is harmless because
+        // their values are absolute.
+        DWORD flush = INFINITE;
+        dev_->GetDeviceData(sizeof(DIDEVICEOBJECTDATA), nullptr, &flush, 0);
+        ++recordStats_.deviceCalls;
+        queue_.Clear();
+        const HRESULT hr = ReadState(current_);
+        if (SUCCEEDED(hr)) {
+            current_.timeMs = 0;
+            synced_ = true;
+            ++recordStats_.snapshots;
+        }
+        return hr;
+    }
+
+    SampleStatus DirectInputBackend::NextRecord(InputState& state, bool read) {
+        if (!synced_) {
+            const HRESULT hr = Resync();
+            if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED) {
+                return Reacquire();
+            }
+            if (FAILED(hr)) return SampleStatus::Disconnected;
+            Emit(state);
+            return SampleStatus::Changed;
+        }
+        if (read && queue_.Empty()) {
+            if (FAILED(ReadEvents())) return SampleStatus::Disconnected;
+            if (!synced_) return NextRecord(state, false); // overflow or lost input: resync now
+        }
+        if (!queue_.ApplyNextGroup(objects_, current_, &recordStats_)) return SampleStatus::Unchanged;
+        Emit(state);
+        return SampleStatus::Changed;
+    }
+
+    SampleStatus DirectInputBackend::PollImpl(InputState& state) {
+        if (polledDevice_) return PollDevice(state);
+        if (eventSourced_) return NextRecord(state, true);
+
+        DWORD items = 0;
+        const SampleStatus drained = Drain(items);
+        if (drained != SampleStatus::Unchanged) return drained;
+        InputState read = state;
+        const HRESULT hr = ReadState(read);
+        if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED) {
+            return Reacquire();
+        }
+        if (FAILED(hr)) {
+            return SampleStatus::Disconnected;
+        }
+        if (items == 0 && polled_) {
+            return SampleStatus::Unchanged;
+        }
+        polled_ = true;
+        ++recordStats_.snapshots;
+        state = read;
+        if (normalizer_.Active()) normalizer_.Apply(state);
+        state.packet = ++packet_;
+        return SampleStatus::Changed;
+    }
+
+    namespace {
+
+        constexpr USAGE kHidPageGenericDesktop = 0x01;
+        constexpr USAGE kHidPageButton = 0x09;
+
+        /// Generic Desktop usages registered for Raw Input: Joystick, Game Pad, Multi-axis Controller.
+        constexpr USHORT kRawInputUsages[] = { 0x04, 0x05, 0x08 };
+
+        bool IsGameControllerUsage(USHORT page, USHORT usage) {
+            if (page != kHidPageGenericDesktop) return false;
+            for (USHORT u : kRawInputUsages) {
+                if (u == usage) return true;
+            }
+            return false;
+        }
+
+    } // namespace
+
+    /**
+     * @brief Decoder for devices without a fixed layout: HidP_* calls on the Raw Input preparsed data.
+     * @details The value and button caps are read once and mapped to slots with MapHidValue(); per
+     *          report only HidP_GetUsageValue and HidP_GetUsages run.
+     */
+    struct HidPDecoder {
+        struct Value {
+            HidOp op;           //!< Slot, logical range and scaling; the bit position is HidP's business.
+            UCHAR reportId;
+            USHORT link;        //!< Link collection passed to HidP_GetUsageValue.
+        };
+
+        struct Buttons {
+            UCHAR reportId;
+            USHORT link;
+            USAGE first;        //!< Button usages first..last (button = usage - 1).
+            USAGE last;
+        };
+
+        std::vector<uint8_t> preparsed;
+        std::vector<Value> values;
+        std::vector<Buttons> buttons;
+        std::vector<USAGE> usages;      //!< HidP_GetUsages scratch.
+
+        PHIDP_PREPARSED_DATA Data() { return reinterpret_cast<PHIDP_PREPARSED_DATA>(preparsed.data()); }
+
+        /// Reads the input caps; false if no field maps to a slot.
+        bool Build();
+
+        /// RawHidDecoder::DecodeFn over a HidPDecoder context.
+        static bool Decode(void* context, const uint8_t* report, size_t len, InputState& state);
+    };
+
+    bool HidPDecoder::Build() {
+        HIDP_CAPS caps = {};
+        if (HidP_GetCaps(Data(), &caps) != HIDP_STATUS_SUCCESS) return false;
+
+        HidSlotAllocator slots;
+        USHORT count = caps.NumberInputValueCaps;
+        std::vector<HIDP_VALUE_CAPS> valueCaps(count);
+        if (count && HidP_GetValueCaps(HidP_Input, valueCaps.data(), &count, Data()) == HIDP_STATUS_SUCCESS) {
+            for (USHORT i = 0; i < count; ++i) {
+                const HIDP_VALUE_CAPS& c = valueCaps[i];
+                if (!c.IsRange && c.ReportCount > 1) continue; // value arrays need HidP_GetUsageValueArray
+                if (c.BitSize == 0 || c.BitSize > 32) continue;
+                int32_t logicalMax = c.LogicalMax;
+                // Same descriptor bug the compiler fixes: an unsigned maximum encoded with its top bit set.
+                if (c.LogicalMin >= 0 && logicalMax < 0) {
+                    logicalMax = c.BitSize >= 32 ? INT32_MAX : static_cast<int32_t>((uint64_t(1) << c.BitSize) - 1);
+                }
+                const USAGE first = c.IsRange ? c.Range.UsageMin : c.NotRange.Usage;
+                const USAGE last = c.IsRange ? c.Range.UsageMax : c.NotRange.Usage;
+                for (uint32_t u = first; u <= last; ++u) {
+                    Value v;
+                    v.op.bitSize = static_cast<uint8_t>(c.BitSize);
+                    v.op.isSigned = c.LogicalMin < 0;
+                    if (!MapHidValue(slots, c.UsagePage, static_cast<uint16_t>(u), c.LogicalMin, logicalMax, v.op)) continue;
+                    v.reportId = c.ReportID;
+                    v.link = c.LinkCollection;
+                    values.push_back(v);
+                }
+            }
+        }
+
+        count = caps.NumberInputButtonCaps;
+        std::vector<HIDP_BUTTON_CAPS> buttonCaps(count);
+        if (count && HidP_GetButtonCaps(HidP_Input, buttonCaps.data(), &count, Data()) == HIDP_STATUS_SUCCESS) {
+            for (USHORT i = 0; i < count; ++i) {
+                const HIDP_BUTTON_CAPS& c = buttonCaps[i];
+                if (c.UsagePage != kHidPageButton) continue;
+                const USAGE first = c.IsRange ? c.Range.UsageMin : c.NotRange.Usage;
+                USAGE last = c.IsRange ? c.Range.UsageMax : c.NotRange.Usage;
+                if (first == 0 || first > kMaxButtons || last < first) continue;
+                if (last > kMaxButtons) last = kMaxButtons;
+                // One HidP_GetUsages call per report and link collection covers all of its ranges.
+                auto it = std::find_if(buttons.begin(), buttons.end(), [&c](const Buttons& b) {
+                    return b.reportId == c.ReportID && b.link == c.LinkCollection;
+                });
+                if (it == buttons.end()) {
+                    buttons.push_back(Buttons{ c.ReportID, c.LinkCollection, first, last });
+                }
+                else {
+                    it->first = std::min(it->first, first);
+                    it->last = std::max(it->last, last);
+                }
+            }
+        }
+        usages.resize(std::max<ULONG>(1, HidP_MaxUsageListLength(HidP_Input, kHidPageButton, Data())));
+        return !values.empty() || !buttons.empty();
+    }
+
+    bool HidPDecoder::Decode(void* context, const uint8_t* report, size_t len, InputState& state) {
+        HidPDecoder& self = *static_cast<HidPDecoder*>(context);
+        if (len == 0) return false;
+        // HidP takes a non-const report pointer but does not write through it.
+        PCHAR data = reinterpret_cast<PCHAR>(const_cast<uint8_t*>(report));
+        const ULONG length = static_cast<ULONG>(len);
+        bool decoded = false;
+        for (const Value& v : self.values) {
+            if (v.reportId != 0 && report[0] != v.reportId) continue;
+            ULONG raw = 0;
+            if (HidP_GetUsageValue(HidP_Input, v.op.usagePage, v.link, v.op.usage, &raw, self.Data(), data, length) != HIDP_STATUS_SUCCESS) {
+                continue;
+            }
+            int32_t value = static_cast<int32_t>(raw);
+            if (v.op.isSigned && v.op.bitSize < 32) {
+                const uint32_t sign = 1u << (v.op.bitSize - 1);
+                value = static_cast<int32_t>((raw ^ sign) - sign);
+            }
+            ApplyHidValue(v.op, value, state);
+            decoded = true;
+        }
+        for (const Buttons& b : self.buttons) {
+            if (b.reportId != 0 && report[0] != b.reportId) continue;
+            ULONG n = static_cast<ULONG>(self.usages.size());
+            if (HidP_GetUsages(HidP_Input, kHidPageButton, b.link, self.usages.data(), &n, self.Data(), data, length) != HIDP_STATUS_SUCCESS) {
+                continue;
+            }
+            for (uint32_t u = b.first; u <= b.last; ++u) SetButton(state, static_cast<int>(u - 1), false);
+            for (ULONG i = 0; i < n; ++i) {
+                const USAGE u = self.usages[i];
+                if (u >= b.first && u <= b.last) SetButton(state, u - 1, true);
+            }
+            decoded = true;
+        }
+        return decoded;
+    }
+
+    RawInputBackend::RawInputBackend() : layout_(RawInputLayout::Native()) {
+        BOOL wow64 = FALSE;
+        if (IsWow64Process(GetCurrentProcess(), &wow64) && wow64) layout_ = RawInputLayout::Wow64();
+    }
+
+    RawInputBackend::~RawInputBackend() {
+        if (!registered_) return;
+        RAWINPUTDEVICE rid[sizeof(kRawInputUsages) / sizeof(kRawInputUsages[0])] = {};
+        for (size_t i = 0; i < sizeof(kRawInputUsages) / sizeof(kRawInputUsages[0]); ++i) {
+            rid[i].usUsagePage = kHidPageGenericDesktop;
+            rid[i].usUsage = kRawInputUsages[i];
+            rid[i].dwFlags = RIDEV_REMOVE;
+            rid[i].hwndTarget = nullptr;
+        }
+        RegisterRawInputDevices(rid, static_cast<UINT>(sizeof(rid) / sizeof(rid[0])), sizeof(RAWINPUTDEVICE));
+    }
+
+    int RawInputBackend::Open(uint16_t vendorId, uint16_t productId, HWND window) {
+        if (!window) {
+            std::cerr << "Raw Input needs a window on the reading thread.\n";
+            return 1;
+        }
+
+        UINT count = 0;
+        if (GetRawInputDeviceList(nullptr, &count, sizeof(RAWINPUTDEVICELIST)) != 0 || count == 0) {
+            std::cerr << "GetRawInputDeviceList failed.\n";
+            return 2;
+        }
+        std::vector<RAWINPUTDEVICELIST> list(count);
+        count = GetRawInputDeviceList(list.data(), &count, sizeof(RAWINPUTDEVICELIST));
+        if (count == static_cast<UINT>(-1)) {
+            std::cerr << "GetRawInputDeviceList failed.\n";
+            return 2;
+        }
+        // Several identical controllers share VID/PID; the first one listed is taken.
+        for (UINT i = 0; i < count && !device_; ++i) {
+            if (list[i].dwType != RIM_TYPEHID) continue;
+            RID_DEVICE_INFO info = {};
+            info.cbSize = sizeof(info);
+            UINT size = sizeof(info);
+            if (GetRawInputDeviceInfoW(list[i].hDevice, RIDI_DEVICEINFO, &info, &size) == static_cast<UINT>(-1)) continue;
+            if (info.hid.dwVendorId == vendorId && info.hid.dwProductId == productId &&
+                IsGameControllerUsage(info.hid.usUsagePage, info.hid.usUsage)) {
+                device_ = list[i].hDevice;
+            }
+        }
+        if (!device_) {
+            std::cerr << "No Raw Input game controller with this vendor/product ID.\n";
+            return 3;
+        }
+
+        if (!decoder_.UseKnown(vendorId, productId)) {
+            hidp_.reset(new HidPDecoder());
+            UINT size = 0;
+            GetRawInputDeviceInfoW(device_, RIDI_PREPARSEDDATA, nullptr, &size);
+            hidp_->preparsed.resize(size);
+            if (size == 0 || GetRawInputDeviceInfoW(device_, RIDI_PREPARSEDDATA, hidp_->preparsed.data(), &size) == static_cast<UINT>(-1) ||
+                !hidp_->Build()) {
+                std::cerr << "The device reports no usable input fields.\n";
+                return 4;
+            }
+            decoder_.UseFunction(&HidPDecoder::Decode, hidp_.get(), StateLayout::Joystick, "HidP preparsed data");
+        }
+
+        // RIDEV_INPUTSINK: reports keep coming while the console, not the hidden window, has focus.
+        RAWINPUTDEVICE rid[sizeof(kRawInputUsages) / sizeof(kRawInputUsages[0])] = {};
+        for (size_t i = 0; i < sizeof(kRawInputUsages) / sizeof(kRawInputUsages[0]); ++i) {
+            rid[i].usUsagePage = kHidPageGenericDesktop;
+            rid[i].usUsage = kRawInputUsages[i];
+            rid[i].dwFlags = RIDEV_INPUTSINK;
+            rid[i].hwndTarget = window;
+        }
+        if (!RegisterRawInputDevices(rid, static_cast<UINT>(sizeof(rid) / sizeof(rid[0])), sizeof(RAWINPUTDEVICE))) {
+            std::cerr << "RegisterRawInputDevices failed.\n";
+            return 5;
+        }
+        registered_ = true;
+        window_ = window;
+        block_.assign(8192, 0); // 64 KiB: a few hundred gamepad reports per call
+        return 0;
+    }
+
+    bool RawInputBackend::ReadBuffer() {
+        queue_.Clear();
+        for (;;) {
+            UINT size = static_cast<UINT>(block_.size() * sizeof(uint64_t));
+            const UINT records = GetRawInputBuffer(reinterpret_cast<PRAWINPUT>(block_.data()), &size, sizeof(RAWINPUTHEADER));
+            if (records == static_cast<UINT>(-1)) {
+                // The next record alone does not fit: grow the block to it and retry.
+                UINT needed = 0;
+                if (GetRawInputBuffer(nullptr, &needed, sizeof(RAWINPUTHEADER)) != 0) return false;
+                const size_t words = (size_t(needed) * 2 + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+                if (words <= block_.size()) return false;
+                block_.assign(words, 0);
+                continue;
+            }
+            if (records == 0) return true;
+
+            ++stats_.batches;
+            RawInputBatchReader reader(reinterpret_cast<const uint8_t*>(block_.data()), block_.size() * sizeof(uint64_t), records, layout_);
+            RawHidRecord record;
+            while (reader.Next(record)) {
+                if (record.device != static_cast<uint64_t>(reinterpret_cast<uintptr_t>(device_))) {
+                    ++stats_.foreign;
+                    continue;
+                }
+                queue_.Append(record);
+                stats_.reports += record.count;
+            }
+            stats_.records += reader.Walked();
+            if (reader.Malformed()) ++stats_.malformed;
+            // The queue points into block_; the next block is read once it is consumed.
+            if (!queue_.Empty()) return true;
+        }
+    }
+
+    SampleStatus RawInputBackend::NextReport(InputState& state) {
+        const uint8_t* report = nullptr;
+        uint32_t size = 0;
+        while (queue_.Pop(report, size)) {
+            if (!decoder_.Decode(report, size, current_)) {
+                ++stats_.undecoded;
+                continue;
+            }
+            // Most pads resend an unchanged report at their full rate; only changes are samples.
+            if (!first_ && DiffStates(last_, current_) == kChangedNone) continue;
+            first_ = false;
+            last_ = current_;
+            state = current_;
+            state.packet = ++packet_;
+            return SampleStatus::Changed;
+        }
+        return SampleStatus::Unchanged;
+    }
+
+    SampleStatus RawInputBackend::SampleImpl(InputState& state) {
+        if (!queue_.Empty()) return NextReport(state);
+
+        HANDLE stop = g_StopEvent;
+        const DWORD timeout = (waitLimitMs_ >= 0 && waitLimitMs_ < 100) ? static_cast<DWORD>(waitLimitMs_) : 100;
+        waitLimitMs_ = -1;
+        const DWORD wait = MsgWaitForMultipleObjectsEx(stop ? 1 : 0, stop ? &stop : nullptr, timeout, QS_RAWINPUT, MWMO_INPUTAVAILABLE);
+        CountWakeup();
+        if (wait == WAIT_FAILED) {
+            std::cerr << "MsgWaitForMultipleObjectsEx failed.\n";
+            return SampleStatus::Failed;
+        }
+        if (!ReadBuffer()) return SampleStatus::Failed;
+        if (queue_.Empty()) {
+            // Quiet period: a removed device's handle no longer resolves.
+            RID_DEVICE_INFO info = {};
+            info.cbSize = sizeof(info);
+            UINT size = sizeof(info);
+            if (wait == WAIT_TIMEOUT && GetRawInputDeviceInfoW(device_, RIDI_DEVICEINFO, &info, &size) == static_cast<UINT>(-1)) {
+                return SampleStatus::Disconnected;
+            }
+            return SampleStatus::Unchanged;
+        }
+        return NextReport(state);
+    }
+
+    SampleStatus RawInputBackend::PollImpl(InputState& state) {
+        if (queue_.Empty() && !ReadBuffer()) return SampleStatus::Failed;
+        return NextReport(state);
+    }
+
+    int RunXInputReader(DWORD userIndex, const ReaderOptions& options) {
+        HotplugWatcher watcher;
+        XInputBackend backend(userIndex, options);
+        std::cout << "Reading XInput controller " << userIndex;
+        if (backend.IsPhaseLocked()) {
+            std::cout << " phase-locked to its report cadence";
+        }
+        else {
+            std::cout << " at " << options.pollHz << " Hz";
+        }
+        if (backend.IsAdaptive()) {
+            std::cout << ", " << backend.Adaptive().Config().idleHz << " Hz after "
+                << options.idleAfterMs << " ms idle";
+        }
+        std::cout << " (Ctrl+C to stop)...\n";
+        if (options.axisProfile.enabled) {
+            std::cout.flush();
+            PrintAxisProfile(options.axisProfile, 0, backend.Normalizer().AxisCount());
+        }
+        if (options.powerSave) {
+            std::cout << "Power-save mode: output flushed every " << options.flushMs << " ms.\n";
+        }
+        std::cout.flush();
+        ConsoleSink sink(backend.Layout(), options.powerSave ? options.flushMs : 0);
+        const WakeupMeter meter;
+        ReaderExit exit = RunConsoleReader(backend, sink, options);
+        while (exit == ReaderExit::Disconnected && g_Running.load() && watcher.IsValid()) {
+            sink.Flush();
+            std::cout << "Controller disconnected; waiting for it to come back (Ctrl+C to stop)...\n";
+            std::cout.flush();
+            // Any arrival may be the pad: only its own slot is probed again.
+            ReconnectTiming timing;
+            if (!WaitForArrival(watcher, [userIndex](const HotplugEvent&) { return IsXInputConnected(userIndex); }, g_Running, &timing)) break;
+            std::cout << "Controller " << userIndex << " reconnected.\n";
+            std::cout.flush();
+            PrintReconnectTiming(timing);
+            exit = RunConsoleReader(backend, sink, options);
+        }
+        sink.Flush();
+        std::cout.flush();
+        PrintWakeups(meter, sink);
+        if (!options.powerSave && options.waitMode == WaitMode::Hybrid) {
+            PrintWaitStats(backend.Scheduler().GetTimer());
+        }
+        if (backend.IsPhaseLocked()) {
+            PrintPhaseLockMetrics(backend.Phase().Metrics(), backend.ElapsedSeconds());
+        }
+        else if (backend.IsAdaptive()) {
+            PrintAdaptiveStats(backend.Adaptive().Config(), backend.Adaptive().Stats());
+        }
+        else {
+            PrintPollStats(options.pollHz, backend.Scheduler().Stats());
+        }
+        if (exit == ReaderExit::Disconnected) {
+            std::cout << "Controller disconnected.\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    int RunDirectInputReader(const GUID& guidInstance, const ReaderOptions& options) {
+        HotplugWatcher watcher;
+        DirectInputBackend backend(options);
+        int rc = backend.Open(guidInstance);
+        if (rc != 0) return rc;
+
+        if (backend.IsPolledDevice()) {
+            std::cout << "Reading DirectInput device, polled at " << options.diPollHz << " Hz";
+        }
+        else {
+            std::cout << "Reading DirectInput device, "
+                << (options.diSnapshot ? "state snapshot per notification" : "event-sourced");
+        }
+        std::cout << " (Ctrl+C to stop)...\n";
+
+        const StateCaps caps = backend.Caps();
+        int axes = 0;
+        for (int i = 0; i < kMaxAxes; ++i) axes += (caps.axisMask >> i) & 1;
+        std::cout << "Data format: " << axes << " axes, " << int(caps.povCount) << " POVs, " << caps.buttonCount
+            << " buttons (" << backend.StateSize() << "-byte state" << (caps.IsFull() ? ", DIJOYSTATE2" : "") << ").\n";
+        if (options.axisProfile.enabled) {
+            std::cout.flush();
+            PrintAxisProfile(options.axisProfile, backend.DriverAxes(), backend.Normalizer().AxisCount());
+        }
+
+        if (options.powerSave) {
+            std::cout << "Power-save mode: untimed event waits, output flushed every " << options.flushMs << " ms.\n";
+        }
+        std::cout.flush();
+        ConsoleSink sink(backend.Layout(), options.powerSave ? options.flushMs : 0);
+        const WakeupMeter meter;
+        ReaderExit exit = RunConsoleReader(backend, sink, options);
+        while (exit == ReaderExit::Disconnected && g_Running.load() && watcher.IsValid()) {
+            sink.Flush();
+            std::cout << "Device disconnected; waiting for it to come back (Ctrl+C to stop)...\n";
+            std::cout.flush();
+            // The instance GUID is stable: one status query, then one open of that device.
+            ReconnectTiming timing;
+            const bool back = WaitForArrival(watcher, [&backend, &guidInstance](const HotplugEvent&) {
+                return IsDirectInputAttached(guidInstance) && backend.Open(guidInstance) == 0;
+            }, g_Running, &timing);
+            if (!back) break;
+            std::cout << "Device reconnected.\n";
+            std::cout.flush();
+            PrintReconnectTiming(timing);
+            exit = RunConsoleReader(backend, sink, options);
+        }
+        sink.Flush();
+        std::cout.flush();
+        PrintWakeups(meter, sink);
+        if (backend.IsPolledDevice()) {
+            PrintPollStats(options.diPollHz, backend.Scheduler().Stats());
+        }
+        else {
+            PrintDiEventStats(backend.RecordStats(), backend.IsEventSourced(), meter.Seconds());
+        }
+        if (!backend.IsPolledDevice() && backend.Mode() == WaitMode::Hybrid) {
+            const EventWaitStats& w = backend.EventStats();
+            std::printf("wait: hybrid, event interval %.3f ms, spin catches %llu, blocked wakes %llu, timeouts %llu, "
+                "spin %.1f ms total, spin window %.1f us\n",
+                w.periodNs / 1e6, (unsigned long long)w.spinCatches, (unsigned long long)w.blockedWakes,
+                (unsigned long long)w.timeouts, (double)w.spinNs / 1e6,
+                (double)backend.Timer().Calibrator().WindowNs() / 1000.0);
+        }
+        if (exit == ReaderExit::Disconnected) {
+            std::cout << "Device disconnected or error.\n";
+        }
+        return 0;
+    }
+
+    int RunRawInputReader(uint16_t vendorId, uint16_t productId, const ReaderOptions& options) {
+        RawInputBackend backend;
+        const int rc = backend.Open(vendorId, productId, g_HiddenWnd);
+        if (rc != 0) return rc;
+
+        char id[16];
+        std::snprintf(id, sizeof(id), "%04X:%04X", vendorId, productId);
+        std::cout << "Reading Raw Input device " << id << " (" << backend.Decoder().Describe()
+            << "), reports drained with GetRawInputBuffer (Ctrl+C to stop)...\n";
+        std::cout.flush();
+        ConsoleSink sink(backend.Layout(), options.powerSave ? options.flushMs : 0);
+        const WakeupMeter meter;
+        const ReaderExit exit = RunConsoleReader(backend, sink, options);
+        sink.Flush();
+        std::cout.flush();
+        PrintWakeups(meter, sink);
+        PrintRawInputStats(backend.Stats(), meter.Seconds());
+        if (exit == ReaderExit::Disconnected) {
+            std::cout << "Device disconnected or error.\n";
+        }
+        return 0;
+    }
+
+    int RunLatencyCompare(DWORD userIndex, const ReaderOptions& options) {
+        CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+        const std::vector<DeviceInfo> proxies = EnumerateXInputProxies();
+        if (proxies.empty()) {
+            std::cerr << "No DirectInput proxy of an XInput pad found.\n";
+            CoUninitialize();
+            return 1;
+        }
+        if (proxies.size() > 1) {
+            // Proxies carry no XInput user index; with several pads the pairing is a guess.
+            std::cerr << proxies.size() << " XInput pads have DirectInput proxies; comparing with the first. "
+                "Connect only the pad under test for a meaningful result.\n";
+        }
+
+        int rc = 0;
+        {
+            DirectInputBackend di(options);
+            rc = di.Open(ToGuid(proxies[0].diGuid));
+            if (rc == 0) {
+                XInputBackend xi(userIndex, options);
+                std::cout << "Comparing XInput controller " << userIndex << " (polled at " << options.pollHz
+                    << " Hz) with DirectInput \"" << proxies[0].name << "\" ("
+                    << (di.IsPolledDevice() ? "polled" : "event-driven") << "). Press buttons; Ctrl+C to stop...\n";
+                std::cout.flush();
+
+                const char* const names[2] = { "xinput", "directinput" };
+                const SystemTimer clock;
+                LatencyComparer comparer;
+                std::mutex lock;
+                std::atomic_bool running(true);
+                auto feed = [&](int path, uint32_t controls) {
+                    // Stamped on arrival in the application: the one point both APIs share.
+                    const uint64_t now = clock.NowNs();
+                    std::vector<MatchedEdge> matched;
+                    std::lock_guard<std::mutex> guard(lock);
+                    comparer.Feed(path, controls, now, &matched);
+                    for (const MatchedEdge& e : matched) {
+                        std::printf("%-9s %-7s %s first by %.3f ms\n", ControlName(e.control), e.pressed ? "press" : "release",
+                            e.deltaNs >= 0 ? names[0] : names[1], (double)(e.deltaNs >= 0 ? e.deltaNs : -e.deltaNs) / 1e6);
+                    }
+                };
+
+                // DirectInput on its own thread so neither path waits for the other.
+                std::thread reader([&] {
+                    CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+                    InputState state;
+                    while (running.load() && g_Running.load()) {
+                        const SampleStatus s = di.Sample(state);
+                        if (s == SampleStatus::Changed) feed(1, ProxyControls(state));
+                        else if (s == SampleStatus::Disconnected || s == SampleStatus::Failed) break;
+                    }
+                    running.store(false);
+                    CoUninitialize();
+                });
+                InputState state;
+                while (running.load() && g_Running.load()) {
+                    const SampleStatus s = xi.Sample(state);
+                    if (s == SampleStatus::Changed) feed(0, GamepadControls(state));
+                    else if (s == SampleStatus::Disconnected || s == SampleStatus::Failed) break;
+                }
+                running.store(false);
+                reader.join();
+
+                // Whatever is still pending never showed up on the other path.
+                comparer.Expire(UINT64_MAX);
+                std::fflush(stdout);
+                PrintLatencyComparison(comparer, names);
+                if (g_Running.load()) std::cout << "Controller disconnected.\n";
+            }
+        }
+        CoUninitialize();
+        return rc;
+    }
+
+    namespace {
+
+        /// Backends of the multi-device reader, with what it takes to open them again.
+        struct DeviceSet {
+            std::vector<std::unique_ptr<XInputBackend>> pads;
+            std::vector<int> padTags;
+            std::vector<DWORD> padUsers;
+            std::vector<std::unique_ptr<DirectInputBackend>> sticks;
+            std::vector<int> stickTags;
+            std::vector<GUID> stickGuids;
+            std::vector<bool> stickUnreadable;  //!< Found on an arrival but could not be opened; not retried.
+        };
+
+        /// Adds a DirectInput device to the reactor: on its own grid when polled, else on its event.
+        bool AddStick(Reactor& reactor, DirectInputBackend& stick, int tag, const ReaderOptions& options) {
+            if (stick.IsPolledDevice()) {
+                // Never signals its event; read on its own grid.
+                reactor.AddPolled(stick, tag, options.diPollHz);
+                return true;
+            }
+            return reactor.AddEvent(stick, tag, reinterpret_cast<intptr_t>(stick.Event()));
+        }
+
+        /// true for HID device interfaces (`\\?\HID#...`), the class DirectInput game controllers arrive as.
+        bool IsHidInterfacePath(const std::string& path) {
+            static const char kPrefix[] = "\\\\?\\HID#";
+            if (path.size() < sizeof(kPrefix) - 1) return false;
+            for (size_t i = 0; i + 1 < sizeof(kPrefix); ++i) {
+                if (std::toupper(static_cast<unsigned char>(path[i])) != kPrefix[i]) return false;
+            }
+            return true;
+        }
+
+        /// Case-insensitive comparison of two interface paths.
+        bool SameInterfacePath(const wchar_t* a, const std::wstring& b) {
+            size_t i = 0;
+            for (; a[i] && i < b.size(); ++i) {
+                if (std::towlower(a[i]) != std::towlower(b[i])) return false;
+            }
+            return !a[i] && i == b.size();
+        }
+
+        /**
+         * @brief Describes the attached DirectInput game controller whose interface path is @p path (UTF-8).
+         * @param known Instances already read; they are not created again.
+         * @return false if no other game controller has that path (another HID device, an XInput proxy).
+         * @details DirectInput cannot open a device by its path: the attached game controllers are
+         *          enumerated (no device is created for that), then only the instances not read yet
+         *          are created to compare their paths.
+         */
+        bool FindDirectInputByPath(const std::string& path, const std::vector<GUID>& known, DeviceInfo& out) {
+            IDirectInput8W* di = SharedDirectInput();
+            if (!di) return false;
+            std::vector<DIDEVICEINSTANCEW> instances;
+            di->EnumDevices(DI8DEVCLASS_GAMECTRL, EnumDIEnumDevicesCallback, &instances, DIEDFL_ATTACHEDONLY);
+            const std::wstring wanted = Utf8ToW(path);
+            for (const DIDEVICEINSTANCEW& inst : instances) {
+                if (std::any_of(known.begin(), known.end(),
+                    [&inst](const GUID& g) { return std::memcmp(&g, &inst.guidInstance, sizeof(GUID)) == 0; })) continue;
+                if (IsXInputProxyInstance(inst, nullptr)) continue;
+                IDirectInputDevice8W* device = nullptr;
+                if (FAILED(di->CreateDevice(inst.guidInstance, &device, nullptr))) continue;
+                DIPROPGUIDANDPATH prop;
+                const bool match = ReadInterfacePath(device, prop) && SameInterfacePath(prop.wszPath, wanted);
+                device->Release();
+                if (match) return !DescribeDirectInput(di, &inst, out);
+            }
+            return false;
+        }
+
+        /**
+         * @brief Reactor watch of the multi-device reader: brings devices back when Windows reports an arrival.
+         * @details Unplugs are noticed by the reads themselves (XInput reports the slot empty, DirectInput
+         *          the device detached) and close the source. Removals need no action. An arrival is
+         *          handled by what its interface path says:
+         *            - any arrival re-probes the closed XInput slots, and with attachNew the free ones
+         *              (XInput pads also arrive as non-HID XUSB interfaces);
+         *            - a HID interface re-checks the closed DirectInput devices by GUID
+         *              (GetDeviceStatus), and with attachNew looks up the one device with that path
+         *              (FindDirectInputByPath()); "IG_" interfaces are XInput proxies and skip the lookup;
+         *            - other interface classes (storage, hubs, audio) touch no DirectInput device.
+         *          The cached device list is not re-enumerated.
+         */
+        class WindowsHotplug {
+        public:
+            WindowsHotplug(Reactor& reactor, HotplugWatcher& watcher, DeviceSet& set, const ReaderOptions& options)
+                : reactor_(reactor), watcher_(watcher), set_(set), options_(options) {
+                for (int tag : set.padTags) nextTag_ = std::max(nextTag_, tag + 1);
+                for (int tag : set.stickTags) nextTag_ = std::max(nextTag_, tag + 1);
+            }
+
+            bool Start() { return reactor_.AddWatch(watcher_.Handle(), &OnReady, this); }
+
+        private:
+            static void OnReady(void* context) { static_cast<WindowsHotplug*>(context)->Update(); }
+
+            void Update() {
+                events_.clear();
+                watcher_.Drain(events_);
+                bool arrived = false;
+                bool hid = false;
+                for (const HotplugEvent& e : events_) {
+                    if (e.action != HotplugAction::Added) continue;
+                    arrived = true;
+                    hid = hid || IsHidInterfacePath(e.path);
+                }
+                if (!arrived) return;
+
+                for (size_t i = 0; i < set_.pads.size(); ++i) {
+                    if (reactor_.IsOpen(set_.padTags[i]) || !IsXInputConnected(set_.padUsers[i])) continue;
+                    reactor_.AddPolled(*set_.pads[i], set_.padTags[i], options_.pollHz);
+                    std::printf("[%d] reconnected\n", set_.padTags[i]);
+                }
+                if (options_.attachNew) AttachNewPads();
+                if (!hid) return;
+
+                for (size_t i = 0; i < set_.sticks.size(); ++i) {
+                    if (set_.stickUnreadable[i] || reactor_.IsOpen(set_.stickTags[i]) || !IsDirectInputAttached(set_.stickGuids[i])) continue;
+                    if (set_.sticks[i]->Open(set_.stickGuids[i]) != 0) continue;
+                    if (AddStick(reactor_, *set_.sticks[i], set_.stickTags[i], options_)) std::printf("[%d] reconnected\n", set_.stickTags[i]);
+                }
+                if (!options_.attachNew) return;
+                for (const HotplugEvent& e : events_) {
+                    if (e.action == HotplugAction::Added && IsHidInterfacePath(e.path) && !HasXInputInterfaceMarker(e.path.c_str())) AttachStick(e.path);
+                }
+            }
+
+            /// Attaches pads in XInput slots not read yet.
+            void AttachNewPads() {
+                for (DWORD user = 0; user < 4; ++user) {
+                    if (std::find(set_.padUsers.begin(), set_.padUsers.end(), user) != set_.padUsers.end() || !IsXInputConnected(user)) continue;
+                    const int tag = nextTag_++;
+                    set_.pads.emplace_back(new XInputBackend(user, options_));
+                    set_.padTags.push_back(tag);
+                    set_.padUsers.push_back(user);
+                    reactor_.AddPolled(*set_.pads.back(), tag, options_.pollHz);
+                    std::printf("[%d] attached: %s XInput Controller %lu\n", tag, DeviceKindTag(DeviceKind::XInput), (unsigned long)user);
+                }
+            }
+
+            /// Attaches the DirectInput game controller that arrived as the HID interface @p path, if any.
+            void AttachStick(const std::string& path) {
+                DeviceInfo d;
+                if (!FindDirectInputByPath(path, set_.stickGuids, d)) return;
+                const int tag = nextTag_++;
+                const GUID guid = ToGuid(d.diGuid);
+                std::unique_ptr<DirectInputBackend> b(new DirectInputBackend(options_));
+                const bool readable = b->Open(guid) == 0 && AddStick(reactor_, *b, tag, options_);
+                // Kept even if it cannot be read: marked unreadable, it is not opened again on every arrival.
+                set_.sticks.push_back(std::move(b));
+                set_.stickTags.push_back(tag);
+                set_.stickGuids.push_back(guid);
+                set_.stickUnreadable.push_back(!readable);
+                if (!readable) {
+                    std::cerr << "[" << tag << "] open failed.\n";
+                    return;
+                }
+                // Printed with the full layout: the output thread owns the sink's caps by now.
+                std::printf("[%d] attached: %s %s\n", tag, DeviceKindTag(d.kind), d.name.c_str());
+            }
+
+            Reactor& reactor_;
+            HotplugWatcher& watcher_;
+            DeviceSet& set_;
+            const ReaderOptions& options_;
+            int nextTag_ = 0;
+            std::vector<HotplugEvent> events_;
+        };
+
+    } // namespace
+
+    int RunMultiDeviceReader(const std::vector<DeviceInfo>& devices, const ReaderOptions& options) {
+        if (options.rawInput) {
+            std::cerr << "--raw-input reads a single device; reading these through DirectInput.\n";
+        }
+        CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+        int rc = 0;
+        {
+            // Backends are declared before the reactor / pool so they outlive it.
+            DeviceSet set;
+            for (const DeviceInfo& d : devices) {
+                if (d.kind == DeviceKind::XInput) {
+                    set.pads.emplace_back(new XInputBackend(d.xinputUser, options));
+                    set.padTags.push_back(d.index);
+                    set.padUsers.push_back(d.xinputUser);
+                    continue;
+                }
+                std::unique_ptr<DirectInputBackend> b(new DirectInputBackend(options));
+                const int open = b->Open(ToGuid(d.diGuid));
+                if (open != 0) {
+                    std::cerr << "[" << d.index << "] open failed (" << open << ").\n";
+                    continue;
+                }
+                set.sticks.push_back(std::move(b));
+                set.stickTags.push_back(d.index);
+                set.stickGuids.push_back(ToGuid(d.diGuid));
+                set.stickUnreadable.push_back(false);
+            }
+
+            TaggedConsoleSink console;
+            for (size_t i = 0; i < set.sticks.size(); ++i) console.SetCaps(set.stickTags[i], set.sticks[i]->Caps());
+            AsyncSink<TaggedConsoleSink> sink(console, StateLayout::Gamepad, options.ringSlots, options.overflow);
+            const WakeupMeter meter;
+            ReaderExit exit = ReaderExit::Stopped;
+            if (options.poolWorkers > 0) {
+                // DirectInput devices are polled on the grid too; their buffers keep what arrives in between.
+                // Polled devices have no buffer, so each tick is one Poll() + GetDeviceState.
+                // The pool's device set is fixed: unplugged devices stay gone.
+                ReaderPool pool(options.poolWorkers, options.pollHz);
+                for (size_t i = 0; i < set.pads.size(); ++i) pool.Add(*set.pads[i], set.padTags[i]);
+                for (size_t i = 0; i < set.sticks.size(); ++i) pool.Add(*set.sticks[i], set.stickTags[i], !set.sticks[i]->IsPolledDevice());
+                if (pool.DeviceCount() == 0) {
+                    std::cerr << "No device could be opened.\n";
+                    rc = 1;
+                }
+                else {
+                    std::cout << "Reading " << pool.DeviceCount() << " devices at " << options.pollHz << " Hz on "
+                        << (pool.DeviceCount() < options.poolWorkers ? pool.DeviceCount() : options.poolWorkers)
+                        << " workers (Ctrl+C to stop)...\n";
+                    std::cout.flush();
+                    exit = pool.Run(sink, g_Running);
+                    sink.Close();
+                    std::fflush(stdout);
+                    PrintPoolStats(pool.Stats(), pool.ActiveWorkers(), meter.Seconds());
+                    PrintRingStats(sink.Ring());
+                }
+            }
+            else {
+                Reactor reactor;
+                HotplugWatcher watcher;
+                WindowsHotplug hotplug(reactor, watcher, set, options);
+                for (size_t i = 0; i < set.pads.size(); ++i) reactor.AddPolled(*set.pads[i], set.padTags[i], options.pollHz);
+                for (size_t i = 0; i < set.sticks.size(); ++i) {
+                    if (!AddStick(reactor, *set.sticks[i], set.stickTags[i], options)) {
+                        std::cerr << "[" << set.stickTags[i] << "] skipped: at most " << Reactor::kMaxEventSources
+                            << " DirectInput devices per reactor (use --pool).\n";
+                    }
+                }
+                const bool hot = reactor.IsValid() && watcher.IsValid() && hotplug.Start();
+                if (!reactor.IsValid() || (reactor.OpenCount() == 0 && !(hot && options.attachNew))) {
+                    std::cerr << "No device could be opened.\n";
+                    rc = 1;
+                }
+                else {
+                    std::cout << "Reading " << reactor.OpenCount() << " devices, XInput at " << options.pollHz << " Hz"
+                        << (hot ? (options.attachNew ? ", attaching controllers as they are plugged in" : ", re-attaching unplugged devices") : "")
+                        << " (Ctrl+C to stop)...\n";
+                    std::cout.flush();
+                    exit = reactor.Run(sink, g_Running);
+                    sink.Close();
+                    std::fflush(stdout);
+                    PrintReactorStats(reactor.Stats(), meter.Seconds());
+                    PrintRingStats(sink.Ring());
+                    if (hot) PrintHotplugStats(watcher.Stats());
+                }
+            }
+            if (rc == 0 && exit == ReaderExit::Disconnected) std::cout << "All devices disconnected.\n";
+            if (exit == ReaderExit::Failed) {
+                std::cerr << "WaitForMultipleObjects failed.\n";
+                rc = 1;
+            }
+        }
+        CoUninitialize();
+        return rc;
+    }
+
+    int RunDeviceReader(const DeviceInfo& device, const ReaderOptions& options) {
+        if (device.kind == DeviceKind::XInput) {
+            if (options.compareApis) return RunLatencyCompare(device.xinputUser, options);
+            return RunXInputReader(device.xinputUser, options);
+        }
+        if (options.compareApis) {
+            std::cerr << "--compare needs an XInput controller; reading this device normally.\n";
+        }
+
+        if (options.rawInput) {
+            if (device.vendorId == 0 && device.productId == 0) {
+                std::cerr << "The device reports no vendor/product ID; Raw Input cannot match it.\n";
+                return 1;
+            }
+            return RunRawInputReader(device.vendorId, device.productId, options);
+        }
+
+        // Initialize COM for safety with some DI providers
+        CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+        int rc = RunDirectInputReader(ToGuid(device.diGuid), options);
+        CoUninitialize();
+        return rc;
+    }
+
+} // namespace joystick
+
+#endif // _WIN32
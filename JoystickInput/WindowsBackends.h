@@ -0,0 +1,474 @@
+﻿/**
+ * @file
+ * @brief XInput, DirectInput and Raw Input backends for the input core (Windows only).
+ * @details
+ *   - Links: xinput9_1_0.lib, dinput8.lib, dxguid.lib, user32.lib, ole32.lib, hid.lib
+ *   - XInput devices (Xbox 360/One/Series) are polled; there is no event API in XInput.
+ *   - DirectInput devices (generic USB gamepads/joysticks) are event-driven via SetEventNotification + buffered data.
+ *   - With --raw-input, a HID controller is read through Raw Input instead: WM_INPUT reports for the
+ *     hidden window, drained in bulk with GetRawInputBuffer and decoded without DirectInput.
+ */
+
+#pragma once
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <Xinput.h>
+#define DIRECTINPUT_VERSION 0x0800
+#include <dinput.h>
+
+#include "AxisNormalizer.h"
+#include "DeviceRegistry.h"
+#include "DiEvents.h"
+#include "InputCore.h"
+#include "PhaseLock.h"
+#include "PollScheduler.h"
+#include "RawInputBatch.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace joystick {
+
+    /// Minimal hidden window required by DirectInput SetCooperativeLevel.
+    extern HWND g_HiddenWnd;
+
+    /// Manual-reset event set by the console control handler, so untimed waits also end on Ctrl+C.
+    extern HANDLE g_StopEvent;
+
+    /**
+     * @brief Creates a hidden message-only window required by DirectInput cooperative level setup.
+     * @return HWND of the created window, or nullptr on failure.
+     * @note The class is registered once; subsequent calls reuse it.
+     */
+    HWND CreateHiddenWindow();
+
+    /**
+     * @brief Converts a UTF-16 wide string to UTF-8.
+     * @param ws Source wide string.
+     * @return UTF-8 encoded std::string.
+     */
+    std::string WToUtf8(const std::wstring& ws);
+
+    /**
+     * @brief Converts a UTF-8 string to UTF-16.
+     * @param s Source UTF-8 string.
+     * @return UTF-16 std::wstring.
+     */
+    std::wstring Utf8ToW(const std::string& s);
+
+    /// Copies a Windows GUID into the portable DeviceGuid.
+    DeviceGuid ToDeviceGuid(const GUID& guid);
+
+    /// Copies a portable DeviceGuid back into a Windows GUID.
+    GUID ToGuid(const DeviceGuid& guid);
+
+    /**
+     * @brief Maps an XINPUT_STATE onto the portable Gamepad layout.
+     * @param s Source state.
+     * @param out Destination state; packet, sticks, triggers and button mask are written.
+     */
+    void ConvertXInputState(const XINPUT_STATE& s, InputState& out);
+
+    /**
+     * @brief Maps a DIJOYSTATE2 onto the portable Joystick layout.
+     * @param js Source state.
+     * @param out Destination state; axes, POVs and 128 buttons are written, packet is untouched.
+     */
+    void ConvertDIState(const DIJOYSTATE2& js, InputState& out);
+
+    /**
+     * @brief XInput slots and DirectInput game controllers, as a BasicDeviceRegistry source.
+     * @details Listing probes the four XInput slots, each on its own thread, while the calling thread
+     *          enumerates DirectInput instances (keyed by instance GUID); describing a DirectInput entry filters XInput proxies
+     *          (known VID/PID without opening it, else the "IG_" interface path; XInputProxies.h), converts the
+     *          name and opens the device for its capabilities. One DirectInput instance is created on
+     *          first use and kept for the life of the source.
+     */
+    class WindowsDeviceSource {
+    public:
+        WindowsDeviceSource() = default;
+        ~WindowsDeviceSource();
+        WindowsDeviceSource(const WindowsDeviceSource&) = delete;
+        WindowsDeviceSource& operator=(const WindowsDeviceSource&) = delete;
+
+        void List(ProbeVisitor visit, void* context);
+        bool Describe(const DeviceProbe& probe, DeviceInfo& out);
+
+        /// The long-lived DirectInput instance (nullptr if DirectInput8Create failed).
+        IDirectInput8W* DirectInput();
+
+    private:
+        IDirectInput8W* di_ = nullptr;
+        bool diFailed_ = false;
+    };
+
+    /// The process-wide DirectInput instance shared by enumeration and the backends (not AddRef'd).
+    IDirectInput8W* SharedDirectInput();
+
+    /**
+     * @brief Polled XInput backend.
+     * @details Uses packet numbers so only state changes are reported; polls are paced by a PollScheduler.
+     */
+    class XInputBackend : public InputBackend<XInputBackend> {
+    public:
+        /**
+         * @param userIndex XInput user index [0..3].
+         * @param options Poll rate and adaptive-rate settings.
+         */
+        XInputBackend(DWORD userIndex, const ReaderOptions& options);
+
+        /// Waits for the next poll tick (the first call does not wait) and reads the pad.
+        SampleStatus SampleImpl(InputState& state);
+
+        /// Reads the pad now (reactor use; the scheduler and rate controllers are bypassed).
+        SampleStatus PollImpl(InputState& state);
+
+        StateLayout OutputLayout() const { return StateLayout::Gamepad; }
+
+        const PollScheduler& Scheduler() const { return scheduler_; }
+
+        /// Adaptive rate controller; only fed when IsAdaptive().
+        const AdaptiveRate& Adaptive() const { return adaptive_; }
+        bool IsAdaptive() const { return adaptiveEnabled_; }
+
+        /// Report-cadence estimator; plans the polls when IsPhaseLocked().
+        const PhaseLock& Phase() const { return phaseLock_; }
+        bool IsPhaseLocked() const { return phaseLockEnabled_; }
+
+        /// Seconds since the first poll.
+        double ElapsedSeconds() const;
+
+        /// Axes scaled by the software normalizer (XInput has no driver-side ranges).
+        const AxisNormalizer& Normalizer() const { return normalizer_; }
+
+    private:
+        DWORD user_;
+        DWORD lastPacket_ = 0;
+        bool first_ = true;
+        PollScheduler scheduler_;
+        AdaptiveRate adaptive_;
+        bool adaptiveEnabled_;
+        PhaseLock phaseLock_;
+        bool phaseLockEnabled_;
+        uint64_t startNs_ = 0;
+        AxisNormalizer normalizer_;
+    };
+
+    /**
+     * @brief How DirectInput event waits completed (hybrid wait mode).
+     */
+    struct EventWaitStats {
+        uint64_t spinCatches = 0;    //!< Events seen while spinning around the expected time.
+        uint64_t blockedWakes = 0;   //!< Events that woke a blocking wait.
+        uint64_t timeouts = 0;       //!< 100 ms waits without an event.
+        uint64_t spinNs = 0;         //!< Time spent spinning.
+        double periodNs = 0;         //!< Estimated event interval while the device is active.
+    };
+
+    /**
+     * @brief DirectInput backend: event-driven via SetEventNotification and buffered data, or
+     *        scheduled Poll() + GetDeviceState for devices that report DIDC_POLLEDDEVICE.
+     * @details By default the state is event-sourced: each notification costs one GetDeviceData
+     *          call, and every group of simultaneous buffered records is applied to the kept state
+     *          and returned as its own sample (see DiEvents.h). GetDeviceState is only read to
+     *          resync: on the first read and after acquisition was lost. With
+     *          ReaderOptions::diSnapshot the buffer is drained and discarded and each notification
+     *          reads a full GetDeviceState, as before.
+     *
+     *          Polled devices never signal the notification event, so they are read on a
+     *          PollScheduler at ReaderOptions::diPollHz instead: Poll(), then GetDeviceState, and a
+     *          sample is returned when the state differs from the last one.
+     */
+    class DirectInputBackend : public InputBackend<DirectInputBackend> {
+    public:
+        /**
+         * @param options waitMode Hybrid spins on the event around its expected time; powerSave waits
+         *        on the event without a timeout (see WaitEvent()).
+         */
+        explicit DirectInputBackend(const ReaderOptions& options = ReaderOptions())
+            : eventSourced_(!options.diSnapshot), tuner_(MakeBufferConfig(options)), profile_(options.axisProfile),
+            scheduler_(options.diPollHz),
+            waitMode_(options.powerSave ? WaitMode::Sleep : options.waitMode), powerSave_(options.powerSave) {}
+        ~DirectInputBackend();
+        DirectInputBackend(const DirectInputBackend&) = delete;
+        DirectInputBackend& operator=(const DirectInputBackend&) = delete;
+
+        /**
+         * @brief Creates, configures and acquires the device (closing the one opened before, if any).
+         * @param guidInstance DirectInput device instance GUID.
+         * @return 0 on success; the non-zero exit codes of the original reader (2..9) on failure.
+         * @details
+         *   - Sets a compact data format holding only the enumerated axes, POVs and buttons
+         *     (DiCompactFormat), or DIJOYSTATE2 if the device reports none or rejects it.
+         *   - Uses non-exclusive, background cooperative level.
+         *   - Reads the capabilities: DIDC_POLLEDDEVICE / DIDC_POLLEDDATAFORMAT devices are polled
+         *     (IsPolledDevice()); the others get the buffer and notification event.
+         *   - Sets DIPROP_RANGE, DIPROP_DEADZONE and DIPROP_SATURATION per axis from
+         *     ReaderOptions::axisProfile; axes that reject them are scaled by AxisNormalizer.
+         *   - Enables buffered input (ReaderOptions::diBufferSize records, or 64 and tuned) and
+         *     attaches an event for notifications.
+         */
+        int Open(const GUID& guidInstance);
+
+        /**
+         * @brief Returns the next buffered record group, waiting for the device event (100 ms timeout)
+         *        when none is pending; handles re-acquire on input loss.
+         */
+        SampleStatus SampleImpl(InputState& state);
+
+        /// Bounds the next untimed power-save wait (batched output flush).
+        void LimitNextWaitImpl(int timeoutMs) { waitLimitMs_ = timeoutMs; }
+
+        /**
+         * @brief Returns the next buffered record group (reading the buffer if none is pending) without
+         *        waiting (reactor use).
+         * @return Changed for a record (or the first snapshot), Unchanged when nothing is buffered,
+         *         Disconnected when the device no longer answers.
+         */
+        SampleStatus PollImpl(InputState& state);
+
+        /// True if the device must be polled (no notifications); see the class notes.
+        bool IsPolledDevice() const { return polledDevice_; }
+
+        /// Poll schedule of a polled device.
+        const PollScheduler& Scheduler() const { return scheduler_; }
+
+        /// Notification event (auto-reset); a reactor waits on it instead of SampleImpl.
+        HANDLE Event() const { return event_; }
+
+        StateLayout OutputLayout() const { return StateLayout::Joystick; }
+
+        /// Objects in the data format (all InputState slots with DIJOYSTATE2).
+        StateCaps CapsImpl() const { return compact_.Empty() ? StateCaps() : compact_.Caps(); }
+
+        /// Bytes GetDeviceState copies per read.
+        uint32_t StateSize() const { return compact_.Empty() ? static_cast<uint32_t>(sizeof(DIJOYSTATE2)) : compact_.DataSize(); }
+
+        WaitMode Mode() const { return waitMode_; }
+        bool IsEventSourced() const { return eventSourced_; }
+        const EventWaitStats& EventStats() const { return waitStats_; }
+        const DiEventStats& RecordStats() const { return recordStats_; }
+        const SystemTimer& Timer() const { return timer_; }
+
+        /// Axes whose range, dead zone and saturation the driver applies.
+        int DriverAxes() const { return driverAxes_; }
+        /// Axes scaled in software because the driver rejected the properties.
+        const AxisNormalizer& Normalizer() const { return normalizer_; }
+
+    private:
+        void Close();
+
+        static DiBufferConfig MakeBufferConfig(const ReaderOptions& options) {
+            DiBufferConfig c;
+            c.initial = options.diBufferSize ? options.diBufferSize : 64;
+            c.autoTune = options.diBufferSize == 0;
+            return c;
+        }
+
+        /**
+         * @brief Sets DIPROP_BUFFERSIZE (unacquiring around the change) and records the size in effect.
+         * @details Changing the size discards the buffer, so the event-sourced state is resynced.
+         */
+        void SetBufferSize(DWORD records);
+
+        /**
+         * @brief Builds a data format from EnumObjects and sets it on the device.
+         * @return false (compact_ left empty) if no usable objects were found or the format was rejected.
+         */
+        bool SetCompactFormat();
+
+        /// GetDeviceState in the active data format, converted into @p out; counts the device call.
+        HRESULT ReadState(InputState& out);
+
+        /// Applies profile_ to every axis in the data format (driver properties, else AxisNormalizer).
+        void ApplyAxisProfile();
+
+        /// Polled devices: Poll() + GetDeviceState; Changed when the present objects differ.
+        SampleStatus PollDevice(InputState& state);
+
+        /// After lost input: re-acquires; Disconnected once DirectInput reports the device detached.
+        SampleStatus Reacquire();
+
+        /// Copies the kept state to @p state, scaling software-normalized axes.
+        void Emit(InputState& state) const {
+            state = current_;
+            if (normalizer_.Active()) normalizer_.Apply(state);
+        }
+
+        /**
+         * @brief Empties the DirectInput buffer; @p items receives the records read.
+         * @return Unchanged, or Reacquire()'s Disconnected when input was lost and the device is gone.
+         *         Lost input is re-acquired once per call, so an unplugged device cannot keep it looping.
+         */
+        SampleStatus Drain(DWORD& items);
+
+        /**
+         * @brief Moves buffered records into the event queue.
+         * @return S_OK, or the failing GetDeviceData result. Lost input (re-acquired) and buffer
+         *         overflows mark the state for a resync (S_FALSE); the tuner may grow the buffer.
+         */
+        HRESULT ReadEvents();
+
+        /**
+         * @brief Discards buffered records and rebuilds the kept state from GetDeviceState.
+         * @return The GetDeviceState result.
+         */
+        HRESULT Resync();
+
+        /// Event-sourced step shared by SampleImpl and PollImpl; @p read fetches new records first.
+        SampleStatus NextRecord(InputState& state, bool read);
+
+        /**
+         * @brief Waits for the device event; returns a WaitForSingleObject() result.
+         * @details In hybrid mode, once the event interval is known, blocks until one spin window
+         *          before the expected event, polls the event with a pause hint until one window after
+         *          it, then falls back to the blocking 100 ms wait. In power-save mode, waits for the
+         *          event or g_StopEvent with no timeout (DirectInput also signals the event when
+         *          acquisition is lost, which covers unplugs), bounded only by LimitNextWait().
+         */
+        DWORD WaitEvent();
+
+        IDirectInput8W* di_ = nullptr;
+        IDirectInputDevice8W* dev_ = nullptr;
+        GUID guid_ = {};               //!< Instance opened last, for GetDeviceStatus().
+        HANDLE event_ = nullptr;
+        bool acquired_ = false;
+        bool polled_ = false;
+        uint32_t packet_ = 0;
+        bool eventSourced_;
+        bool synced_ = false;          //!< current_ reflects the device (event-sourced mode).
+        InputState current_;           //!< Kept state the records are applied to.
+        DiObjectMap objects_ = DiObjectMap::Joystick2();
+        DiCompactFormat compact_;      //!< Objects the device reported; empty = c_dfDIJoystick2.
+        std::vector<uint8_t> stateBlock_; //!< GetDeviceState buffer of the compact format.
+        DiEventQueue queue_;
+        DiEventStats recordStats_;
+        DiBufferTuner tuner_;
+        AxisProfile profile_;
+        AxisNormalizer normalizer_;
+        int driverAxes_ = 0;
+        bool polledDevice_ = false;
+        PollScheduler scheduler_;      //!< Paces polled devices.
+        WaitMode waitMode_;
+        bool powerSave_;
+        int waitLimitMs_ = -1;
+        SystemTimer timer_;
+        uint64_t lastEventNs_ = 0;
+        EventWaitStats waitStats_;
+    };
+
+    struct HidPDecoder;
+
+    /**
+     * @brief Raw Input backend: HID reports of one controller, read in batches with GetRawInputBuffer.
+     * @details Registers the joystick, gamepad and multi-axis usages with RIDEV_INPUTSINK on a
+     *          window of the reading thread, waits with MsgWaitForMultipleObjectsEx(QS_RAWINPUT) and
+     *          drains pending WM_INPUT messages with one GetRawInputBuffer call per block. Each report
+     *          of the selected device becomes its own sample; reports of other controllers are
+     *          counted and dropped.
+     *
+     *          Known controllers use their fixed layout (KnownControllers.h). Other devices are
+     *          decoded with HidP_GetUsageValue / HidP_GetUsages on the preparsed data, mapped to
+     *          slots as the descriptor compiler maps them (HidDescriptor.h).
+     * @note Raw Input registration is per process and usage, so only one backend reads at a time.
+     */
+    class RawInputBackend : public InputBackend<RawInputBackend> {
+    public:
+        RawInputBackend();
+        ~RawInputBackend();
+        RawInputBackend(const RawInputBackend&) = delete;
+        RawInputBackend& operator=(const RawInputBackend&) = delete;
+
+        /**
+         * @brief Finds the HID game controller with @p vendorId / @p productId and registers for its reports.
+         * @param window Target window; must belong to the thread that calls Sample().
+         * @return 0 on success; non-zero if the device is missing, has no decoder, or registration fails.
+         */
+        int Open(uint16_t vendorId, uint16_t productId, HWND window);
+
+        /// Returns the next pending report, waiting for WM_INPUT when none is pending (100 ms bound).
+        SampleStatus SampleImpl(InputState& state);
+
+        /// Returns the next pending report after draining the buffer, without waiting.
+        SampleStatus PollImpl(InputState& state);
+
+        StateLayout OutputLayout() const { return decoder_.Layout(); }
+
+        void LimitNextWaitImpl(int timeoutMs) { waitLimitMs_ = timeoutMs; }
+
+        const RawHidDecoder& Decoder() const { return decoder_; }
+        const RawInputStats& Stats() const { return stats_; }
+
+    private:
+        /// Reads one GetRawInputBuffer block into queue_ (call only when queue_ is empty); false if the call failed.
+        bool ReadBuffer();
+
+        /// Decodes the oldest pending report; Changed when it differs from the last state returned.
+        SampleStatus NextReport(InputState& state);
+
+        HWND window_ = nullptr;
+        HANDLE device_ = nullptr;
+        bool registered_ = false;
+        RawInputLayout layout_;
+        std::vector<uint64_t> block_;   //!< GetRawInputBuffer target (QWORD aligned); queue_ points into it.
+        RawHidQueue queue_;
+        RawHidDecoder decoder_;
+        std::unique_ptr<HidPDecoder> hidp_;
+        InputState current_;
+        InputState last_;
+        bool first_ = true;
+        uint32_t packet_ = 0;
+        int waitLimitMs_ = -1;
+        RawInputStats stats_;
+    };
+
+    /**
+     * @brief Polls and prints input for a given XInput controller until interrupted.
+     * @param userIndex XInput user index [0..3].
+     * @param options Poll rate and adaptive-rate settings.
+     * @return 0 on graceful exit, non-zero on disconnects or errors.
+     */
+    int RunXInputReader(DWORD userIndex, const ReaderOptions& options);
+
+    /**
+     * @brief Reads and prints input from a DirectInput device using event notification and buffered data.
+     * @param guidInstance DirectInput device instance GUID.
+     * @param options Wait mode and power-save settings (the poll settings do not apply to event-driven devices).
+     * @return 0 on success; non-zero error code on failure.
+     */
+    int RunDirectInputReader(const GUID& guidInstance, const ReaderOptions& options);
+
+    /**
+     * @brief Reads and prints a HID game controller through Raw Input (`--raw-input`).
+     * @param vendorId USB vendor ID of the device.
+     * @param productId USB product ID of the device.
+     * @param options Output settings (the poll and DirectInput settings do not apply).
+     * @return 0 on success; non-zero error code on failure.
+     */
+    int RunRawInputReader(uint16_t vendorId, uint16_t productId, const ReaderOptions& options);
+
+    /**
+     * @brief DirectInput proxies of XInput pads (known VID/PID or "IG_" interface path), which EnumerateDevices() leaves out.
+     */
+    std::vector<DeviceInfo> EnumerateXInputProxies();
+
+    /**
+     * @brief Reads an XInput pad through XInput and its DirectInput proxy at once (`--compare`).
+     * @details Each button or D-pad change is matched across the two APIs on one clock; every match is
+     *          printed, and the delay distribution when interrupted.
+     * @param userIndex XInput user index [0..3].
+     * @param options Poll rate of the XInput side and DirectInput settings.
+     * @return 0 on success; non-zero error code on failure.
+     */
+    int RunLatencyCompare(DWORD userIndex, const ReaderOptions& options);
+
+} // namespace joystick
+
+#endif // _WIN32
@@ -0,0 +1,21 @@
+﻿/**
+ * @file
+ * @brief XInput proxy table definition and its compile-time checks.
+ */
+
+#include "XInputProxies.h"
+
+namespace joystick {
+
+    // Out-of-class definition of the key table (required for ODR-use in C++14).
+    constexpr uint32_t XInputProxyIds::kKeys[];
+
+    static_assert(IsKnownXInputProxy(0x045E, 0x028E), "Xbox 360 pad must be a proxy");
+    static_assert(IsKnownXInputProxy(0x046D, 0xC21D), "Logitech F310 (XInput mode) must be a proxy");
+    static_assert(!IsKnownXInputProxy(0x046D, 0xC216), "Logitech F310 (DirectInput mode) is not a proxy");
+    static_assert(!IsKnownXInputProxy(0x054C, 0x0CE6), "DualSense is not a proxy");
+    static_assert(!IsKnownXInputProxy(0, 0), "an unknown VID/PID is not a proxy");
+    static_assert(HasXInputInterfaceMarker(L"\\\\?\\hid#vid_1234&pid_5678&ig_00#7&1a2b&0&0000#{4d1e55b2}"), "IG_ marker");
+    static_assert(!HasXInputInterfaceMarker(L"\\\\?\\hid#vid_1234&pid_5678#7&1a2b&0&0000#{4d1e55b2}"), "no IG_ marker");
+
+} // namespace joystick
@@ -0,0 +1,142 @@
+﻿/**
+ * @file
+ * @brief XInput proxy detection for DirectInput devices: a compile-time perfect-hash VID/PID table
+ *        and the "IG_" interface path marker (portable).
+ * @details
+ *   - XInput pads also appear in DirectInput as HID "proxies"; XInput already lists them, so the
+ *     merged device list leaves them out.
+ *   - Known XInput products are matched by VID/PID (from guidProduct, no device is created) in a
+ *     PerfectHashSet: the seed and the slot table are computed by the compiler, so a lookup is one
+ *     multiply, one shift and one compare, without allocation.
+ *   - Other devices are proxies when their interface path carries "IG_" (the interface of an
+ *     XInput-capable device, e.g. `\\?\hid#vid_045e&pid_02ff&ig_00#...`); that needs the created
+ *     device (DIPROP_GUIDANDPATH).
+ *   - Product names are not looked at: proxies do not reliably say "XInput" or "Xbox", and other
+ *     devices can contain "ig_".
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace joystick {
+
+    /// VID in the high half, PID in the low half; 0 is never a device.
+    constexpr uint32_t VidPidKey(uint16_t vendorId, uint16_t productId) {
+        return (uint32_t(vendorId) << 16) | productId;
+    }
+
+    namespace detail {
+
+        /// Multiplicative hash of @p key into 2^bits slots (@p seed odd).
+        constexpr uint32_t HashSlot(uint32_t key, uint32_t seed, uint32_t bits) {
+            return ((key ^ (key >> 15)) * seed) >> (32 - bits);
+        }
+
+        template <class Keys>
+        constexpr size_t KeyCount() {
+            return sizeof(Keys::kKeys) / sizeof(Keys::kKeys[0]);
+        }
+
+        template <class Keys, uint32_t Bits>
+        constexpr bool IsCollisionFree(uint32_t seed) {
+            bool used[1u << Bits] = {};
+            for (size_t i = 0; i < KeyCount<Keys>(); ++i) {
+                const uint32_t slot = HashSlot(Keys::kKeys[i], seed, Bits);
+                if (used[slot]) return false;
+                used[slot] = true;
+            }
+            return true;
+        }
+
+        /// First odd seed that puts every key in its own slot; 0 if none of the tried seeds does.
+        template <class Keys, uint32_t Bits>
+        constexpr uint32_t FindPerfectSeed() {
+            uint32_t seed = 0x9E3779B1u;
+            for (int tries = 0; tries < 4096; ++tries, seed += 0x6A09E668u) {
+                if (IsCollisionFree<Keys, Bits>(seed)) return seed;
+            }
+            return 0;
+        }
+
+        template <uint32_t Slots>
+        struct SlotTable {
+            uint32_t keys[Slots];
+        };
+
+        template <class Keys, uint32_t Bits>
+        constexpr SlotTable<(1u << Bits)> BuildSlots(uint32_t seed) {
+            SlotTable<(1u << Bits)> table{};
+            for (size_t i = 0; i < KeyCount<Keys>(); ++i) table.keys[HashSlot(Keys::kKeys[i], seed, Bits)] = Keys::kKeys[i];
+            return table;
+        }
+
+    } // namespace detail
+
+    /**
+     * @brief Set of non-zero 32-bit keys with a perfect hash found at compile time.
+     * @tparam Keys Provides `static constexpr uint32_t kKeys[]` (distinct, non-zero).
+     * @tparam Bits The table has 2^Bits slots; about four per key keeps the seed search short.
+     */
+    template <class Keys, uint32_t Bits>
+    struct PerfectHashSet {
+        static constexpr uint32_t kSeed = detail::FindPerfectSeed<Keys, Bits>();
+        static_assert(kSeed != 0, "no collision-free seed for these keys: raise Bits");
+        static constexpr detail::SlotTable<(1u << Bits)> kSlots = detail::BuildSlots<Keys, Bits>(kSeed);
+
+        static constexpr bool Contains(uint32_t key) {
+            return key != 0 && kSlots.keys[detail::HashSlot(key, kSeed, Bits)] == key;
+        }
+    };
+
+    template <class Keys, uint32_t Bits>
+    constexpr uint32_t PerfectHashSet<Keys, Bits>::kSeed;
+    template <class Keys, uint32_t Bits>
+    constexpr detail::SlotTable<(1u << Bits)> PerfectHashSet<Keys, Bits>::kSlots;
+
+    /**
+     * @brief VID/PID of XInput-capable controllers whose HID interface DirectInput also lists.
+     */
+    struct XInputProxyIds {
+        static constexpr uint32_t kKeys[] = {
+            // Microsoft: Xbox 360, Xbox One, Elite, Series X|S (USB, wireless adapters, Bluetooth)
+            VidPidKey(0x045E, 0x028E), VidPidKey(0x045E, 0x028F), VidPidKey(0x045E, 0x0291), VidPidKey(0x045E, 0x02A1),
+            VidPidKey(0x045E, 0x0719), VidPidKey(0x045E, 0x02D1), VidPidKey(0x045E, 0x02DD), VidPidKey(0x045E, 0x02E0),
+            VidPidKey(0x045E, 0x02E3), VidPidKey(0x045E, 0x02EA), VidPidKey(0x045E, 0x02FD), VidPidKey(0x045E, 0x02FF),
+            VidPidKey(0x045E, 0x0B00), VidPidKey(0x045E, 0x0B05), VidPidKey(0x045E, 0x0B12), VidPidKey(0x045E, 0x0B13),
+            VidPidKey(0x045E, 0x0B20), VidPidKey(0x045E, 0x0B22),
+            // Logitech F310 / F510 / F710 in XInput mode
+            VidPidKey(0x046D, 0xC21D), VidPidKey(0x046D, 0xC21E), VidPidKey(0x046D, 0xC21F),
+            // Mad Catz, Hori, PowerA wired pads; Steam virtual gamepad
+            VidPidKey(0x0738, 0x4716), VidPidKey(0x0F0D, 0x0067), VidPidKey(0x24C6, 0x543A), VidPidKey(0x28DE, 0x11FF),
+        };
+    };
+
+    using XInputProxySet = PerfectHashSet<XInputProxyIds, 7>;
+
+    /// true if @p vendorId / @p productId is a known XInput controller (its DirectInput entry is a proxy).
+    constexpr bool IsKnownXInputProxy(uint16_t vendorId, uint16_t productId) {
+        return XInputProxySet::Contains(VidPidKey(vendorId, productId));
+    }
+
+    /// true if a device interface path contains "IG_" (any case), the marker of XInput-capable interfaces.
+    template <class Char>
+    constexpr bool HasXInputInterfaceMarker(const Char* path) {
+        if (!path) return false;
+        for (; path[0] && path[1] && path[2]; ++path) {
+            if ((path[0] == 'I' || path[0] == 'i') && (path[1] == 'G' || path[1] == 'g') && path[2] == '_') return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Proxy decision for one DirectInput device.
+     * @param vendorId, productId From guidProduct; 0 when it does not carry them (not a HID device).
+     * @param interfacePath Device interface path (DIPROP_GUIDANDPATH), or nullptr if it was not read.
+     */
+    constexpr bool IsXInputProxy(uint16_t vendorId, uint16_t productId, const wchar_t* interfacePath) {
+        return IsKnownXInputProxy(vendorId, productId) || HasXInputInterfaceMarker(interfacePath);
+    }
+
+} // namespace joystick